@@ -0,0 +1 @@
+#define OO_UK_INTF_VER  "f8ab901370dcc3f050803b5a0e5ee0e8"
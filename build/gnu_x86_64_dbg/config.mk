@@ -0,0 +1,17 @@
+PLATFORM := gnu_x86_64
+BUILDPATH := /root/repo/build/gnu_x86_64_dbg
+SRCPATH := /root/repo/src
+TOPPATH := /root/repo
+BUILDENV := Debian12.12-x86_64-linux-gnu
+
+
+
+W_NO_UNUSED_RESULT := 
+W_NO_STRING_TRUNCATION := 1
+W_IMPLICIT_FALLTHROUGH := 1
+W_NO_IGNORED_ATTRIBUTES := 
+W_NO_STRINGOP_OVERFLOW := 1
+W_NO_DEPRECATED_DECLARATIONS := 1
+M_NO_OUTLINE_ATOMICS := 
+
+
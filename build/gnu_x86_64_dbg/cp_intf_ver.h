@@ -0,0 +1 @@
+#define OO_CP_INTF_VER 947d27b130ff236e9f046f1c0480eca9
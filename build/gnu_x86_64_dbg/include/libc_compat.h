@@ -0,0 +1,8 @@
+/* This header is generated by scripts/libc_compat.sh */
+#define CI_LIBC_HAS_fcntl64 1
+#define CI_LIBC_HAS_epoll_pwait2 1
+#define CI_HAVE_PCAP 0
+#define CI_HAVE_SPLICE_RETURNS_SSIZE_T 0
+#define CI_HAVE_SPLICE_RETURNS___SSIZE_T 1
+#define CI_HAVE_RECVMMSG_NOCONST_TIMESPEC 1
+#define CI_HAVE_NET_TSTAMP 1
@@ -0,0 +1 @@
+#define EFCH_INTF_VER  "6b8dac9ff87569fa74ce686ee98ff457"
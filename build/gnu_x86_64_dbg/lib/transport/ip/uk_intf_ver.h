@@ -0,0 +1 @@
+#define OO_UK_INTF_VER  "ba8c03d067ec33ac94ad226bc60c9b08"
@@ -183,6 +183,15 @@ MODULE_PARM_DESC(cplane_use_prefsrc_as_local,
                  "interface.\n"
                  "See also oof_use_all_local_ip_addresses module parameter.");
 
+static bool cplane_neigh_refresh = false;
+module_param_cb(cplane_neigh_refresh, &cplane_server_param_bool_ops,
+                &cplane_neigh_refresh, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(cplane_neigh_refresh,
+                 "If true, the Control Plane Server asks the kernel to "
+                 "re-resolve the neighbours of actively-used routes before "
+                 "they expire, so that Onload does not have to wait for "
+                 "ARP resolution on a hot path.");
+
 
 #if CI_CFG_WANT_BPF_NATIVE && CI_HAVE_BPF_NATIVE
 bool cplane_track_xdp = false;
@@ -2040,7 +2049,7 @@ static int cp_spawn_server(ci_uint32 flags)
    *
    * We also can use smaller value if !NDEBUG, etc etc.
    */
-  const int DIRECT_PARAM_MAX = 12;
+  const int DIRECT_PARAM_MAX = 13;
 
   char* ns_file_path = NULL;
   char* path = cp_get_server_path();
@@ -2152,6 +2161,9 @@ static int cp_spawn_server(ci_uint32 flags)
   if( cplane_use_prefsrc_as_local )
     argv[direct_param_base + direct_param++] = "--"CPLANE_SERVER_PREFSRC_AS_LOCAL;
 
+  if( cplane_neigh_refresh )
+    argv[direct_param_base + direct_param++] = "--"CPLANE_SERVER_NEIGH_REFRESH;
+
 #if CI_CFG_WANT_BPF_NATIVE && CI_HAVE_BPF_NATIVE
   if( cplane_track_xdp )
     argv[direct_param_base + direct_param++] = "--"CPLANE_SERVER_TRACK_XDP;
@@ -449,6 +449,7 @@ int oo_fop_stack_flush_unlock(struct file *f, fl_owner_t id)
 {
   ci_private_t* priv = f->private_data;
   tcp_helper_resource_t* trs;
+  int intf_i;
 
   if( priv->fd_flags != OO_FDFLAG_STACK )
     return 0;
@@ -456,14 +457,18 @@ int oo_fop_stack_flush_unlock(struct file *f, fl_owner_t id)
     return 0;
 
   trs = efab_priv_to_thr(priv);
+  if( current->flags & PF_EXITING )
+    tcp_helper_reap_send_nolock(trs);
   if( trs->netif.state->exiting_pid != task_tgid_vnr(current) )
     return 0;
 
   /* This is an exiting task, and it closes the stack file descriptor.
-   * Unlock it.
+   * Unlock it, and drop any TX claims it died with.
    * See oo_exit_hook().
    */
   trs->netif.state->exiting_pid = 0;
+  OO_STACK_FOR_EACH_INTF_I(&trs->netif, intf_i)
+    ci_netif_tx_release(&trs->netif, intf_i);
   ci_netif_unlock(&trs->netif);
   return 0;
 }
@@ -480,7 +485,8 @@ struct file_operations oo_fops = {
   .read = cp_fop_read,
   .poll = cp_fop_poll,
 
-  /* flush is really needed for a stack fd only */
+  /* flush is really needed for a stack fd only, to clean up after an
+   * exiting process */
   .flush = oo_fop_stack_flush_unlock,
 };
 
@@ -74,6 +74,12 @@ struct oo_epoll1_private {
   ci_uint32 flags;
 #define OO_EPOLL1_FLAG_HOME_STACK_CHANGED 1
   ci_waitable_t home_w;
+
+  /* ready lists owned in non-home stacks; thr is NULL if slot is free */
+  struct {
+    tcp_helper_resource_t* thr;
+    int ready_list;
+  } other[OO_EPOLL1_OTHER_STACKS_MAX];
 #endif
 };
 
@@ -679,6 +685,9 @@ static int oo_epoll1_mmap(struct oo_epoll1_private* priv,
 static int oo_epoll1_release(struct oo_epoll_private* priv)
 {
   struct oo_epoll1_private* priv1 = &priv->p.p1;
+#if CI_CFG_EPOLL3
+  int i;
+#endif
 
   ci_assert(priv1->whead);
   remove_wait_queue(priv1->whead, &priv1->wait);
@@ -690,6 +699,10 @@ static int oo_epoll1_release(struct oo_epoll_private* priv)
 #if CI_CFG_EPOLL3
   if( priv1->home_stack )
     ci_netif_put_ready_list(&priv1->home_stack->netif, priv1->ready_list);
+  for( i = 0; i < OO_EPOLL1_OTHER_STACKS_MAX; i++ )
+    if( priv1->other[i].thr != NULL )
+      ci_netif_put_ready_list(&priv1->other[i].thr->netif,
+                              priv1->other[i].ready_list);
 #endif
 
   oo_epoll_release_common(priv);
@@ -755,6 +768,43 @@ static void oo_epoll1_set_home_stack(struct oo_epoll1_private* priv,
   else
     ci_waitable_wakeup_all(&priv->home_w);
 }
+
+
+/* Ready lists that UL owns in non-home stacks are recorded here so that
+ * they are put on release if UL does not get to put them itself.  As for
+ * the home stack, UL serialises these calls with the epoll lock.
+ */
+static int oo_epoll1_add_other_ready_list(struct oo_epoll1_private* priv,
+                                          tcp_helper_resource_t* thr,
+                                          int ready_list)
+{
+  int i;
+
+  if( ready_list < 0 || ready_list >= CI_CFG_N_READY_LISTS )
+    return -EINVAL;
+  for( i = 0; i < OO_EPOLL1_OTHER_STACKS_MAX; i++ )
+    if( priv->other[i].thr == NULL ) {
+      priv->other[i].ready_list = ready_list;
+      priv->other[i].thr = thr;
+      return 0;
+    }
+  return -ENOSPC;
+}
+
+static int oo_epoll1_del_other_ready_list(struct oo_epoll1_private* priv,
+                                          tcp_helper_resource_t* thr,
+                                          int ready_list)
+{
+  int i;
+
+  for( i = 0; i < OO_EPOLL1_OTHER_STACKS_MAX; i++ )
+    if( priv->other[i].thr == thr &&
+        priv->other[i].ready_list == ready_list ) {
+      priv->other[i].thr = NULL;
+      return 0;
+    }
+  return -ENOENT;
+}
 #endif
 
 static void oo_epoll_prime_all_stacks(struct oo_epoll_private* priv)
@@ -1279,6 +1329,44 @@ static long oo_epoll_fop_unlocked_ioctl(struct file* filp,
     rc = oo_epoll1_setup_shared(&priv->p.p1);
     break;
 
+#if CI_CFG_EPOLL3
+  case OO_EPOLL1_IOC_ADD_OTHER_READY_LIST:
+  case OO_EPOLL1_IOC_DEL_OTHER_READY_LIST: {
+    struct oo_epoll1_set_home_arg local_arg;
+    struct file *stack_file;
+    ci_private_t *stack_priv;
+
+    ci_assert_equal(_IOC_SIZE(cmd), sizeof(local_arg));
+    if( priv->type != OO_EPOLL_TYPE_1 )
+      return -EINVAL;
+    if( copy_from_user(&local_arg, argp, _IOC_SIZE(cmd)) )
+      return -EFAULT;
+
+    stack_file = fget(local_arg.sockfd);
+    if( stack_file == NULL )
+      return -EINVAL;
+    if( stack_file->f_op != &oo_fops ) {
+      fput(stack_file);
+      return -EINVAL;
+    }
+    stack_priv = stack_file->private_data;
+
+    /* The stack reference taken here is kept until release, which is
+     * where any ready list still recorded is put. */
+    if( cmd == OO_EPOLL1_IOC_DEL_OTHER_READY_LIST )
+      rc = oo_epoll1_del_other_ready_list(&priv->p.p1, stack_priv->thr,
+                                          local_arg.ready_list);
+    else if( oo_epoll_add_stack(priv, stack_priv->thr) )
+      rc = oo_epoll1_add_other_ready_list(&priv->p.p1, stack_priv->thr,
+                                          local_arg.ready_list);
+    else
+      rc = -ENOSPC;
+
+    fput(stack_file);
+    break;
+  }
+#endif
+
   default:
     /* If libc is used on our sockets, sometimes it may call TCGETS ioctl to
      * determine whether the file is a tty.
@@ -127,11 +127,17 @@ EFRM_FILE_HAS_F_EP	member	struct_file	f_ep	include/linux/fs.h
 
 EFRM_HAS_FLUSH_DELAYED_FPUT	export	flush_delayed_fput	include/linux/file.h	fs/file_table.c
 EFRM_NETDEV_HAS_XDP_METADATA_OPS	member	struct_net_device	xdp_metadata_ops	include/linux/netdevice.h
+EFRM_HAVE_XSK_SHARED_UMEM_RINGS	symbol	xp_assign_dev_shared	include/net/xsk_buff_pool.h
+EFRM_NETDEV_HAS_NAPI_DEFER_HARD_IRQS	member	struct_net_device	napi_defer_hard_irqs	include/linux/netdevice.h
+EFRM_NAPI_HAS_DEFER_HARD_IRQS	member	struct_napi_struct	defer_hard_irqs	include/linux/netdevice.h
+EFRM_NETDEV_HAS_NAPI_CONFIG	member	struct_net_device	napi_config	include/linux/netdevice.h
+EFRM_SOCK_HAS_PREFER_BUSY_POLL	member	struct_sock	sk_prefer_busy_poll	include/net/sock.h
 
 EFRM_IRQ_FREE_RETURNS_NAME	symtype	free_irq	include/linux/interrupt.h void *(unsigned int, void *)
 
 EFRM_HAS_LINUX_STDARG_H			file	include/linux/stdarg.h
 EFRM_TASK_HAS_CPUMASK		member	struct_task_struct	cpus_mask	include/linux/sched.h
+EFRM_HAVE_KTHREAD_USE_MM	symbol	kthread_use_mm	include/linux/kthread.h
 
 EFRM_HAVE_LOWCASE_PDE_DATA symbol pde_data include/linux/proc_fs.h
 EFRM_HAVE_NETIF_RX_NI symbol netif_rx_ni include/linux/netdevice.h
@@ -142,10 +142,16 @@
 	((nic)->efhw_func->af_xdp_mem ? \
 	 (nic)->efhw_func->af_xdp_mem((nic), (instance)) : NULL)
 
-#define efhw_nic_af_xdp_init(nic, instance, chunk_size, headroom, pages_out) \
+#define efhw_nic_af_xdp_init(nic, instance, chunk_size, headroom, \
+                             umem_nic, umem_instance, pages_out) \
 	((nic)->efhw_func->af_xdp_init ? \
 	 (nic)->efhw_func->af_xdp_init((nic), (instance), (chunk_size), \
-	 (headroom), (pages_out)) : 0)
+	 (headroom), (umem_nic), (umem_instance), (pages_out)) : 0)
+
+#define efhw_nic_af_xdp_busy_poll(nic, instance, budget, fallback_usec) \
+	((nic)->efhw_func->af_xdp_busy_poll ? \
+	 (nic)->efhw_func->af_xdp_busy_poll((nic), (instance), (budget), \
+	 (fallback_usec)) : -EOPNOTSUPP)
 
 /*-------------- MAC Low level interface ---- */
 #define efhw_gmac_get_mac_addr(nic) \
@@ -15,6 +15,7 @@ struct efab_af_xdp_offsets_ring
   int64_t producer;
   int64_t consumer;
   int64_t desc;
+  int64_t flags;
 };
 
 struct efab_af_xdp_offsets_rings
@@ -25,10 +26,22 @@ struct efab_af_xdp_offsets_rings
   struct efab_af_xdp_offsets_ring cr;
 };
 
+/* The socket was bound with XDP_USE_NEED_WAKEUP, so the ring flags are
+ * valid and a kick is only needed when XDP_RING_NEED_WAKEUP is set. */
+#define EFAB_AF_XDP_FEATURE_NEED_WAKEUP 0x1
+/* The socket was bound with XDP_USE_SG, so a frame may span several
+ * descriptors, chained with XDP_PKT_CONTD. */
+#define EFAB_AF_XDP_FEATURE_SG          0x2
+/* The socket uses preferred busy polling: the kernel only processes the
+ * queue when kicked, so every poll must kick. */
+#define EFAB_AF_XDP_FEATURE_BUSY_POLL   0x4
+
 struct efab_af_xdp_offsets
 {
   int64_t mmap_bytes;
   struct efab_af_xdp_offsets_rings rings;
+  /* Added after the fields above, so that their layout is unchanged */
+  int64_t features;
 };
 
 #endif
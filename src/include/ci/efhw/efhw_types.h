@@ -459,11 +459,22 @@ struct efhw_func_ops {
 	/*! Initialise a VI for use with AF_XDP.
 	 * This must be called after registering all buffer memory through
 	 * the buffer table interface. pages_out is populated with the queue
-	 * memory pages, which can be mapped into user space. */
+	 * memory pages, which can be mapped into user space.
+	 * If umem_nic is not NULL, the VI shares the umem of umem_instance
+	 * on umem_nic when the buffer memory is the same, rather than
+	 * registering its own. */
 	int (*af_xdp_init) (struct efhw_nic* nic, int instance,
 	                    int chunk_size, int headroom,
+	                    struct efhw_nic* umem_nic, int umem_instance,
 	                    struct efhw_page_map* pages_out);
 
+	/*! Switch an initialised AF_XDP VI to preferred busy polling, so
+	 * that kicks run the device's NAPI poll with the given budget.  If
+	 * fallback_usec is non-zero, the device is configured to resume
+	 * interrupts when not polled for that long. */
+	int (*af_xdp_busy_poll) (struct efhw_nic* nic, int instance,
+	                         int budget, int fallback_usec);
+
   /*-------------- device ------------------------ */
 
 	/*! Returns the struct pci_dev for the NIC, taking out a reference to
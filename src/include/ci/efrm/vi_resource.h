@@ -287,6 +287,9 @@ extern int efrm_vi_set_get_vi_instance(struct efrm_vi *);
 
 extern int efrm_vi_af_xdp_kick(struct efrm_vi *vi);
 
+extern int efrm_vi_af_xdp_busy_poll(struct efrm_vi *vi, int budget,
+				    int fallback_usec);
+
 extern int
 efrm_interrupt_vectors_ctor(struct efrm_nic *nic,
 			    const struct vi_resource_dimensions *res_dim);
@@ -330,9 +333,13 @@ efrm_vi_resource_alloc(struct efrm_client *client,
 		       uint32_t *out_rxq_capacity,
 		       int print_resource_warnings);
 
+/* Finish setting up a VI whose queues are allocated late (AF_XDP).  If
+ * [umem_virs] is not NULL the VI shares its packet buffer registration
+ * where possible. */
 extern int
 efrm_vi_resource_deferred(struct efrm_vi *evq_virs,
 	                       int chunk_size, int headroom,
+                          struct efrm_vi *umem_virs,
                           uint32_t *out_mem_mmap_bytes);
 
 extern void efrm_vi_resource_release(struct efrm_vi *);
@@ -42,6 +42,14 @@ typedef struct {
 extern ci_cfg_opts_t ci_cfg_opts CI_HV;
 extern int ci_cfg_query(void);
 
+#if !defined(__KERNEL__)
+/* getenv() for EF_ options, served from a table built by one walk of the
+ * environment.  ci_cfg_env_scan() (re)builds the table; ci_cfg_getenv()
+ * builds it on first use if necessary. */
+extern void ci_cfg_env_scan(void);
+extern const char* ci_cfg_getenv(const char* name);
+#endif
+
 /* Needed to support list of port numbers in EF_ options */
 struct ci_port_list {
   ci_dllink link;
@@ -453,6 +453,8 @@ extern void ci_netif_config_opts_rangecheck(ci_netif_config_opts* opts) CI_HF;
 extern void ci_netif_config_opts_getenv(ci_netif_config_opts* opts) CI_HF;
 extern void ci_netif_config_opts_set_derived(ci_netif_config_opts* opts) CI_HF;
 extern void ci_netif_config_opts_defaults(ci_netif_config_opts* opts) CI_HF;
+extern int ci_netif_config_opts_equal(const ci_netif_config_opts* a,
+                                      const ci_netif_config_opts* b) CI_HF;
 #ifdef __KERNEL__
 extern void ci_netif_state_init(ci_netif* ni, int cpu_khz, 
                                 const char* name) CI_HF;
@@ -481,6 +483,7 @@ extern int  ci_netif_poll_intf_future(ci_netif*, int intf_i, ci_uint64 now_frc)
 #endif
 extern int  ci_netif_poll_n(ci_netif*, int max_evs) CI_HF;
 #define     ci_netif_poll(ni)  ci_netif_poll_n((ni), NI_OPTS(ni).evs_per_poll)
+extern int  ci_netif_poll_claimed(ci_netif*, int intf_i) CI_HF;
 extern void ci_netif_loopback_pkts_send(ci_netif* ni) CI_HF;
 
 #if CI_CFG_WANT_BPF_NATIVE
@@ -513,6 +516,77 @@ ci_inline void ci_netif_send(ci_netif* ni, ci_ip_pkt_fmt* pkt)
   pkt->flags |= CI_PKT_FLAG_TX_PENDING;
   __ci_netif_send(ni, pkt);
 }
+
+/* With EF_TCP_SEND_NOLOCK, TCP senders that do not hold the netif lock
+ * post to the TX ring too, so everything that posts to the ring of
+ * [intf_i] must claim it first.  The claim records its [owner]: the thread
+ * id of a sender without the lock, or CI_NETIF_TX_OWNER_LOCKED for the
+ * lock holder.  A claim is held only while descriptors are written and the
+ * doorbell rung, so it is worth spinning for, but not forever: returns
+ * false if the claim stays busy, and then the caller must leave its
+ * packets on the overflow queue (or go without).  See also
+ * ci_netif_tx_claim_wait().
+ */
+#define CI_NETIF_TX_CLAIM_SPINS   10000
+#define CI_NETIF_TX_OWNER_LOCKED  0xffffffffu
+
+ci_inline int ci_netif_tx_claim_spins(ci_netif* ni, int intf_i,
+                                      ci_uint32 owner, int spins)
+{
+  ci_uint32* claim = &ni->state->nic[intf_i].tx_claim;
+  ci_assert_nequal(owner, 0);
+  while( OO_ACCESS_ONCE(*claim) != 0 || ci_cas32u_fail(claim, 0, owner) ) {
+    if( --spins <= 0 )
+      return 0;
+    ci_spinloop_pause();
+  }
+  return 1;
+}
+
+ci_inline int ci_netif_tx_claim(ci_netif* ni, int intf_i)
+{
+  return ! NI_OPTS(ni).tcp_send_nolock ||
+         ci_netif_tx_claim_spins(ni, intf_i, CI_NETIF_TX_OWNER_LOCKED,
+                                 CI_NETIF_TX_CLAIM_SPINS);
+}
+
+/* Drops a claim taken by [owner].  If the claim has been released on
+ * behalf of [owner] in the meantime, it is no longer ours to drop.
+ */
+ci_inline void ci_netif_tx_unclaim(ci_netif* ni, int intf_i, ci_uint32 owner)
+{
+  ci_wmb();
+  ci_cas32u_succeed(&ni->state->nic[intf_i].tx_claim, owner, 0);
+}
+
+ci_inline void ci_netif_tx_release(ci_netif* ni, int intf_i)
+{
+  if( NI_OPTS(ni).tcp_send_nolock )
+    ci_netif_tx_unclaim(ni, intf_i, CI_NETIF_TX_OWNER_LOCKED);
+}
+
+/* Account for packets posted without the lock before handling the TX
+ * completions for them.  Returns true if there were any.
+ */
+ci_inline int ci_netif_tx_nolock_fold(ci_netif* ni, int intf_i)
+{
+  ci_netif_state_nic_t* nsn = &ni->state->nic[intf_i];
+  ci_uint32 pkts = OO_ACCESS_ONCE(nsn->tx_nolock_pkts);
+  ci_uint32 bytes;
+
+  ci_assert(ci_netif_is_locked(ni));
+  if( pkts == nsn->tx_nolock_pkts_folded )
+    return 0;
+  /* The sender adds the bytes first, so these cover at least [pkts]. */
+  ci_rmb();
+  bytes = OO_ACCESS_ONCE(nsn->tx_nolock_bytes);
+  nsn->tx_dmaq_insert_seq += pkts - nsn->tx_nolock_pkts_folded;
+  nsn->tx_bytes_added += bytes - nsn->tx_nolock_bytes_folded;
+  nsn->tx_nolock_pkts_folded = pkts;
+  nsn->tx_nolock_bytes_folded = bytes;
+  return 1;
+}
+
 extern void ci_netif_rx_post(ci_netif* netif, int nic_index) CI_HF;
 extern int  ci_netif_set_rxq_limit(ci_netif*) CI_HF;
 #ifdef __KERNEL__
@@ -653,6 +727,29 @@ extern void ci_netif_pkt_free(ci_netif* ni, ci_ip_pkt_fmt* pkt
 #define CI_PKT_ALLOC_FOR_TCP_TX 1
 #define CI_PKT_ALLOC_USE_NONB   2
 #define CI_PKT_ALLOC_NO_REAP    4
+
+/* Every packet buffer is CI_CFG_PKT_BUF_SIZE bytes: ids map to buffers
+ * with a fixed stride shared with the driver's DMA mappings, so there is
+ * one pool for all sizes of packet.  These describe how much of its buffer
+ * a packet fills, so that stackdump can show how much of the pool is held
+ * by small frames or by multi-buffer chains.  They are not used to choose
+ * a buffer.
+ */
+#define CI_PKT_FILL_SMALL_MAX  256
+#define CI_PKT_FILL_SMALL      0  /* <= CI_PKT_FILL_SMALL_MAX */
+#define CI_PKT_FILL_STD        1
+#define CI_PKT_FILL_CHAIN      2  /* part of a frag_next chain */
+#define CI_PKT_FILL_N          3
+
+ci_inline int ci_pkt_fill(const ci_ip_pkt_fmt* pkt)
+{
+  if( pkt->n_buffers > 1 || OO_PP_NOT_NULL(pkt->frag_next) )
+    return CI_PKT_FILL_CHAIN;
+  if( pkt->buf_len <= CI_PKT_FILL_SMALL_MAX )
+    return CI_PKT_FILL_SMALL;
+  return CI_PKT_FILL_STD;
+}
+
 extern ci_ip_pkt_fmt*
 ci_netif_pkt_alloc_slow_ptrerr(ci_netif*, int flags) CI_HF;
 
@@ -1501,6 +1598,16 @@ extern int /*bool*/ ci_tcp_is_cacheable_active_wild_sharer(ci_sock_cmn*);
 
 extern void ci_tcp_prev_seq_remember(ci_netif*, ci_tcp_state*);
 extern ci_uint32 ci_tcp_prev_seq_lookup(ci_netif*, const ci_tcp_state*);
+extern ci_uint32
+ci_tcp_prev_seq_lookup_tuple(ci_netif*, ci_addr_t laddr, unsigned lport,
+                             ci_addr_t raddr, unsigned rport) CI_HF;
+
+extern void ci_tcp_timewait_compact(ci_netif*, ci_tcp_state*) CI_HF;
+extern int ci_tcp_timewait_rx(ci_netif*, ciip_tcp_rx_pkt*,
+                              ci_addr_t laddr, ci_addr_t raddr) CI_HF;
+extern ci_uint32
+ci_tcp_timewait_reuse(ci_netif*, ci_addr_t laddr, unsigned lport,
+                      ci_addr_t raddr, unsigned rport) CI_HF;
 
 /*********************************************************************
 ****************************** PIPE ***********************************
@@ -1566,6 +1673,20 @@ extern void citp_waitable_cleanup(ci_netif* ni, citp_waitable_obj* wo,
 #endif
 extern const char* citp_waitable_type_str(citp_waitable* w) CI_HF;
 extern void citp_waitable_dump(ci_netif*, citp_waitable*, const char*) CI_HF;
+#ifndef __KERNEL__
+/* Record in [sa] that a call waited [wait_cycles], at [khz], and whether
+ * it got what it waited for while spinning ([hit]) or only after sleeping.
+ * Then choose the spin time that covers [percentile] of recent waits.  See
+ * EF_SPIN_ADAPT. */
+extern void ci_spin_adapt_record(ci_spin_adapt* sa, ci_uint32 khz,
+                                 unsigned percentile, ci_uint64 wait_cycles,
+                                 int hit) CI_HF;
+/* Record that a receive call on [w] waited [wait_cycles] for data, as
+ * ci_spin_adapt_record().  Caller must hold the socket lock. */
+extern void citp_waitable_spin_adapt_record(ci_netif* ni, citp_waitable* w,
+                                            ci_uint64 wait_cycles,
+                                            int hit) CI_HF;
+#endif
 extern void citp_waitable_dump_to_logger(ci_netif* ni, citp_waitable* w,
                                          const char* pf, oo_dump_log_fn_t logger,
                                          void* log_arg) CI_HF;
@@ -1667,6 +1788,9 @@ extern void ci_tcp_send_rst(ci_netif* netif, ci_tcp_state* ts) CI_HF;
 extern void
 ci_tcp_reply_with_rst(ci_netif* netif, const struct oo_sock_cplane* sock_cp,
                       ciip_tcp_rx_pkt* rxp) CI_HF;
+extern void
+ci_tcp_timewait_reply_ack(ci_netif* netif, ciip_tcp_rx_pkt* rxp,
+                          const ci_tcp_timewait_t* tw) CI_HF;
 extern int ci_tcp_reset_untrusted(ci_netif *netif, ci_tcp_state *ts) CI_HF;
 extern void ci_tcp_send_zwin_probe(ci_netif* netif, ci_tcp_state* ts) CI_HF;
 extern void ci_tcp_set_established_state(ci_netif*, ci_tcp_state*) CI_HF;
@@ -1961,6 +2085,7 @@ extern void ci_tcp_sendmsg_enqueue_prequeue(ci_netif* ni,
                                             ci_tcp_state* ts,
                                             int/*bool*/ shutdown) CI_HF;
 extern void ci_tcp_perform_deferred_socket_work(ci_netif*, ci_tcp_state*)CI_HF;
+extern void __ci_tcp_send_nolock_merge(ci_netif*, ci_tcp_state*) CI_HF;
 
 /* Guarantees that deferred work will be performed at some point in the
  * near future, either by the calling thread (in this call), or deferred to
@@ -2760,10 +2885,77 @@ ci_inline int ci_netif_need_timer_prime(ci_netif* ni, ci_uint64 frc_now) {
 }
 
 
+/* With preferred busy polling the kernel only processes an AF_XDP queue
+ * when we poll, so a spinning thread must poll whether or not there are
+ * events.
+ */
+ci_inline int ci_netif_af_xdp_busy_poll(ci_netif* ni)
+{
+  int intf_i;
+  if(CI_LIKELY( NI_OPTS(ni).af_xdp_busy_poll_budget == 0 ))
+    return 0;
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i)
+    if( ni->state->nic[intf_i].oo_vi_flags & OO_VI_FLAGS_AF_XDP_BUSY_POLL )
+      return 1;
+  return 0;
+}
+
+
 ci_inline int ci_netif_need_poll_spinning(ci_netif* ni, ci_uint64 frc_now)
 {
   return ci_netif_has_event(ni) ||
-         ci_netif_need_timer_prime(ni, frc_now);
+         ci_netif_need_timer_prime(ni, frc_now) ||
+         ci_netif_af_xdp_busy_poll(ni);
+}
+
+
+/* Returns true if EF_POLL_CLAIM_USEC applies to a thread spinning on a
+ * socket which receives on [intf_i].
+ */
+ci_inline int ci_netif_poll_claims_on(ci_netif* ni, int intf_i)
+{
+  return ni->state->poll_claim_cycles != 0 &&
+         (unsigned) intf_i < (unsigned) oo_stack_intf_max(ni);
+}
+
+
+/* Returns true if [intf_i] is claimed by a thread other than one spinning
+ * on [own_intf_i].
+ */
+ci_inline int ci_netif_intf_claimed(ci_netif* ni, int intf_i,
+                                    int own_intf_i, ci_uint64 frc_now)
+{
+  return intf_i != own_intf_i &&
+         (ci_int64) (frc_now - ni->state->nic[intf_i].poll_claim_frc) <
+         (ci_int64) ni->state->poll_claim_cycles;
+}
+
+
+/* As ci_netif_need_poll_spinning(), for a thread spinning on a socket which
+ * receives on [intf_i].  Events on interfaces claimed by other spinning
+ * threads are left to them.  Also renews this thread's claim on [intf_i].
+ */
+ci_inline int ci_netif_need_poll_claimed(ci_netif* ni, int intf_i,
+                                         ci_uint64 frc_now)
+{
+  ci_netif_state_nic_t* nic;
+  int i;
+
+  if( ! ci_netif_poll_claims_on(ni, intf_i) )
+    return ci_netif_need_poll_spinning(ni, frc_now);
+
+  /* Don't dirty the cache line on every spin. */
+  nic = &ni->state->nic[intf_i];
+  if( frc_now - nic->poll_claim_frc > ni->state->poll_claim_cycles / 2 )
+    nic->poll_claim_frc = frc_now;
+
+  OO_STACK_FOR_EACH_INTF_I(ni, i)
+    if( ! ci_netif_intf_claimed(ni, i, intf_i, frc_now) &&
+        ci_netif_intf_has_event(ni, i) )
+      return 1;
+  return OO_PP_NOT_NULL(ni->state->looppkts) ||
+         ci_netif_need_timer_prime(ni, frc_now) ||
+         ci_netif_af_xdp_busy_poll(ni);
 }
 
 
@@ -2815,6 +3007,7 @@ ci_inline void __ci_netif_pkt_clean(ci_ip_pkt_fmt* pkt)
   pkt->rx_flags = 0;
   pkt->n_buffers = 1;
   pkt->frag_next = OO_PP_NULL;
+  pkt->tx_lat_frc = 0;
   CI_DEBUG(pkt->pkt_start_off = PKT_START_OFF_BAD;
            pkt->pkt_eth_payload_off = PKT_START_OFF_BAD);
 #if CI_CFG_TIMESTAMPING
@@ -4227,6 +4420,168 @@ ci_inline int ci_tcp_sendq_n_pkts(ci_tcp_state* ts) {
   return n >= 0 ? n : 0;
 }
 
+/* Moves the packets that senders without the lock (EF_TCP_SEND_NOLOCK)
+ * have sent on [ts] to its retransmit queue.  This must be done before
+ * anything looks at the retransmit queue, such as handling an ACK.
+ */
+ci_inline void ci_tcp_send_nolock_merge(ci_netif* ni, ci_tcp_state* ts)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  if(CI_UNLIKELY( OO_ACCESS_ONCE(ts->send_nolock) != OO_PP_ID_NULL ))
+    __ci_tcp_send_nolock_merge(ni, ts);
+}
+
+/* Claims the TX ring of [intf_i] for the lock holder however long a
+ * sender without the lock holds on to it.  For cleanup that cannot leave
+ * the ring for later.  This does not wait forever on a sender that dies
+ * holding the claim, as the claim is released on its behalf when its
+ * process exits: see ci_netif_tx_claim_reap().  A claim still marked as
+ * the lock holder's can only have been left by a lock holder that died
+ * with it, since the caller holds the lock now, so it is simply taken
+ * over.  Release with ci_netif_tx_release().
+ */
+ci_inline void ci_netif_tx_claim_wait(ci_netif* ni, int intf_i)
+{
+  ci_uint32* claim = &ni->state->nic[intf_i].tx_claim;
+  ci_uint32 owner;
+
+  ci_assert(ci_netif_is_locked(ni));
+  if( ! NI_OPTS(ni).tcp_send_nolock )
+    return;
+  while( 1 ) {
+    owner = OO_ACCESS_ONCE(*claim);
+    if( owner == CI_NETIF_TX_OWNER_LOCKED ||
+        (owner == 0 &&
+         ci_cas32u_succeed(claim, 0, CI_NETIF_TX_OWNER_LOCKED)) )
+      return;
+    ci_spinloop_pause();
+  }
+}
+
+/* Releases the claim of [intf_i] on behalf of [owner], which has died
+ * holding it.  The caller must know that [owner] is dead: a live one could
+ * be writing descriptors.  Returns true if [owner] held the claim.
+ */
+ci_inline int ci_netif_tx_claim_reap(ci_netif* ni, int intf_i,
+                                     ci_uint32 owner)
+{
+  ci_assert_nequal(owner, 0);
+  if( ci_cas32u_fail(&ni->state->nic[intf_i].tx_claim, owner, 0) )
+    return 0;
+  CITP_STATS_NETIF_INC(ni, tcp_send_nolock_reclaims);
+  return 1;
+}
+
+/* Called by a sender without the lock, [owner], to take the gate of [ts].
+ * Returns false if the gate is not open.
+ */
+ci_inline int ci_tcp_send_nolock_enter(ci_tcp_state* ts, ci_uint32 owner)
+{
+  if( ci_cas32u_fail(&ts->send_nolock_gate, CI_TCP_SEND_NOLOCK_IDLE,
+                     CI_TCP_SEND_NOLOCK_BUSY) )
+    return 0;
+  OO_ACCESS_ONCE(ts->send_nolock_owner) = owner;
+  return 1;
+}
+
+/* Whether [owner] still holds the gate of [ts], which may have been
+ * released on its behalf by ci_tcp_send_nolock_reap().  The sender checks
+ * this with the TX claim held before it changes the send sequence.
+ */
+ci_inline int ci_tcp_send_nolock_held(ci_tcp_state* ts, ci_uint32 owner)
+{
+  return OO_ACCESS_ONCE(ts->send_nolock_gate) == CI_TCP_SEND_NOLOCK_BUSY &&
+         OO_ACCESS_ONCE(ts->send_nolock_owner) == owner;
+}
+
+/* Called by the sender [owner] to open the gate of [ts] again, unless it
+ * has been released on its behalf meanwhile.
+ */
+ci_inline void ci_tcp_send_nolock_leave(ci_tcp_state* ts, ci_uint32 owner)
+{
+  ci_wmb();
+  if( ci_tcp_send_nolock_held(ts, owner) ) {
+    OO_ACCESS_ONCE(ts->send_nolock_owner) = 0;
+    ci_cas32u_succeed(&ts->send_nolock_gate, CI_TCP_SEND_NOLOCK_BUSY,
+                      CI_TCP_SEND_NOLOCK_IDLE);
+  }
+}
+
+/* Releases the gate of [ts] on behalf of [owner], which has died holding
+ * it, and closes it: the sender may have died half way through a send, so
+ * only the lock holder may open it again.  Any packets that the sender
+ * posted were handed over before it rang the doorbell, and are merged as
+ * usual.  Returns true if [owner] held the gate.
+ */
+ci_inline int ci_tcp_send_nolock_reap(ci_netif* ni, ci_tcp_state* ts,
+                                      ci_uint32 owner)
+{
+  if( ! ci_tcp_send_nolock_held(ts, owner) ||
+      ci_cas32u_fail(&ts->send_nolock_gate, CI_TCP_SEND_NOLOCK_BUSY,
+                     CI_TCP_SEND_NOLOCK_CLOSED) )
+    return 0;
+  OO_ACCESS_ONCE(ts->send_nolock_owner) = 0;
+  CITP_STATS_NETIF_INC(ni, tcp_send_nolock_reclaims);
+  return 1;
+}
+
+/* Closes the gate of [ts] for ci_tcp_send_nolock_block() when a sender
+ * holds it.  The sender holds it for a single send without blocking, so
+ * wait for it.  If it dies holding the gate, the gate is released on its
+ * behalf when its process exits.
+ */
+ci_inline void __ci_tcp_send_nolock_block(ci_netif* ni, ci_tcp_state* ts)
+{
+  ci_uint32* gate = &ts->send_nolock_gate;
+
+  while( 1 ) {
+    switch( OO_ACCESS_ONCE(*gate) ) {
+    case CI_TCP_SEND_NOLOCK_CLOSED:
+      return;
+    case CI_TCP_SEND_NOLOCK_IDLE:
+      if( ci_cas32u_succeed(gate, CI_TCP_SEND_NOLOCK_IDLE,
+                            CI_TCP_SEND_NOLOCK_CLOSED) )
+        return;
+      continue;
+    }
+    ci_spinloop_pause();
+  }
+}
+
+/* Stops senders without the lock from sending on [ts], waiting for one
+ * that is sending now to finish, and merges what they have sent.  The lock
+ * holder must call this before it changes the send sequence or queues of a
+ * socket.  Sending without the lock is allowed again only by
+ * ci_tcp_send_nolock_open().
+ */
+ci_inline void ci_tcp_send_nolock_block(ci_netif* ni, ci_tcp_state* ts)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  if( OO_ACCESS_ONCE(ts->send_nolock_gate) != CI_TCP_SEND_NOLOCK_CLOSED &&
+      ci_cas32u_fail(&ts->send_nolock_gate, CI_TCP_SEND_NOLOCK_IDLE,
+                     CI_TCP_SEND_NOLOCK_CLOSED) )
+    __ci_tcp_send_nolock_block(ni, ts);
+  ci_tcp_send_nolock_merge(ni, ts);
+}
+
+/* Allows senders without the lock to send on [ts] again, provided that
+ * nothing queued on the socket would have to go first.
+ */
+ci_inline void ci_tcp_send_nolock_open(ci_netif* ni, ci_tcp_state* ts)
+{
+  ci_assert(ci_netif_is_locked(ni));
+  if( NI_OPTS(ni).tcp_send_nolock &&
+      ts->send_nolock_gate == CI_TCP_SEND_NOLOCK_CLOSED &&
+      ts->s.b.state == CI_TCP_ESTABLISHED &&
+      ci_ip_queue_is_empty(&ts->send) &&
+      ts->send_prequeue == OO_PP_ID_NULL &&
+      ts->s.tx_errno == 0 && ts->snd_delegated == 0 &&
+      ! (ts->tcpflags & (CI_TCPT_FLAG_MSG_WARM | CI_TCPT_FLAG_FIN_PENDING)) ) {
+    ci_wmb();
+    OO_ACCESS_ONCE(ts->send_nolock_gate) = CI_TCP_SEND_NOLOCK_IDLE;
+  }
+}
+
 /* This test is used to decide whether we should indicate to the app that
 ** it can enqueue more data on a socket.  ie. It is used to decide when to
 ** wake a blocking thread, and to decide whether to indicate the socket is
@@ -4458,6 +4813,7 @@ static inline const char* ci_tcp_aux_type2str(int type)
     case CI_TCP_AUX_TYPE_BUCKET:  return "syn-recv bucket";
     case CI_TCP_AUX_TYPE_EPOLL: return "epoll3 state";
     case CI_TCP_AUX_TYPE_PMTUS: return "path mtu data";
+    case CI_TCP_AUX_TYPE_LAT_HIST: return "latency histogram";
     default: return "unknown";
   }
 }
@@ -4492,6 +4848,12 @@ ci_inline ci_pmtu_state_t* ci_ni_aux_p2pmtus(ci_netif* ni, oo_p oop)
   ci_assert_equal(aux->type, CI_TCP_AUX_TYPE_PMTUS);
   return &aux->u.pmtus;
 }
+ci_inline ci_tcp_lat_hist* ci_ni_aux_p2lat_hist(ci_netif* ni, oo_p oop)
+{
+  ci_ni_aux_mem* aux = ci_ni_aux_p2aux(ni, oop);
+  ci_assert_equal(aux->type, CI_TCP_AUX_TYPE_LAT_HIST);
+  return &aux->u.lat_hist;
+}
 
 ci_inline citp_waitable*
 ci_ni_aux2container_w(ci_ni_aux_mem* aux)
@@ -4531,6 +4893,9 @@ ci_inline void ci_sb_epoll_free(ci_netif* ni, ci_sb_epoll_state* epoll) {
 ci_inline void ci_pmtu_state_free(ci_netif* ni, ci_pmtu_state_t* pmtus) {
   ci_ni_aux_free(ni, CI_CONTAINER(ci_ni_aux_mem, u.pmtus, pmtus));
 }
+ci_inline void ci_tcp_lat_hist_aux_free(ci_netif* ni, ci_tcp_lat_hist* h) {
+  ci_ni_aux_free(ni, CI_CONTAINER(ci_ni_aux_mem, u.lat_hist, h));
+}
 
 extern void ci_ni_aux_more_bufs(ci_netif* ni);
 ci_inline int/*bool*/ ci_ni_aux_can_alloc(ci_netif* ni, int type)
@@ -4596,6 +4961,57 @@ ci_inline ci_tcp_state_synrecv* ci_tcp_link2synrecv(struct oo_p_dllink* link) {
   return &CI_CONTAINER(ci_ni_aux_mem, link, link)->u.synrecv;
 }
 
+/*********************************************************************
+*********************** TCP latency histograms ***********************
+*********************************************************************/
+
+extern void ci_tcp_lat_hist_init(ci_netif* ni, ci_tcp_state* ts) CI_HF;
+extern void ci_tcp_lat_hist_free(ci_netif* ni, ci_tcp_state* ts) CI_HF;
+extern ci_uint64 ci_tcp_lat_hist_percentile(const ci_tcp_lat_hist* h,
+                                            unsigned permille) CI_HF;
+extern void ci_tcp_lat_hist_dump(ci_netif* ni, ci_tcp_state* ts,
+                                 oo_dump_log_fn_t logger,
+                                 void* log_arg) CI_HF;
+
+ci_inline int ci_tcp_lat_hist_bucket(const ci_tcp_lat_hist* h, ci_uint64 v)
+{
+  int msb, i;
+  if( v < (1ull << h->shift) )
+    return 0;
+  msb = 63 - __builtin_clzll(v);
+  i = 1 + ((msb - h->shift) << 1) + (int) ((v >> (msb - 1)) & 1);
+  return CI_MIN(i, CI_TCP_LAT_HIST_BUCKETS - 1);
+}
+
+/* Exclusive upper limit of bucket [i] in cycles, or 0 for the last
+ * bucket, which is unbounded. */
+ci_inline ci_uint64
+ci_tcp_lat_hist_bucket_limit(const ci_tcp_lat_hist* h, int i)
+{
+  ci_uint64 base;
+  if( i >= CI_TCP_LAT_HIST_BUCKETS - 1 )
+    return 0;
+  if( i == 0 )
+    return 1ull << h->shift;
+  base = 1ull << (h->shift + ((i - 1) >> 1));
+  return ((i - 1) & 1) ? base << 1 : base + (base >> 1);
+}
+
+ci_inline void ci_tcp_lat_hist_record(ci_netif* ni, ci_tcp_state* ts,
+                                      int kind, ci_uint64 cycles)
+{
+  ci_tcp_lat_hist* h = ci_ni_aux_p2lat_hist(ni, ts->lat_hist[kind]);
+  ++h->count[ci_tcp_lat_hist_bucket(h, cycles)];
+  if( cycles > h->max )
+    h->max = CI_MIN(cycles, (ci_uint64) 0xffffffffu);
+}
+
+ci_inline ci_uint64 ci_tcp_lat_hist_cycles2ns(ci_netif* ni, ci_uint64 c)
+{
+  return c * 1000000 / IPTIMER_STATE(ni)->khz;
+}
+
+
 /* finc current Path MTU */
 ci_inline unsigned ci_tcp_get_pmtu(ci_netif* netif, ci_tcp_state* ts)
 {
@@ -4649,13 +5065,48 @@ ci_sb_epoll_ready_link(ci_netif* ni, ci_sb_epoll_state* epoll, int i)
   ci_assert_lt((bitmask), 1u << CI_CFG_N_READY_LISTS); \
   OO_FOR_EACH_BIT(bitmask, tmp, i)
 
+/* Returns the ready lists that [sb] should be queued on for an event: all
+ * of the lists whose epoll sets have [sb] without EPOLLEXCLUSIVE, plus one
+ * of the exclusive lists (if any).  The exclusive list is chosen
+ * round-robin: see ci_sb_epoll_excl_advance().
+ */
+ci_inline ci_uint32 ci_sb_epoll_ready_lists(citp_waitable* sb)
+{
+  ci_uint32 excl = sb->ready_lists_excl & sb->ready_lists_in_use;
+  ci_uint32 lists = sb->ready_lists_in_use & ~excl;
+
+  CI_BUILD_ASSERT(CI_CFG_N_READY_LISTS <= 16);
+  if( excl != 0 ) {
+    if( excl & (1u << sb->ready_list_excl_last) )
+      lists |= 1u << sb->ready_list_excl_last;
+    else
+      lists |= 1u << (ci_ffs64(excl) - 1);
+  }
+  return lists;
+}
+
+/* Moves [sb] on to the next exclusive ready list once an event has been
+ * queued and woken.  Stack lock.
+ */
+ci_inline void ci_sb_epoll_excl_advance(citp_waitable* sb)
+{
+  ci_uint32 excl = sb->ready_lists_excl & sb->ready_lists_in_use;
+  ci_uint32 next;
+
+  if( excl == 0 )
+    return;
+  next = excl & ~((2u << sb->ready_list_excl_last) - 1);
+  sb->ready_list_excl_last = ci_ffs64(next != 0 ? next : excl) - 1;
+}
+
 ci_inline void
 ci_netif_put_on_post_poll_epoll(ci_netif* ni, citp_waitable* sb)
 {
 #if CI_CFG_EPOLL3
   ci_sb_epoll_state* epoll = ci_ni_aux_p2epoll(ni, sb->epoll);
   ci_uint32 tmp, i;
-  CI_READY_LIST_EACH(sb->ready_lists_in_use, tmp, i) {
+  ci_uint32 lists = ci_sb_epoll_ready_lists(sb);
+  CI_READY_LIST_EACH(lists, tmp, i) {
     struct oo_p_dllink_state link = ci_sb_epoll_ready_link(ni, epoll, i);
     oo_p_dllink_del(ni, link);
     oo_p_dllink_add_tail(ni,
@@ -4685,6 +5136,7 @@ citp_waitable_remove_from_epoll(ci_netif* ni, citp_waitable* w, int do_free)
     oo_p_dllink_init(ni, link);
   }
   w->ready_lists_in_use = 0;
+  w->ready_lists_excl = 0;
   if( do_free ) {
     ci_ni_aux_free(ni, CI_CONTAINER(ci_ni_aux_mem, u.epoll, epoll));
     w->epoll = OO_PP_NULL;
@@ -5041,11 +5493,39 @@ ci_inline ci_uint16 oo_tcpdump_queue_len(ci_netif* ni)
   return ni->state->dump_write_i - ni->state->dump_read_i;
 }
 
+ci_inline void
+ci_netif_capture_init(ci_netif* ni, char* base, ci_uint32 n_slots,
+                      ci_uint32 stride, ci_uint32 max_snaplen)
+{
+  ni->capture.filter = (struct oo_capture_insn*) base;
+  ni->capture.slots = base +
+                      sizeof(struct oo_capture_insn) * OO_CAPTURE_FILTER_MAX;
+  ni->capture.mask = n_slots - 1;
+  ni->capture.stride = stride;
+  ni->capture.max_snaplen = max_snaplen;
+}
+
+/* Is onload_tcpdump using the capture ring rather than the dump queue? */
+ci_inline int oo_tcpdump_ring_on(ci_netif* ni)
+{
+  return ni->state->capture.on && ni->capture.filter != NULL;
+}
+
+/* Run a classic BPF program over a packet.  Returns the number of bytes to
+ * capture, or 0 to reject the packet. */
+extern unsigned oo_capture_filter_run(const struct oo_capture_insn* prog,
+                                      unsigned n_insns, const ci_uint8* data,
+                                      unsigned caplen, unsigned wirelen) CI_HF;
+
+/* Filter the packet and copy it into the capture ring. */
+extern void oo_tcpdump_capture(ci_netif* ni, ci_ip_pkt_fmt* pkt) CI_HF;
+
 /* Should we dump this packet? */
 ci_inline int oo_tcpdump_check(ci_netif *ni, ci_ip_pkt_fmt *pkt, int intf_i)
 {
   if( ni->state->dump_intf[intf_i] == OO_INTF_I_DUMP_ALL ) {
-    if( oo_tcpdump_queue_len(ni) < CI_CFG_DUMPQUEUE_LEN - 1 )
+    if( oo_tcpdump_ring_on(ni) ||
+        oo_tcpdump_queue_len(ni) < CI_CFG_DUMPQUEUE_LEN - 1 )
       return 1;
     else
       CITP_STATS_NETIF_INC(ni, tcpdump_missed);
@@ -5058,7 +5538,8 @@ ci_inline int oo_tcpdump_check_no_match(ci_netif *ni, ci_ip_pkt_fmt *pkt,
                                         int intf_i)
 {
   if( ni->state->dump_intf[intf_i] == OO_INTF_I_DUMP_NO_MATCH ) {
-    if( oo_tcpdump_queue_len(ni) < CI_CFG_DUMPQUEUE_LEN - 1 )
+    if( oo_tcpdump_ring_on(ni) ||
+        oo_tcpdump_queue_len(ni) < CI_CFG_DUMPQUEUE_LEN - 1 )
       return 1;
     else
       CITP_STATS_NETIF_INC(ni, tcpdump_missed);
@@ -5078,6 +5559,11 @@ ci_inline void oo_tcpdump_dump_pkt(ci_netif *ni, ci_ip_pkt_fmt *pkt)
   if(CI_UNLIKELY( pkt->flags & CI_PKT_FLAG_MSG_WARM ))
     return;
 
+  if( oo_tcpdump_ring_on(ni) ) {
+    oo_tcpdump_capture(ni, pkt);
+    return;
+  }
+
   if( dq[write_i % CI_CFG_DUMPQUEUE_LEN] != OO_PP_NULL )
     oo_tcpdump_free_pkts(ni, write_i);
 
@@ -5180,6 +5666,27 @@ ci_inline ci_uint64 __oo_usec_to_cycles64(ci_uint32 khz, unsigned usec)
 #define oo_usec_to_cycles64(ni, usec) \
     __oo_usec_to_cycles64(IPTIMER_STATE(ni)->khz, usec)
 
+/* How long a call that is allowed to spin for [max_spin] should actually
+ * spin, given the waits seen so far in [sa].  See EF_SPIN_ADAPT. */
+ci_inline ci_uint64 ci_spin_adapt_budget(const ci_spin_adapt* sa,
+                                         ci_uint32 khz, ci_uint64 max_spin)
+{
+  if( sa->budget_usec == CI_SPIN_ADAPT_NO_BUDGET )
+    return max_spin;
+  return CI_MIN(max_spin, __oo_usec_to_cycles64(khz, sa->budget_usec));
+}
+
+/* How long a receive call on [w] that is allowed to spin for [max_spin]
+ * should actually spin. */
+ci_inline ci_uint64 citp_waitable_spin_budget(ci_netif* ni, citp_waitable* w,
+                                              ci_uint64 max_spin)
+{
+  if( NI_OPTS(ni).spin_adapt == 0 )
+    return max_spin;
+  return ci_spin_adapt_budget(&w->spin_adapt, IPTIMER_STATE(ni)->khz,
+                              max_spin);
+}
+
 
 /**********************************************************************
  * Zero-copy API helpers
@@ -279,8 +279,8 @@ struct ci_ip_pkt_fmt_s {
   union {
     char                  unused_padding[CI_CACHE_LINE_SIZE];
 
-#if CI_CFG_TIMESTAMPING
     struct {
+#if CI_CFG_TIMESTAMPING
       /*! Timestamp of the first TCP transmit */
       struct oo_timespec    first_tx_hw_stamp;
 
@@ -289,8 +289,12 @@ struct ci_ip_pkt_fmt_s {
 
       /*! Key for SOF_TIMESTAMPING_OPT_ID */
       ci_uint32             ts_key;
-    };
 #endif
+
+      /*! TCP data on a socket with latency histograms: frc at send(),
+       *  replaced by the frc at TX completion.  Otherwise 0. */
+      ci_uint64             tx_lat_frc;
+    };
   };
 
   /* N.B. The first member after the above padding is the subject of
@@ -575,6 +579,29 @@ typedef struct {
 #define CI_TCP_PREV_SEQ_IS_FREE(prev_seq)     (CI_IPX_ADDR_IS_ANY((prev_seq).laddr))
 #define CI_TCP_PREV_SEQ_IS_TERMINAL(prev_seq) ((prev_seq).route_count == 0)
 
+
+/* What remains of a connection in TIME_WAIT once its endpoint has been
+ * freed (EF_TCP_TIME_WAIT_COMPACT).  Enough to ACK a retransmitted FIN,
+ * validate a reopening SYN and let an active open reuse the four-tuple. */
+typedef struct {
+  ci_addr_t laddr;
+  ci_addr_t raddr;
+  ci_uint16 lport;
+  ci_uint16 rport;
+  ci_uint32 snd_nxt;
+  ci_uint32 rcv_nxt;
+  ci_uint32 tsrecent;
+  ci_iptime_t expiry; /* time (ticks) at which 2MSL is over */
+  ci_uint32 route_count; /* for handling tombstones */
+  ci_uint16 rcv_wnd_be16; /* window to advertise in ACKs */
+  ci_uint8  flags;
+#define CI_TCP_TIMEWAIT_FLAG_TSO              0x1
+#define CI_TCP_TIMEWAIT_FLAG_SEQNO_REMEMBERED 0x2
+} ci_tcp_timewait_t;
+
+#define CI_TCP_TIMEWAIT_IS_FREE(tw)     (CI_IPX_ADDR_IS_ANY((tw).laddr))
+#define CI_TCP_TIMEWAIT_IS_TERMINAL(tw) ((tw).route_count == 0)
+
 #if CI_CFG_IPV6
 typedef struct {
   ci_int32  id;
@@ -1020,9 +1047,84 @@ typedef struct {
   ci_uint32             ctpio_frame_len_check;
   ci_uint32             ctpio_max_frame_len;
 #endif
+  /* With EF_TCP_SEND_NOLOCK, TCP senders that do not hold the lock may
+   * post to the TX ring, so everyone who posts to it takes this claim
+   * first.  Zero when free, else the owner.  See ci_netif_tx_claim(). */
+  ci_uint32             tx_claim;
+  /* Packets and bytes posted to the TX ring without the lock.  The lock
+   * holder folds them into [tx_dmaq_insert_seq] and [tx_bytes_added]; the
+   * _folded counters say how much it has taken so far. */
+  ci_uint32             tx_nolock_pkts;
+  ci_uint32             tx_nolock_bytes;
+  ci_uint32             tx_nolock_pkts_folded;
+  ci_uint32             tx_nolock_bytes_folded;
+  /* When a spinning thread last claimed this interface, see
+   * EF_POLL_CLAIM_USEC.  Written without the lock: it is only a hint. */
+  ci_uint64             poll_claim_frc CI_ALIGN(8);
 } ci_netif_state_nic_t;
 
 
+#if CI_CFG_TCPDUMP
+/*!
+** Packet capture ring for onload_tcpdump --ring, see EF_TCPDUMP_RING.
+**
+** The capturing tool installs a classic BPF program and a snaplen with the
+** stack locked, and turns the ring on.  From then on, the stack copies the
+** head of each packet which passes the filter into the next free slot of
+** the ring, so that no packet buffer is held while the tool catches up.
+** The stack never waits for the tool: when the ring is full the packet is
+** counted as dropped.
+**
+** The capture area at [capture_ofs] holds the filter program, followed by
+** the slots.  Each slot is an oo_capture_rec followed by the packet data.
+*/
+
+/* One classic BPF instruction, laid out as struct sock_filter. */
+struct oo_capture_insn {
+  ci_uint16 code;
+  ci_uint8  jt;
+  ci_uint8  jf;
+  ci_uint32 k;
+};
+
+#define OO_CAPTURE_FILTER_MAX  512
+
+struct oo_capture_rec {
+  ci_uint64 frc;        /* frc at which the stack saw the packet */
+  ci_uint32 hw_sec;     /* NIC timestamp if OO_CAPTURE_REC_F_HW_TS */
+  ci_uint32 hw_nsec;
+  ci_uint32 len;        /* length of the frame */
+  ci_uint16 caplen;     /* bytes of the frame which follow */
+  ci_uint8  intf_i;
+  ci_uint8  flags;
+#define OO_CAPTURE_REC_F_RX     0x1
+#define OO_CAPTURE_REC_F_HW_TS  0x2
+};
+
+struct oo_capture_intf_stats {
+  ci_uint32 seen;       /* offered for capture */
+  ci_uint32 accepted;   /* passed the filter */
+  ci_uint32 dropped;    /* passed the filter, but the ring was full */
+};
+
+struct oo_capture_state {
+  /* Geometry of the ring; there is no ring if [stride] is 0. */
+  CI_ULCONST ci_uint32 mask;
+  CI_ULCONST ci_uint32 stride;
+  CI_ULCONST ci_uint32 max_snaplen;
+  /* Set by the capturing tool with the stack locked. */
+  ci_uint32            on;
+  ci_uint32            snaplen;
+  ci_uint32            filter_len;  /* 0 accepts every packet */
+  /* Number of records written by the stack and read by the tool. */
+  volatile ci_uint32   write_i;
+  volatile ci_uint32   read_i;
+  /* Indexed by intf_i, up to OO_INTF_I_NUM. */
+  struct oo_capture_intf_stats intf[CI_CFG_MAX_INTERFACES + 2];
+};
+#endif
+
+
 struct ci_netif_state_s {
 
   ci_netif_state_nic_t  nic[CI_CFG_MAX_INTERFACES];
@@ -1057,6 +1159,13 @@ struct ci_netif_state_s {
 #define OO_SW_FILTER_OPS_SIZE (CI_CFG_MAX_LOCAL_IPADDRS * 2)
   struct oo_ringbuffer_state sw_filter_ops;
 
+#if CI_CFG_TIMESTAMPING
+  /* TX timestamp completions for the application, see EF_TX_TIMESTAMP_RING.
+   * Written by whoever polls the stack; the readers keep their own read
+   * index, so [read] is unused.  Empty (stride 0) if there is no ring. */
+  struct oo_ringbuffer_state tx_ts_ring;
+#endif
+
   ci_uint32  flags;
 # define CI_NETIF_FLAG_DEBUG              0x1 /* driver is debug build   */
 #if CI_CFG_FD_CACHING
@@ -1194,8 +1303,15 @@ struct ci_netif_state_s {
 #if CI_CFG_UL_INTERRUPT_HELPER
   CI_ULCONST ci_uint32  closed_eps_ofs; /**< offset of colsed eps ringbuffer */
   CI_ULCONST ci_uint32  sw_filter_ofs;  /**< offset of sw filter operations */
+#endif
+#if CI_CFG_TIMESTAMPING
+  CI_ULCONST ci_uint32  tx_ts_ring_ofs; /**< offset of TX timestamp ring */
+#endif
+#if CI_CFG_TCPDUMP
+  CI_ULCONST ci_uint32  capture_ofs;    /**< offset of capture ring */
 #endif
   CI_ULCONST ci_uint32  seq_table_ofs;   /**< offset of seq no table */
+  CI_ULCONST ci_uint32  timewait_table_ofs; /**< offset of TIME_WAIT table */
   CI_ULCONST ci_uint32  deferred_pkts_ofs; /**< offset of deferred pkts array */
   CI_ULCONST ci_uint32  buf_ofs;         /**< offset of packet metadata */
   CI_ULCONST ci_uint32  dma_ofs;         /**< offset of dma_addrs */
@@ -1279,7 +1395,8 @@ struct ci_netif_state_s {
 #define CI_TCP_AUX_TYPE_BUCKET  1
 #define CI_TCP_AUX_TYPE_EPOLL   2
 #define CI_TCP_AUX_TYPE_PMTUS   3
-#define CI_TCP_AUX_TYPE_NUM     4
+#define CI_TCP_AUX_TYPE_LAT_HIST 4
+#define CI_TCP_AUX_TYPE_NUM     5
   struct oo_p_dllink    free_aux_mem;    /**< Free list of synrecv bufs. */
   ci_uint32             n_free_aux_bufs; /**< Number of free aux bufs */
   ci_uint32             n_aux_bufs[CI_TCP_AUX_TYPE_NUM];
@@ -1302,6 +1419,7 @@ struct ci_netif_state_s {
   ci_uint64             sock_spin_cycles    CI_ALIGN(8);
   ci_uint64             buzz_cycles         CI_ALIGN(8);
   ci_uint64             timer_prime_cycles  CI_ALIGN(8);
+  ci_uint64             poll_claim_cycles   CI_ALIGN(8);
 
   CI_ULCONST ci_uint32  timesync_bytes;
   CI_ULCONST ci_uint32  io_mmap_bytes;
@@ -1340,6 +1458,11 @@ struct ci_netif_state_s {
    */
   CI_ULCONST uid_t      uuid;
   CI_ULCONST ci_uint32  creation_time_sec;
+  /* Driver-wide stack pool counters as of this stack's allocation, and
+   * whether it was handed out from the pool of pre-created stacks. */
+  CI_ULCONST ci_uint32  stack_pool_hits;
+  CI_ULCONST ci_uint32  stack_pool_misses;
+  CI_ULCONST ci_uint32  from_stack_pool;
   
   ci_uint32             defer_work_count;
 
@@ -1360,6 +1483,7 @@ struct ci_netif_state_s {
   ci_uint8              dump_intf[OO_INTF_I_NUM];
   volatile ci_uint16    dump_read_i;
   volatile ci_uint16    dump_write_i;
+  struct oo_capture_state capture;
 #endif
 
   ef_vi_stats           vi_stats CI_ALIGN(8);
@@ -1391,6 +1515,9 @@ struct ci_netif_state_s {
   /* Number of entries in the table of previously-used sequence numbers. */
   CI_ULCONST ci_uint32  seq_table_entries_n;
 
+  /* Number of entries in the table of compact TIME_WAIT records. */
+  CI_ULCONST ci_uint32  timewait_table_entries_n;
+
   CI_ULCONST ci_uint16  rss_instance;
   CI_ULCONST ci_uint16  cluster_size;
 
@@ -1485,6 +1612,24 @@ struct oo_ep_header {
   ci_uint32             state;
 };
 
+/* Adaptive spinning (EF_SPIN_ADAPT).  Records how long blocking receive
+ * calls on a socket, or a thread's epoll_wait() calls, have waited.
+ * Bucket 0 counts waits below 1us, bucket i waits below 2^i us, and the
+ * last bucket everything longer.  The counts are halved from time to time
+ * so that old waits fade out.
+ *
+ * Written only under the socket lock, or by the thread that owns it.
+ */
+#define CI_SPIN_ADAPT_BUCKETS  12
+typedef struct {
+  ci_uint16             count[CI_SPIN_ADAPT_BUCKETS];
+  ci_uint32             ewma_ns;     /* mean wait, weight 1/8 per sample */
+  ci_uint32             budget_usec; /* spin time chosen from [count] */
+#define CI_SPIN_ADAPT_NO_BUDGET  ((ci_uint32) -1)  /* spin the full time */
+  ci_uint32             hits;        /* data arrived while spinning */
+  ci_uint32             misses;      /* spin ran out before data arrived */
+} ci_spin_adapt;
+
 /*!
 ** citp_waitable
 **
@@ -1506,6 +1651,13 @@ typedef struct {
   */
   ci_sleep_seq_t sleep_seq CI_ALIGN(8);
 
+  /* Value of [sleep_seq] for the last event that was claimed by an epoll
+  ** set that has this object with EPOLLEXCLUSIVE.  Changed only with CAS,
+  ** so that only one such set reports each event.
+  */
+  volatile ci_uint64    epoll_excl_seq CI_ALIGN(8);
+#define CI_SB_EPOLL_EXCL_SEQ_NONE  ((ci_uint64) -1)
+
   /* Per-socket SO_BUSY_POLL settings */
   ci_uint64             spin_cycles CI_ALIGN(8);
 
@@ -1619,6 +1771,9 @@ typedef struct {
 
   ci_int32              sigown;  /** pid that receives signals from this */
 
+  /* Receive wait statistics for EF_SPIN_ADAPT.  Socket lock. */
+  ci_spin_adapt         spin_adapt;
+
 #if CI_CFG_ENDPOINT_MOVE
   ci_uint32             moved_to_stack_id;
 #define OO_STACK_ID_INVALID ((ci_uint32)(-1))
@@ -1637,6 +1792,12 @@ typedef struct {
    */
   ci_uint32             ready_lists_in_use;
   oo_p                  epoll;
+  /* The ready lists in [ready_lists_in_use] whose epoll set has this
+   * object with EPOLLEXCLUSIVE, and the one of them that was picked last.
+   * Only one of them is queued on for each event.  Stack lock.
+   */
+  ci_uint16             ready_lists_excl;
+  ci_uint16             ready_list_excl_last;
 } citp_waitable;
 
 
@@ -2147,11 +2308,8 @@ typedef struct {
 struct  ci_udp_state_s {
   ci_sock_cmn           s;
 
-  /*! Cache used for "unconnected" destinations - i.e. where a dest. addr
-   * has been provided by the caller.  We use this cache regardless of 
-   * whether we are connected */
-  ci_ip_cached_hdrs     ephemeral_pkt CI_ALIGN(8);
-
+  /* Fields used for every datagram received or sent come first; as for
+   * ci_tcp_state, keep slow-path state further down. */
   ci_uint32 udpflags;
 #define CI_UDPF_FILTERED        0x00000001  /*!< filter inserted         */
 #define CI_UDPF_MCAST_LOOP      0x00000002  /*!< IP_MULTICAST_LOOP       */
@@ -2169,8 +2327,6 @@ struct  ci_udp_state_s {
 #define CI_UDPF_LAST_SEND_NOMAC 0x00040000  /*!< last send was via nomac path */
 #define CI_UDPF_NO_MCAST_FILTER 0x00080000  /*!< don't add multicast filters */
 
-  ci_uint32 future_intf_i; /* Interface to check for incoming future packets */
-
 #if CI_CFG_ZC_RECV_FILTER
   /* Only safe to use these at user-level in context of caller who set them */
   ci_uint64     recv_q_filter CI_ALIGN(8);
@@ -2178,6 +2334,24 @@ struct  ci_udp_state_s {
 #endif
   ci_udp_recv_q recv_q;
 
+  /* Linked list of UDP datagrams.  Datagrams to be sent are queued here
+   * (in reverse order) when the netif lock is contended in sendmsg().
+   * Manipulated atomically.  Link field is [pkt->netif.tx.dmaq_next].
+   */
+  ci_int32  tx_async_q;
+  oo_atomic_t tx_async_q_level;
+  /* Number of bytes "inflight".  i.e. Sent to interface (including
+   * overflow queue) and not yet had TX event.
+   */
+  ci_uint32 tx_count;
+
+  ci_uint32 future_intf_i; /* Interface to check for incoming future packets */
+
+  /*! Cache used for "unconnected" destinations - i.e. where a dest. addr
+   * has been provided by the caller.  We use this cache regardless of 
+   * whether we are connected */
+  ci_ip_cached_hdrs     ephemeral_pkt CI_ALIGN(8);
+
 #if CI_CFG_TIMESTAMPING
   ci_udp_recv_q timestamp_q;
 #endif
@@ -2197,17 +2371,6 @@ struct  ci_udp_state_s {
   /*! Value of stamp before SO_TIMESTAMP enabled */
   ci_uint64 stamp_pre_sots CI_ALIGN(8); 
 
-  /* Linked list of UDP datagrams.  Datagrams to be sent are queued here
-   * (in reverse order) when the netif lock is contended in sendmsg().
-   * Manipulated atomically.  Link field is [pkt->netif.tx.dmaq_next].
-   */
-  ci_int32  tx_async_q;
-  oo_atomic_t tx_async_q_level;
-  /* Number of bytes "inflight".  i.e. Sent to interface (including
-   * overflow queue) and not yet had TX event.
-   */
-  ci_uint32 tx_count;
-
   /* Cache for IP_PKTINFO and IPV6_PKTINFO */
   struct {
     /* PKT info: */
@@ -2395,6 +2558,30 @@ typedef struct {
   oo_p bucket[CI_TCP_LISTEN_BUCKET_SIZE];
 } ci_tcp_listen_bucket;
 
+/* Per-socket latency histogram (EF_TCP_LATENCY_HIST).
+ *
+ * Samples are in frc cycles.  Bucket 0 counts samples below 2^shift
+ * cycles, then each power of two is split into two buckets, and the last
+ * bucket counts everything that is larger still.
+ *
+ * Each histogram has a single writer: the receive path under the socket
+ * lock for CI_TCP_LAT_HIST_RX and the stack-locked paths for the others.
+ * So updates are plain stores, and readers such as onload_stackdump may
+ * see a sample that is only partly written.
+ */
+#define CI_TCP_LAT_HIST_RX       0  /* RX event to recv() return */
+#define CI_TCP_LAT_HIST_TX       1  /* send() to TX completion */
+#define CI_TCP_LAT_HIST_RTT      2  /* TX completion to ACK arrival */
+#define CI_TCP_LAT_HIST_N        3
+#define CI_TCP_LAT_HIST_BUCKETS  24
+typedef struct {
+  ci_uint8             kind;      /* CI_TCP_LAT_HIST_* */
+  ci_uint8             shift;     /* log2 of bucket 0 limit in cycles */
+  ci_uint16            reserved;
+  ci_uint32            max;       /* largest sample, saturated */
+  ci_uint32            count[CI_TCP_LAT_HIST_BUCKETS];
+} ci_tcp_lat_hist;
+
 /* This memory is cacheline-aligned for performance reasons. */
 #define CI_AUX_MEM_SIZE 128
 #define CI_AUX_HEADER_SIZE CI_CACHE_LINE_SIZE
@@ -2407,6 +2594,7 @@ typedef struct {
     ci_tcp_listen_bucket bucket;
     ci_sb_epoll_state    epoll;
     ci_pmtu_state_t      pmtus;
+    ci_tcp_lat_hist      lat_hist;
   } u;
 
   /* This is not a real member.  It just brings the sizeof(ci_ni_aux_mem)
@@ -2465,12 +2653,13 @@ struct ci_tcp_state_s {
   ci_sock_cmn         s;
   ci_tcp_socket_cmn   c;
 
-  /* Id of the local peer socket in case of loopback connection */
-  oo_sp                 local_peer;
-
-  /* List of allocated templated sends on this socket */
-  oo_pkt_p            tmpl_head;
-
+  /* Fast path.  Everything read or written for each segment received or
+   * sent in the established state lives here, directly after the common
+   * socket state, so that ci_tcp_handle_rx() and ci_tcp_sendmsg() touch as
+   * few cache lines of the endpoint as possible.  "onload_stackdump sizeof"
+   * reports where this section lands.  Do not add fields here that only
+   * slow paths need.
+   */
   /* Various options.  Should be updated under the stack lock only. */
   ci_uint32            tcpflags;
   /* Options negotiated with SYN options. */
@@ -2523,84 +2712,16 @@ struct ci_tcp_state_s {
    * because packet allocation failed.  Must send FIN, really. */
 #define CI_TCPT_FLAG_FIN_PENDING        0x800000
 
+  /* The socket is in TIME_WAIT and is waiting for the timeout timer to
+   * move it into the compact TIME_WAIT table and free it. */
+#define CI_TCPT_FLAG_TW_COMPACT         0x1000000
+
   /* flags advertised on SYN */
 # define CI_TCPT_SYN_FLAGS \
         (CI_TCPT_FLAG_WSCL | CI_TCPT_FLAG_TSO | CI_TCPT_FLAG_SACK)
 # define CI_TCPT_NEG_FLAGS \
         (CI_TCPT_FLAG_TSO | CI_TCPT_FLAG_WSCL | CI_TCPT_FLAG_SACK | \
          CI_TCPT_FLAG_ECN)
-  /* Path MTU data: timer, value, etc */
-  oo_p pmtus;
-
-  /* SO_SNDBUF measured in packet buffers. */
-  ci_int32            so_sndbuf_pkts;
-
-  /* the part of SO_RVCBUF used as window */
-  ci_uint32           rcv_window_max;
-
-  ci_uint32           send_in;    /**< Packets added directly to send queue */
-  ci_uint32           send_out;   /**< Packets removed from send queue */
-  ci_ip_pkt_queue     send;       /**< Send queue. */
-
-  ci_ip_pkt_queue     retrans;    /**< Retransmit queue. */
-
-  ci_ip_pkt_queue     recv1;      /**< Receive queue. */
-  ci_ip_pkt_queue     recv2;      /**< Aux receive queue for urgent data */
-  oo_pkt_p            recv1_extract; 
-                                  /**< Next id in main receive queue to be 
-                                       extracted by recvmsg */
-  ci_uint16           recv_off;   /**< Offset to current recv queue
-                                       from base of [ci_tcp_state] */
-
-  ci_uint16           outgoing_hdrs_len;
-  /* Length of IP + TCP headers (inc TSO if any).
-   * Does not include Ethernet header len any more! */
-
-  ci_ip_pkt_queue     rob;        /**< Re-order buffer. */
-  oo_pkt_p            last_sack[CI_TCP_SACK_MAX_BLOCKS + 1];  
-                                  /**< First packets of last-received
-                                   * block (in [0]) and last-sent 
-                                   * SACKed blocks */
-  ci_uint32           dsack_start;/**< Start SEQ of DSACK option */
-  ci_uint32           dsack_end;  /**< End SEQ of DSACK option */
-  oo_pkt_p            dsack_block;/**< Second block packet id: 
-                                   * CI_ILL_END used for no second block;
-                                   * CI_ILL_UNUSED when no DSACK present */
-
-#if CI_CFG_TIMESTAMPING
-  /* About timestamp_q management:
-   * This queue is for delivery to the app when it asks for the list of
-   * completed tx timestamps. The timestamp to be given is that of the last
-   * transmit, so we add to this queue when we get the ACK confirming that
-   * there aren't going to be any more retransmits.
-   *
-   * The trickiness arises because that ACK may arrive before the tx
-   * completion. In that case we split timestamp_q at timestamp_q_pending so
-   * that the non-tx-complete don't appear to be visible to the app;
-   * ci_netif_rx_pkt_complete_tcp() checks for this in poll and can make them
-   * visible.
-   *
-   * Full diagram of what's what:
-   *   ts_q.head (oldest packet) (===ts_q.pkts_reaped)
-   *      > ci_udp_recv_q_reapable()
-   *   ts_q.extract  (===ts_q.pkts_delivered)
-   *      > ci_udp_recv_q_pkts()
-   *   ts_q_pending (===ts_q.pkts_added)
-   *   ts_q.tail (newest packet)
-   *
-   * NB: the timestamp_q is used both for tx timestamping and for zc
-   * completions: they have identical needs so they share an implementation.
-   * */
-  ci_udp_recv_q       timestamp_q;/**< TX timestamp queue */
-  oo_pkt_p            timestamp_q_pending; /* First non-tx-complete packet on
-                                       timestamp_q, or OO_PP_NULL if there is
-                                       no such packet. Protected by the stack
-                                       lock */
-#endif
-
-  /* Next field is needed to support PathMTU discovery functionality */
-  ci_uint32            snd_check;   /* equal to snd_nxt at beginning of
-                                       tested interval */
 
   ci_uint32            snd_nxt;     /* next sequence number to send       */
   ci_uint32            snd_max;     /* maximum sequence number advertised */
@@ -2617,12 +2738,20 @@ struct ci_tcp_state_s {
   ** is set to an invalid value that should never match a TCP packet.
   */
 
-  ci_uint32            snd_up;      /* send urgent pointer, holds the seq 
-                                       num of byte following the OOB byte */
-  ci_uint16            amss;        /* advertised mss to the sending side */
-  ci_uint16            smss;        /* sending MSS (excl IP & TCP hdrs)   */
-  ci_uint16            eff_mss;     /* PMTU-based mss, excl TCP options   */
-  ci_uint16            retransmits; /* number of retransmissions */
+  ci_uint32            cwnd;        /* congestion window                  */
+  ci_uint32            cwnd_extra;  /* adjustments when congested         */
+  ci_uint32            ssthresh;    /* slow-start threshold               */
+  ci_uint32            bytes_acked; /* bytes acked but not yet added to cwnd */
+  
+#if CI_CFG_TCP_FASTSTART  
+  ci_uint32            faststart_acks; /* Bytes to ack before leaving faststart */
+#endif
+
+#if CI_CFG_TAIL_DROP_PROBE
+  /* This is set to snd_nxt value when a Tail Loss Probe is sent.
+   * Valid iff CI_TCPT_FLAG_TAIL_DROP_MARKED flag is set. */
+  ci_uint32            taildrop_mark;
+#endif
 
   ci_uint32            rcv_wnd_advertised; /* receive window to advertise in
                                               outgoing packets            */
@@ -2639,8 +2768,15 @@ struct ci_tcp_state_s {
                                         any packets from other side,
                                         or zero if unlimited */
 #endif
-  ci_uint32            rcv_up;      /* receive urgent pointer, holds the
-                                       seq num of the OOB byte            */
+
+  ci_uint16            amss;        /* advertised mss to the sending side */
+  ci_uint16            smss;        /* sending MSS (excl IP & TCP hdrs)   */
+  ci_uint16            eff_mss;     /* PMTU-based mss, excl TCP options   */
+  ci_uint16            retransmits; /* number of retransmissions */
+
+  ci_uint16           outgoing_hdrs_len;
+  /* Length of IP + TCP headers (inc TSO if any).
+   * Does not include Ethernet header len any more! */
 
   ci_uint8             rcv_wscl;    /* receive window scaling             */
   ci_uint8             snd_wscl;    /* send window scaling                */
@@ -2657,24 +2793,28 @@ struct ci_tcp_state_s {
 
   ci_uint8             incoming_tcp_hdr_len; /* expected TCP header length */
 
-  ci_uint32            congrecover; /* snd_nxt when loss detected         */
-  oo_pkt_p             retrans_ptr; /* next packet to retransmit          */
-  ci_uint32            retrans_seq; /* seq of next packet to retransmit   */
-
-  ci_uint32            cwnd;        /* congestion window                  */
-  ci_uint32            cwnd_extra;  /* adjustments when congested         */
-  ci_uint32            ssthresh;    /* slow-start threshold               */
-  ci_uint32            bytes_acked; /* bytes acked but not yet added to cwnd */
-  
-#if CI_CFG_TCP_FASTSTART  
-  ci_uint32            faststart_acks; /* Bytes to ack before leaving faststart */
-#endif
+  /* delayed acknowledgements */
+  ci_uint16            acks_pending;/* number of packets needing ack      */
+/* These bits are ORed into acks_pending */
+#define CI_TCP_DELACK_SOON_FLAG 0x8000
+#define CI_TCP_ACK_FORCED_FLAG  0x4000
+/* Mask to get the number of acks pending (includes ACK_FORCED but not
+ * DELACK_SOON bit)
+ */
+#define CI_TCP_ACKS_PENDING_MASK 0x7fff
 
-#if CI_CFG_TAIL_DROP_PROBE
-  /* This is set to snd_nxt value when a Tail Loss Probe is sent.
-   * Valid iff CI_TCPT_FLAG_TAIL_DROP_MARKED flag is set. */
-  ci_uint32            taildrop_mark;
+  /* timestamp option fields see RFC1323 */
+  ci_uint32            tsrecent;    /* TS.Recent RFC1323                  */
+  ci_uint32            tslastack;   /* Last.ACK.sent RFC1323              */ 
+#ifndef NDEBUG
+  ci_uint32            tslastseq;   /* Sequence no of packet that updated tsrecent
+                                       Just being used for debugging - purge at will */
 #endif
+  ci_iptime_t          tspaws;      /* last active timestamp for tsrecent */
+#define CI_TCP_TSO_WORD (CI_BSWAPC_BE32((CI_TCP_OPT_NOP       << 24u)  | \
+                                        (CI_TCP_OPT_NOP       << 16u)  | \
+                                        (CI_TCP_OPT_TIMESTAMP <<  8u)  | \
+                                        (0xa                        )))
 
   /* Keep alive probes, and sending ACKs after gaps that may cause
    * other end to validated its congetion window 
@@ -2701,9 +2841,6 @@ struct ci_tcp_state_s {
    */
 #endif
 
-  ci_iptime_t          t_last_invalid_ack; /* timestamp of last ACK for
-                                              an invalid incoming packet */
-
   /* sa and sv are scaled by 8 and 4 respectively to minimize roundoff
   ** error when time has a large granularity See the appendix of
   ** Jacobson's SIGCOMM 88  */
@@ -2719,28 +2856,118 @@ struct ci_tcp_state_s {
   ci_uint32            timed_seq;   /* first byte of timed packet         */
   ci_iptime_t          timed_ts;    /* timestamp for timed packet         */
 
-  /* timestamp option fields see RFC1323 */
-  ci_uint32            tsrecent;    /* TS.Recent RFC1323                  */
-  ci_uint32            tslastack;   /* Last.ACK.sent RFC1323              */ 
-#ifndef NDEBUG
-  ci_uint32            tslastseq;   /* Sequence no of packet that updated tsrecent
-                                       Just being used for debugging - purge at will */
+  ci_uint32            congrecover; /* snd_nxt when loss detected         */
+  oo_pkt_p             retrans_ptr; /* next packet to retransmit          */
+  ci_uint32            retrans_seq; /* seq of next packet to retransmit   */
+
+  /* SO_SNDBUF measured in packet buffers. */
+  ci_int32            so_sndbuf_pkts;
+
+  /* the part of SO_RVCBUF used as window */
+  ci_uint32           rcv_window_max;
+
+  ci_uint32           send_in;    /**< Packets added directly to send queue */
+  ci_uint32           send_out;   /**< Packets removed from send queue */
+  ci_ip_pkt_queue     send;       /**< Send queue. */
+
+  ci_ip_pkt_queue     retrans;    /**< Retransmit queue. */
+
+  ci_ip_pkt_queue     recv1;      /**< Receive queue. */
+  ci_ip_pkt_queue     recv2;      /**< Aux receive queue for urgent data */
+  oo_pkt_p            recv1_extract; 
+                                  /**< Next id in main receive queue to be 
+                                       extracted by recvmsg */
+  ci_uint16           recv_off;   /**< Offset to current recv queue
+                                       from base of [ci_tcp_state] */
+
+  /* An extension of the send queue.  Packets are put here when the netif
+  ** lock is contended, and are later transferred to the sendq.  This is a
+  ** linked list of packets in reverse order. */
+  ci_int32             send_prequeue;
+  /* send_prequeue_in is an atomic addition to send_in; it is never
+   * decremented.  See ci_tcp_sendq_n_pkts(). */
+  oo_atomic_t          send_prequeue_in;
+
+  /* Packets sent without the netif lock (EF_TCP_SEND_NOLOCK), waiting for
+  ** the lock holder to move them to the retransmit queue.  Like the
+  ** prequeue, a linked list in reverse order. */
+  ci_int32             send_nolock;
+  /* Who may send on this socket: a sender without the lock, only while
+  ** this is IDLE, or the lock holder, while it is CLOSED.  See
+  ** ci_tcp_send_nolock_block(). */
+  ci_uint32            send_nolock_gate;
+#define CI_TCP_SEND_NOLOCK_IDLE    0u
+#define CI_TCP_SEND_NOLOCK_BUSY    1u
+#define CI_TCP_SEND_NOLOCK_CLOSED  2u
+  /* Thread id of the sender without the lock that holds the gate BUSY. */
+  ci_uint32            send_nolock_owner;
+
+
+  /* Slow path: timers, loss recovery, urgent data, keepalive, loopback,
+   * statistics and the like.  Nothing below here should be needed for an
+   * in-order segment on an established connection.
+   */
+  /* timer ids for timers */
+  ci_ip_timer          rto_tid;     /* retransmit timer                   */
+  ci_ip_timer          delack_tid;  /* delayed acknowledgement timer      */
+  ci_ip_timer          zwin_tid;    /* zero window probe timer            */
+  ci_ip_timer          kalive_tid;  /* keep alive timer                   */
+#if CI_CFG_TCP_SOCK_STATS
+  ci_ip_timer          stats_tid;   /* Statistics report timer            */
 #endif
-  ci_iptime_t          tspaws;      /* last active timestamp for tsrecent */
-#define CI_TCP_TSO_WORD (CI_BSWAPC_BE32((CI_TCP_OPT_NOP       << 24u)  | \
-                                        (CI_TCP_OPT_NOP       << 16u)  | \
-                                        (CI_TCP_OPT_TIMESTAMP <<  8u)  | \
-                                        (0xa                        )))
+  ci_ip_timer          cork_tid;    /* TCP timer for TCP_CORK/MSG_MORE   */
 
-  /* delayed acknowledgements */
-  ci_uint16            acks_pending;/* number of packets needing ack      */
-/* These bits are ORed into acks_pending */
-#define CI_TCP_DELACK_SOON_FLAG 0x8000
-#define CI_TCP_ACK_FORCED_FLAG  0x4000
-/* Mask to get the number of acks pending (includes ACK_FORCED but not
- * DELACK_SOON bit)
- */
-#define CI_TCP_ACKS_PENDING_MASK 0x7fff
+  ci_ip_pkt_queue     rob;        /**< Re-order buffer. */
+  oo_pkt_p            last_sack[CI_TCP_SACK_MAX_BLOCKS + 1];  
+                                  /**< First packets of last-received
+                                   * block (in [0]) and last-sent 
+                                   * SACKed blocks */
+  ci_uint32           dsack_start;/**< Start SEQ of DSACK option */
+  ci_uint32           dsack_end;  /**< End SEQ of DSACK option */
+  oo_pkt_p            dsack_block;/**< Second block packet id: 
+                                   * CI_ILL_END used for no second block;
+                                   * CI_ILL_UNUSED when no DSACK present */
+
+#if CI_CFG_TIMESTAMPING
+  /* About timestamp_q management:
+   * This queue is for delivery to the app when it asks for the list of
+   * completed tx timestamps. The timestamp to be given is that of the last
+   * transmit, so we add to this queue when we get the ACK confirming that
+   * there aren't going to be any more retransmits.
+   *
+   * The trickiness arises because that ACK may arrive before the tx
+   * completion. In that case we split timestamp_q at timestamp_q_pending so
+   * that the non-tx-complete don't appear to be visible to the app;
+   * ci_netif_rx_pkt_complete_tcp() checks for this in poll and can make them
+   * visible.
+   *
+   * Full diagram of what's what:
+   *   ts_q.head (oldest packet) (===ts_q.pkts_reaped)
+   *      > ci_udp_recv_q_reapable()
+   *   ts_q.extract  (===ts_q.pkts_delivered)
+   *      > ci_udp_recv_q_pkts()
+   *   ts_q_pending (===ts_q.pkts_added)
+   *   ts_q.tail (newest packet)
+   *
+   * NB: the timestamp_q is used both for tx timestamping and for zc
+   * completions: they have identical needs so they share an implementation.
+   * */
+  ci_udp_recv_q       timestamp_q;/**< TX timestamp queue */
+  oo_pkt_p            timestamp_q_pending; /* First non-tx-complete packet on
+                                       timestamp_q, or OO_PP_NULL if there is
+                                       no such packet. Protected by the stack
+                                       lock */
+#endif
+
+  /* Next field is needed to support PathMTU discovery functionality */
+  ci_uint32            snd_check;   /* equal to snd_nxt at beginning of
+                                       tested interval */
+
+  ci_uint32            snd_up;      /* send urgent pointer, holds the seq 
+                                       num of byte following the OOB byte */
+
+  ci_uint32            rcv_up;      /* receive urgent pointer, holds the
+                                       seq num of the OOB byte            */
 
   ci_uint16 urg_data; /** out-of-band byte store & relevant flags */
 #define CI_TCP_URG_DATA_MASK    0x00ff
@@ -2748,29 +2975,43 @@ struct ci_tcp_state_s {
 #define CI_TCP_URG_IS_HERE      0x0200  /* oob byte is valid (got it) */
 #define CI_TCP_URG_PTR_VALID    0x0400  /* tcp_rcv_up is valid */
 
+  ci_iptime_t          t_last_invalid_ack; /* timestamp of last ACK for
+                                              an invalid incoming packet */
+
   /* keepalive vailables */
   ci_uint32            ka_probes;   /* number of probes sent              */
 
   ci_uint16            zwin_probes; /* zero window probes counter         */
   ci_uint16            zwin_acks;   /* zero window acks counter           */
 
-  /* timer ids for timers */
-  ci_ip_timer          rto_tid;     /* retransmit timer                   */
-  ci_ip_timer          delack_tid;  /* delayed acknowledgement timer      */
-  ci_ip_timer          zwin_tid;    /* zero window probe timer            */
-  ci_ip_timer          kalive_tid;  /* keep alive timer                   */
-#if CI_CFG_TCP_SOCK_STATS
-  ci_ip_timer          stats_tid;   /* Statistics report timer            */
-#endif
-  ci_ip_timer          cork_tid;    /* TCP timer for TCP_CORK/MSG_MORE   */
+  /* Id of the local peer socket in case of loopback connection */
+  oo_sp                 local_peer;
+
+  /* List of allocated templated sends on this socket */
+  oo_pkt_p            tmpl_head;
 
+  /* Path MTU data: timer, value, etc */
+  oo_p pmtus;
+
+  /* Latency histograms, indexed by CI_TCP_LAT_HIST_*.  Allocated when the
+   * connection is established if EF_TCP_LATENCY_HIST is set. */
+  oo_p lat_hist[CI_TCP_LAT_HIST_N];
+
+  struct oo_p_dllink   timeout_q_link;
+
+  /* Additional stats for Dynamic Right Sizing */
+  struct {
+    ci_uint32          bytes;
+    ci_uint32          seq;
+    ci_iptime_t        time;
+  } rcvbuf_drs;
 
 #if CI_CFG_TCP_SOCK_STATS
   ci_ip_sock_stats     stats_snapshot CI_ALIGN(8);   /**< statistics snapshot */
   ci_ip_sock_stats     stats_cumulative CI_ALIGN(8); /**< cummulative statistics */
   ci_int32             stats_fmt;        /**< Output format */
 #endif
- 
+
 #if CI_CFG_FD_CACHING
   /* Used to cache TCP-state and associated fds to improve accept performance */
   ci_int32             cached_on_fd;
@@ -2783,23 +3024,6 @@ struct ci_tcp_state_s {
   struct oo_p_dllink   epcache_fd_link;
 #endif
 
-  /* An extension of the send queue.  Packets are put here when the netif
-  ** lock is contended, and are later transferred to the sendq.  This is a
-  ** linked list of packets in reverse order. */
-  ci_int32             send_prequeue;
-  /* send_prequeue_in is an atomic addition to send_in; it is never
-   * decremented.  See ci_tcp_sendq_n_pkts(). */
-  oo_atomic_t          send_prequeue_in;
-
-  struct oo_p_dllink   timeout_q_link;
-
-  /* Additional stats for Dynamic Right Sizing */
-  struct {
-    ci_uint32          bytes;
-    ci_uint32          seq;
-    ci_iptime_t        time;
-  } rcvbuf_drs;
-
   /* Destination address before NAT.  Required for getpeername(). */
   struct {
     ci_addr_t          daddr_be32;
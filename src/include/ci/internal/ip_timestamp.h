@@ -60,6 +60,7 @@ enum {
    * Onload extension flags. Used with extension API v2.
    */
   ONLOAD_SOF_TIMESTAMPING_TRAILER = SOF_TIMESTAMPING_OOEXT_TRAILER,
+  ONLOAD_SOF_TIMESTAMPING_TX_RING = SOF_TIMESTAMPING_OOEXT_TX_RING,
 };
 
 /* Ensure no overlapping bits from three parts of flags. */
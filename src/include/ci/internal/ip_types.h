@@ -176,6 +176,7 @@ struct ci_netif_s {
   struct oo_p_dllink* active_wild_table;
 #endif
   ci_tcp_prev_seq_t*   seq_table;
+  ci_tcp_timewait_t*   timewait_table;
 
   struct oo_deferred_pkt* deferred_pkts;
 
@@ -203,6 +204,21 @@ struct ci_netif_s {
   struct oo_ringbuffer closed_eps;
   struct oo_ringbuffer sw_filter_ops;
 #endif
+#if CI_CFG_TIMESTAMPING
+  /* [data] is NULL if there is no TX timestamp ring */
+  struct oo_ringbuffer tx_ts_ring;
+#endif
+#if CI_CFG_TCPDUMP
+  /* Our own copy of the capture ring geometry: the kernel must not trust
+   * the one in the shared state.  [filter] is NULL if there is no ring. */
+  struct {
+    struct oo_capture_insn* filter;
+    char*                   slots;
+    ci_uint32               mask;
+    ci_uint32               stride;
+    ci_uint32               max_snaplen;
+  } capture;
+#endif
 
   /* This is pointer to the shared state of packet sets */
   oo_pktbuf_manager*    packets;
@@ -369,6 +385,16 @@ struct ci_netif_poll_state {
   oo_pkt_p  tx_pkt_free_list;
   oo_pkt_p* tx_pkt_free_list_insert;
   int       tx_pkt_free_list_n;
+
+  /* EF_RX_BATCH: received packets parked until the end of the current
+   * event batch, and the TCP socket that the most recently delivered
+   * packet matched.  [rx_sock_cache] lets the following packets of the same
+   * flow skip the filter-table lookup.
+   */
+  int       rx_batch;
+  int       rx_batch_n;
+  oo_pkt_p  rx_batch_pkts[CI_CFG_RX_BATCH_MAX];
+  oo_sp     rx_sock_cache;
 };
 
 
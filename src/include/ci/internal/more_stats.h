@@ -90,6 +90,8 @@ static inline void get_more_stats(ci_netif* ni, more_stats_t* s)
   s->ef_vi_rx_ev_bad_desc_i = ni->state->vi_stats.rx_ev_bad_desc_i;
   s->ef_vi_rx_ev_bad_q_label = ni->state->vi_stats.rx_ev_bad_q_label;
   s->ef_vi_evq_gap = ni->state->vi_stats.evq_gap;
+  s->ef_vi_xdp_kicks = ni->state->vi_stats.xdp_kicks;
+  s->ef_vi_xdp_kicks_avoided = ni->state->vi_stats.xdp_kicks_avoided;
 }
 
 
@@ -142,4 +142,11 @@ OO_STAT(MORE_STATS_DERIVED_DESC,
         unsigned, ef_vi_rx_ev_bad_q_label, count)
 OO_STAT(MORE_STATS_DERIVED_DESC,
         unsigned, ef_vi_evq_gap, count)
+OO_STAT("Number of system calls made to kick an AF_XDP socket, either to "
+        "start transmit or to wake the kernel up to consume the fill ring.",
+        unsigned, ef_vi_xdp_kicks, count)
+OO_STAT("Number of AF_XDP kicks avoided, either because the kernel did not "
+        "ask for a wakeup (need_wakeup) or because the kick was coalesced "
+        "with another made at the end of the same poll.",
+        unsigned, ef_vi_xdp_kicks_avoided, count)
 
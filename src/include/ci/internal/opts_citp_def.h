@@ -109,6 +109,13 @@ CI_CFG_OPT("EF_EPOLL_SPIN", ul_epoll_spin, ci_uint32,
 "kernel and block.  The spin timeout is set by EF_SPIN_USEC or EF_POLL_USEC.",
            1, , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_SPIN_ADAPT", ul_spin_adapt, ci_uint32,
+"Chooses how long each thread spins in epoll_wait() from how long its recent "
+"epoll_wait() calls waited for events, as EF_SPIN_ADAPT does for receive "
+"calls on each socket.  The value is a percentile; EF_SPIN_USEC remains the "
+"upper limit.  Set to zero (the default) to always spin for EF_SPIN_USEC.",
+           , , 0, 0, 100, count)
+
 CI_CFG_OPT("EF_EPOLL_CTL_FAST", ul_epoll_ctl_fast, ci_uint32, 
 "Avoid system calls in epoll_ctl() when using an accelerated epoll "
 "implementation.  System calls are deferred until epoll_wait() blocks, and in "
@@ -577,6 +584,21 @@ CI_CFG_OPT("EF_VFORK_MODE", vfork_mode, ci_uint32,
 "  2 - Replace vfork() with vfork()",
            2, , 1, 0, 2, level)
 
+CI_CFG_OPT("EF_SYSCALL_DISPATCH", syscall_dispatch, ci_uint32,
+"When set, Onload also intercepts system calls that the application issues "
+"directly with a syscall instruction rather than via libc, as is done by "
+"the Go runtime and by code with inline system calls.  This uses the "
+"kernel's Syscall User Dispatch feature (Linux 5.11 and later, x86-64 "
+"only): such system calls raise SIGSYS, and Onload's handler routes the "
+"socket and file descriptor calls to Onload and issues the rest unchanged.  "
+"System calls made via libc are not affected.  Threads must be created "
+"with pthread_create() to be covered; threads created with a raw clone() "
+"are not.  Each intercepted call costs a signal delivery, so this is "
+"only worthwhile for applications that cannot otherwise be accelerated.\n"
+"  0 - disabled\n"
+"  1 - intercept raw system calls",
+           1, , 0, 0, 1, yesno)
+
 CI_CFG_OPT("EF_CLUSTER_SIZE", cluster_size, ci_uint32,
 "If use of SO_REUSEPORT creates a cluster, this option specifies size "
 "of the cluster to be created.  This option has no impact if use of "
@@ -375,6 +375,15 @@ CI_CFG_OPT("EF_TX_TIMESTAMPING", tx_timestamping, ci_uint32,
 " does not succeed;\n",
            2, , 0, 0, 3, count)
 
+CI_CFG_OPT("EF_TX_TIMESTAMP_RING", tx_ts_ring_size, ci_uint32,
+"Number of entries in the per-stack ring of TX timestamp completions, "
+"rounded up to a power of two.  Sockets opt in with "
+"SOF_TIMESTAMPING_OOEXT_TX_RING, and the application reads their TX "
+"timestamps from the ring in shared memory rather than with "
+"recvmsg(MSG_ERRQUEUE).  0 (the default) means no ring.\n"
+"See onload_tx_timestamp_ring() in onload/extensions_timestamping.h.",
+           , , 0, 0, 65536, bincount)
+
 CI_CFG_OPT("EF_TCP_TSOPT_MODE", tcp_tsopt_mode, ci_uint32,
 "Enable or disable per-stack TCP header timestamps (as defined in RFC 1323).  "
 "Overrides system setting ipv4.tcp_timestamps and EF_TCP_SYN_OPTS.  "
@@ -475,6 +484,20 @@ CI_CFG_OPT("EF_TCP_SEND_NONBLOCK_NO_PACKETS_MODE",
            "able to send without error) to malfunction.",
            1, , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_TCP_SEND_NOLOCK", tcp_send_nolock, ci_uint32,
+"When a TCP send finds the stack lock held by another thread, it normally "
+"leaves its data on the socket's prequeue for the lock holder to send.  "
+"With this option set, a send on an established socket whose send queue "
+"is empty and whose congestion and receive windows are open builds its "
+"segments and posts them to the NIC itself, without waiting for the "
+"lock.  The retransmit queue, timers and statistics are brought up to date "
+"by the lock holder afterwards.\n"
+"This is useful when several threads each send on their own sockets in "
+"one stack.  It applies only to IPv4 connections sending by DMA, and not "
+"to MSG_MORE or TCP_CORK sends or while Nagle's algorithm is holding data "
+"back.  Off by default.",
+           1, , 0, 0, 1, yesno)
+
 CI_CFG_OPT("EF_TCP_RCVBUF_STRICT", tcp_rcvbuf_strict, ci_uint32,
 "This option prevents TCP small segment attack.  With this option set, "
 "Onload limits the number of packets inside TCP receive queue and "
@@ -972,6 +995,17 @@ CI_CFG_OPT("EF_EVS_PER_POLL", evs_per_poll, ci_uint32,
 "value is 192, to increasing batching efficiency.",
            , , 64, 0, 0x7fffffff, level)
 
+CI_CFG_OPT("EF_RX_BATCH", rx_batch, ci_uint32,
+"When enabled, the packets received in each pass over the event queue are "
+"classified before any of them is delivered, and are then delivered grouped "
+"by flow.  Consecutive TCP packets for one connection reuse the socket found "
+"by the first packet's filter-table lookup, and each socket's state is "
+"touched in a single burst rather than being interleaved with other flows.  "
+"This reduces cache misses per packet for high-rate receivers, at the cost of "
+"slightly delaying delivery of the first packets in each batch.  Packets "
+"destined for any one socket are always delivered in arrival order.",
+           1, , 0, 0, 1, yesno)
+
 #if CI_CFG_PORT_STRIPING
 CI_CFG_OPT("EF_STRIPE_NETMASK", stripe_netmask_be32, ci_uint32,
 "Port striping is only negotiated with hosts whose IP address is on the same "
@@ -995,6 +1029,35 @@ CI_CFG_OPT("EF_BUZZ_USEC", buzz_usec, ci_uint32,
 "by the EF_POLL_USEC option.",
            ,  poll_cycles, 0, MIN, MAX, time:usec)
 
+CI_CFG_OPT("EF_SPIN_ADAPT", spin_adapt, ci_uint32,
+"Chooses how long blocking receive calls on each TCP and UDP socket spin "
+"from how long recent calls on that socket waited for data, rather than "
+"always spinning for EF_SPIN_USEC.  The value is a percentile: calls spin "
+"for the shortest time that would have covered that percentage of the "
+"recent waits, and then block.  EF_SPIN_USEC (or SO_BUSY_POLL) remains the "
+"upper limit, and is used in full when the waits are too long for any "
+"shorter spin to cover the percentile."
+"\n"
+"The chosen spin time and the number of waits that spinning did and did not "
+"cover are shown per socket by onload_stackdump.  Set to zero (the default) "
+"to always spin for EF_SPIN_USEC.",
+           ,  , 0, 0, 100, count)
+
+CI_CFG_OPT("EF_POLL_CLAIM_USEC", poll_claim_usec, ci_uint32,
+"Lets threads spinning on a stack that spans several interfaces claim "
+"the interface that their socket receives from.  A thread spinning in a "
+"receive call claims that interface, and when it polls the stack it leaves "
+"alone interfaces claimed by other spinning threads.  So each spinning "
+"thread holds the stack lock only for its own interface's events, rather "
+"than for a poll of every interface.  A claim lapses when its thread has "
+"not spun for this many microseconds, after which the interface is polled "
+"by everyone again."
+"\n"
+"This does not poll interfaces in parallel: every poll is still made with "
+"the stack lock held, so one poll runs at a time.  Set to zero (the "
+"default) to have every poll cover every interface.",
+           ,  poll_cycles, 0, MIN, MAX, time:usec)
+
 CI_CFG_OPT("EF_HELPER_USEC", timer_usec, ci_uint32,
 "Timeout in microseconds for the count-down interrupt timer.  This timer "
 "generates an interrupt if network events are not handled by the application "
@@ -1700,6 +1763,45 @@ CI_CFG_OPT("EF_TCP_ISN_CACHE_SIZE", tcp_isn_cache_size, ci_uint32,
 "Relevant when EF_TCP_ISN_MODE is set to clocked+cache.",
            , , 0, MIN, MAX, time:sec)
 
+CI_CFG_OPT("EF_TCP_TIME_WAIT_COMPACT", tcp_time_wait_compact, ci_uint32,
+"Size of a table of compact TIME_WAIT records.  When non-zero, an orphaned "
+"connection that enters TIME_WAIT and does not hold a hardware filter of its "
+"own (for example a passively-opened connection, or one using "
+"EF_TCP_SHARED_LOCAL_PORTS) hands its four-tuple, sequence numbers and "
+"timestamp over to this table and its endpoint is freed straight away.  The "
+"table then answers retransmitted FINs, permits reopening SYNs and absorbs "
+"other late segments until 2MSL expires, as the full endpoint would have "
+"done.  This allows many more connections to be in TIME_WAIT than there are "
+"endpoints in the stack.  0 disables the table.",
+           , , 0, MIN, MAX, count)
+
+CI_CFG_OPT("EF_TCP_LATENCY_HIST", tcp_latency_hist, ci_uint32,
+"Keep per-connection latency histograms for TCP sockets.  When enabled, "
+"each established connection records the time from receiving a segment to "
+"the recv() call that returns its data, the time from send() to TX "
+"completion, and the time from TX completion to the ACK covering the data.  "
+"The histograms are shown by the onload_stackdump lat_hist command and in "
+"the sockets output of onload_remote_monitor.  Each connection uses three "
+"auxiliary buffers from the endpoint pool.",
+           1, , 0, 0, 1, yesno)
+
+#if CI_CFG_TCPDUMP
+CI_CFG_OPT("EF_TCPDUMP_RING", tcpdump_ring, ci_uint32,
+"Number of slots in the stack's packet capture ring, rounded up to a power "
+"of two.  With a ring, onload_tcpdump --ring installs its BPF filter in the "
+"stack, and the stack copies the head of each matching packet into the ring "
+"instead of holding the packet buffer until onload_tcpdump has read it.  "
+"Packets which find the ring full are dropped from the capture and counted.  "
+"0 (the default) means no ring.",
+           , , 0, 0, 65536, bincount)
+
+CI_CFG_OPT("EF_TCPDUMP_RING_SNAPLEN", tcpdump_ring_snaplen, ci_uint32,
+"Number of bytes of each packet which a slot of the capture ring can hold; "
+"onload_tcpdump --ring cannot capture more than this.  "
+"See EF_TCPDUMP_RING.",
+           , , 128, 64, 9216, count)
+#endif
+
 #if CI_CFG_IPV6
 #define CITP_IP6_AUTO_FLOW_LABEL_OFF     0
 #define CITP_IP6_AUTO_FLOW_LABEL_OPTOUT  1
@@ -1740,6 +1842,24 @@ CI_CFG_OPT("EF_AF_XDP_ZEROCOPY", af_xdp_zerocopy, ci_uint32,
 "Enables zerocopy on AF_XDP NICs. Support for zerocopy is required. ",
            1, , 0, 0, 1, yesno)
 
+CI_CFG_OPT("EF_AF_XDP_BUSY_POLL_BUDGET", af_xdp_busy_poll_budget, ci_uint32,
+"When non-zero, AF_XDP sockets use preferred busy polling "
+"(SO_PREFER_BUSY_POLL) with this NAPI budget (SO_BUSY_POLL_BUDGET).  The "
+"kernel then processes the device queue when Onload polls the stack, rather "
+"than in softirq context on some other core, and a spinning thread drives "
+"receive and transmit itself.  Requires linux-5.11 or later.",
+           16, , 0, 0, 65535, count)
+
+CI_CFG_OPT("EF_AF_XDP_BUSY_POLL_FALLBACK_USEC", af_xdp_busy_poll_fallback_usec,
+           ci_uint32,
+"With EF_AF_XDP_BUSY_POLL_BUDGET, how long the kernel waits for Onload to "
+"poll before resuming interrupt-driven processing of the device queue.  This "
+"sets the gro_flush_timeout and napi_defer_hard_irqs of the device, which "
+"affect every user of it, so it is off by default.  The original settings "
+"are restored when the last AF_XDP interface using them is freed.  0 "
+"(the default) leaves the device settings unchanged.",
+           , , 0, 0, MAX, time:usec)
+
 CI_CFG_OPT("EF_ICMP_PKTS", icmp_msg_max, ci_uint32,
            "Maximum number of ICMP messages which can be queued to "
            "one Onload stack.",
@@ -51,6 +51,9 @@ OO_STAT("Number of times event queue was polled from user-level.",
         ci_uint32, u_polls, count)
 OO_STAT("Number of times event queue was polled from user-level with ioctl.",
         ci_uint32, ioctl_evq_polls, count)
+OO_STAT("Number of times a poll left an interface to the spinning thread "
+        "which had claimed it (EF_POLL_CLAIM_USEC).",
+        ci_uint32, poll_claim_skips, count)
 OO_STAT("Number of RX events handled.  Not always 1:1 with number of "
         "packets received, an event can cover a batch of packets in "
         "high-throughput mode.",
@@ -175,6 +178,12 @@ OO_STAT("Number of times we've scrambled (l1) to find free buffers.  "
 OO_STAT("Number of times we've scrambled (l2) to find free buffers.  "
         "Indication of severe memory_pressure.",
         ci_uint32, pkt_scramble2, count)
+OO_STAT("Number of times a TCP transmit allocation took the slow path "
+        "(free pool of the current packet set empty, or tcp tx limit).",
+        ci_uint32, pkt_alloc_slow_tcp_tx, count)
+OO_STAT("Number of times a non-TCP-transmit allocation (receive ring, "
+        "UDP, control packets) took the slow path.",
+        ci_uint32, pkt_alloc_slow_other, count)
 OO_STAT("Number of times something tried to allocate memory, and "
         "span, waiting to do so.",
         ci_uint32, pkt_wait_spin, count)
@@ -226,6 +235,17 @@ OO_STAT("Number of times TCP sendmsg() found the non-blocking pool empty.",
         ci_uint32, tcp_send_nonb_pool_empty, count)
 OO_STAT("Number of times TCP sendmsg() contended the stack lock.",
         ci_uint32, tcp_send_ni_lock_contends, count)
+OO_STAT("Number of TCP sendmsg() calls which found the stack lock "
+        "contended and sent without it (EF_TCP_SEND_NOLOCK).",
+        ci_uint32, tcp_send_nolock, count)
+OO_STAT("Number of TCP sendmsg() calls which could not send without the "
+        "stack lock because the TX ring was busy, full or backed up, and "
+        "left their data for the lock holder instead.",
+        ci_uint32, tcp_send_nolock_ring_busy, count)
+OO_STAT("Number of TX claims and socket send gates released on behalf of "
+        "a sender without the lock that died holding them "
+        "(EF_TCP_SEND_NOLOCK).",
+        ci_uint32, tcp_send_nolock_reclaims, count)
 OO_STAT("Number of times TCP sendmsg() failed to find an acceleratable route.",
         ci_uint32, tcp_send_fail_noroute, count)
 OO_STAT("Number of times UDP sendmsg() contended the stack lock.",
@@ -541,6 +561,16 @@ OO_STAT("Number of RX packets from the future which did not arrive.",
         ci_uint32, rx_future_rollback_timeout, count)
 OO_STAT("Number of RX packets from the future where other event arrived.",
         ci_uint32, rx_future_rollback_event, count)
+OO_STAT("Number of batches of received packets delivered grouped by flow "
+        "(EF_RX_BATCH).",
+        ci_uint32, rx_batches, count)
+OO_STAT("Number of received packets delivered in batches (EF_RX_BATCH).  "
+        "Compare with rx_batches to see the average batch size.",
+        ci_uint32, rx_batch_pkts, count)
+OO_STAT("Number of received TCP packets that were delivered to the socket "
+        "matched by the previous packet of the batch, without a filter-table "
+        "lookup (EF_RX_BATCH).",
+        ci_uint32, rx_batch_sock_cache_hits, count)
 OO_STAT("Number of times we've tried to free packet-buffers by reaping.  "
         "Indicates that we are very close to a memory_pressure situation.",
         ci_uint32, reap_rx_limited, count)
@@ -677,6 +707,12 @@ OO_STAT("Number of loops x sockets spent in epoll_wait() busy-waiting, "
         "with EF_UL_EPOLL=2",
         ci_uint64, spin_epoll_kernel, count)
 #endif
+OO_STAT("Number of receive calls whose data arrived within the spin time "
+        "chosen by EF_SPIN_ADAPT",
+        ci_uint32, spin_adapt_hits, count)
+OO_STAT("Number of receive calls that blocked because data did not arrive "
+        "within the spin time chosen by EF_SPIN_ADAPT",
+        ci_uint32, spin_adapt_misses, count)
 #if CI_CFG_FD_CACHING
 OO_STAT("Number of sockets cached over lifetime of the stack",
         ci_uint32, sockcache_cached, count)
@@ -851,6 +887,19 @@ OO_STAT("Number of insertions with short expiry.",
 OO_STAT("Number of times there was no need to create entry.",
         ci_uint32, tcp_seq_table_avoided, count)
 
+OO_STAT("Number of TIME_WAIT connections moved to the compact table.",
+        ci_uint32, tcp_time_wait_compact_insertions, count)
+OO_STAT("Number of received segments that matched a compact TIME_WAIT entry.",
+        ci_uint32, tcp_time_wait_compact_hits, count)
+OO_STAT("Number of compact TIME_WAIT entries reopened by a SYN.",
+        ci_uint32, tcp_time_wait_compact_reopens, count)
+OO_STAT("Number of ACKs sent on behalf of compact TIME_WAIT entries.",
+        ci_uint32, tcp_time_wait_compact_acks, count)
+OO_STAT("Number of compact TIME_WAIT entries expired after 2MSL.",
+        ci_uint32, tcp_time_wait_compact_expiries, count)
+OO_STAT("Number of compact TIME_WAIT entries purged as oldest in set.",
+        ci_uint32, tcp_time_wait_compact_purgations, count)
+
 OO_STAT("Number of times the urgent flag was ignored in received packets",
         ci_uint32, tcp_urgent_ignore_rx, count)
 OO_STAT("Number of times the urgent flag was processed in received packets",
@@ -866,6 +915,9 @@ OO_STAT("Number of packets received via discard that subsequently passed sw "
 OO_STAT("Number of packets not captured by onload_tcpdump because the "
         "dump ring was full.",
         ci_uint32, tcpdump_missed, count)
+OO_STAT("Number of packets which matched the filter of onload_tcpdump --ring "
+        "but were not captured because the capture ring was full.",
+        ci_uint32, tcpdump_ring_drop, count)
 #endif
 
 OO_STAT("Lowest recorded number of free packets",
@@ -79,6 +79,12 @@
 #define CI_CFG_USERSPACE_SYSCALL        0
 #endif
 
+/* Whether to support intercepting raw system calls (issued other than via
+ * libc) with Syscall User Dispatch, see EF_SYSCALL_DISPATCH.  This shares
+ * the x86-64 syscall routing used by the syscall() intercept.
+ */
+#define CI_CFG_SYSCALL_USER_DISPATCH    CI_CFG_USERSPACE_SYSCALL
+
 /* Maximum number of onload stacks handled by single epoll object.
  * See also epoll_max_stacks module parameter.
  * Socket from other stacks will look just like "regular file descriptor"
@@ -159,6 +165,10 @@
 /* How many RX descriptors to push at a time. */
 #define CI_CFG_RX_DESC_BATCH		16
 
+/* How many received packets may be parked by the event-queue poll loop
+** before they are delivered, when EF_RX_BATCH is enabled. */
+#define CI_CFG_RX_BATCH_MAX		16
+
 /* How many packets to fill on TX path before pushing them out. */
 #define CI_CFG_TCP_TX_BATCH		8
 
@@ -100,7 +100,8 @@ extern int oo_cp_get_acceleratable_ifindices(struct oo_cplane_handle*,
 
 extern int
 cp_svc_check_dnat(struct oo_cplane_handle* cp,
-                  ci_addr_sh_t* dst_addr, ci_uint16* dst_port);
+                  ci_addr_sh_t* dst_addr, ci_uint16* dst_port,
+                  ci_uint32 flow_hash);
 
 
 extern ci_ifid_t
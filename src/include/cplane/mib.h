@@ -571,6 +571,8 @@ struct cp_tables_dim {
   ci_int32 svc_arrays_max;
   /* Number of k8s service endpoints (front and back end) */
   ci_int32 svc_ep_max;
+  /* Number of Maglev lookup tables for k8s services */
+  ci_int32 svc_maglev_max;
 
   /* Number of fwd cache rows, must be 2^n */
   ci_uint8 fwd_ln2;
@@ -667,6 +669,9 @@ struct cp_svc_ep_dllist {
       cicp_rowid_t tail_array_id;
       /* Number of backends in linked list and array */
       size_t n_backends;
+      /* Index of the service's table in mib svc_maglev field, or
+       * CICP_ROWID_BAD if it has none */
+      cicp_rowid_t maglev_id;
     } service;
 
     struct {
@@ -697,6 +702,25 @@ struct cp_svc_ep_array {
   struct cp_svc_endpoint eps[CP_SVC_BACKENDS_PER_ARRAY];
 };
 
+/* Number of entries in a service's Maglev lookup table.  Must be prime.
+ * Services with more backends than this fall back to plain modulo
+ * selection. */
+#define CP_SVC_MAGLEV_SIZE 4093
+
+/* Maglev consistent-hash lookup table for a k8s service, mapping a flow
+ * hash to a backend in O(1).  Tables are allocated to services with more
+ * than one backend, for as long as there are tables free; other services
+ * fall back to plain modulo selection.  The table is rebuilt by the server
+ * whenever the service's backends change. */
+struct cp_svc_maglev_table {
+  /* The value of n_backends that the table was built for.  The table is not
+   * valid for the service unless this matches. */
+  ci_uint32 n_backends;
+  /* Position of the chosen backend in svc_arrays for each entry, encoded as
+   * array_id * CP_SVC_BACKENDS_PER_ARRAY + index. */
+  ci_uint32 entry[CP_SVC_MAGLEV_SIZE];
+};
+
 #define CP_STRING_LEN 256
 
 typedef struct cp_string { char value[CP_STRING_LEN]; } cp_string_t;
@@ -762,6 +786,9 @@ struct cp_mibs {
   /* Table of k8s service backends organised by service.
    * Logically an array of arrays, each of length CP_SVC_BACKENDS_PER_ARRAY. */
   struct cp_svc_ep_array* svc_arrays;
+
+  /* Maglev lookup tables for k8s services, indexed by maglev_id. */
+  struct cp_svc_maglev_table* svc_maglev;
 };
 
 
@@ -746,9 +746,9 @@ typedef struct {
   /** Descriptors removed from the ring */
   uint32_t  removed;
   /** Packets received as part of a jumbo (7000-series only) */
-  uint32_t  in_jumbo;                           /* ef10 only */
+  uint32_t  in_jumbo;                           /* ef10 and af_xdp */
   /** Bytes received as part of a jumbo (7000-series only) */
-  uint32_t  bytes_acc;                          /* ef10 only */
+  uint32_t  bytes_acc;                          /* ef10 and af_xdp */
   /** Last descriptor index completed (7000-series only) */
   uint16_t  last_desc_i;                        /* ef10 only */
   /** Credit for packed stream handling (7000-series only) */
@@ -923,6 +923,13 @@ typedef struct {
   uint32_t rx_ev_bad_q_label;
   /** Gaps in the event queue (empty slot followed by event) */
   uint32_t evq_gap;
+  /* New counters go at the end.  This struct is allocated only by ef_vi
+   * itself or by users of ef_vi_set_stats_buf() built with it. */
+  /** AF_XDP: system calls made to kick TX or wake the fill ring */
+  uint32_t xdp_kicks;
+  /** AF_XDP: kicks skipped because the kernel did not need waking or
+   ** because they were coalesced with a later kick */
+  uint32_t xdp_kicks_avoided;
 } ef_vi_stats;
 
 /*! \brief The type of NIC in use
@@ -1226,6 +1233,12 @@ typedef struct ef_vi {
                            const struct ef_filter_cookie* cookie, int rxq,
                            bool shared_mode);
   } internal_ops;
+
+  /* Members added after this point must go at the end, so that the
+   * offsets of those above stay fixed for already-built applications. */
+
+  /** State of AF_XDP kick coalescing; see ef_vi_transmit_kick_defer() */
+  int                           xdp_kick_defer;
 } ef_vi;
 
 
@@ -50,6 +50,14 @@ extern int ef_vi_add_queue(ef_vi* evq_vi, ef_vi* add_vi);
  */
 extern void ef_vi_set_stats_buf(ef_vi* vi, ef_vi_stats* s);
 
+/* Coalesce transmit doorbells.  After ef_vi_transmit_kick_defer() any
+ * system call needed to kick an AF_XDP VI is postponed until
+ * ef_vi_transmit_kick_flush(), which issues at most one.  Other VI types
+ * need no kick, and both calls are cheap no-ops for them.
+ */
+extern void ef_vi_transmit_kick_defer(ef_vi* vi);
+extern void ef_vi_transmit_kick_flush(ef_vi* vi);
+
 
 /**********************************************************************
  * Re-Initialisation **************************************************
@@ -97,6 +97,11 @@ struct oo_epoll1_set_home_arg {
   ci_int32              ready_list;  /**< id of ready list to use */
 };
 
+/* Maximum number of non-home stacks in which an epoll set may own a ready
+ * list.  OO_EPOLL1_IOC_{ADD,DEL}_OTHER_READY_LIST use oo_epoll1_set_home_arg.
+ */
+#define OO_EPOLL1_OTHER_STACKS_MAX 8
+
 struct oo_epoll1_spin_on_arg {
   ci_uint64     timeout_ns CI_ALIGN(8);
   ci_fixed_descriptor_t epoll_fd;
@@ -170,6 +175,17 @@ enum {
   OO_EPOLL1_OP_INIT,
 #define OO_EPOLL1_IOC_INIT \
   _IO(OO_EPOLL_IOC_BASE, OO_EPOLL1_OP_INIT)
+
+#if CI_CFG_EPOLL3
+  OO_EPOLL1_OP_ADD_OTHER_READY_LIST,
+#define OO_EPOLL1_IOC_ADD_OTHER_READY_LIST \
+  _IOW(OO_EPOLL_IOC_BASE, OO_EPOLL1_OP_ADD_OTHER_READY_LIST, \
+       struct oo_epoll1_set_home_arg)
+  OO_EPOLL1_OP_DEL_OTHER_READY_LIST,
+#define OO_EPOLL1_IOC_DEL_OTHER_READY_LIST \
+  _IOW(OO_EPOLL_IOC_BASE, OO_EPOLL1_OP_DEL_OTHER_READY_LIST, \
+       struct oo_epoll1_set_home_arg)
+#endif
 };
 
 #endif /* __ONLOAD_EPOLL_H__ */
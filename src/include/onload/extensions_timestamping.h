@@ -123,7 +123,8 @@ extern int onload_timestamping_request(int fd, unsigned flags);
  * allocate down from top of the word. */
 #define SOF_TIMESTAMPING_OOEXT_LAST    (1U << 31)
 #define SOF_TIMESTAMPING_OOEXT_TRAILER (1U << 31)
-#define SOF_TIMESTAMPING_OOEXT_FIRST   (1U << 31)
+#define SOF_TIMESTAMPING_OOEXT_TX_RING (1U << 30)
+#define SOF_TIMESTAMPING_OOEXT_FIRST   (1U << 30)
 #define SOF_TIMESTAMPING_OOEXT_MASK ((((SOF_TIMESTAMPING_OOEXT_LAST) << 1) - 1) \
                                      - ((SOF_TIMESTAMPING_OOEXT_FIRST) - 1))
 
@@ -144,6 +145,112 @@ struct scm_timestamping_ooext {
 };
 
 
+/**********************************************************************
+ * TX timestamp completion ring.
+ *
+ * Rather than reading each TX timestamp with recvmsg(MSG_ERRQUEUE), an
+ * application can have them written to a ring in the stack's shared memory
+ * as the transmit completions are processed, and drain the ring without
+ * calling into Onload at all.
+ *
+ * The ring is per-stack, and is created when EF_TX_TIMESTAMP_RING is set.
+ * A socket opts in with
+ *
+ * struct so_timestamping val = {
+ *   .flags = SOF_TIMESTAMPING_TX_HARDWARE
+ *          | SOF_TIMESTAMPING_RAW_HARDWARE
+ *          | SOF_TIMESTAMPING_OPT_ID
+ *          | SOF_TIMESTAMPING_OOEXT_TX_RING
+ * };
+ * setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING_OOEXT, &val, sizeof val);
+ *
+ * and then its TX timestamps go to the ring instead of the error queue.
+ * onload_tx_timestamp_ring() gives a view of the ring of the socket's
+ * stack, and the key which identifies the socket in the records:
+ *
+ * struct onload_tx_ts_ring ring;
+ * struct onload_tx_ts_record rec;
+ * uint32_t key;
+ *
+ * onload_tx_timestamp_ring(fd, &ring, &key);
+ * ...
+ * while( onload_tx_timestamp_ring_next(&ring, &rec) )
+ *   if( rec.sock_key == key )
+ *     handle_tx_ts(rec.id, rec.len, &rec.timestamp);
+ *
+ * Onload never waits for the reader: when the ring is full, the oldest
+ * records are overwritten and counted in [lost].  Any number of readers may
+ * have a view of the same ring, each with its own read position.  A new
+ * view starts at the current end of the ring.
+ *
+ * For TCP, each record covers a segment, and a retransmitted segment gets
+ * a new record flagged ONLOAD_TX_TS_RECORD_RETRANS.  The id is the sequence
+ * number of the first payload byte, relative to the SOF_TIMESTAMPING_OPT_ID
+ * key.  For UDP the key is that of
+ * SOF_TIMESTAMPING_OPT_ID, i.e. the number of datagrams sent before this one.
+ * Only NIC timestamps are reported through the ring.
+ *
+ * Returns 0 on success, or a negative error code on failure.
+ *   -ENOTTY     fd does not refer to an onload-accelerated socket
+ *   -ENOENT     the socket's stack has no ring (EF_TX_TIMESTAMP_RING=0)
+ *   -EOPNOTSUPP this build of onload does not support timestamping
+ */
+
+struct onload_tx_ts_record {
+  /* Socket, as reported by onload_tx_timestamp_ring() */
+  uint32_t sock_key;
+  /* SOF_TIMESTAMPING_OPT_ID key of the first byte (TCP) or datagram (UDP) */
+  uint32_t id;
+  /* Number of payload bytes covered */
+  uint32_t len;
+  /* ONLOAD_TX_TS_RECORD_* */
+  uint32_t flags;
+#define ONLOAD_TX_TS_RECORD_TCP     1
+#define ONLOAD_TX_TS_RECORD_RETRANS 2
+  /* NIC timestamp; sec is zero if the NIC did not provide one */
+  struct onload_timestamp timestamp;
+};
+
+struct onload_tx_ts_ring {
+  /* Shared with Onload */
+  const volatile uint32_t* write;
+  const struct onload_tx_ts_record* records;
+  uint32_t mask;
+  /* Private to this view */
+  uint32_t read;
+  uint32_t lost;
+};
+
+extern int onload_tx_timestamp_ring(int fd, struct onload_tx_ts_ring* ring,
+                                    uint32_t* sock_key_out);
+
+/* Copy out the next record.  Returns 1 on success, 0 if the ring is empty. */
+static inline int
+onload_tx_timestamp_ring_next(struct onload_tx_ts_ring* ring,
+                              struct onload_tx_ts_record* rec_out)
+{
+  uint32_t write;
+
+  do {
+    write = __atomic_load_n(ring->write, __ATOMIC_ACQUIRE);
+    if( ring->read == write )
+      return 0;
+    /* Onload may be writing [write] over the oldest record right now, so
+     * the oldest we can read is the one after it. */
+    if( write - ring->read > ring->mask ) {
+      ring->lost += write - ring->read - ring->mask;
+      ring->read = write - ring->mask;
+    }
+    *rec_out = ring->records[ring->read & ring->mask];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    /* Try again if it was overwritten while we were copying it. */
+  } while( *ring->write - ring->read > ring->mask );
+
+  ring->read++;
+  return 1;
+}
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,10 @@
  * Both kernel and UL must interlock these function calls inside kernel and
  * UL respectively.
  *
+ * The exception is a ring which has no kernel reader, such as the TX
+ * timestamp ring: it is written by whoever holds the stack lock, kernel or
+ * UL, and is read by the application with its own read index.
+ *
  * This ringbuffer is designed to be safe for kernel, i.e. misbehaving UL
  * can't harm.  When all the instances behave, UL reads kernel-written data
  * in time and without corruption.
@@ -70,17 +74,23 @@ oo_ringbuffer_init(struct oo_ringbuffer *ring,
   ring->data = data;
 }
 
-#ifdef __KERNEL__
 static inline void
 oo_ringbuffer_write(struct oo_ringbuffer* ring, const void* data)
 {
+#ifdef __KERNEL__
   ci_uint32 idx = ring->state->write & ring->mask;
   memcpy(ring->data + idx * ring->stride, data, ring->stride);
   ci_wmb();
   ring->state->write++;
+#else
+  struct oo_ringbuffer_state* state = ring->state;
+  ci_uint32 idx = state->write & state->mask;
+  memcpy((char*) ring->data + idx * state->stride, data, state->stride);
   ci_wmb();
-}
+  *(ci_uint32*) &state->write = state->write + 1;
 #endif
+  ci_wmb();
+}
 
 #if OO_DO_STACK_POLL
 #include <onload/drv/dump_to_user.h>
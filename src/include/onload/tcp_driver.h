@@ -40,6 +40,16 @@ typedef struct {
    *  interfaces from going down. */
   ci_uint32     stack_count;
 
+  /*! Pre-created stacks waiting to be handed out (see stack_pool_size),
+   *  the number of further stacks being built for the pool, and counts of
+   *  stack allocations that were and were not satisfied from the pool.
+   *  stack_pool_n + stack_pool_pending never exceeds stack_pool_size. */
+  ci_dllist     stack_pool;
+  ci_uint32     stack_pool_n;
+  ci_uint32     stack_pool_pending;
+  ci_uint32     stack_pool_hits;
+  ci_uint32     stack_pool_misses;
+
   /*! Lock */
   ci_irqlock_t  lock;
 } tcp_helpers_table_t;
@@ -190,6 +190,11 @@ typedef struct tcp_helper_resource_s {
   /*! Link for global list of stacks. */
   ci_dllink              all_stacks_link;
 
+  /*! Link for the pool of pre-created stacks, and the alloc flags the
+   *  stack was pre-created for.  Protected by THR_TABLE.lock. */
+  ci_dllink              stack_pool_link;
+  ci_uint16              stack_pool_in_flags;
+
   /* VI destruction completion helper. */
   struct completion complete;
 
@@ -182,6 +182,9 @@ extern int tcp_helper_kill_stack_by_id(unsigned id);
 extern void tcp_helper_kill_stack(tcp_helper_resource_t *thr);
 #endif
 
+/*! Release what senders without the lock that have died were holding */
+extern void tcp_helper_reap_send_nolock(tcp_helper_resource_t* thr);
+
 extern int
 oo_version_check(const char* version, const char* uk_intf_ver, int debug_lib);
 
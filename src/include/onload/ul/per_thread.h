@@ -46,8 +46,15 @@ struct oo_per_thread {
   ci_uint64                  select_nonblock_fast_frc;
   struct oo_timesync         timesync;
   unsigned                   spinstate; 
+  /* How long this thread's epoll_wait() calls wait, see EF_SPIN_ADAPT. */
+  ci_spin_adapt              epoll_spin_adapt;
+  /* Thread id, for marking what this thread holds in shared stack state. */
+  ci_uint32                  tid;
   int                        in_vfork_child;
   void*                      vfork_scratch[OO_VFORK_SCRATCH_SIZE];
+  /* Syscall User Dispatch selector, read by the kernel on each system
+   * call made outside libc. */
+  char                       sud_selector;
 };
 
 
@@ -20,27 +20,15 @@
 #include "af_xdp_defs.h"
 #include "logging.h"
 
-/* Currently, AF_XDP requires a system call to start transmitting.
- *
- * There is a limit (undocumented, so we can't rely on it being 16) to the
- * number of packets which will be sent each time. We use the "previous"
- * field to store the last packet known to be sent; if this does not cover
- * all those in the queue, we will try again once a send has completed.
- */
-#define AF_XDP_TX_BATCH_MAX 16
-static int efxdp_tx_need_kick(ef_vi* vi)
-{
-  ef_vi_txq_state* qs = &vi->ep_state->txq;
-  return qs->previous != qs->added;
-}
+#ifndef XDP_RING_NEED_WAKEUP
+/* Old headers: the feature bit will never be set, so this is unused */
+#define XDP_RING_NEED_WAKEUP (1 << 0)
+#endif
 
-static void efxdp_tx_kick(ef_vi* vi)
-{
-  if( vi->xdp_kick(vi) == 0 ) {
-    ef_vi_txq_state* qs = &vi->ep_state->txq;
-    qs->previous = qs->added;
-  }
-}
+#ifndef XDP_PKT_CONTD
+/* Old headers: the kernel will never set this without XDP_USE_SG */
+#define XDP_PKT_CONTD (1 << 0)
+#endif
 
 /* Access the AF_XDP rings, using the offsets provided in the mapped memory.
  * The (fake) event queue pointer must be initialised to point to the start
@@ -60,26 +48,103 @@ static struct efab_af_xdp_offsets* xdp_offsets(ef_vi* vi)
 #define RING_CONSUMER(vi, ring) \
   ((volatile uint32_t*)RING_THING(vi, ring, consumer))
 
+#define RING_FLAGS(vi, ring) \
+  ((volatile uint32_t*)RING_THING(vi, ring, flags))
+
 #define RING_DESC(vi, ring) RING_THING(vi, ring, desc)
 
+#define INC_VI_STAT(vi, name)                   \
+  do {                                          \
+    if( (vi)->vi_stats != NULL )                \
+      ++(vi)->vi_stats->name;                   \
+  } while( 0 )
+
+/* Values of vi->xdp_kick_defer */
+#define EFXDP_KICK_NOW      0  /* kick immediately */
+#define EFXDP_KICK_DEFER    1  /* defer kicks until flushed */
+#define EFXDP_KICK_PENDING  2  /* as above, and a kick has been deferred */
+
+/* Returns true if the socket was bound with need_wakeup and the kernel has
+ * asked for a system call to make progress on [flags]' ring.
+ */
+static int efxdp_ring_wants_wakeup(ef_vi* vi, volatile uint32_t* flags)
+{
+  return (xdp_offsets(vi)->features & EFAB_AF_XDP_FEATURE_NEED_WAKEUP) &&
+         (*flags & XDP_RING_NEED_WAKEUP);
+}
+
+/* Currently, AF_XDP requires a system call to start transmitting, unless
+ * the socket is bound with need_wakeup and the kernel says it is already
+ * polling the TX ring.
+ *
+ * There is a limit (undocumented, so we can't rely on it being 16) to the
+ * number of packets which will be sent each time. We use the "previous"
+ * field to store the last packet known to be sent; if this does not cover
+ * all those in the queue, we will try again once a send has completed.
+ */
+#define AF_XDP_TX_BATCH_MAX 16
+static int efxdp_tx_need_kick(ef_vi* vi)
+{
+  ef_vi_txq_state* qs = &vi->ep_state->txq;
+  if( qs->previous == qs->added )
+    return 0;
+  if( (xdp_offsets(vi)->features & EFAB_AF_XDP_FEATURE_NEED_WAKEUP) &&
+      ! (*RING_FLAGS(vi, tx) & XDP_RING_NEED_WAKEUP) ) {
+    /* The kernel will pick these up without being told */
+    qs->previous = qs->added;
+    INC_VI_STAT(vi, xdp_kicks_avoided);
+    return 0;
+  }
+  return 1;
+}
+
+/* Kick the socket, which serves both to start transmit and to wake the
+ * kernel up to consume the fill ring.  While kicks are being coalesced we
+ * just note that one is wanted.
+ */
+static void efxdp_kick(ef_vi* vi)
+{
+  if( vi->xdp_kick_defer != EFXDP_KICK_NOW ) {
+    if( vi->xdp_kick_defer == EFXDP_KICK_PENDING )
+      INC_VI_STAT(vi, xdp_kicks_avoided);
+    vi->xdp_kick_defer = EFXDP_KICK_PENDING;
+    return;
+  }
+
+  INC_VI_STAT(vi, xdp_kicks);
+  if( vi->xdp_kick(vi) == 0 ) {
+    ef_vi_txq_state* qs = &vi->ep_state->txq;
+    qs->previous = qs->added;
+  }
+}
+
 static int efxdp_ef_vi_transmitv_init(ef_vi* vi, const ef_iovec* iov,
                                       int iov_len, ef_request_id dma_id)
 {
   ef_vi_txq* q = &vi->vi_txq;
   ef_vi_txq_state* qs = &vi->ep_state->txq;
   struct xdp_desc* dq = RING_DESC(vi, tx);
-  int i;
+  int i = 0, j;
 
-  if( iov_len != 1 )
-    return -EINVAL; /* Multiple buffers per packet not supported */
+  EF_VI_BUG_ON(iov_len <= 0);
 
-  if( qs->added - qs->removed >= q->mask )
+  /* Multiple buffers per packet need a socket bound with XDP_USE_SG */
+  if( iov_len != 1 &&
+      ! (xdp_offsets(vi)->features & EFAB_AF_XDP_FEATURE_SG) )
+    return -EINVAL;
+
+  if( qs->added - qs->removed + iov_len > q->mask )
     return -EAGAIN;
 
-  i = qs->added++ & q->mask;
-  dq[i].addr = iov->iov_base;
-  dq[i].len = iov->iov_len;
-  EF_VI_BUG_ON(q->ids[i] != EF_REQUEST_ID_MASK);
+  /* One descriptor per buffer, each but the last flagged as continued.
+   * The request id goes with the last one, as for other architectures. */
+  for( j = 0; j < iov_len; ++j ) {
+    i = qs->added++ & q->mask;
+    dq[i].addr = iov[j].iov_base;
+    dq[i].len = iov[j].iov_len;
+    dq[i].options = j + 1 < iov_len ? XDP_PKT_CONTD : 0;
+    EF_VI_BUG_ON(q->ids[i] != EF_REQUEST_ID_MASK);
+  }
   q->ids[i] = dma_id;
   return 0;
 }
@@ -96,10 +161,11 @@ static void efxdp_ef_vi_transmit_push(ef_vi* vi)
    *  * at least every packets if queue is quarter stuffed.
    */
   EF_VI_BUG_ON(vi->ep_state->txq.added == vi->ep_state->txq.previous);
-  if( vi->ep_state->txq.added - vi->ep_state->txq.removed < 3 ||
-      (vi->ep_state->txq.added ^ vi->ep_state->txq.previous) /
-      (AF_XDP_TX_BATCH_MAX >> 2) )
-    efxdp_tx_kick(vi);
+  if( (vi->ep_state->txq.added - vi->ep_state->txq.removed < 3 ||
+       (vi->ep_state->txq.added ^ vi->ep_state->txq.previous) /
+       (AF_XDP_TX_BATCH_MAX >> 2)) &&
+      efxdp_tx_need_kick(vi) )
+    efxdp_kick(vi);
 }
 
 static int efxdp_ef_vi_transmit(ef_vi* vi, ef_addr base, int len,
@@ -259,6 +325,8 @@ static void efxdp_ef_vi_receive_push(ef_vi* vi)
 {
   wmb();
   *RING_PRODUCER(vi, fr) = vi->ep_state->rxq.added;
+  if( efxdp_ring_wants_wakeup(vi, RING_FLAGS(vi, fr)) )
+    efxdp_kick(vi);
 }
 
 static int efxdp_ef_vi_receive_get_timestamp(struct ef_vi* vi, const void* pkt,
@@ -307,6 +375,7 @@ static int efxdp_ef_eventq_poll(ef_vi* vi, ef_event* evs, int evs_len)
 
       do {
         unsigned desc_i = qs->removed++ & q->mask;
+        unsigned flags = qs->in_jumbo ? 0 : EF_EVENT_FLAG_SOP;
 
         evs[n].rx.type = EF_EVENT_TYPE_RX;
         evs[n].rx.q_id = 0;
@@ -322,12 +391,23 @@ static int efxdp_ef_eventq_poll(ef_vi* vi, ef_event* evs, int evs_len)
 
         q->ids[desc_i] = EF_REQUEST_ID_MASK;  /* Debug only? */
 
-        /* FIXME: handle jumbo, multicast */
-        evs[n].rx.flags = EF_EVENT_FLAG_SOP;
         /* In case of AF_XDP offset of the placement of payload from
          * the beginning of the packet buffer may vary. */
         evs[n].rx.ofs = dq[desc_i].addr & (vi->rx_buffer_len - 1); 
-        evs[n].rx.len = dq[desc_i].len;
+
+        /* A multi-buffer frame arrives as a chain of descriptors flagged
+         * with XDP_PKT_CONTD.  Report it as ef10 does for jumbos: SOP on
+         * the first, CONT on all but the last, and a running total of
+         * the bytes received so far.  The chain may span polls. */
+        if( flags & EF_EVENT_FLAG_SOP )
+          qs->bytes_acc = dq[desc_i].len;
+        else
+          qs->bytes_acc += dq[desc_i].len;
+        qs->in_jumbo = !!(dq[desc_i].options & XDP_PKT_CONTD);
+        if( qs->in_jumbo )
+          flags |= EF_EVENT_FLAG_CONT;
+        evs[n].rx.flags = flags;
+        evs[n].rx.len = qs->bytes_acc;
 
         ++n;
         ++cons;
@@ -366,8 +446,13 @@ static int efxdp_ef_eventq_poll(ef_vi* vi, ef_event* evs, int evs_len)
 
     }
   }
-  if( efxdp_tx_need_kick(vi) )
-    efxdp_tx_kick(vi);
+  /* With preferred busy polling the kernel makes no progress unless we
+   * kick it, so do so on every poll. */
+  if( efxdp_tx_need_kick(vi) ||
+      (xdp_offsets(vi)->features & EFAB_AF_XDP_FEATURE_BUSY_POLL) ||
+      (ef_vi_receive_capacity(vi) != 0 &&
+       efxdp_ring_wants_wakeup(vi, RING_FLAGS(vi, fr))) )
+    efxdp_kick(vi);
 
   return n;
 }
@@ -445,7 +530,24 @@ long efxdp_vi_mmap_bytes(ef_vi* vi)
 {
   return xdp_offsets(vi)->mmap_bytes;
 }
+
+void ef_vi_transmit_kick_defer(ef_vi* vi)
+{
+  if( vi->nic_type.arch == EF_VI_ARCH_AF_XDP &&
+      vi->xdp_kick_defer == EFXDP_KICK_NOW )
+    vi->xdp_kick_defer = EFXDP_KICK_DEFER;
+}
+
+void ef_vi_transmit_kick_flush(ef_vi* vi)
+{
+  int pending = vi->xdp_kick_defer == EFXDP_KICK_PENDING;
+  vi->xdp_kick_defer = EFXDP_KICK_NOW;
+  if( pending )
+    efxdp_kick(vi);
+}
 #else
 void efxdp_vi_init(ef_vi* vi) {}
 long efxdp_vi_mmap_bytes(ef_vi* vi) { return 0; }
+void ef_vi_transmit_kick_defer(ef_vi* vi) {}
+void ef_vi_transmit_kick_flush(ef_vi* vi) {}
 #endif
@@ -76,6 +76,7 @@ static const struct cp_mib_region cp_mib_regions[] = {
 
   DB_TABLE(struct cp_svc_ep_dllist, svc_ep_table, svc_ep_max),
   DB_TABLE(struct cp_svc_ep_array, svc_arrays, svc_arrays_max),
+  DB_TABLE(struct cp_svc_maglev_table, svc_maglev, svc_maglev_max),
 
   END_PUBLIC_REGION(),
 
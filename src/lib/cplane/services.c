@@ -11,12 +11,14 @@
 #include <cplane/cplane.h>
 
 
-/* Returns a backend endpoint randomly selected from a service's set of
- * backends */
+/* Returns the backend endpoint of a service that [flow_hash] maps to, using
+ * the service's Maglev table where possible. */
 static struct cp_svc_endpoint*
-cp_svc_select_backend(const struct cp_mibs* mib, const cicp_mac_rowid_t id)
+cp_svc_select_backend(const struct cp_mibs* mib, const cicp_mac_rowid_t id,
+                      ci_uint32 flow_hash)
 {
   struct cp_svc_ep_dllist* svc = &mib->svc_ep_table[id];
+  cicp_rowid_t maglev_id;
   cicp_rowid_t element_id;
   struct cp_svc_ep_array* arr;
   cicp_rowid_t index;
@@ -26,8 +28,21 @@ cp_svc_select_backend(const struct cp_mibs* mib, const cicp_mac_rowid_t id)
     return NULL;
   ci_assert( CICP_ROWID_IS_VALID(svc->u.service.head_array_id) );
 
-  /* Copy approximate hash generator from oo_cp_multipath_hash */
-  element_id = (ci_frc64_get() >> 4) % svc->u.service.n_backends;
+  /* The table may be in the middle of being reassigned or rebuilt, in which
+   * case the caller will retry once it sees the version change. */
+  maglev_id = svc->u.service.maglev_id;
+  if( CICP_ROWID_IS_VALID(maglev_id) && maglev_id < mib->dim->svc_maglev_max &&
+      mib->svc_maglev[maglev_id].n_backends == svc->u.service.n_backends ) {
+    ci_uint32 pos = mib->svc_maglev[maglev_id].
+                      entry[flow_hash % CP_SVC_MAGLEV_SIZE];
+    if( pos >= (ci_uint32) mib->dim->svc_arrays_max *
+               CP_SVC_BACKENDS_PER_ARRAY )
+      return NULL;
+    return &mib->svc_arrays[pos / CP_SVC_BACKENDS_PER_ARRAY].
+                eps[pos % CP_SVC_BACKENDS_PER_ARRAY];
+  }
+
+  element_id = flow_hash % svc->u.service.n_backends;
   cp_svc_walk_array_chain(mib, svc->u.service.head_array_id, element_id,
                           &arr, &index);
 
@@ -36,11 +51,13 @@ cp_svc_select_backend(const struct cp_mibs* mib, const cicp_mac_rowid_t id)
 
 
 /* Performs a DNAT operation on the provided address.  If the address points to
- * a valid service then attempt to replace the address with a backend's.
+ * a valid service then attempt to replace the address with a backend's.  The
+ * backend is chosen by [flow_hash], so a given flow always gets the same one.
  * Returns positive if we need DNAT, zero if not, and negative on error. */
 int
 cp_svc_check_dnat(struct oo_cplane_handle* cp,
-                  ci_addr_sh_t* dst_addr, ci_uint16* dst_port)
+                  ci_addr_sh_t* dst_addr, ci_uint16* dst_port,
+                  ci_uint32 flow_hash)
 {
   struct cp_mibs* mib;
   cp_version_t version;
@@ -59,7 +76,7 @@ cp_svc_check_dnat(struct oo_cplane_handle* cp,
       mib->svc_ep_table[id].row_type != CP_SVC_SERVICE )
     goto out;
 
-  svc_backend = cp_svc_select_backend(mib, id);
+  svc_backend = cp_svc_select_backend(mib, id, flow_hash);
   if( svc_backend == NULL ) {
     /* Found a service, but could not get a backend.  This is invalid. */
     rc = -ENOENT;
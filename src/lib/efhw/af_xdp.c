@@ -154,6 +154,8 @@ struct efhw_af_xdp_vi
   int rxq_capacity;
   int txq_capacity;
   unsigned flags;
+  /* Holds a reference to the device's busy-poll interrupt deferral */
+  bool busy_poll_fallback;
 
   struct efab_af_xdp_offsets kernel_offsets;
   struct efhw_page user_offsets_page;
@@ -169,6 +171,14 @@ struct efhw_nic_af_xdp
   struct efhw_af_xdp_vi* vi;
   struct efhw_buddy_allocator vi_allocator;
   spinlock_t alloc_lock;
+
+  /* VIs that have changed the device's interrupt deferral settings for
+   * busy polling, and the settings from before the first of them did.
+   * The settings are put back when the last such VI goes.  rtnl lock.
+   */
+  int busy_poll_fallback_users;
+  unsigned long saved_gro_flush_timeout;
+  u32 saved_defer_hard_irqs;
 };
 
 /*----------------------------------------------------------------------------
@@ -292,6 +302,11 @@ static int xdp_prog_load(struct sys_call_area* area, int map_fd)
   prog[20] |= (uint64_t) map_fd << 32; /* immediate value */
 
   attr->prog_type = BPF_PROG_TYPE_XDP;
+#ifdef BPF_F_XDP_HAS_FRAGS
+  /* The program only reads headers from the first buffer, so it is safe
+   * to run on multi-buffer frames. */
+  attr->prog_flags = BPF_F_XDP_HAS_FRAGS;
+#endif
   attr->insn_cnt = sizeof(const_prog) / sizeof(struct bpf_insn);
   attr->insns = sys_call_area_user_addr(area, prog);
   attr->license = sys_call_area_user_addr(area, license);
@@ -362,17 +377,34 @@ fail_sock:
   return rc;
 }
 
-/* Bind an AF_XDP socket to an interface */
-static int xdp_bind(struct socket* sock, int ifindex, unsigned queue, unsigned flags)
+/* Bind an AF_XDP socket to an interface, sharing the umem registered with
+ * [umem_sock] if that is not NULL */
+static int xdp_bind(struct socket* sock, int ifindex, unsigned queue,
+                    unsigned flags, struct socket* umem_sock)
 {
   struct sockaddr_xdp sxdp = {};
+  int rc, umem_fd = -1;
 
   sxdp.sxdp_family = PF_XDP;
   sxdp.sxdp_ifindex = ifindex;
   sxdp.sxdp_queue_id = queue;
   sxdp.sxdp_flags = flags;
 
-  return kernel_bind(sock, (struct sockaddr*)&sxdp, sizeof(sxdp));
+  if( umem_sock != NULL ) {
+    /* The kernel finds the umem owner by fd, and takes the mode flags from
+     * it: we must not pass any of our own. */
+    rc = umem_fd = xdp_alloc_fd(umem_sock->file);
+    if( rc < 0 )
+      return rc;
+    sxdp.sxdp_flags = XDP_SHARED_UMEM;
+    sxdp.sxdp_shared_umem_fd = umem_fd;
+  }
+
+  rc = kernel_bind(sock, (struct sockaddr*)&sxdp, sizeof(sxdp));
+
+  if( umem_fd >= 0 )
+    ci_close_fd(umem_fd);
+  return rc;
 }
 
 /* Link an XDP program to an interface */
@@ -575,10 +607,16 @@ static int xdp_create_ring(struct socket* sock,
   kern_offset->producer = kern_base + xdp_offset->producer;
   kern_offset->consumer = kern_base + xdp_offset->consumer;
   kern_offset->desc     = kern_base + xdp_offset->desc;
+#ifdef XDP_USE_NEED_WAKEUP
+  kern_offset->flags    = kern_base + xdp_offset->flags;
+#endif
 
   user_offset->producer = user_base + xdp_offset->producer;
   user_offset->consumer = user_base + xdp_offset->consumer;
   user_offset->desc     = user_base + xdp_offset->desc;
+#ifdef XDP_USE_NEED_WAKEUP
+  user_offset->flags    = user_base + xdp_offset->flags;
+#endif
 
   return 0;
 }
@@ -667,6 +705,72 @@ static int xdp_create_rings(struct socket* sock,
   return rc;
 }
 
+/* Can we change how long the device defers interrupts for busy polling? */
+#ifdef EFRM_NETDEV_HAS_NAPI_DEFER_HARD_IRQS
+#define AF_XDP_HAVE_IRQ_DEFERRAL 1
+
+static void xdp_set_irq_deferral(struct net_device* dev,
+                                 unsigned long gro_flush_timeout,
+                                 u32 defer_hard_irqs)
+{
+#ifdef EFRM_NAPI_HAS_DEFER_HARD_IRQS
+  struct napi_struct* napi;
+#endif
+#ifdef EFRM_NETDEV_HAS_NAPI_CONFIG
+  unsigned i, n;
+#endif
+
+  ASSERT_RTNL();
+  WRITE_ONCE(dev->gro_flush_timeout, gro_flush_timeout);
+  WRITE_ONCE(dev->napi_defer_hard_irqs, defer_hard_irqs);
+#ifdef EFRM_NAPI_HAS_DEFER_HARD_IRQS
+  /* From linux-6.13 the settings live in each NAPI instance, and changing
+   * only the device's copy would not affect the queues that already exist.
+   * The kernel's helpers to set them all are not exported, so do as they
+   * do. */
+  list_for_each_entry(napi, &dev->napi_list, dev_list) {
+    WRITE_ONCE(napi->gro_flush_timeout, gro_flush_timeout);
+    WRITE_ONCE(napi->defer_hard_irqs, defer_hard_irqs);
+  }
+#endif
+#ifdef EFRM_NETDEV_HAS_NAPI_CONFIG
+  /* The settings that a queue takes when its NAPI instance is recreated */
+  if( dev->napi_config != NULL ) {
+    n = max(dev->num_rx_queues, dev->num_tx_queues);
+    for( i = 0; i < n; ++i ) {
+      dev->napi_config[i].gro_flush_timeout = gro_flush_timeout;
+      dev->napi_config[i].defer_hard_irqs = defer_hard_irqs;
+    }
+  }
+#endif
+}
+
+/* Drop [vi]'s reference to the device's interrupt deferral settings, and
+ * put back the original ones if it was the last. */
+static void xdp_put_irq_deferral(struct efhw_nic* nic,
+                                 struct efhw_af_xdp_vi* vi)
+{
+  struct efhw_nic_af_xdp* xdp = nic->arch_extra;
+
+  if( ! vi->busy_poll_fallback )
+    return;
+  vi->busy_poll_fallback = false;
+
+  rtnl_lock();
+  if( --xdp->busy_poll_fallback_users == 0 && nic->net_dev != NULL )
+    xdp_set_irq_deferral(nic->net_dev, xdp->saved_gro_flush_timeout,
+                         xdp->saved_defer_hard_irqs);
+  rtnl_unlock();
+}
+#else
+#define AF_XDP_HAVE_IRQ_DEFERRAL 0
+
+static void xdp_put_irq_deferral(struct efhw_nic* nic,
+                                 struct efhw_af_xdp_vi* vi)
+{
+}
+#endif
+
 static void xdp_release_vi(struct efhw_nic* nic, struct efhw_af_xdp_vi* vi)
 {
   int i;
@@ -677,6 +781,8 @@ static void xdp_release_vi(struct efhw_nic* nic, struct efhw_af_xdp_vi* vi)
      * This can happen on cleanup from failure of stack allocation */
     return;
 
+  xdp_put_irq_deferral(nic, vi);
+
   /* Stop from using this socket */
   if( vi->waiter.wait.func != NULL )
     remove_wait_queue(sk_sleep(vi->sock->sk), &vi->waiter.wait);
@@ -719,12 +825,53 @@ static void* af_xdp_mem(struct efhw_nic* nic, int instance)
   return vi ? &vi->kernel_offsets : NULL;
 }
 
+#ifdef EFRM_HAVE_XSK_SHARED_UMEM_RINGS
+/* Find the VI whose umem a new socket may share.  It must already be bound,
+ * and its buffer table must map exactly the same pages as [sw_bt] so that
+ * buffer addresses mean the same on both.
+ *
+ * Sharing across devices and queues needs a fill and completion ring per
+ * socket, which arrived in linux-5.10 together with xp_assign_dev_shared().
+ * xsk_buff_pool.h itself is older, so is not enough to go by.
+ */
+static struct efhw_af_xdp_vi*
+xdp_shared_umem_vi(struct efhw_nic* umem_nic, int umem_instance,
+                   struct efhw_sw_bt* sw_bt)
+{
+  struct efhw_af_xdp_vi* umem_vi;
+  struct efhw_sw_bt* umem_sw_bt;
+  int i;
+
+  if( umem_nic->devtype.arch != EFHW_ARCH_AF_XDP )
+    return NULL;
+
+  umem_vi = vi_by_instance(umem_nic, umem_instance);
+  if( umem_vi == NULL || umem_vi->sock == NULL ||
+      (umem_vi->flags & XDP_SHARED_UMEM) )
+    return NULL;
+
+  umem_sw_bt = efhw_sw_bt_by_owner(umem_nic, umem_vi->owner_id);
+  if( umem_sw_bt == NULL ||
+      umem_sw_bt->used_page_count != sw_bt->used_page_count )
+    return NULL;
+
+  for( i = 0; i < sw_bt->used_page_count; ++i )
+    if( efhw_sw_bt_get_pfn(umem_sw_bt, i) != efhw_sw_bt_get_pfn(sw_bt, i) )
+      return NULL;
+
+  return umem_vi;
+}
+#endif
+
 static int af_xdp_init(struct efhw_nic* nic, int instance,
                        int chunk_size, int headroom,
+                       struct efhw_nic* umem_nic, int umem_instance,
                        struct efhw_page_map* page_map)
 {
   int rc;
   struct efhw_af_xdp_vi* vi;
+  struct efhw_af_xdp_vi* umem_vi = NULL;
+  struct socket* umem_sock = NULL;
   int owner_id;
   struct efhw_sw_bt* sw_bt;
   struct socket* sock;
@@ -749,6 +896,13 @@ static int af_xdp_init(struct efhw_nic* nic, int instance,
   if( sw_bt == NULL )
     return -EINVAL;
 
+#ifdef EFRM_HAVE_XSK_SHARED_UMEM_RINGS
+  if( umem_nic != NULL )
+    umem_vi = xdp_shared_umem_vi(umem_nic, umem_instance, sw_bt);
+  if( umem_vi != NULL )
+    umem_sock = umem_vi->sock;
+#endif
+
   /* We need to use network namespace of network device so that
    * ifindex passed in bpf syscalls makes sense
    * TODO AF_XDP: there is a race here with device changing netns
@@ -772,9 +926,11 @@ static int af_xdp_init(struct efhw_nic* nic, int instance,
   if( rc < 0 )
     goto fail;
 
-  rc = xdp_register_umem(sock, sw_bt, chunk_size, headroom);
-  if( rc < 0 )
-    goto fail;
+  if( umem_sock == NULL ) {
+    rc = xdp_register_umem(sock, sw_bt, chunk_size, headroom);
+    if( rc < 0 )
+      goto fail;
+  }
 
   rc = xdp_create_rings(sock, page_map, &vi->kernel_offsets,
                         vi->rxq_capacity, vi->txq_capacity,
@@ -787,8 +943,18 @@ static int af_xdp_init(struct efhw_nic* nic, int instance,
   if( rc < 0 )
     goto fail;
 
+#ifdef XDP_USE_NEED_WAKEUP
+  /* Let the kernel tell us when it needs a system call to make progress,
+   * rather than kicking it after every batch of transmits. */
+  vi->flags |= XDP_USE_NEED_WAKEUP;
+#endif
+#ifdef XDP_USE_SG
+  /* Multi-buffer frames let us handle an MTU larger than a packet buffer */
+  vi->flags |= XDP_USE_SG;
+#endif
+
   /* TODO AF_XDP: currently instance number matches net_device channel */
-  rc = xdp_bind(sock, nic->net_dev->ifindex, instance, vi->flags);
+  rc = xdp_bind(sock, nic->net_dev->ifindex, instance, vi->flags, umem_sock);
   if( rc == -EBUSY ) {
     /* AF_XDP resource release happens asynchronously - the socket through RCU
      * and the associated umem through deferred work on the global workqueue.
@@ -806,15 +972,52 @@ static int af_xdp_init(struct efhw_nic* nic, int instance,
 #else
     flush_scheduled_work();
 #endif
-    rc = xdp_bind(sock, nic->net_dev->ifindex, instance, vi->flags);
+    rc = xdp_bind(sock, nic->net_dev->ifindex, instance, vi->flags, umem_sock);
+  }
+  if( rc < 0 && umem_sock != NULL ) {
+    /* The shared umem imposes its owner's mode, which this device may not
+     * support.  Register the buffers again and bind in our own mode. */
+    EFHW_WARN("%s: %s queue %d can not share umem (rc=%d)",
+              __func__, nic->net_dev->name, instance, rc);
+    umem_sock = NULL;
+    rc = xdp_register_umem(sock, sw_bt, chunk_size, headroom);
+    if( rc < 0 )
+      goto fail;
+    rc = xdp_bind(sock, nic->net_dev->ifindex, instance, vi->flags, NULL);
   }
+#ifdef XDP_USE_SG
+  if( rc == -EOPNOTSUPP && umem_sock == NULL && (vi->flags & XDP_USE_SG) ) {
+    /* Zero-copy drivers may not support multi-buffer frames.  Carry on
+     * without them: jumbo frames will then be dropped as before. */
+    EFHW_WARN("%s: %s does not support XDP_USE_SG on queue %d",
+              __func__, nic->net_dev->name, instance);
+    vi->flags &= ~XDP_USE_SG;
+    rc = xdp_bind(sock, nic->net_dev->ifindex, instance, vi->flags, NULL);
+  }
+#endif
   if( rc < 0 )
     goto fail;
 
+  /* A socket sharing a umem takes its mode from the umem's owner */
+  if( umem_sock != NULL )
+    vi->flags = umem_vi->flags | XDP_SHARED_UMEM;
+
   if( vi->waiter.wait.func != NULL )
     add_wait_queue(sk_sleep(vi->sock->sk), &vi->waiter.wait);
 
   user_offsets->mmap_bytes = efhw_page_map_bytes(page_map);
+#ifdef XDP_USE_NEED_WAKEUP
+  if( vi->flags & XDP_USE_NEED_WAKEUP ) {
+    vi->kernel_offsets.features |= EFAB_AF_XDP_FEATURE_NEED_WAKEUP;
+    user_offsets->features |= EFAB_AF_XDP_FEATURE_NEED_WAKEUP;
+  }
+#endif
+#ifdef XDP_USE_SG
+  if( vi->flags & XDP_USE_SG ) {
+    vi->kernel_offsets.features |= EFAB_AF_XDP_FEATURE_SG;
+    user_offsets->features |= EFAB_AF_XDP_FEATURE_SG;
+  }
+#endif
   return 0;
 
  fail:
@@ -827,11 +1030,87 @@ static int af_xdp_dmaq_kick(struct efhw_nic *nic, int instance)
 {
   struct efhw_af_xdp_vi* vi;
   struct msghdr msg = {.msg_flags = MSG_DONTWAIT};
+  int rc;
   vi = vi_by_instance(nic, instance);
   if( vi == NULL )
     return -ENODEV;
 
-  return kernel_sendmsg(vi->sock, &msg, NULL, 0, 0);
+  rc = kernel_sendmsg(vi->sock, &msg, NULL, 0, 0);
+
+#ifdef XDP_USE_NEED_WAKEUP
+  /* The same kick serves the fill ring: with need_wakeup a zero-copy
+   * driver may stop polling the fill ring until woken by recvmsg(). */
+  if( vi->flags & XDP_USE_NEED_WAKEUP && vi->rxq_capacity != 0 ) {
+    volatile uint32_t* fr_flags = (void*)((char*)&vi->kernel_offsets +
+                                          vi->kernel_offsets.rings.fr.flags);
+    if( *fr_flags & XDP_RING_NEED_WAKEUP ) {
+      struct msghdr rmsg = {.msg_flags = MSG_DONTWAIT};
+      kernel_recvmsg(vi->sock, &rmsg, NULL, 0, 0, MSG_DONTWAIT);
+    }
+  }
+#endif
+
+  return rc;
+}
+
+/* Any non-zero value will do: we only ever poll the socket non-blocking */
+#define AF_XDP_BUSY_POLL_USEC 20
+/* Interrupts deferred before the kernel gives up on us polling, as in the
+ * example in Documentation/networking/napi.rst */
+#define AF_XDP_DEFER_HARD_IRQS 2
+
+static int af_xdp_busy_poll(struct efhw_nic* nic, int instance,
+                            int budget, int fallback_usec)
+{
+#if defined(EFRM_SOCK_HAS_PREFER_BUSY_POLL) && defined(CONFIG_NET_RX_BUSY_POLL)
+  struct efhw_af_xdp_vi* vi;
+  struct efab_af_xdp_offsets* user_offsets;
+  struct sock* sk;
+
+  vi = vi_by_instance(nic, instance);
+  if( vi == NULL || vi->sock == NULL )
+    return -ENODEV;
+  if( budget <= 0 || budget > U16_MAX )
+    return -EINVAL;
+
+  /* sendmsg() and recvmsg() on the socket now run the NAPI poll of the
+   * queue, and prefer_busy_poll stops softirqs from doing so while we
+   * keep polling. */
+  sk = vi->sock->sk;
+  WRITE_ONCE(sk->sk_ll_usec, AF_XDP_BUSY_POLL_USEC);
+  WRITE_ONCE(sk->sk_prefer_busy_poll, 1);
+  WRITE_ONCE(sk->sk_busy_poll_budget, budget);
+
+  if( fallback_usec > 0 && ! vi->busy_poll_fallback ) {
+#if AF_XDP_HAVE_IRQ_DEFERRAL
+    struct efhw_nic_af_xdp* xdp = nic->arch_extra;
+    struct net_device* dev = nic->net_dev;
+
+    /* The settings are per device, so the most recent stack to ask wins
+     * until the last of them goes away. */
+    rtnl_lock();
+    if( xdp->busy_poll_fallback_users++ == 0 ) {
+      xdp->saved_gro_flush_timeout = READ_ONCE(dev->gro_flush_timeout);
+      xdp->saved_defer_hard_irqs = READ_ONCE(dev->napi_defer_hard_irqs);
+    }
+    xdp_set_irq_deferral(dev, (unsigned long)fallback_usec * NSEC_PER_USEC,
+                         AF_XDP_DEFER_HARD_IRQS);
+    vi->busy_poll_fallback = true;
+    rtnl_unlock();
+#else
+    EFHW_WARN("%s: %s: cannot set interrupt deferral for busy polling with "
+              "this kernel, so interrupts will not be held off",
+              __func__, nic->net_dev->name);
+#endif
+  }
+
+  user_offsets = (void*)efhw_page_ptr(&vi->user_offsets_page);
+  vi->kernel_offsets.features |= EFAB_AF_XDP_FEATURE_BUSY_POLL;
+  user_offsets->features |= EFAB_AF_XDP_FEATURE_BUSY_POLL;
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
 }
 
 /*----------------------------------------------------------------------------
@@ -1496,6 +1775,7 @@ struct efhw_func_ops af_xdp_char_functional_units = {
 	.dmaq_kick = af_xdp_dmaq_kick,
 	.af_xdp_mem = af_xdp_mem,
 	.af_xdp_init = af_xdp_init,
+	.af_xdp_busy_poll = af_xdp_busy_poll,
 	.vi_io_region = af_xdp_vi_io_region,
 };
 
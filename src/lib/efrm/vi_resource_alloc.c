@@ -433,6 +433,16 @@ int efrm_vi_af_xdp_kick(struct efrm_vi *virs)
 EXPORT_SYMBOL(efrm_vi_af_xdp_kick);
 
 
+int efrm_vi_af_xdp_busy_poll(struct efrm_vi *virs, int budget,
+			     int fallback_usec)
+{
+	return efhw_nic_af_xdp_busy_poll(virs->rs.rs_client->nic,
+					 virs->rs.rs_instance,
+					 budget, fallback_usec);
+}
+EXPORT_SYMBOL(efrm_vi_af_xdp_busy_poll);
+
+
 /* Try to allocate an instance out of the VIset.  If no free instances
  * and some instances are flushing, block.  Else return error.
  */
@@ -1426,13 +1436,22 @@ EXPORT_SYMBOL(efrm_vi_resource_alloc);
 
 int
 efrm_vi_resource_deferred(struct efrm_vi *virs, int chunk_size, int headroom,
+                          struct efrm_vi *umem_virs,
                           uint32_t *out_mem_mmap_bytes)
 {
 	int rc;
 	struct efhw_nic *nic = efrm_client_get_nic(virs->rs.rs_client);
+	struct efhw_nic *umem_nic = NULL;
+	int umem_instance = 0;
+
+	if (umem_virs != NULL) {
+		umem_nic = efrm_client_get_nic(umem_virs->rs.rs_client);
+		umem_instance = umem_virs->allocation.instance;
+	}
 
 	rc = efhw_nic_af_xdp_init(nic, virs->allocation.instance,
-	                          chunk_size, headroom, &virs->mem_mmap);
+	                          chunk_size, headroom,
+	                          umem_nic, umem_instance, &virs->mem_mmap);
 	if (rc < 0)
 		return rc;
 
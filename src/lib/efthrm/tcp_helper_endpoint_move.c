@@ -73,7 +73,8 @@ static int efab_file_move_supported_tcp(ci_netif *ni, ci_tcp_state *ts,
       ci_ip_timer_pending(ni, &ts->rto_tid) ||
       ci_ip_timer_pending(ni, &ts->zwin_tid) ||
       ci_ip_timer_pending(ni, &ts->cork_tid) ||
-      OO_PP_NOT_NULL(ts->pmtus) ) {
+      OO_PP_NOT_NULL(ts->pmtus) ||
+      OO_P_NOT_NULL(ts->lat_hist[0]) ) {
     if( do_assert ) {
       ci_assert(ci_ip_queue_is_empty(&ts->send));
       ci_assert_equal(ts->send_prequeue, OO_PP_ID_NULL);
@@ -83,6 +84,7 @@ static int efab_file_move_supported_tcp(ci_netif *ni, ci_tcp_state *ts,
       ci_assert(! ci_ip_timer_pending(ni, &ts->zwin_tid));
       ci_assert(! ci_ip_timer_pending(ni, &ts->cork_tid));
       ci_assert(OO_PP_IS_NULL(ts->pmtus));
+      ci_assert(OO_P_IS_NULL(ts->lat_hist[0]));
     }
     return false;
   }
@@ -349,6 +351,9 @@ int efab_file_move_to_alien_stack(ci_private_t *priv, ci_netif *alien_ni,
     ci_ip_queue_init(&mid_ts->send);
     ci_ip_queue_init(&mid_ts->retrans);
     mid_ts->send_prequeue = OO_PP_ID_NULL;
+    mid_ts->send_nolock = OO_PP_ID_NULL;
+    mid_ts->send_nolock_gate = CI_TCP_SEND_NOLOCK_CLOSED;
+    mid_ts->send_nolock_owner = 0;
     new_ts->retrans_ptr = OO_PP_NULL;
     mid_ts->tmpl_head = OO_PP_NULL;
     oo_atomic_set(&mid_ts->send_prequeue_in, 0);
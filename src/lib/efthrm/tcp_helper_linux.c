@@ -1282,11 +1282,13 @@ efab_os_wakeup_epoll3_locked(tcp_helper_resource_t* trs,
   ci_sb_epoll_state* epoll;
   ci_uint8 i, tmp;
   ci_netif* ni = &trs->netif;
+  ci_uint32 lists = ci_sb_epoll_ready_lists(sb);
 
   ci_assert(OO_PP_NOT_NULL(sb->epoll));
   epoll = ci_ni_aux_p2epoll(ni, sb->epoll);
+  ci_sb_epoll_excl_advance(sb);
 
-  CI_READY_LIST_EACH(sb->ready_lists_in_use, tmp, i) {
+  CI_READY_LIST_EACH(lists, tmp, i) {
     struct oo_p_dllink_state link = ci_sb_epoll_ready_link(ni, epoll, i);
     oo_p_dllink_del(ni, link);
     oo_p_dllink_add_tail(ni, oo_p_dllink_ptr(ni, &ni->state->ready_lists[i]),
@@ -1369,9 +1371,13 @@ static void efab_os_wakeup_event(tcp_helper_endpoint_t *ep,
        * the os ready list.
        */
       ci_uint8 i, tmp;
+      /* Read without the stack lock, so the exclusive list may be stale.
+       * That only costs fairness between EPOLLEXCLUSIVE sets.
+       */
+      ci_uint32 lists = ci_sb_epoll_ready_lists(&s->b);
 
       spin_lock_irqsave(&trs->os_ready_list_lock, flags);
-      CI_READY_LIST_EACH(s->b.ready_lists_in_use, tmp, i) {
+      CI_READY_LIST_EACH(lists, tmp, i) {
         ci_dllist_remove(&ep->epoll[i].os_ready_link);
         ci_dllist_put(&trs->os_ready_lists[i], &ep->epoll[i].os_ready_link);
       }
@@ -1382,7 +1388,7 @@ static void efab_os_wakeup_event(tcp_helper_endpoint_t *ep,
                                                   CI_EPLOCK_NETIF_NEED_WAKE,
                                                   1) ) {
         spin_lock_irqsave(&trs->os_ready_list_lock, flags);
-        CI_READY_LIST_EACH(s->b.ready_lists_in_use, tmp, i)
+        CI_READY_LIST_EACH(lists, tmp, i)
           ci_dllist_remove_safe(&ep->epoll[i].os_ready_link);
         spin_unlock_irqrestore(&trs->os_ready_list_lock, flags);
 
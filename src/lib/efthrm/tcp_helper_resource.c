@@ -47,6 +47,14 @@
 #include "tcp_helper_resource.h"
 #include "tcp_helper_stats_dump.h"
 #include <kernel_utils/hugetlb.h>
+#include <linux/sched/mm.h>
+#ifdef EFRM_HAVE_KTHREAD_USE_MM
+#include <linux/kthread.h>
+#else
+#include <linux/mmu_context.h>
+#define kthread_use_mm use_mm
+#define kthread_unuse_mm unuse_mm
+#endif
 
 #ifdef NDEBUG
 # define DEBUG_STR  ""
@@ -89,6 +97,18 @@ MODULE_PARM_DESC(max_packets_per_stack,
                  "option are not applied retrospectively to stacks already "
                  "existing before the change.");
 
+static unsigned stack_pool_size = 0;
+module_param(stack_pool_size, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(stack_pool_size,
+                 "Number of spare Onload stacks to keep pre-created.  After "
+                 "each stack allocation the pool is topped up in the "
+                 "background with spare stacks built like it, with the "
+                 "same EF_ options, up to this limit.  Later allocations "
+                 "with identical options, namespaces and user are handed a "
+                 "spare stack instead of building a new one.  Spare stacks "
+                 "hold NIC and memory resources while idle.  Defaults to 0 "
+                 "(disabled).");
+
 static int allow_insecure_setuid_sharing;
 module_param(allow_insecure_setuid_sharing, int, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(allow_insecure_setuid_sharing,
@@ -469,6 +489,11 @@ static int thr_table_ctor(tcp_helpers_table_t *table)
   ci_dllist_init(&table->all_stacks);
   ci_dllist_init(&table->started_stacks);
   table->stack_count = 0;
+  ci_dllist_init(&table->stack_pool);
+  table->stack_pool_n = 0;
+  table->stack_pool_pending = 0;
+  table->stack_pool_hits = 0;
+  table->stack_pool_misses = 0;
   ci_irqlock_ctor(&table->lock);
   ci_id_pool_ctor(&table->instances, EFAB_THR_MAX_NUM_INSTANCES,
                   /* initial size */ 8);
@@ -531,6 +556,61 @@ void tcp_helper_kill_stack(tcp_helper_resource_t *thr)
 #endif
 
 
+/* Whether the thread [tid], in the PID namespace of [ni], is gone or on
+ * its way out. */
+static int tcp_helper_tid_is_dead(ci_netif* ni, pid_t tid)
+{
+  struct task_struct* task = NULL;
+  struct pid* pid;
+  int dead;
+
+  rcu_read_lock();
+  pid = ci_netif_pid_lookup(ni, tid);
+  if( pid != NULL )
+    task = pid_task(pid, PIDTYPE_PID);
+  dead = task == NULL || (task->flags & PF_EXITING);
+  rcu_read_unlock();
+  return dead;
+}
+
+
+/* Releases the TX claims and socket send gates held by senders without the
+ * lock (EF_TCP_SEND_NOLOCK) that have died, so that the lock holder does
+ * not wait for them forever.  Called when an exiting process closes the
+ * stack fd, by which time all of its threads are exiting.  This is done
+ * without the stack lock, which the lock holder keeps while it waits.
+ */
+void tcp_helper_reap_send_nolock(tcp_helper_resource_t* thr)
+{
+  ci_netif* ni = &thr->netif;
+  ci_uint32 owner;
+  int intf_i, id;
+
+  if( ! NI_OPTS(ni).tcp_send_nolock )
+    return;
+
+  OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
+    owner = OO_ACCESS_ONCE(ni->state->nic[intf_i].tx_claim);
+    if( owner != 0 && owner != CI_NETIF_TX_OWNER_LOCKED &&
+        tcp_helper_tid_is_dead(ni, owner) &&
+        ci_netif_tx_claim_reap(ni, intf_i, owner) )
+      ci_log("[%d] intf %d: released TX claim of dead sender %u",
+             thr->id, intf_i, owner);
+  }
+
+  for( id = 0; id < ni->ep_tbl_n; ++id ) {
+    citp_waitable_obj* wo = ID_TO_WAITABLE_OBJ(ni, id);
+    if( ! (wo->waitable.state & CI_TCP_STATE_TCP_CONN) )
+      continue;
+    owner = OO_ACCESS_ONCE(wo->tcp.send_nolock_owner);
+    if( owner != 0 && tcp_helper_tid_is_dead(ni, owner) &&
+        ci_tcp_send_nolock_reap(ni, &wo->tcp, owner) )
+      ci_log("[%d:%d] released send gate of dead sender %u",
+             thr->id, id, owner);
+  }
+}
+
+
 static void thr_table_dtor(tcp_helpers_table_t *table)
 {
   /* Onload is going away, so kill off any remaining stacks. */
@@ -540,6 +620,22 @@ static void thr_table_dtor(tcp_helpers_table_t *table)
   ci_dllink* link;
   int rc;
 
+  /* Spare stacks have no file to release them, so drop the application
+   * reference they were created with.  Let any refill finish first. */
+  flush_workqueue(CI_GLOBAL_WORKQUEUE);
+  ci_irqlock_lock(&table->lock, &lock_flags);
+  while( ci_dllist_not_empty(&table->stack_pool) ) {
+    link = ci_dllist_pop(&table->stack_pool);
+    ci_dllink_mark_free(link);
+    --table->stack_pool_n;
+    thr = CI_CONTAINER(tcp_helper_resource_t, stack_pool_link, link);
+    ci_irqlock_unlock(&table->lock, &lock_flags);
+    oo_thr_ref_drop(thr->ref, OO_THR_REF_APP);
+    ci_irqlock_lock(&table->lock, &lock_flags);
+  }
+  ci_irqlock_unlock(&table->lock, &lock_flags);
+  flush_workqueue(CI_GLOBAL_WORKQUEUE);
+
   ci_irqlock_lock(&table->lock, &lock_flags);
 
   /* Gracefully shutdown all time-wait sockets */
@@ -1889,6 +1985,7 @@ static int deferred_vis(tcp_helper_resource_t* trs)
 {
   int rc, intf_i;
   ci_netif* ni = &trs->netif;
+  struct efrm_vi* umem_vi = NULL;
 
   if( ni->flags & CI_NETIF_FLAG_AF_XDP ) {
     /* hugetlbfs pages are incompatible with AF_XDP */
@@ -1911,12 +2008,29 @@ static int deferred_vis(tcp_helper_resource_t* trs)
     struct tcp_helper_nic* trs_nic = &trs->nic[intf_i];
     uint32_t mmap_bytes;
 
+    /* Every interface maps the same packet buffers, so AF_XDP sockets
+     * after the first can share its umem rather than registering the
+     * buffers again. */
     rc = efrm_vi_resource_deferred(tcp_helper_vi(trs, intf_i),
                                    CI_CFG_PKT_BUF_SIZE,
-                                   xdp_headroom,
+                                   xdp_headroom, umem_vi,
                                    &mmap_bytes);
     if( rc < 0 )
       return rc;
+    if( umem_vi == NULL && mmap_bytes != 0 )
+      umem_vi = tcp_helper_vi(trs, intf_i);
+
+    if( mmap_bytes != 0 && NI_OPTS(ni).af_xdp_busy_poll_budget != 0 ) {
+      rc = efrm_vi_af_xdp_busy_poll(tcp_helper_vi(trs, intf_i),
+                                    NI_OPTS(ni).af_xdp_busy_poll_budget,
+                                    NI_OPTS(ni).af_xdp_busy_poll_fallback_usec);
+      if( rc == 0 )
+        ni->state->nic[intf_i].oo_vi_flags |= OO_VI_FLAGS_AF_XDP_BUSY_POLL;
+      else
+        NI_LOG(ni, RESOURCE_WARNINGS,
+               "[%s]: WARNING: preferred busy polling unavailable on "
+               "interface %d (rc=%d)", ni->state->pretty_name, intf_i, rc);
+    }
 
     trs->buf_mmap_bytes += mmap_bytes;
     trs_nic->thn_vi_mmap_bytes = mmap_bytes;
@@ -2157,6 +2271,13 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   int no_active_wild_pools, no_active_wild_table_entries;
 #endif
   int no_seq_table_entries;
+  int no_timewait_table_entries;
+#if CI_CFG_TIMESTAMPING
+  ci_uint32 no_tx_ts_ring_entries;
+#endif
+#if CI_CFG_TCPDUMP
+  ci_uint32 no_capture_slots, capture_stride;
+#endif
   unsigned vi_state_bytes = 0;
   unsigned dma_addrs_bytes;
 #if CI_CFG_PIO
@@ -2196,6 +2317,29 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
     no_seq_table_entries = 0;
   }
 
+  if( NI_OPTS(ni).tcp_time_wait_compact != 0 )
+    no_timewait_table_entries =
+      1u << ci_log2_ge(NI_OPTS(ni).tcp_time_wait_compact, 1);
+  else
+    no_timewait_table_entries = 0;
+
+#if CI_CFG_TIMESTAMPING
+  no_tx_ts_ring_entries = 0;
+  if( NI_OPTS(ni).tx_ts_ring_size )
+    no_tx_ts_ring_entries = 1u << ci_log2_ge(NI_OPTS(ni).tx_ts_ring_size, 1);
+#endif
+
+#if CI_CFG_TCPDUMP
+  no_capture_slots = 0;
+  capture_stride = 0;
+  if( NI_OPTS(ni).tcpdump_ring ) {
+    no_capture_slots = 1u << ci_log2_ge(NI_OPTS(ni).tcpdump_ring, 1);
+    capture_stride = CI_ROUND_UP(sizeof(struct oo_capture_rec) +
+                                 NI_OPTS(ni).tcpdump_ring_snaplen,
+                                 CI_CACHE_LINE_SIZE);
+  }
+#endif
+
   /* pkt_sets_n should be zeroed before possible NIC reset */
   if( NI_OPTS(ni).max_packets > max_packets_per_stack ) {
     OO_DEBUG_ERR(ci_log("WARNING: EF_MAX_PACKETS reduced from %d to %d due to "
@@ -2308,6 +2452,8 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
 #endif
   sz = CI_ROUND_UP(sz, __alignof__(ci_tcp_prev_seq_t));
   sz += sizeof(ci_tcp_prev_seq_t) * no_seq_table_entries;
+  sz = CI_ROUND_UP(sz, __alignof__(ci_tcp_timewait_t));
+  sz += sizeof(ci_tcp_timewait_t) * no_timewait_table_entries;
   sz = CI_ROUND_UP(sz, __alignof__(struct oo_deferred_pkt));
   sz += sizeof(struct oo_deferred_pkt) * NI_OPTS(ni).defer_arp_pkts;
   sz = CI_ROUND_UP(sz, __alignof__(ci_netif_filter_table));
@@ -2327,6 +2473,21 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   sz += sizeof(struct oo_sw_filter_op) * OO_SW_FILTER_OPS_SIZE;
 #endif
 
+#if CI_CFG_TIMESTAMPING
+  if( no_tx_ts_ring_entries ) {
+    sz = CI_ROUND_UP(sz, __alignof__(struct onload_tx_ts_record));
+    sz += sizeof(struct onload_tx_ts_record) * no_tx_ts_ring_entries;
+  }
+#endif
+
+#if CI_CFG_TCPDUMP
+  if( no_capture_slots ) {
+    sz = CI_ROUND_UP(sz, CI_CACHE_LINE_SIZE);
+    sz += sizeof(struct oo_capture_insn) * OO_CAPTURE_FILTER_MAX;
+    sz += capture_stride * no_capture_slots;
+  }
+#endif
+
 #if CI_CFG_PIO
   /* Allocate shmbuf for pio regions.  We haven't tried to allocate
    * PIOs yet and we don't know how many ef10s we have.  So just
@@ -2422,6 +2583,11 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ns->seq_table_entries_n = no_seq_table_entries;
   ns_ofs += sizeof(ci_tcp_prev_seq_t) * ns->seq_table_entries_n;
 
+  ns_ofs = CI_ROUND_UP(ns_ofs, __alignof__(ci_tcp_timewait_t));
+  ns->timewait_table_ofs = ns_ofs;
+  ns->timewait_table_entries_n = no_timewait_table_entries;
+  ns_ofs += sizeof(ci_tcp_timewait_t) * ns->timewait_table_entries_n;
+
   ns_ofs = CI_ROUND_UP(ns_ofs, __alignof__(struct oo_deferred_pkt));
   ns->deferred_pkts_ofs = ns_ofs;
   ns_ofs += sizeof(struct oo_deferred_pkt) * NI_OPTS(ni).defer_arp_pkts;
@@ -2450,6 +2616,23 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ns_ofs += sizeof(struct oo_sw_filter_op) * OO_SW_FILTER_OPS_SIZE;
 #endif
 
+#if CI_CFG_TIMESTAMPING
+  if( no_tx_ts_ring_entries ) {
+    ns_ofs = CI_ROUND_UP(ns_ofs, __alignof__(struct onload_tx_ts_record));
+    ns->tx_ts_ring_ofs = ns_ofs;
+    ns_ofs += sizeof(struct onload_tx_ts_record) * no_tx_ts_ring_entries;
+  }
+#endif
+
+#if CI_CFG_TCPDUMP
+  if( no_capture_slots ) {
+    ns_ofs = CI_ROUND_UP(ns_ofs, CI_CACHE_LINE_SIZE);
+    ns->capture_ofs = ns_ofs;
+    ns_ofs += sizeof(struct oo_capture_insn) * OO_CAPTURE_FILTER_MAX;
+    ns_ofs += capture_stride * no_capture_slots;
+  }
+#endif
+
   /* The last addition to ns_ofs is not really used */
   (void)ns_ofs;
 
@@ -2462,6 +2645,7 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ni->active_wild_table = (void*) ((char*) ns + ns->active_wild_ofs);
 #endif
   ni->seq_table = (void*) ((char*) ns + ns->seq_table_ofs);
+  ni->timewait_table = (void*) ((char*) ns + ns->timewait_table_ofs);
   ni->deferred_pkts = (void*) ((char*) ns + ns->deferred_pkts_ofs);
   ni->filter_table = (void*) ((char*) ns + ns->table_ofs);
   ni->filter_table_ext = (void*) ((char*) ns + ns->table_ext_ofs);
@@ -2482,6 +2666,25 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
                      (void*)((char*) ns + ns->sw_filter_ofs));
 #endif
 
+#if CI_CFG_TIMESTAMPING
+  if( no_tx_ts_ring_entries ) {
+    oo_ringbuffer_state_init(&ns->tx_ts_ring, no_tx_ts_ring_entries,
+                             sizeof(struct onload_tx_ts_record));
+    oo_ringbuffer_init(&ni->tx_ts_ring, &ns->tx_ts_ring,
+                       (void*)((char*) ns + ns->tx_ts_ring_ofs));
+  }
+#endif
+
+#if CI_CFG_TCPDUMP
+  if( no_capture_slots ) {
+    ns->capture.mask = no_capture_slots - 1;
+    ns->capture.stride = capture_stride;
+    ns->capture.max_snaplen = NI_OPTS(ni).tcpdump_ring_snaplen;
+    ci_netif_capture_init(ni, (char*) ns + ns->capture_ofs, no_capture_slots,
+                          capture_stride, NI_OPTS(ni).tcpdump_ring_snaplen);
+  }
+#endif
+
   ni->packets->sets_max = ni->pkt_sets_max;
   ni->packets->sets_n = 0;
   ni->packets->n_pkts_allocated = 0;
@@ -2494,6 +2697,8 @@ allocate_netif_resources(ci_resource_onload_alloc_t* alloc,
   ns->max_aux_bufs[CI_TCP_AUX_TYPE_BUCKET] = ni->opts.max_ep_bufs;
   ns->max_aux_bufs[CI_TCP_AUX_TYPE_EPOLL] = ni->opts.max_ep_bufs;
   ns->max_aux_bufs[CI_TCP_AUX_TYPE_PMTUS] = ni->opts.max_ep_bufs;
+  ns->max_aux_bufs[CI_TCP_AUX_TYPE_LAT_HIST] = ni->opts.tcp_latency_hist ?
+                                     ni->opts.max_ep_bufs * CI_TCP_LAT_HIST_N : 0;
 
   /* The shared netif-state buffer and EP buffers are part of the mem mmap */
   trs->mem_mmap_bytes += ns->netif_mmap_bytes;
@@ -3240,6 +3445,119 @@ ci_inline void tcp_helper_init_max_mss(tcp_helper_resource_t* rs)
 }
 
 
+/* Record the driver-wide pool counters in the stack's shared state, so
+ * that stackdump can report the hit rate. */
+static void tcp_helper_stack_pool_stats(tcp_helper_resource_t* rs,
+                                        int from_pool)
+{
+  ci_netif_state* ns = rs->netif.state;
+
+  ns->stack_pool_hits = THR_TABLE.stack_pool_hits;
+  ns->stack_pool_misses = THR_TABLE.stack_pool_misses;
+  ns->from_stack_pool = from_pool;
+}
+
+
+static int tcp_helper_stack_pool_match(tcp_helper_resource_t* rs,
+                                       const ci_resource_onload_alloc_t* alloc,
+                                       const ci_netif_config_opts* opts)
+{
+  ci_netif* ni = &rs->netif;
+
+  /* Spares are built without the caller's memfds, so a caller that wants
+   * its packets or efct queues in them must have a stack of its own. */
+  if( alloc->in_pktbuf_memfd >= 0 || alloc->in_efct_memfd >= 0 )
+    return 0;
+  if( rs->stack_pool_in_flags != alloc->in_flags ||
+      ni->kuid != ci_getuid() || ni->keuid != ci_geteuid() )
+    return 0;
+#ifdef EFRM_DO_NAMESPACES
+  if( rs->net_ns != current->nsproxy->net_ns ||
+      rs->pid_ns != ci_get_pid_ns(current->nsproxy) )
+    return 0;
+#endif
+#ifdef EFRM_DO_USER_NS
+  if( rs->user_ns != current_user_ns() )
+    return 0;
+#endif
+  return ci_netif_config_opts_equal(&ni->opts, opts);
+}
+
+
+/* Hand out a pre-created stack matching this allocation, renaming it and
+ * giving it to the calling process.  Returns -ENOENT if there is no
+ * suitable stack in the pool. */
+static int tcp_helper_stack_pool_get(ci_resource_onload_alloc_t* alloc,
+                                     const ci_netif_config_opts* opts,
+                                     tcp_helper_resource_t** rs_out)
+{
+  tcp_helper_resource_t* rs = NULL;
+  ci_irqlock_state_t lock_flags;
+  ci_netif_state* ns;
+  ci_dllink* link;
+  int rc;
+
+  alloc->in_name[CI_CFG_STACK_NAME_LEN] = '\0';
+
+  ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
+  CI_DLLIST_FOR_EACH(link, &THR_TABLE.stack_pool) {
+    rs = CI_CONTAINER(tcp_helper_resource_t, stack_pool_link, link);
+    if( tcp_helper_stack_pool_match(rs, alloc, opts) )
+      break;
+    rs = NULL;
+  }
+  if( rs == NULL ) {
+    ++THR_TABLE.stack_pool_misses;
+    ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+    return -ENOENT;
+  }
+  if( alloc->in_name[0] ) {
+    rc = efab_thr_table_check_name(alloc->in_name,
+                                   rs->netif.cplane->cp_netns);
+    if( rc != 0 ) {
+      ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+      return rc;
+    }
+  }
+  ci_dllist_remove(&rs->stack_pool_link);
+  ci_dllink_mark_free(&rs->stack_pool_link);
+  --THR_TABLE.stack_pool_n;
+  ++THR_TABLE.stack_pool_hits;
+
+  ns = rs->netif.state;
+  strcpy(rs->name, alloc->in_name);
+  strcpy(ns->name, alloc->in_name);
+  if( rs->name[0] == '\0' )
+    snprintf(ns->pretty_name, sizeof(ns->pretty_name), "%d", ns->stack_id);
+  else
+    snprintf(ns->pretty_name, sizeof(ns->pretty_name), "%d,%s",
+             ns->stack_id, rs->name);
+  tcp_helper_stack_pool_stats(rs, 1);
+  ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+
+#ifdef EFRM_DO_NAMESPACES
+  ns->pid = task_pid_nr_ns(current, ci_netif_get_pidns(&rs->netif));
+#else
+  ns->pid = task_pid_vnr(current);
+#endif
+  efab_notify_stacklist_change(rs);
+
+  alloc->out_netif_mmap_bytes = rs->mem_mmap_bytes;
+  alloc->out_nic_set = rs->netif.nic_set;
+  *rs_out = rs;
+  OO_DEBUG_RES(ci_log("%s: handed out pre-created stack %u", __func__,
+                      rs->id));
+  return 0;
+}
+
+
+static void
+tcp_helper_stack_pool_refill(tcp_helper_resource_t* rs,
+                             const ci_resource_onload_alloc_t* alloc,
+                             const ci_netif_config_opts* opts,
+                             int ifindices_len);
+
+
 static int
 tcp_helper_rm_alloc_proxy(ci_resource_onload_alloc_t* alloc,
                           const ci_netif_config_opts* opts,
@@ -3286,8 +3604,22 @@ tcp_helper_rm_alloc_proxy(ci_resource_onload_alloc_t* alloc,
   else
 #endif
   {
-    return tcp_helper_rm_alloc(alloc, opts, ifindices_len,
-                               NULL, rs_out);
+    int pooled = stack_pool_size != 0;
+
+    if( pooled ) {
+      rc = tcp_helper_stack_pool_get(alloc, opts, rs_out);
+      if( rc == 0 )
+        tcp_helper_stack_pool_refill(*rs_out, alloc, opts, ifindices_len);
+      if( rc != -ENOENT )
+        return rc;
+    }
+    rc = tcp_helper_rm_alloc(alloc, opts, ifindices_len,
+                             NULL, rs_out);
+    if( rc == 0 && pooled ) {
+      tcp_helper_stack_pool_stats(*rs_out, 0);
+      tcp_helper_stack_pool_refill(*rs_out, alloc, opts, ifindices_len);
+    }
+    return rc;
   }
 }
 
@@ -3897,15 +4229,14 @@ void tcp_helper_put_ns_components(struct oo_cplane_handle* cplane,
 }
 
 
-int tcp_helper_get_ns_components(struct oo_cplane_handle** cplane,
-                                 struct oo_filter_ns**  filter_ns)
+static int tcp_helper_get_ns_components_net(struct net* net,
+                                            struct oo_cplane_handle** cplane,
+                                            struct oo_filter_ns** filter_ns)
 {
   int oof_preexisted;
   int rc;
 
-  /* Kernel uses current->nsproxy->net_ns without any additional locks (for
-   * the "current" task only!), so we believe it is safe. */
-  *cplane = cp_acquire_from_netns_if_exists(current->nsproxy->net_ns);
+  *cplane = cp_acquire_from_netns_if_exists(net);
   if( *cplane == NULL ) {
     OO_DEBUG_ERR(ci_log("ERROR: cplane server not running"));
     return -ENOMEM;
@@ -3915,8 +4246,7 @@ int tcp_helper_get_ns_components(struct oo_cplane_handle** cplane,
    * Although cplane does not hold reference to oof the fact that the stack
    * does allocates and frees in appropriate order is expected to ensure
    * the condition is met */
-  *filter_ns = oo_filter_ns_get(&efab_tcp_driver,
-                                current->nsproxy->net_ns, &oof_preexisted);
+  *filter_ns = oo_filter_ns_get(&efab_tcp_driver, net, &oof_preexisted);
   if( *filter_ns == NULL ) {
     OO_DEBUG_ERR(ci_log("%s: failed to allocated filter_ns", __func__));
     cp_release(*cplane);
@@ -3939,6 +4269,16 @@ int tcp_helper_get_ns_components(struct oo_cplane_handle** cplane,
 }
 
 
+int tcp_helper_get_ns_components(struct oo_cplane_handle** cplane,
+                                 struct oo_filter_ns**  filter_ns)
+{
+  /* Kernel uses current->nsproxy->net_ns without any additional locks (for
+   * the "current" task only!), so we believe it is safe. */
+  return tcp_helper_get_ns_components_net(current->nsproxy->net_ns,
+                                          cplane, filter_ns);
+}
+
+
 struct user_namespace* tcp_helper_get_user_ns(tcp_helper_resource_t* trs)
 {
 #ifdef EFRM_DO_USER_NS
@@ -4127,17 +4467,66 @@ static void put_namespaces(tcp_helper_resource_t* rs)
 #endif
 }
 
-static void generate_efct_filter_irqmask(cpumask_t* result)
+static const cpumask_t* current_cpus_allowed(void)
 {
-  /* The goal here is to maintain NUMA-locality, but avoid contention between
-   * app and IRQs. */
-  int cpu;
 #ifdef EFRM_TASK_HAS_CPUMASK
 /* >= 5.3, backported to RHEL8 */
-  cpumask_t* current_cpus = &current->cpus_mask;
+  return &current->cpus_mask;
 #else
-  cpumask_t* current_cpus = &current->cpus_allowed;
+  return &current->cpus_allowed;
 #endif
+}
+
+/* What a stack built on behalf of another process takes from it, rather
+ * than from current.  Credentials and the mm are borrowed by the building
+ * task itself; see tcp_helper_stack_pool_refill(). */
+struct tcp_helper_creator {
+  struct net* net_ns;
+#ifdef EFRM_DO_NAMESPACES
+  struct pid_namespace* pid_ns;
+#ifdef OO_HAS_IPC_NS
+  struct ipc_namespace* ipc_ns;
+#endif
+#endif
+  cpumask_t cpus;
+};
+
+static void tcp_helper_creator_get(struct tcp_helper_creator* creator)
+{
+#ifdef EFRM_DO_NAMESPACES
+  struct nsproxy* nsproxy = task_nsproxy_start(current);
+  ci_assert(nsproxy);
+  creator->net_ns = get_net(nsproxy->net_ns);
+  creator->pid_ns = get_pid_ns(ci_get_pid_ns(nsproxy));
+#ifdef OO_HAS_IPC_NS
+  if( my_put_ipc_ns != NULL )
+    creator->ipc_ns = get_ipc_ns(nsproxy->ipc_ns);
+#endif
+  task_nsproxy_done(current);
+#else
+  creator->net_ns = get_net(current->nsproxy->net_ns);
+#endif
+  cpumask_copy(&creator->cpus, current_cpus_allowed());
+}
+
+static void tcp_helper_creator_put(struct tcp_helper_creator* creator)
+{
+#ifdef EFRM_DO_NAMESPACES
+#ifdef OO_HAS_IPC_NS
+  if( my_put_ipc_ns != NULL )
+    my_put_ipc_ns(creator->ipc_ns);
+#endif
+  put_pid_ns(creator->pid_ns);
+#endif
+  put_net(creator->net_ns);
+}
+
+static void generate_efct_filter_irqmask(cpumask_t* result,
+                                         const cpumask_t* current_cpus)
+{
+  /* The goal here is to maintain NUMA-locality, but avoid contention between
+   * app and IRQs. */
+  int cpu;
 
   cpumask_clear(result);
   for_each_cpu(cpu, current_cpus)
@@ -4149,10 +4538,13 @@ static void generate_efct_filter_irqmask(cpumask_t* result)
     cpumask_andnot(result, result, current_cpus);
 }
 
-int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
-                        const ci_netif_config_opts* opts,
-                        int ifindices_len, tcp_helper_cluster_t* thc,
-                        tcp_helper_resource_t** rs_out)
+/* Build a stack.  [creator] is NULL when it is for the calling process. */
+static int
+__tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
+                      const ci_netif_config_opts* opts,
+                      int ifindices_len, tcp_helper_cluster_t* thc,
+                      const struct tcp_helper_creator* creator,
+                      tcp_helper_resource_t** rs_out)
 {
   tcp_helper_resource_t* rs;
   ci_irqlock_state_t lock_flags;
@@ -4233,7 +4625,11 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   ni->opts = *opts;
   ci_netif_config_opts_rangecheck(&ni->opts);
 
-  rc = tcp_helper_get_ns_components(&ni->cplane, &rs->filter_ns);
+  if( creator != NULL )
+    rc = tcp_helper_get_ns_components_net(creator->net_ns,
+                                          &ni->cplane, &rs->filter_ns);
+  else
+    rc = tcp_helper_get_ns_components(&ni->cplane, &rs->filter_ns);
   if( rc != 0 )
     goto fail1a;
 
@@ -4284,7 +4680,9 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   rs->thc = NULL;
 #endif
   strcpy(rs->name, alloc->in_name);
-  generate_efct_filter_irqmask(&rs->filter_irqmask);
+  generate_efct_filter_irqmask(&rs->filter_irqmask,
+                               creator ? &creator->cpus :
+                                         current_cpus_allowed());
 
   spin_lock_init(&ni->swf_update_lock);
   ni->swf_update_last =  ni->swf_update_first = NULL;
@@ -4314,15 +4712,25 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
 
 #ifdef EFRM_DO_NAMESPACES
   /* Initialise namespaces */
-  nsproxy = task_nsproxy_start(current);
-  ci_assert(nsproxy);
-  rs->net_ns = get_net(nsproxy->net_ns);
-  rs->pid_ns = get_pid_ns(ci_get_pid_ns(nsproxy));
+  if( creator != NULL ) {
+    rs->net_ns = get_net(creator->net_ns);
+    rs->pid_ns = get_pid_ns(creator->pid_ns);
 #ifdef OO_HAS_IPC_NS
-  if( my_put_ipc_ns != NULL )
-    rs->ipc_ns = get_ipc_ns(nsproxy->ipc_ns);
+    if( my_put_ipc_ns != NULL )
+      rs->ipc_ns = get_ipc_ns(creator->ipc_ns);
 #endif
-  task_nsproxy_done(current);
+  }
+  else {
+    nsproxy = task_nsproxy_start(current);
+    ci_assert(nsproxy);
+    rs->net_ns = get_net(nsproxy->net_ns);
+    rs->pid_ns = get_pid_ns(ci_get_pid_ns(nsproxy));
+#ifdef OO_HAS_IPC_NS
+    if( my_put_ipc_ns != NULL )
+      rs->ipc_ns = get_ipc_ns(nsproxy->ipc_ns);
+#endif
+    task_nsproxy_done(current);
+  }
   netns_get_identifiers(rs->netif.state, rs->net_ns);
 #endif
 
@@ -4716,6 +5124,164 @@ int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
   return rc;
 }
 
+int tcp_helper_rm_alloc(ci_resource_onload_alloc_t* alloc,
+                        const ci_netif_config_opts* opts,
+                        int ifindices_len, tcp_helper_cluster_t* thc,
+                        tcp_helper_resource_t** rs_out)
+{
+  return __tcp_helper_rm_alloc(alloc, opts, ifindices_len, thc, NULL, rs_out);
+}
+
+
+/* Background top-up of the stack pool.  Spares must match the allocation
+ * that triggered the refill (see tcp_helper_stack_pool_match()), so the
+ * worker builds them with the requester's credentials, mm, namespaces and
+ * CPU affinity rather than its own. */
+struct tcp_helper_stack_pool_refill {
+  struct work_struct         work;
+  ci_resource_onload_alloc_t alloc;
+  ci_netif_config_opts       opts;
+  int                        ifindices_len;
+  const struct cred*         cred;
+  struct mm_struct*          mm;
+  struct tcp_helper_creator  creator;
+};
+
+
+/* Reserve a slot for one more spare.  Returns false if the pool is full
+ * once stacks already being built are counted. */
+static bool tcp_helper_stack_pool_reserve(void)
+{
+  ci_irqlock_state_t lock_flags;
+  bool reserved = false;
+
+  ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
+  if( THR_TABLE.stack_pool_n + THR_TABLE.stack_pool_pending <
+      stack_pool_size ) {
+    ++THR_TABLE.stack_pool_pending;
+    reserved = true;
+  }
+  ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+  return reserved;
+}
+
+
+static void tcp_helper_stack_pool_unreserve(void)
+{
+  ci_irqlock_state_t lock_flags;
+
+  ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
+  ci_assert_gt(THR_TABLE.stack_pool_pending, 0);
+  --THR_TABLE.stack_pool_pending;
+  ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+}
+
+
+static void tcp_helper_stack_pool_refill_work(struct work_struct* data)
+{
+  struct tcp_helper_stack_pool_refill* refill =
+    container_of(data, struct tcp_helper_stack_pool_refill, work);
+  const struct cred* old_cred;
+  tcp_helper_resource_t* rs;
+  ci_irqlock_state_t lock_flags;
+  bool more;
+  int rc;
+
+  /* The requester may already have exited. */
+  if( refill->mm != NULL && ! mmget_not_zero(refill->mm) ) {
+    tcp_helper_stack_pool_unreserve();
+    goto out;
+  }
+  if( refill->mm != NULL )
+    kthread_use_mm(refill->mm);
+  old_cred = override_creds(refill->cred);
+
+  /* We hold one reservation on entry to each iteration. */
+  do {
+    rc = __tcp_helper_rm_alloc(&refill->alloc, &refill->opts,
+                               refill->ifindices_len, NULL,
+                               &refill->creator, &rs);
+
+    more = false;
+    ci_irqlock_lock(&THR_TABLE.lock, &lock_flags);
+    ci_assert_gt(THR_TABLE.stack_pool_pending, 0);
+    --THR_TABLE.stack_pool_pending;
+    if( rc == 0 ) {
+      rs->stack_pool_in_flags = refill->alloc.in_flags;
+      ci_dllist_push(&THR_TABLE.stack_pool, &rs->stack_pool_link);
+      ++THR_TABLE.stack_pool_n;
+      if( THR_TABLE.stack_pool_n + THR_TABLE.stack_pool_pending <
+          stack_pool_size ) {
+        ++THR_TABLE.stack_pool_pending;
+        more = true;
+      }
+    }
+    ci_irqlock_unlock(&THR_TABLE.lock, &lock_flags);
+
+    if( rc != 0 )
+      OO_DEBUG_ERR(ci_log("%s: failed to pre-create stack (%d)",
+                          __func__, rc));
+  } while( more );
+
+  revert_creds(old_cred);
+  if( refill->mm != NULL ) {
+    kthread_unuse_mm(refill->mm);
+    mmput(refill->mm);
+  }
+ out:
+  put_cred(refill->cred);
+  if( refill->mm != NULL )
+    mmdrop(refill->mm);
+  tcp_helper_creator_put(&refill->creator);
+  kfree(refill);
+}
+
+
+/* Top the pool up with stacks built like [rs], the one just allocated.
+ * The stacks are built on the global workqueue so that the allocation
+ * which triggered the refill is not delayed by it.
+ *
+ * AF_XDP stacks are not pooled: their VIs need a user process to set up
+ * the socket (see __sys_call_area_alloc()), and the sockets belong to the
+ * files of the process that creates them, neither of which a worker has.
+ */
+static void
+tcp_helper_stack_pool_refill(tcp_helper_resource_t* rs,
+                             const ci_resource_onload_alloc_t* alloc,
+                             const ci_netif_config_opts* opts,
+                             int ifindices_len)
+{
+  struct tcp_helper_stack_pool_refill* refill;
+
+  if( rs->netif.flags & CI_NETIF_FLAG_AF_XDP )
+    return;
+  if( ! tcp_helper_stack_pool_reserve() )
+    return;
+
+  refill = kmalloc(sizeof(*refill), GFP_KERNEL);
+  if( refill == NULL ) {
+    tcp_helper_stack_pool_unreserve();
+    return;
+  }
+
+  refill->alloc = *alloc;
+  refill->alloc.in_name[0] = '\0';
+  /* The memfds belong to the caller's stack; hugepage-backed memory for
+   * spare stacks comes from the driver's own hugetlb file. */
+  refill->alloc.in_efct_memfd = -1;
+  refill->alloc.in_pktbuf_memfd = -1;
+  refill->opts = *opts;
+  refill->ifindices_len = ifindices_len;
+  refill->cred = get_current_cred();
+  refill->mm = current->mm;
+  if( refill->mm != NULL )
+    mmgrab(refill->mm);
+  tcp_helper_creator_get(&refill->creator);
+
+  INIT_WORK(&refill->work, tcp_helper_stack_pool_refill_work);
+  queue_work(CI_GLOBAL_WORKQUEUE, &refill->work);
+}
+
 int tcp_helper_alloc_ul(ci_resource_onload_alloc_t* alloc,
                         int ifindices_len, tcp_helper_resource_t** rs_out)
 {
@@ -4830,8 +5396,10 @@ static void tcp_helper_purge_txq_locked(tcp_helper_resource_t* thr)
       if( nic->resetting & NIC_RESETTING_FLAG_UNPLUGGED ) {
         struct thr_reset_stack_tx_cb_state cb_state;
         ef_vi* vi = ci_netif_vi(ni, intf_i);
+        ci_netif_tx_claim_wait(ni, intf_i);
         thr_reset_stack_tx_cb_state_init(&cb_state, thr, intf_i);
         ef_vi_txq_reinit(vi, thr_reset_stack_tx_cb, &cb_state);
+        ci_netif_tx_release(ni, intf_i);
         /* Purge the eventq as well, to get rid of any references to TX
          * descriptors that we just purged. */
         ef_vi_evq_reinit(vi);
@@ -4993,8 +5561,12 @@ static void tcp_helper_reset_stack_locked(tcp_helper_resource_t* thr)
       ef_vi_evq_reinit(vi);
       ef_vi_rxq_reinit(vi, thr_reset_stack_rx_cb, thr);
 
+      /* Keep senders without the stack lock off the ring while we purge
+       * it. */
+      ci_netif_tx_claim_wait(ni, intf_i);
       thr_reset_stack_tx_cb_state_init(&cb_state, thr, intf_i);
       ef_vi_txq_reinit(vi, thr_reset_stack_tx_cb, &cb_state);
+      ci_netif_tx_release(ni, intf_i);
 
       /* Reset hw queues.  This must be done after resetting the sw
          queues as the hw will start delivering events after being reset.  If
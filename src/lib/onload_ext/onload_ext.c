@@ -212,6 +212,14 @@ int onload_timestamping_request(int fd, unsigned flags)
 }
 
 
+__attribute__((weak))
+int onload_tx_timestamp_ring(int fd, struct onload_tx_ts_ring* ring,
+                             uint32_t* sock_key_out)
+{
+  return -ENOSYS;
+}
+
+
 /**************************************************************************/
 
 __attribute__((weak))
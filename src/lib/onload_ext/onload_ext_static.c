@@ -198,6 +198,10 @@ wrap( int, onload_ordered_epoll_wait, (int epfd, struct epoll_event *events,
 wrap(int, onload_timestamping_request, (int fd, unsigned flags),
      (fd, flags), -ENOSYS)
 
+wrap(int, onload_tx_timestamp_ring,
+     (int fd, struct onload_tx_ts_ring* ring, uint32_t* sock_key_out),
+     (fd, ring, sock_key_out), -ENOSYS)
+
 wrap(enum onload_delegated_send_rc,  onload_delegated_send_prepare,
      (int fd, int size, unsigned flags, struct onload_delegated_send* out),
      (fd, size, flags, out), ONLOAD_DELEGATED_SEND_RC_BAD_SOCKET)
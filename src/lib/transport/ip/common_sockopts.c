@@ -1750,6 +1750,9 @@ int ci_set_sol_socket(ci_netif* netif, ci_sock_cmn* s,
     if( (v & ONLOAD_SOF_TIMESTAMPING_STREAM) &&
         (optname == SO_TIMESTAMPING_OOEXT) )
       goto fail_inval;
+    if( (v & ONLOAD_SOF_TIMESTAMPING_TX_RING) &&
+        ! (v & ONLOAD_SOF_TIMESTAMPING_TX_HARDWARE) )
+      goto fail_inval;
 
     if( (v & ONLOAD_SOF_TIMESTAMPING_TX_HARDWARE) ) {
       int intf_i;
@@ -44,6 +44,10 @@ int ci_cfg_query(void)
    */
   ci_netif_config_opts_defaults(&ci_cfg_opts.netif_opts);
 
+  /* Snapshot the EF_ environment once for all the option parsing below
+   * and in citp_transport_init(). */
+  ci_cfg_env_scan();
+
   /* adjust the netif options again... */
   ci_netif_config_opts_getenv(&ci_cfg_opts.netif_opts);
   ci_netif_config_opts_rangecheck(&ci_cfg_opts.netif_opts);
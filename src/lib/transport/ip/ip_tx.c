@@ -92,10 +92,15 @@ void ci_ip_send_pkt_defer(ci_netif* ni, const struct oo_sock_cplane* sock_cp,
       ipcache_protocol(ipcache) == IPPROTO_TCP ) {
     ci_addr_sh_t laddr = CI_ADDR_SH_FROM_ADDR(dpkt->src);
     ci_uint16 lport = sock_cp->lport_be16;
+    ci_uint32 flow_hash = onload_hash3(dpkt->src, lport,
+                                       ipcache_raddr(ipcache),
+                                       ipcache_rport_be16(ipcache),
+                                       IPPROTO_TCP);
     /* We ignore failure returns from cp_svc_check_dnat().  In the event that
      * it fails, it leaves the address untranslated, which is the best that
      * we can do. */
-    if( cp_svc_check_dnat(ni->cplane_init_net, &laddr, &lport) > 0 )
+    if( cp_svc_check_dnat(ni->cplane_init_net, &laddr, &lport,
+                          flow_hash) > 0 )
       dpkt->src = CI_ADDR_FROM_ADDR_SH(laddr);
   }
   dpkt->nexthop = ipcache->nexthop;
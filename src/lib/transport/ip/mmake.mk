@@ -19,6 +19,9 @@ LIB_SRCS	:=		\
 		tcp_tx_reformat.c \
 		tcp_timer.c	\
 		tcp_close.c	\
+		tcp_timewait.c	\
+		tcp_lat_hist.c	\
+		netif_capture.c \
 		tcp_init_shared.c \
 		pmtu.c		\
 		ip_tx.c		\
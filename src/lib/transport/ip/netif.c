@@ -173,6 +173,8 @@ void ci_netif_timeout_reap(ci_netif* ni)
       if( ts->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN ) {
 #endif
         LOG_NV(log(LPF "Reaping %d from %s", S_FMT(ts), state_str(ts)));
+        if( ts->tcpflags & CI_TCPT_FLAG_TW_COMPACT )
+          ci_tcp_timewait_compact(ni, ts);
         ci_netif_timeout_leave(ni, ts);
         CITP_STATS_NETIF(++ni->state->stats.timewait_reap);
         if( OO_SP_NOT_NULL(ni->state->free_eps_head) )
@@ -212,6 +214,8 @@ ci_netif_timeout_state(ci_netif* ni)
       if( TIME_GT(ts->t_last_sent, ci_ip_time_now(ni)) )
         break; /* break from the inner loop */
 
+      if( ts->tcpflags & CI_TCPT_FLAG_TW_COMPACT )
+        ci_tcp_timewait_compact(ni, ts);
       /* ci_netif_timeout_leave() calls ci_tcp_drop() calls
        * ci_netif_timeout_remove() which re-enables timer */
       ci_netif_timeout_leave(ni, ts);
@@ -237,6 +241,11 @@ void ci_netif_timeout_restart(ci_netif *ni, ci_tcp_state *ts)
   ci_assert(ts);
   ci_assert( is_tw || ci_tcp_is_timeout_orphan(ts));
 
+  /* Already due to be handed over to the compact table; the table
+   * restarts 2MSL itself when it needs to. */
+  if( ts->tcpflags & CI_TCPT_FLAG_TW_COMPACT )
+    return;
+
   /* take it off the list */
   ci_netif_timeout_remove(ni, ts);
   /* store time to leave TIMEWAIT state */
@@ -250,6 +259,23 @@ void ci_netif_timeout_restart(ci_netif *ni, ci_tcp_state *ts)
 }
 
 
+/* Can [ts], which is about to enter TIME_WAIT, be replaced by an entry in
+ * the compact TIME_WAIT table?  Only orphans qualify, and only if they use
+ * software filters alone: a hardware filter of their own would go away
+ * with the endpoint, and late segments would then reach the kernel. */
+ci_inline int /*bool*/
+ci_netif_timewait_can_compact(ci_netif* ni, ci_tcp_state* ts)
+{
+  return ni->state->timewait_table_entries_n != 0 &&
+         (ts->s.b.sb_aflags & CI_SB_AFLAG_ORPHAN) &&
+#if CI_CFG_FD_CACHING
+         ! (ts->s.b.sb_aflags & CI_SB_AFLAG_IN_CACHE) &&
+#endif
+         ! (ts->s.s_flags & CI_SOCK_FLAG_FILTER) &&
+         OO_SP_IS_NULL(ts->local_peer);
+}
+
+
 /*
 ** - add a connection to the timewait queue,
 ** - stop its timers
@@ -277,6 +303,20 @@ void ci_netif_timewait_enter(ci_netif* ni, ci_tcp_state* ts)
 
   ci_tcp_stop_timers(ni, ts);
 
+  if( ci_netif_timewait_can_compact(ni, ts) ) {
+    /* Our caller is still using [ts], so leave the handover to the timeout
+     * timer.  Put [ts] at the head of the queue, due now, so that the timer
+     * gets to it on its next run. */
+    ts->tcpflags |= CI_TCPT_FLAG_TW_COMPACT;
+    ts->t_last_sent = ci_ip_time_now(ni);
+    oo_p_dllink_add(ni,
+                    oo_p_dllink_ptr(ni,
+                                    &ni->state->timeout_q[OO_TIMEOUT_Q_TIMEWAIT]),
+                    oo_p_dllink_sb(ni, &ts->s.b, &ts->timeout_q_link));
+    ci_netif_timeout_set_timer(ni, ts->t_last_sent - 1);
+    return;
+  }
+
   /* store time to leave TIMEWAIT state */
   ts->t_last_sent = ci_ip_time_now(ni) + NI_CONF(ni).tconst_2msl_time;
   /* add to list */
@@ -1800,6 +1840,13 @@ static oo_sp __ci_netif_active_wild_pool_get(ci_netif* ni, int aw_pool,
 
       CITP_STATS_NETIF_INC(ni, tcp_shared_local_ports_skipped_in_use);
     }
+    else if( (*prev_seq_out = ci_tcp_timewait_reuse(ni, laddr, lport,
+                                                    raddr, rport)) != 0 ) {
+      /* The 4-tuple's TIME_WAIT has been compacted; reuse it as above. */
+      CITP_STATS_NETIF_INC(ni, tcp_shared_local_ports_reused_tw);
+      *port_out = lport;
+      return SC_SP(&aw->s);
+    }
     else if( __ci_netif_active_wild_allow_reuse(ni, aw, laddr,
                                                 raddr, rport) ) {
       /* If no-one's using this 4-tuple we can let the caller share this
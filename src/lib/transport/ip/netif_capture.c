@@ -0,0 +1,354 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+/**************************************************************************\
+*//*! \file
+**  \brief  In-stack packet capture for onload_tcpdump (EF_TCPDUMP_RING)
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* The capture filter is a classic BPF program written by the capturing
+ * tool into shared memory, and it is run in the kernel as well as at user
+ * level.  So the interpreter below must be safe whatever the program says,
+ * and whatever the tool does to it while it runs: each instruction is read
+ * once, every jump and load is bounds checked, and jumps can only go
+ * forwards so the program always terminates.
+ */
+
+#include "ip_internal.h"
+
+#if CI_CFG_TCPDUMP
+
+/* Instruction classes and fields, as in linux/bpf_common.h. */
+#define OO_BPF_CLASS(code)  ((code) & 0x07)
+#define OO_BPF_LD           0x00
+#define OO_BPF_LDX          0x01
+#define OO_BPF_ST           0x02
+#define OO_BPF_STX          0x03
+#define OO_BPF_ALU          0x04
+#define OO_BPF_JMP          0x05
+#define OO_BPF_RET          0x06
+#define OO_BPF_MISC         0x07
+
+#define OO_BPF_SIZE(code)   ((code) & 0x18)
+#define OO_BPF_W            0x00
+#define OO_BPF_H            0x08
+#define OO_BPF_B            0x10
+
+#define OO_BPF_MODE(code)   ((code) & 0xe0)
+#define OO_BPF_IMM          0x00
+#define OO_BPF_ABS          0x20
+#define OO_BPF_IND          0x40
+#define OO_BPF_MEM          0x60
+#define OO_BPF_LEN          0x80
+#define OO_BPF_MSH          0xa0
+
+#define OO_BPF_OP(code)     ((code) & 0xf0)
+#define OO_BPF_ADD          0x00
+#define OO_BPF_SUB          0x10
+#define OO_BPF_MUL          0x20
+#define OO_BPF_DIV          0x30
+#define OO_BPF_OR           0x40
+#define OO_BPF_AND          0x50
+#define OO_BPF_LSH          0x60
+#define OO_BPF_RSH          0x70
+#define OO_BPF_NEG          0x80
+#define OO_BPF_MOD          0x90
+#define OO_BPF_XOR          0xa0
+
+#define OO_BPF_JA           0x00
+#define OO_BPF_JEQ          0x10
+#define OO_BPF_JGT          0x20
+#define OO_BPF_JGE          0x30
+#define OO_BPF_JSET         0x40
+
+#define OO_BPF_SRC(code)    ((code) & 0x08)
+#define OO_BPF_K            0x00
+#define OO_BPF_X            0x08
+
+#define OO_BPF_RVAL(code)   ((code) & 0x18)
+#define OO_BPF_A            0x10
+
+#define OO_BPF_MISCOP(code) ((code) & 0xf8)
+#define OO_BPF_TAX          0x00
+#define OO_BPF_TXA          0x80
+
+#define OO_BPF_MEMWORDS     16
+
+
+/* Load [size] bytes at [off] in network order.  Returns false if they are
+ * not all within the first [caplen] bytes of the packet. */
+static int oo_capture_load(const ci_uint8* data, unsigned caplen,
+                           ci_uint32 off, int size, ci_uint32* val_out)
+{
+  int n = size == OO_BPF_W ? 4 : size == OO_BPF_H ? 2 : 1;
+  if( off >= caplen || caplen - off < n )
+    return 0;
+  data += off;
+  switch( n ) {
+  case 4:
+    *val_out = ((ci_uint32) data[0] << 24) | ((ci_uint32) data[1] << 16) |
+               ((ci_uint32) data[2] << 8) | data[3];
+    break;
+  case 2:
+    *val_out = ((ci_uint32) data[0] << 8) | data[1];
+    break;
+  default:
+    *val_out = data[0];
+    break;
+  }
+  return 1;
+}
+
+
+unsigned oo_capture_filter_run(const struct oo_capture_insn* prog,
+                               unsigned n_insns, const ci_uint8* data,
+                               unsigned caplen, unsigned wirelen)
+{
+  ci_uint32 A = 0, X = 0, M[OO_BPF_MEMWORDS];
+  unsigned pc;
+
+  memset(M, 0, sizeof(M));
+
+  for( pc = 0; pc < n_insns; ++pc ) {
+    struct oo_capture_insn insn = prog[pc];
+    ci_uint32 k = insn.k;
+    ci_uint32 src;
+
+    switch( OO_BPF_CLASS(insn.code) ) {
+    case OO_BPF_LD:
+      switch( OO_BPF_MODE(insn.code) ) {
+      case OO_BPF_IMM:
+        A = k;
+        break;
+      case OO_BPF_ABS:
+        if( ! oo_capture_load(data, caplen, k, OO_BPF_SIZE(insn.code), &A) )
+          return 0;
+        break;
+      case OO_BPF_IND:
+        if( X + k < X ||
+            ! oo_capture_load(data, caplen, X + k, OO_BPF_SIZE(insn.code),
+                              &A) )
+          return 0;
+        break;
+      case OO_BPF_MEM:
+        if( k >= OO_BPF_MEMWORDS )
+          return 0;
+        A = M[k];
+        break;
+      case OO_BPF_LEN:
+        A = wirelen;
+        break;
+      default:
+        return 0;
+      }
+      break;
+
+    case OO_BPF_LDX:
+      switch( OO_BPF_MODE(insn.code) ) {
+      case OO_BPF_IMM:
+        X = k;
+        break;
+      case OO_BPF_MEM:
+        if( k >= OO_BPF_MEMWORDS )
+          return 0;
+        X = M[k];
+        break;
+      case OO_BPF_LEN:
+        X = wirelen;
+        break;
+      case OO_BPF_MSH:
+        if( ! oo_capture_load(data, caplen, k, OO_BPF_B, &X) )
+          return 0;
+        X = (X & 0xf) << 2;
+        break;
+      default:
+        return 0;
+      }
+      break;
+
+    case OO_BPF_ST:
+    case OO_BPF_STX:
+      if( k >= OO_BPF_MEMWORDS )
+        return 0;
+      M[k] = OO_BPF_CLASS(insn.code) == OO_BPF_ST ? A : X;
+      break;
+
+    case OO_BPF_ALU:
+      src = OO_BPF_SRC(insn.code) == OO_BPF_X ? X : k;
+      switch( OO_BPF_OP(insn.code) ) {
+      case OO_BPF_ADD:  A += src;  break;
+      case OO_BPF_SUB:  A -= src;  break;
+      case OO_BPF_MUL:  A *= src;  break;
+      case OO_BPF_OR:   A |= src;  break;
+      case OO_BPF_AND:  A &= src;  break;
+      case OO_BPF_XOR:  A ^= src;  break;
+      case OO_BPF_NEG:  A = -A;    break;
+      case OO_BPF_DIV:
+        if( src == 0 )
+          return 0;
+        A /= src;
+        break;
+      case OO_BPF_MOD:
+        if( src == 0 )
+          return 0;
+        A %= src;
+        break;
+      case OO_BPF_LSH:
+        A = src < 32 ? A << src : 0;
+        break;
+      case OO_BPF_RSH:
+        A = src < 32 ? A >> src : 0;
+        break;
+      default:
+        return 0;
+      }
+      break;
+
+    case OO_BPF_JMP:
+      if( OO_BPF_OP(insn.code) == OO_BPF_JA ) {
+        if( k >= n_insns - pc )
+          return 0;
+        pc += k;
+        break;
+      }
+      src = OO_BPF_SRC(insn.code) == OO_BPF_X ? X : k;
+      switch( OO_BPF_OP(insn.code) ) {
+      case OO_BPF_JEQ:   pc += A == src ? insn.jt : insn.jf;      break;
+      case OO_BPF_JGT:   pc += A > src ? insn.jt : insn.jf;       break;
+      case OO_BPF_JGE:   pc += A >= src ? insn.jt : insn.jf;      break;
+      case OO_BPF_JSET:  pc += (A & src) ? insn.jt : insn.jf;     break;
+      default:
+        return 0;
+      }
+      /* The loop bound catches a jump past the end. */
+      break;
+
+    case OO_BPF_RET:
+      switch( OO_BPF_RVAL(insn.code) ) {
+      case OO_BPF_K:  return k;
+      case OO_BPF_A:  return A;
+      default:        return 0;
+      }
+
+    case OO_BPF_MISC:
+      switch( OO_BPF_MISCOP(insn.code) ) {
+      case OO_BPF_TAX:  X = A;  break;
+      case OO_BPF_TXA:  A = X;  break;
+      default:          return 0;
+      }
+      break;
+    }
+  }
+
+  /* Fell off the end of the program. */
+  return 0;
+}
+
+
+#if OO_DO_STACK_POLL
+/* Length of a segment that starts [off] bytes into its buffer's dma_start,
+ * limited to what fits in the buffer.  The lengths live in shared state, so
+ * they may be garbage and we must not copy beyond the buffer whatever they
+ * say. */
+static unsigned oo_capture_seg_len(int off, int len)
+{
+  int room = CI_CFG_PKT_BUF_SIZE - CI_MEMBER_OFFSET(ci_ip_pkt_fmt, dma_start) -
+             off;
+  if( len <= 0 || room <= 0 )
+    return 0;
+  return CI_MIN(len, room);
+}
+
+
+void oo_tcpdump_capture(ci_netif* ni, ci_ip_pkt_fmt* pkt)
+{
+  struct oo_capture_state* cs = &ni->state->capture;
+  const ci_uint8* data = (const ci_uint8*) oo_ether_hdr(pkt);
+  unsigned len = CI_MAX(pkt->pay_len, 0);
+  unsigned first_len = oo_capture_seg_len(pkt->pkt_start_off, pkt->pay_len);
+  int n_segs = CI_MIN(pkt->n_buffers, CI_IP_PKT_SEGMENTS_MAX);
+  unsigned filter_len = cs->filter_len;
+  unsigned snaplen = CI_MIN(cs->snaplen, ni->capture.max_snaplen);
+  ci_uint32 write_i = cs->write_i;
+  struct oo_capture_intf_stats* st;
+  struct oo_capture_rec* rec;
+  unsigned n, frag_n;
+  int seg_i;
+  char* p;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if(CI_UNLIKELY( (unsigned) pkt->intf_i >= OO_INTF_I_NUM ))
+    return;
+  st = &cs->intf[pkt->intf_i];
+  if( n_segs > 1 )
+    first_len = CI_MIN(first_len,
+                       oo_capture_seg_len(pkt->pkt_start_off, pkt->buf_len));
+
+  ++st->seen;
+  if( filter_len != 0 ) {
+    unsigned ret = oo_capture_filter_run(ni->capture.filter,
+                                         CI_MIN(filter_len,
+                                                OO_CAPTURE_FILTER_MAX),
+                                         data, first_len, len);
+    if( ret == 0 )
+      return;
+    snaplen = CI_MIN(snaplen, ret);
+  }
+  ++st->accepted;
+
+  if( write_i - cs->read_i > ni->capture.mask ) {
+    ++st->dropped;
+    CITP_STATS_NETIF_INC(ni, tcpdump_ring_drop);
+    return;
+  }
+
+  rec = (void*) (ni->capture.slots +
+                 (write_i & ni->capture.mask) * ni->capture.stride);
+  rec->frc = pkt->tstamp_frc;
+  rec->hw_sec = 0;
+  rec->hw_nsec = 0;
+  rec->len = len;
+  rec->intf_i = pkt->intf_i;
+  rec->flags = (pkt->flags & CI_PKT_FLAG_RX) ? OO_CAPTURE_REC_F_RX : 0;
+#if CI_CFG_TIMESTAMPING
+  /* TX packets get their NIC timestamp only at completion. */
+  if( (pkt->flags & CI_PKT_FLAG_RX) && pkt->hw_stamp.tv_sec != 0 ) {
+    rec->hw_sec = pkt->hw_stamp.tv_sec;
+    rec->hw_nsec = pkt->hw_stamp.tv_nsec;
+    rec->flags |= OO_CAPTURE_REC_F_HW_TS;
+  }
+#endif
+
+  p = (char*) (rec + 1);
+  n = CI_MIN(snaplen, len);
+  frag_n = CI_MIN(n, first_len);
+  memcpy(p, data, frag_n);
+  p += frag_n;
+  n -= frag_n;
+  /* A corrupt chain may loop, so stop after the number of segments that a
+   * packet can have. */
+  if( n != 0 && n_segs > 1 && OO_PP_NOT_NULL(pkt->frag_next) ) {
+    ci_ip_pkt_fmt* frag = PKT_CHK(ni, pkt->frag_next);
+    seg_i = 1;
+    while( 1 ) {
+      frag_n = CI_MIN(n, oo_capture_seg_len(0, frag->buf_len));
+      memcpy(p, frag->dma_start, frag_n);
+      p += frag_n;
+      n -= frag_n;
+      if( n == 0 || ++seg_i >= n_segs || OO_PP_IS_NULL(frag->frag_next) )
+        break;
+      frag = PKT_CHK(ni, frag->frag_next);
+    }
+  }
+  rec->caplen = p - (char*) (rec + 1);
+
+  ci_wmb();
+  cs->write_i = write_i + 1;
+}
+#endif
+
+#endif /* CI_CFG_TCPDUMP */
@@ -312,6 +312,8 @@ void ci_netif_pkt_dump_all(ci_netif* ni)
 {
   ci_netif_state* ns = ni->state;
   int i, j, n_zero_refs = 0;
+  int n_fill[CI_PKT_FILL_N] = { 0, };
+  ci_uint64 used_bytes = 0;
   ci_buffer_alloc_info_t * alloc;
 
   log("%s: id=%d  "CI_DEBUG("uid=%d pid=%d"), __FUNCTION__, NI_ID(ni)
@@ -335,6 +337,9 @@ void ci_netif_pkt_dump_all(ci_netif* ni)
       ++n_zero_refs;
       continue;
     }
+    ++n_fill[ci_pkt_fill(pkt)];
+    if( pkt->buf_len > 0 )
+      used_bytes += pkt->buf_len;
     for( j = 0; j < MAX_NO_DIFF_ALLOCS; j++ )
       if( alloc[j].flags == pkt->flags ) {
         alloc[j].no_buffers++;
@@ -352,6 +357,12 @@ void ci_netif_pkt_dump_all(ci_netif* ni)
           alloc[j].flags, __CI_PKT_FLAGS_PRI_ARG(alloc[j].flags));
   ci_free(alloc);
 
+  i = ni->packets->n_pkts_allocated - n_zero_refs;
+  log("   buffer_fill: small(<=%d)=%d std=%d chained=%d used=%d%%",
+      CI_PKT_FILL_SMALL_MAX, n_fill[CI_PKT_FILL_SMALL],
+      n_fill[CI_PKT_FILL_STD], n_fill[CI_PKT_FILL_CHAIN],
+      i ? (int) (used_bytes * 100 / ((ci_uint64) i * CI_CFG_PKT_BUF_SIZE)) : 0);
+
   log("   n_zero_refs=%d n_freepkts=%d estimated_free_nonb=%d",
       n_zero_refs, ni->packets->id, n_zero_refs - ni->packets->id);
 
@@ -897,6 +908,12 @@ void ci_netif_dump_to_logger(ci_netif* ni, oo_dump_log_fn_t logger,
   logger(log_arg, "  creation_time=%s (delta=%lusecs)", buff,
          nowt - ns->creation_time_sec);
 #endif
+  if( ns->stack_pool_hits + ns->stack_pool_misses != 0 )
+    logger(log_arg, "  stack_pool: %s hits=%u misses=%u hit_rate=%u%%",
+           ns->from_stack_pool ? "pre-created" : "created",
+           ns->stack_pool_hits, ns->stack_pool_misses,
+           (unsigned) ((ci_uint64) ns->stack_pool_hits * 100 /
+                       (ns->stack_pool_hits + ns->stack_pool_misses)));
 
   tmp = ni->state->lock.lock;
   logger(log_arg, "  lock=%"CI_PRIx64" "CI_NETIF_LOCK_FMT"  nics=%"CI_PRIx64
@@ -944,6 +961,14 @@ void ci_netif_dump_to_logger(ci_netif* ni, oo_dump_log_fn_t logger,
       logger(log_arg, "  tcpdump: %d/%d packets in queue (wr=%u rd=%u)",
              (int)(ci_uint16) (dwi - dri), CI_CFG_DUMPQUEUE_LEN, dwi, dri);
   }
+  if( ns->capture.stride != 0 ) {
+    const struct oo_capture_state* cs = &ns->capture;
+    logger(log_arg, "  tcpdump ring: %s %u/%u slots in use (wr=%u rd=%u) "
+           "snaplen=%u/%u filter=%u drop=%u", cs->on ? "on" : "off",
+           cs->write_i - cs->read_i, cs->mask + 1, cs->write_i, cs->read_i,
+           cs->snaplen, cs->max_snaplen, cs->filter_len,
+           ns->stats.tcpdump_ring_drop);
+  }
 
 #if CI_CFG_FD_CACHING
   logger(log_arg, "  active cache: hit=%d avail=%d cache=%s pending=%s",
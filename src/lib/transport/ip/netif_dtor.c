@@ -39,7 +39,8 @@ static int is_expecting_events(ci_netif* ni)
   OO_STACK_FOR_EACH_INTF_I(ni, intf_i) {
     ci_netif_state_nic_t* nic = &ni->state->nic[intf_i];
     if( ci_netif_intf_has_event(ni, intf_i) || 
-         nic->tx_dmaq_insert_seq != nic->tx_dmaq_done_seq ) {
+         nic->tx_dmaq_insert_seq != nic->tx_dmaq_done_seq ||
+         nic->tx_nolock_pkts != nic->tx_nolock_pkts_folded ) {
       return 1;
     }
   }
@@ -694,18 +694,122 @@ ci_inline int oo_xdp_check_pkt(ci_netif* ni, ci_ip_pkt_fmt** pkt)
 #endif
 
 
+/* Returns a key identifying the flow that [pkt] belongs to, for the purpose
+ * of grouping packets in an RX batch.  All packets that could be delivered
+ * to the same socket must have the same key, so that grouping preserves the
+ * order in which each socket sees its packets: TCP packets are keyed by
+ * their ports, and UDP packets by their destination port alone so that an
+ * unconnected socket sees all of its senders in arrival order.  Collisions
+ * merely merge groups, which is harmless.  Packets we don't classify get a
+ * key of their own.
+ */
+static ci_uint64 rx_batch_flow_key(ci_ip_pkt_fmt* pkt, int i)
+{
+  ci_uint16 ether_type = *((ci_uint16*)oo_l3_hdr(pkt) - 1);
+  ci_uint16* ports;
+  unsigned proto;
+
+  if(CI_LIKELY( ether_type == CI_ETHERTYPE_IP )) {
+    ci_ip4_hdr* ip = oo_ip_hdr(pkt);
+    if( ip->ip_frag_off_be16 & (CI_IP4_OFFSET_MASK | CI_IP4_FRAG_MORE) )
+      goto unclassified;
+    proto = ip->ip_protocol;
+    ports = (ci_uint16*) ((char*) ip + CI_IP4_IHL(ip));
+  }
+#if CI_CFG_IPV6
+  else if( ether_type == CI_ETHERTYPE_IP6 ) {
+    ci_ip6_hdr* ip6 = oo_ip6_hdr(pkt);
+    proto = ip6->next_hdr;
+    ports = (ci_uint16*) (ip6 + 1);
+  }
+#endif
+  else {
+    goto unclassified;
+  }
+
+  /* The source and destination ports are the first two 16-bit words of
+   * both the TCP and UDP headers. */
+  if( proto == IPPROTO_TCP )
+    return ((ci_uint64) IPPROTO_TCP << 32) | ((ci_uint32) ports[0] << 16) |
+           ports[1];
+  if( proto == IPPROTO_UDP )
+    return ((ci_uint64) IPPROTO_UDP << 32) | ports[1];
+
+ unclassified:
+  return ~(ci_uint64) i;
+}
+
+
+/* Deliver the packets parked by __handle_rx_pkt() in batched mode.  The
+ * batch is classified first, and then delivered one flow at a time, so that
+ * each socket's state is brought into cache once per batch and consecutive
+ * TCP packets for a connection can reuse its filter-table match.  Wakeups
+ * and ACKs are already deferred to post-poll processing, so each socket
+ * makes one wakeup and one ACK decision per batch.
+ */
+static void handle_rx_batch(ci_netif* ni, struct ci_netif_poll_state* ps)
+{
+  ci_uint64 key[CI_CFG_RX_BATCH_MAX];
+  int n = ps->rx_batch_n;
+  int i, j;
+
+  if( n == 0 )
+    return;
+  ps->rx_batch_n = 0;
+
+  for( i = 0; i < n; ++i ) {
+    ci_ip_pkt_fmt* pkt = PKT_CHK(ni, ps->rx_batch_pkts[i]);
+    key[i] = rx_batch_flow_key(pkt, i);
+    ci_prefetch(pkt->dma_start + CI_CACHE_LINE_SIZE);
+  }
+
+  CITP_STATS_NETIF_INC(ni, rx_batches);
+  CITP_STATS_NETIF_ADD(ni, rx_batch_pkts, n);
+
+  for( i = 0; i < n; ++i ) {
+    if( OO_PP_IS_NULL(ps->rx_batch_pkts[i]) )
+      continue;
+    for( j = i; j < n; ++j ) {
+      if( OO_PP_NOT_NULL(ps->rx_batch_pkts[j]) && key[j] == key[i] ) {
+        ci_ip_pkt_fmt* pkt = PKT_CHK(ni, ps->rx_batch_pkts[j]);
+        ps->rx_batch_pkts[j] = OO_PP_NULL;
+        handle_rx_pkt(ni, ps, pkt);
+      }
+    }
+  }
+}
+
+
 ci_inline void __handle_rx_pkt(ci_netif* ni, struct ci_netif_poll_state* ps,
                                ci_ip_pkt_fmt** pkt)
 {
   if( *pkt ) {
     if( oo_xdp_check_pkt(ni, pkt) ) {
       ci_parse_rx_vlan(*pkt);
-      handle_rx_pkt(ni, ps, *pkt);
+      if( ps->rx_batch ) {
+        if( ps->rx_batch_n == CI_CFG_RX_BATCH_MAX )
+          handle_rx_batch(ni, ps);
+        ps->rx_batch_pkts[ps->rx_batch_n++] = OO_PKT_P(*pkt);
+      }
+      else {
+        handle_rx_pkt(ni, ps, *pkt);
+      }
     }
   }
 }
 
 
+ci_inline void ci_netif_poll_state_init(ci_netif* ni,
+                                        struct ci_netif_poll_state* ps)
+{
+  ps->tx_pkt_free_list_insert = &ps->tx_pkt_free_list;
+  ps->tx_pkt_free_list_n = 0;
+  ps->rx_batch = NI_OPTS(ni).rx_batch;
+  ps->rx_batch_n = 0;
+  ps->rx_sock_cache = OO_SP_NULL;
+}
+
+
 #ifndef __KERNEL__
 /* Partially handle an incoming packet before its completion event.
  * As much work as possible should be done here, before waiting for the packet
@@ -924,10 +1028,12 @@ static void handle_rx_scatter_last_frag(ci_netif* ni, struct oo_rx_state* s,
  * in the jumbo.
  *
  * In this case s->frag_bytes tracks the accumulated length from received frags.
+ * [frag_ofs] is where the data starts in buffers after the first, relative to
+ * dma_start: zero for hardware, but AF_XDP leaves headroom in every buffer.
  */
 static void handle_rx_scatter(ci_netif* ni, struct oo_rx_state* s,
                               ci_ip_pkt_fmt* pkt, int frame_bytes,
-                              unsigned flags)
+                              unsigned flags, int frag_ofs)
 {
   s->rx_pkt = NULL;
 
@@ -946,7 +1052,7 @@ static void handle_rx_scatter(ci_netif* ni, struct oo_rx_state* s,
     ci_assert_gt(s->frag_bytes, 0);
     ci_assert_gt(frame_bytes, s->frag_bytes);
     pkt->buf_len = frame_bytes - s->frag_bytes;
-    oo_offbuf_init(&pkt->buf, pkt->dma_start, pkt->buf_len);
+    oo_offbuf_init(&pkt->buf, pkt->dma_start + frag_ofs, pkt->buf_len);
     s->frag_bytes = frame_bytes;
     CI_DEBUG(pkt->pay_len = -1);
     if( flags & EF_EVENT_FLAG_CONT ) {
@@ -1372,7 +1478,8 @@ static void process_post_poll_list(ci_netif* ni)
       ci_mb();
 
 #if CI_CFG_EPOLL3
-      lists_need_wake |= sb->ready_lists_in_use;
+      lists_need_wake |= ci_sb_epoll_ready_lists(sb);
+      ci_sb_epoll_excl_advance(sb);
 #endif
 
       if( ! (sb->sb_flags & sb->wake_request) ) {
@@ -1455,6 +1562,48 @@ static void process_post_poll_list(ci_netif* ni)
 #define CI_NETIF_RX_VI(ni, nic_i, label)  ci_netif_vi((ni), (nic_i))
 
 
+#if CI_CFG_TIMESTAMPING
+/* Report the TX timestamp of [pkt] in the TX timestamp ring, if the socket
+ * asked for it.  Returns true if it did. */
+static int ci_netif_tx_ts_ring_put(ci_netif* ni, ci_sock_cmn* s,
+                                   ci_ip_pkt_fmt* pkt)
+{
+  struct onload_tx_ts_record rec;
+  int af = oo_pkt_af(pkt);
+
+  if( ni->tx_ts_ring.data == NULL ||
+      ! (s->timestamping_flags & ONLOAD_SOF_TIMESTAMPING_TX_RING) )
+    return 0;
+
+  rec.sock_key = OO_SP_TO_INT(SC_SP(s));
+  if( pkt->flags & CI_PKT_FLAG_UDP ) {
+    ci_udp_hdr* udp = TX_PKT_IPX_UDP(af, pkt,
+                                     TX_PKT_PROTOCOL(af, pkt) != IPPROTO_UDP);
+    rec.id = pkt->ts_key;
+    rec.len = CI_UDP_PAYLEN(udp);
+    rec.flags = 0;
+  }
+  else {
+    rec.id = pkt->pf.tcp_tx.start_seq - s->ts_key;
+    rec.len = pkt->pf.tcp_tx.end_seq - pkt->pf.tcp_tx.start_seq;
+    /* FIN and SYN eat seq space, but the user is not interested in them */
+    if( TX_PKT_IPX_TCP(af, pkt)->tcp_flags & CI_TCP_FLAG_SYN )
+      rec.id++;
+    if( TX_PKT_IPX_TCP(af, pkt)->tcp_flags &
+        (CI_TCP_FLAG_SYN|CI_TCP_FLAG_FIN) )
+      rec.len--;
+    rec.flags = ONLOAD_TX_TS_RECORD_TCP;
+    if( pkt->flags & CI_PKT_FLAG_RTQ_RETRANS )
+      rec.flags |= ONLOAD_TX_TS_RECORD_RETRANS;
+  }
+  ci_rx_pkt_timestamp_nic(pkt, &rec.timestamp);
+
+  oo_ringbuffer_write(&ni->tx_ts_ring, &rec);
+  return 1;
+}
+#endif
+
+
 static void ci_netif_tx_pkt_complete_udp(ci_netif* netif,
                                          struct ci_netif_poll_state* ps,
                                          ci_ip_pkt_fmt* pkt)
@@ -1496,6 +1645,7 @@ static void ci_netif_tx_pkt_complete_udp(ci_netif* netif,
    * If the outgoing packet has to be fragmented, then only the first
    * fragment is time stamped and returned to the sending socket. */
   if( pkt->flags & CI_PKT_FLAG_TX_TIMESTAMPED &&
+      ! ci_netif_tx_ts_ring_put(netif, &us->s, pkt) &&
       ci_udp_timestamp_q_enqueue(netif, us, pkt) == 0 )
     return;
 #endif
@@ -1518,10 +1668,37 @@ static void ci_netif_tx_pkt_complete_udp(ci_netif* netif,
 }
 
 
+/* First TX completion of a TCP data packet sent on a socket with latency
+ * histograms.  The completion time is kept in the packet for the RTT
+ * sample taken when it is acknowledged.  Retransmitted packets give no
+ * samples, as the ACK cannot be matched to a transmission. */
+static void ci_netif_tx_pkt_complete_lat_hist(ci_netif* ni,
+                                              ci_ip_pkt_fmt* pkt)
+{
+  citp_waitable_obj* wo = SP_TO_WAITABLE_OBJ(ni, pkt->pf.tcp_tx.sock_id);
+  ci_uint64 now_frc;
+
+  if( (pkt->flags & CI_PKT_FLAG_RTQ_RETRANS) ||
+      ! (wo->waitable.state & CI_TCP_STATE_TCP_CONN) ||
+      OO_P_IS_NULL(wo->tcp.lat_hist[CI_TCP_LAT_HIST_TX]) ) {
+    pkt->tx_lat_frc = 0;
+    return;
+  }
+  ci_frc64(&now_frc);
+  if( now_frc > pkt->tx_lat_frc )
+    ci_tcp_lat_hist_record(ni, &wo->tcp, CI_TCP_LAT_HIST_TX,
+                           now_frc - pkt->tx_lat_frc);
+  pkt->tx_lat_frc = now_frc;
+}
+
+
 static void ci_netif_rx_pkt_complete_tcp(ci_netif* ni,
                                          struct ci_netif_poll_state* ps,
                                          ci_ip_pkt_fmt* pkt)
 {
+  if(CI_UNLIKELY( pkt->tx_lat_frc != 0 ))
+    ci_netif_tx_pkt_complete_lat_hist(ni, pkt);
+
 #if CI_CFG_TIMESTAMPING
   if( pkt->flags & (CI_PKT_FLAG_TX_TIMESTAMPED | CI_PKT_FLAG_INDIRECT) ) {
     /* This packet is destined for the timestamp_q. We need to check if our
@@ -1536,6 +1713,12 @@ static void ci_netif_rx_pkt_complete_tcp(ci_netif* ni,
       unsigned n_bufs = 0;
       ci_ip_pkt_fmt* pp;
 
+      /* The timestamp_q is not used by the sockets which report to the
+       * ring, see ci_tcp_rx_free_acked_bufs(). */
+      if( pkt->flags & CI_PKT_FLAG_TX_TIMESTAMPED &&
+          ci_netif_tx_ts_ring_put(ni, &ts->s, pkt) )
+        goto release;
+
       /* The socket may have been closed (and even reopened) by the time we
        * get this tx completion - that's the reason for the state checking
        * above. The following code, however, has no reliance at all on pkt, so
@@ -1555,6 +1738,7 @@ static void ci_netif_rx_pkt_complete_tcp(ci_netif* ni,
       }
     }
   }
+ release:
 #endif
   ci_netif_pkt_release_in_poll(ni, pkt, ps);
 }
@@ -1690,6 +1874,13 @@ static int ci_netif_poll_evq(ci_netif* ni, struct ci_netif_poll_state* ps,
       break;
 
 have_events:
+    /* Account for sends made without the lock before their completions.
+     * Those went by DMA, so there's no point attempting CTPIO until the
+     * TXQ has drained; the senders leave that to us as it needs the lock.
+     */
+    if( NI_OPTS(ni).tcp_send_nolock && ci_netif_tx_nolock_fold(ni, intf_i) )
+      ci_netif_ctpio_desist(ni, intf_i);
+
     /* This loop is implemented with a 1 packet lag on processing (i.e.
      * __handle_rx_pkt() is called for the packet from the previous loop
      * iteration just as the next packet is being picked up, due to a
@@ -1721,7 +1912,9 @@ have_events:
         else {
           handle_rx_scatter(ni, &s, pkt,
                             EF_EVENT_RX_BYTES(ev[i]) - evq->rx_prefix_len,
-                            ev[i].rx.flags);
+                            ev[i].rx.flags,
+                            evq->nic_type.arch == EF_VI_ARCH_AF_XDP ?
+                              pkt->pkt_start_off : 0);
         }
       }
 
@@ -1840,6 +2033,7 @@ have_events:
 
       else if( EF_EVENT_TYPE(ev[i]) == EF_EVENT_TYPE_OFLOW ) {
         LOG_E(CI_RLLOG(1, LPF "***** EVENT QUEUE OVERFLOW *****"));
+        handle_rx_batch(ni, ps);
         return 0;
       }
 
@@ -1856,7 +2050,9 @@ have_events:
 #ifndef NDEBUG
     {
       ef_vi* vi = CI_NETIF_TX_VI(ni, intf_i, ev[i].tx_timestamp.q_id);
-      if( vi->nic_type.arch != EF_VI_ARCH_AF_XDP ) {
+      /* A sender without the lock may post at any moment. */
+      if( vi->nic_type.arch != EF_VI_ARCH_AF_XDP &&
+          ! NI_OPTS(ni).tcp_send_nolock ) {
         ci_assert_equiv((ef_vi_transmit_fill_level(vi) == 0 &&
                         ni->state->nic[intf_i].dmaq.num == 0),
                         (ni->state->nic[intf_i].tx_dmaq_insert_seq ==
@@ -1866,6 +2062,7 @@ have_events:
 #endif
 
     __handle_rx_pkt(ni, ps, &s.rx_pkt);
+    handle_rx_batch(ni, ps);
 
     total_evs += n_evs;
   } while( total_evs < NI_OPTS(ni).evs_per_poll );
@@ -1896,8 +2093,7 @@ ci_inline int ci_netif_poll_intf(ci_netif* ni, int intf_i, int max_evs)
 #endif
 
   ci_assert(ci_netif_is_locked(ni));
-  ps.tx_pkt_free_list_insert = &ps.tx_pkt_free_list;
-  ps.tx_pkt_free_list_n = 0;
+  ci_netif_poll_state_init(ni, &ps);
 
   do {
     rc = ci_netif_poll_evq(ni, &ps, intf_i, 0);
@@ -1991,8 +2187,7 @@ int ci_netif_poll_intf_future(ci_netif* ni, int intf_i, ci_uint64 start_frc)
   CITP_STATS_NETIF_INC(ni, rx_future);
   CITP_STATS_NETIF_INC(ni, rx_evs);
 
-  ps.tx_pkt_free_list_insert = &ps.tx_pkt_free_list;
-  ps.tx_pkt_free_list_n = 0;
+  ci_netif_poll_state_init(ni, &ps);
 
   /* We expect the completion event within a microsecond or so. The timeout
    * of 10us is to avoid wedging the stack in the case of hardware
@@ -2146,7 +2341,23 @@ void ci_netif_loopback_pkts_send(ci_netif* ni)
 }
 
 
-int ci_netif_poll_n(ci_netif* netif, int max_evs)
+ci_inline int ci_netif_poll_claim_skip(ci_netif* ni, int intf_i,
+                                       int claim_intf_i)
+{
+  if( claim_intf_i < 0 ||
+      ! ci_netif_intf_claimed(ni, intf_i, claim_intf_i,
+                              IPTIMER_STATE(ni)->frc) )
+    return 0;
+  CITP_STATS_NETIF_INC(ni, poll_claim_skips);
+  return 1;
+}
+
+
+/* Poll the stack.  If [claim_intf_i] is a valid interface, the poll is on
+ * behalf of a thread spinning on it, and skips interfaces claimed by other
+ * spinning threads.  See EF_POLL_CLAIM_USEC.
+ */
+static int __ci_netif_poll_n(ci_netif* netif, int max_evs, int claim_intf_i)
 {
   int offset, intf_i, intf_max, n_evs_handled = 0;
 
@@ -2182,6 +2393,11 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
   ci_assert(netif->state->in_poll == 0);
   ++netif->state->in_poll;
 
+  /* AF_XDP needs a system call to start transmit.  Make at most one per
+   * interface for everything sent during this poll. */
+  OO_STACK_FOR_EACH_INTF_I(netif, intf_i)
+    ef_vi_transmit_kick_defer(ci_netif_vi(netif, intf_i));
+
   /* Poll all interfaces in a cycle, then set the next interface we start with
    * to be the next interface in the cycle. For example, suppose we have three
    * interfaces (0, 1, 2), then polling a bond of these interfaces will result
@@ -2193,13 +2409,22 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
    * ... */
   offset = netif->state->poll_start_intf;
   intf_max = oo_stack_intf_max(netif);
+  if( claim_intf_i >= 0 )
+    netif->state->nic[claim_intf_i].poll_claim_frc =
+      IPTIMER_STATE(netif)->frc;
   for( intf_i = offset; intf_i < intf_max; intf_i++ ) {
-    int n = ci_netif_poll_intf(netif, intf_i, max_evs);
+    int n;
+    if( ci_netif_poll_claim_skip(netif, intf_i, claim_intf_i) )
+      continue;
+    n = ci_netif_poll_intf(netif, intf_i, max_evs);
     ci_assert(n >= 0);
     n_evs_handled += n;
   }
   for( intf_i = 0; intf_i < offset; intf_i++ ) {
-    int n = ci_netif_poll_intf(netif, intf_i, max_evs);
+    int n;
+    if( ci_netif_poll_claim_skip(netif, intf_i, claim_intf_i) )
+      continue;
+    n = ci_netif_poll_intf(netif, intf_i, max_evs);
     ci_assert(n >= 0);
     n_evs_handled += n;
   }
@@ -2256,11 +2481,32 @@ int ci_netif_poll_n(ci_netif* netif, int max_evs)
     if( ci_netif_mem_pressure_try_exit(netif) )
       CITP_STATS_NETIF_INC(netif, memory_pressure_exit_poll);
 
+  OO_STACK_FOR_EACH_INTF_I(netif, intf_i)
+    ef_vi_transmit_kick_flush(ci_netif_vi(netif, intf_i));
+
   netif->state->poll_work_outstanding = 0;
 
   /* returns the number of events handled */
   return n_evs_handled;
 }
 
+
+int ci_netif_poll_n(ci_netif* netif, int max_evs)
+{
+  return __ci_netif_poll_n(netif, max_evs, -1);
+}
+
+
+/* Poll the stack for a thread spinning on a socket which receives on
+ * [intf_i], leaving interfaces claimed by other spinning threads to them.
+ * The caller holds the stack lock, as for any other poll.
+ */
+int ci_netif_poll_claimed(ci_netif* netif, int intf_i)
+{
+  if( ! ci_netif_poll_claims_on(netif, intf_i) )
+    intf_i = -1;
+  return __ci_netif_poll_n(netif, NI_OPTS(netif).evs_per_poll, intf_i);
+}
+
 #endif /* OO_DO_STACK_POLL */
 /*! \cidoxg_end */
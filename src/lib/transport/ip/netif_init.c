@@ -151,6 +151,8 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
             __oo_usec_to_cycles64(cpu_khz, NI_OPTS(ni).buzz_usec);
   nis->timer_prime_cycles =
             __oo_usec_to_cycles64(cpu_khz, NI_OPTS(ni).timer_prime_usec);
+  nis->poll_claim_cycles =
+            __oo_usec_to_cycles64(cpu_khz, NI_OPTS(ni).poll_claim_usec);
 #if CI_CFG_INJECT_PACKETS
   nis->kernel_packets_cycles =
             __oo_usec_to_cycles64(cpu_khz,
@@ -209,6 +211,8 @@ void ci_netif_state_init(ci_netif* ni, int cpu_khz, const char* name)
 
   for( i = 0; i < nis->seq_table_entries_n; ++i )
     assert_zero(ni->seq_table[i].route_count);
+  for( i = 0; i < nis->timewait_table_entries_n; ++i )
+    assert_zero(ni->timewait_table[i].route_count);
 
   nis->packet_alloc_numa_nodes = 0;
   nis->sock_alloc_numa_nodes = 0;
@@ -613,9 +617,142 @@ void ci_netif_config_opts_rangecheck(ci_netif_config_opts* opts)
 }
 
 
+/* Compare option by option rather than with memcmp(), as the padding
+ * around bitfields is not guaranteed to match. */
+int ci_netif_config_opts_equal(const ci_netif_config_opts* a,
+                               const ci_netif_config_opts* b)
+{
+#undef  CI_CFG_OPTFILE_VERSION
+#undef  CI_CFG_OPTGROUP
+#undef  CI_CFG_OPT
+#undef  CI_CFG_STR_OPT
+
+#define CI_CFG_OPT(env, name, type, doc, bits, group, default, minimum,   \
+                   maximum, presentation)                                 \
+  if( a->name != b->name )                                                \
+    return 0;
+
+#define CI_CFG_STR_OPT(env, name, type, doc, bits, group, default,        \
+                       minimum, maximum, presentation)                    \
+  if( strncmp(a->name, b->name, sizeof(a->name)) != 0 )                   \
+    return 0;
+
+# include <ci/internal/opts_netif_def.h>
+
+  return 1;
+}
+
+
 
 #ifndef __KERNEL__
 
+/* Table of the EF_ variables in the environment, filled by a single walk
+ * of environ so that each option lookup is a hash probe rather than a
+ * scan of the whole environment.  Open addressing; a table that fills up
+ * is abandoned in favour of plain getenv().
+ *
+ * The entries are copied, as the application may change or free the
+ * strings in environ once we have looked at them. */
+#define CI_CFG_ENV_TABLE_SIZE  512
+
+static struct {
+  const char* entry;     /* "EF_NAME=value", in ci_cfg_env_buf */
+  unsigned    hash;
+} ci_cfg_env_table[CI_CFG_ENV_TABLE_SIZE];
+static char* ci_cfg_env_buf;
+static int ci_cfg_env_state;  /* 0 = not scanned, 1 = scanned, -1 = full */
+
+extern char** environ;
+
+static unsigned ci_cfg_env_hash(const char* name, int len)
+{
+  unsigned h = 2166136261u;
+  int i;
+  for( i = 0; i < len; ++i )
+    h = (h ^ (unsigned char) name[i]) * 16777619u;
+  return h;
+}
+
+
+static int ci_cfg_env_is_option(const char* e)
+{
+  return strncmp(e, "EF_", 3) == 0 && strchr(e, '=') != NULL;
+}
+
+
+void ci_cfg_env_scan(void)
+{
+  char** env;
+  char* buf;
+  size_t bytes = 0;
+  int n = 0;
+
+  memset(ci_cfg_env_table, 0, sizeof(ci_cfg_env_table));
+  free(ci_cfg_env_buf);
+  ci_cfg_env_buf = NULL;
+  ci_cfg_env_state = -1;
+
+  for( env = environ; env != NULL && *env != NULL; ++env )
+    if( ci_cfg_env_is_option(*env) ) {
+      if( ++n > CI_CFG_ENV_TABLE_SIZE / 2 )
+        return;
+      bytes += strlen(*env) + 1;
+    }
+  if( n != 0 && (ci_cfg_env_buf = malloc(bytes)) == NULL )
+    return;
+  ci_cfg_env_state = 1;
+
+  buf = ci_cfg_env_buf;
+  for( env = environ; env != NULL && *env != NULL; ++env ) {
+    const char* e = *env;
+    int len;
+    unsigned h, i;
+
+    if( ! ci_cfg_env_is_option(e) )
+      continue;
+    len = strchr(e, '=') - e;
+    h = ci_cfg_env_hash(e, len);
+    for( i = h; ; ++i ) {
+      const char* t = ci_cfg_env_table[i % CI_CFG_ENV_TABLE_SIZE].entry;
+      if( t == NULL ) {
+        strcpy(buf, e);
+        ci_cfg_env_table[i % CI_CFG_ENV_TABLE_SIZE].entry = buf;
+        ci_cfg_env_table[i % CI_CFG_ENV_TABLE_SIZE].hash = h;
+        buf += strlen(buf) + 1;
+        break;
+      }
+      /* getenv() returns the first of duplicated names, so do we. */
+      if( ci_cfg_env_table[i % CI_CFG_ENV_TABLE_SIZE].hash == h &&
+          strncmp(t, e, len + 1) == 0 )
+        break;
+    }
+  }
+}
+
+
+const char* ci_cfg_getenv(const char* name)
+{
+  int len;
+  unsigned h, i;
+
+  if( ci_cfg_env_state == 0 )
+    ci_cfg_env_scan();
+  if( ci_cfg_env_state < 0 || strncmp(name, "EF_", 3) != 0 )
+    return getenv(name);
+
+  len = strlen(name);
+  h = ci_cfg_env_hash(name, len);
+  for( i = h; ; ++i ) {
+    const char* t = ci_cfg_env_table[i % CI_CFG_ENV_TABLE_SIZE].entry;
+    if( t == NULL )
+      return NULL;
+    if( ci_cfg_env_table[i % CI_CFG_ENV_TABLE_SIZE].hash == h &&
+        strncmp(t, name, len) == 0 && t[len] == '=' )
+      return t + len + 1;
+  }
+}
+
+
 struct string_to_bitmask {
   int               stb_index;
   const char*const  stb_str;
@@ -687,7 +824,7 @@ static void ci_netif_config_opts_getenv_ef_log(ci_netif_config_opts* opts)
     {EF_LOG_USAGE_WARNINGS, "usage_warnings"},
   };
 
-  convert_string_to_bitmask(getenv("EF_LOG"), options, EF_LOG_MAX,
+  convert_string_to_bitmask(ci_cfg_getenv("EF_LOG"), options, EF_LOG_MAX,
                             &opts->log_category);
 }
 
@@ -717,7 +854,7 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
    * others...
    */
 
-  if( (s = getenv("EF_POLL_USEC")) ) {
+  if( (s = ci_cfg_getenv("EF_POLL_USEC")) ) {
     opts->spin_usec = atoi(s);
     if( opts->spin_usec != 0 ) {
       /* Don't buzz for too long by default! */
@@ -730,17 +867,17 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
        */
     }
   }
-  if( (s = getenv("EF_SPIN_USEC")) ) {
+  if( (s = ci_cfg_getenv("EF_SPIN_USEC")) ) {
     opts->spin_usec = atoi(s);
     /* Disable EF_INT_DRIVEN by default when spinning. */
     if( opts->spin_usec != 0 )
       opts->int_driven = 0;
   }
 
-  if( (s = getenv("EF_INT_DRIVEN")) )
+  if( (s = ci_cfg_getenv("EF_INT_DRIVEN")) )
     opts->int_driven = atoi(s);
 #if CI_CFG_WANT_BPF_NATIVE
-  if( (s = getenv("EF_POLL_IN_KERNEL")) )
+  if( (s = ci_cfg_getenv("EF_POLL_IN_KERNEL")) )
     opts->poll_in_kernel = atoi(s);
   static const char* const xdp_mode_opts[] = { "disabled", "compatible", 0 };
   opts->xdp_mode = parse_enum(opts, "EF_XDP_MODE", xdp_mode_opts, "disabled");
@@ -752,16 +889,16 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   if( opts->int_driven )
     /* Disable count-down timer when interrupt driven. */
     opts->timer_usec = 0;
-  if( (s = getenv("EF_HELPER_USEC")) ) {
+  if( (s = ci_cfg_getenv("EF_HELPER_USEC")) ) {
     opts->timer_usec = atoi(s);
     if( opts->timer_usec != 0 )
       /* Set the prime interval to half the timeout by default. */
       opts->timer_prime_usec = opts->timer_usec / 2;
   }
-  if( (s = getenv("EF_HELPER_PRIME_USEC")) )
+  if( (s = ci_cfg_getenv("EF_HELPER_PRIME_USEC")) )
     opts->timer_prime_usec = atoi(s);
 
-  if( (s = getenv("EF_BUZZ_USEC")) ) {
+  if( (s = ci_cfg_getenv("EF_BUZZ_USEC")) ) {
     opts->buzz_usec = atoi(s);
   }
 
@@ -770,27 +907,27 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
    */
 
 #if CI_CFG_POISON_BUFS
-  if( (s = getenv("EF_POISON")) )       opts->poison_rx_buf = atoi(s);
+  if( (s = ci_cfg_getenv("EF_POISON")) )       opts->poison_rx_buf = atoi(s);
 #endif
 #if CI_CFG_RANDOM_DROP
-  if( (s = getenv("EF_RX_DROP_RATE")) ) {
+  if( (s = ci_cfg_getenv("EF_RX_DROP_RATE")) ) {
     int r = atoi(s);
     if( r )  opts->rx_drop_rate = RAND_MAX / r;
   }
 #endif
-  if( (s = getenv("EF_URG_RFC")) )
+  if( (s = ci_cfg_getenv("EF_URG_RFC")) )
     opts->urg_rfc = atoi(s);
 
   static const char* const urgent_opts[] = { "allow", "ignore", 0 };
   opts->urg_mode = parse_enum(opts, "EF_TCP_URG_MODE", urgent_opts, "ignore");
 
-  if( (s = getenv("EF_MCAST_RECV")) )
+  if( (s = ci_cfg_getenv("EF_MCAST_RECV")) )
     opts->mcast_recv = atoi(s);
-  if( (s = getenv("EF_FORCE_SEND_MULTICAST")) )
+  if( (s = ci_cfg_getenv("EF_FORCE_SEND_MULTICAST")) )
     opts->force_send_multicast = atoi(s);
-  if( (s = getenv("EF_MCAST_SEND")) )
+  if( (s = ci_cfg_getenv("EF_MCAST_SEND")) )
     opts->mcast_send = atoi(s);
-  else if( (s = getenv("EF_MULTICAST_LOOP_OFF")) ) {
+  else if( (s = ci_cfg_getenv("EF_MULTICAST_LOOP_OFF")) ) {
     opts->multicast_loop_off = atoi(s);
     switch( opts->multicast_loop_off ) {
       case 0:
@@ -801,28 +938,30 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
         break;
     }
   }
-  if( (s = getenv("EF_MCAST_RECV_HW_LOOP")) )
+  if( (s = ci_cfg_getenv("EF_MCAST_RECV_HW_LOOP")) )
     opts->mcast_recv_hw_loop = atoi(s);
-  if( (s = getenv("EF_EVS_PER_POLL")) )
+  if( (s = ci_cfg_getenv("EF_EVS_PER_POLL")) )
     opts->evs_per_poll = atoi(s);
 #if CI_CFG_WANT_BPF_NATIVE
   else if( opts->poll_in_kernel )
     opts->evs_per_poll = 192;     /* See EF_EVS_PER_POLL documentation */
 #endif
-  if( (s = getenv("EF_TCP_TCONST_MSL")) )
+  if( (s = ci_cfg_getenv("EF_RX_BATCH")) )
+    opts->rx_batch = atoi(s);
+  if( (s = ci_cfg_getenv("EF_TCP_TCONST_MSL")) )
     opts->msl_seconds = atoi(s);
-  if( (s = getenv("EF_TCP_FIN_TIMEOUT")) )
+  if( (s = ci_cfg_getenv("EF_TCP_FIN_TIMEOUT")) )
     opts->fin_timeout = atoi(s);
-  if( (s = getenv("EF_TCP_ADV_WIN_SCALE_MAX")) )
+  if( (s = ci_cfg_getenv("EF_TCP_ADV_WIN_SCALE_MAX")) )
     opts->tcp_adv_win_scale_max = atoi(s);
 
-  if( (s = getenv("EF_TCP_SYN_OPTS")) ) {
+  if( (s = ci_cfg_getenv("EF_TCP_SYN_OPTS")) ) {
     unsigned v;
     ci_verify(sscanf(s, "%x", &v) == 1);
     opts->syn_opts = citp_syn_opts = v;
   }
 
-  if ( (s = getenv("EF_MAX_PACKETS")) ) {
+  if ( (s = ci_cfg_getenv("EF_MAX_PACKETS")) ) {
     int max_packets_rq = atoi(s);
     opts->max_packets = (max_packets_rq + PKTS_PER_SET - 1) &
                                                 ~(PKTS_PER_SET - 1);
@@ -832,36 +971,36 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->max_rx_packets = opts->max_packets * 3 / 4;
     opts->max_tx_packets = opts->max_packets * 3 / 4;
   }
-  if ( (s = getenv("EF_MAX_RX_PACKETS")) ) {
+  if ( (s = ci_cfg_getenv("EF_MAX_RX_PACKETS")) ) {
     opts->max_rx_packets = atoi(s);
     if( opts->max_rx_packets > opts->max_packets )
       opts->max_rx_packets = opts->max_packets;
   }
-  if ( (s = getenv("EF_MAX_TX_PACKETS")) ) {
+  if ( (s = ci_cfg_getenv("EF_MAX_TX_PACKETS")) ) {
     opts->max_tx_packets = atoi(s);
     if( opts->max_tx_packets > opts->max_packets )
       opts->max_tx_packets = opts->max_packets;
   }
-  if ( (s = getenv("EF_PREALLOC_PACKETS")) )
+  if ( (s = ci_cfg_getenv("EF_PREALLOC_PACKETS")) )
     opts->prealloc_packets = atoi(s);
-  if ( (s = getenv("EF_RXQ_MIN")) )
+  if ( (s = ci_cfg_getenv("EF_RXQ_MIN")) )
     opts->rxq_min = atoi(s);
-  if ( (s = getenv("EF_MIN_FREE_PACKETS")) )
+  if ( (s = ci_cfg_getenv("EF_MIN_FREE_PACKETS")) )
     opts->min_free_packets = atoi(s);
-  if( (s = getenv("EF_PREFAULT_PACKETS")) )
+  if( (s = ci_cfg_getenv("EF_PREFAULT_PACKETS")) )
     opts->prefault_packets = atoi(s);
-  if ( (s = getenv("EF_MAX_ENDPOINTS")) )
+  if ( (s = ci_cfg_getenv("EF_MAX_ENDPOINTS")) )
     opts->max_ep_bufs = atoi(s);
-  if ( (s = getenv("EF_ENDPOINT_PACKET_RESERVE")) )
+  if ( (s = ci_cfg_getenv("EF_ENDPOINT_PACKET_RESERVE")) )
     opts->endpoint_packet_reserve = atoi(s);
-  if ( (s = getenv("EF_DEFER_ARP_MAX")) )
+  if ( (s = ci_cfg_getenv("EF_DEFER_ARP_MAX")) )
     opts->defer_arp_pkts = atoi(s);
-  if ( (s = getenv("EF_DEFER_ARP_TIMEOUT")) )
+  if ( (s = ci_cfg_getenv("EF_DEFER_ARP_TIMEOUT")) )
     opts->defer_arp_timeout = atoi(s);
-  if ( (s = getenv("EF_SHARE_WITH")) )
+  if ( (s = ci_cfg_getenv("EF_SHARE_WITH")) )
     opts->share_with = atoi(s);
 #if CI_CFG_PKTS_AS_HUGE_PAGES
-  if( (s = getenv("EF_USE_HUGE_PAGES")) )
+  if( (s = ci_cfg_getenv("EF_USE_HUGE_PAGES")) )
     opts->huge_pages = atoi(s);
   if( opts->huge_pages != 0 && opts->share_with != 0 ) {
     CONFIG_LOG(opts, CONFIG_WARNINGS, "Turning huge pages off because the "
@@ -869,40 +1008,40 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->huge_pages = 0;
   }
 #endif
-  if ( (s = getenv("EF_COMPOUND_PAGES_MODE")) )
+  if ( (s = ci_cfg_getenv("EF_COMPOUND_PAGES_MODE")) )
     opts->compound_pages = atoi(s);
-  if ( (s = getenv("EF_RXQ_SIZE")) )
+  if ( (s = ci_cfg_getenv("EF_RXQ_SIZE")) )
     opts->rxq_size = atoi(s);
-  if ( (s = getenv("EF_RXQ_LIMIT")) )
+  if ( (s = ci_cfg_getenv("EF_RXQ_LIMIT")) )
     opts->rxq_limit = atoi(s);
-  if ( (s = getenv("EF_SHARED_RXQ_NUM")) )
+  if ( (s = ci_cfg_getenv("EF_SHARED_RXQ_NUM")) )
     opts->shared_rxq_num = atoi(s);
-  if ( (s = getenv("EF_TXQ_SIZE")) )
+  if ( (s = ci_cfg_getenv("EF_TXQ_SIZE")) )
     opts->txq_size = atoi(s);
-  if ( (s = getenv("EF_SEND_POLL_THRESH")) )
+  if ( (s = ci_cfg_getenv("EF_SEND_POLL_THRESH")) )
     opts->send_poll_thresh = atoi(s);
-  if ( (s = getenv("EF_SEND_POLL_MAX_EVS")) )
+  if ( (s = ci_cfg_getenv("EF_SEND_POLL_MAX_EVS")) )
     opts->send_poll_max_events = atoi(s);
-  if ( (s = getenv("EF_DEFER_WORK_LIMIT")) )
+  if ( (s = ci_cfg_getenv("EF_DEFER_WORK_LIMIT")) )
     opts->defer_work_limit = atoi(s);
-  if( (s = getenv("EF_UDP_SEND_UNLOCK_THRESH")) )
+  if( (s = ci_cfg_getenv("EF_UDP_SEND_UNLOCK_THRESH")) )
     opts->udp_send_unlock_thresh = atoi(s);
-  if( (s = getenv("EF_UDP_PORT_HANDOVER_MIN")) )
+  if( (s = ci_cfg_getenv("EF_UDP_PORT_HANDOVER_MIN")) )
     opts->udp_port_handover_min = atoi(s);
-  if( (s = getenv("EF_UDP_PORT_HANDOVER_MAX")) )
+  if( (s = ci_cfg_getenv("EF_UDP_PORT_HANDOVER_MAX")) )
     opts->udp_port_handover_max = atoi(s);
-  if( (s = getenv("EF_UDP_PORT_HANDOVER2_MIN")) )
+  if( (s = ci_cfg_getenv("EF_UDP_PORT_HANDOVER2_MIN")) )
     opts->udp_port_handover2_min = atoi(s);
-  if( (s = getenv("EF_UDP_PORT_HANDOVER2_MAX")) )
+  if( (s = ci_cfg_getenv("EF_UDP_PORT_HANDOVER2_MAX")) )
     opts->udp_port_handover2_max = atoi(s);
-  if( (s = getenv("EF_UDP_PORT_HANDOVER3_MIN")) )
+  if( (s = ci_cfg_getenv("EF_UDP_PORT_HANDOVER3_MIN")) )
     opts->udp_port_handover3_min = atoi(s);
-  if( (s = getenv("EF_UDP_PORT_HANDOVER3_MAX")) )
+  if( (s = ci_cfg_getenv("EF_UDP_PORT_HANDOVER3_MAX")) )
     opts->udp_port_handover3_max = atoi(s);
-  if ( (s = getenv("EF_DELACK_THRESH")) )
+  if ( (s = ci_cfg_getenv("EF_DELACK_THRESH")) )
     opts->delack_thresh = atoi(s);
 #if CI_CFG_DYNAMIC_ACK_RATE
-  if ( (s = getenv("EF_DYNAMIC_ACK_THRESH")) )
+  if ( (s = ci_cfg_getenv("EF_DYNAMIC_ACK_THRESH")) )
     opts->dynack_thresh = atoi(s);
   /* Always want this value to be >= delack_thresh to simplify code
    * that uses it 
@@ -910,12 +1049,12 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   opts->dynack_thresh = CI_MAX(opts->dynack_thresh, opts->delack_thresh);
 #endif
 
-  if ( (s = getenv("EF_INVALID_ACK_RATELIMIT")) )
+  if ( (s = ci_cfg_getenv("EF_INVALID_ACK_RATELIMIT")) )
     opts->oow_ack_ratelimit = atoi(s);
 #if CI_CFG_FD_CACHING
-  if ( (s = getenv("EF_SOCKET_CACHE_MAX")) )
+  if ( (s = ci_cfg_getenv("EF_SOCKET_CACHE_MAX")) )
     opts->sock_cache_max = atoi(s);
-  if ( (s = getenv("EF_PER_SOCKET_CACHE_MAX")) )
+  if ( (s = ci_cfg_getenv("EF_PER_SOCKET_CACHE_MAX")) )
     opts->per_sock_cache_max = atoi(s);
   if( opts->per_sock_cache_max < 0 )
     opts->per_sock_cache_max = opts->sock_cache_max;
@@ -923,75 +1062,75 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
 
 #if CI_CFG_PORT_STRIPING
   /* configuration opttions for striping */
-  if ( (s = getenv("EF_STRIPE_NETMASK")) ) {
+  if ( (s = ci_cfg_getenv("EF_STRIPE_NETMASK")) ) {
     int a1, a2, a3, a4;
     sscanf(s, "%d.%d.%d.%d", &a1, &a2, &a3, &a4);
     opts->stripe_netmask_be32 = (a1 << 24) | (a2 << 16) | (a3 << 8) | a4;
     opts->stripe_netmask_be32 = CI_BSWAP_BE32(opts->stripe_netmask_be32);
   }
-  if ( (s = getenv("EF_STRIPE_DUPACK_THRESH")) ) {
+  if ( (s = ci_cfg_getenv("EF_STRIPE_DUPACK_THRESH")) ) {
     opts->stripe_dupack_threshold = atoi(s);
     opts->stripe_dupack_threshold =
           CI_MAX(opts->stripe_dupack_threshold, CI_CFG_TCP_DUPACK_THRESH_BASE);
     opts->stripe_dupack_threshold  =
           CI_MIN(opts->stripe_dupack_threshold, CI_CFG_TCP_DUPACK_THRESH_MAX);
   }
-  if( (s = getenv("EF_STRIPE_TCP_OPT")) )
+  if( (s = ci_cfg_getenv("EF_STRIPE_TCP_OPT")) )
     opts->stripe_tcp_opt = atoi(s);
 #endif
-  if( (s = getenv("EF_TX_PUSH")) )
+  if( (s = ci_cfg_getenv("EF_TX_PUSH")) )
     opts->tx_push = atoi(s);
-  if( opts->tx_push && (s = getenv("EF_TX_PUSH_THRESHOLD")) )
+  if( opts->tx_push && (s = ci_cfg_getenv("EF_TX_PUSH_THRESHOLD")) )
     opts->tx_push_thresh = atoi(s);
-  if( (s = getenv("EF_PACKET_BUFFER_MODE")) )
+  if( (s = ci_cfg_getenv("EF_PACKET_BUFFER_MODE")) )
     opts->packet_buffer_mode = atoi(s);
-  if( (s = getenv("EF_TCP_RST_DELAYED_CONN")) )
+  if( (s = ci_cfg_getenv("EF_TCP_RST_DELAYED_CONN")) )
     opts->rst_delayed_conn = atoi(s);
-  if( (s = getenv("EF_TCP_SNDBUF_MODE")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SNDBUF_MODE")) )
     opts->tcp_sndbuf_mode = atoi(s);
-  if( (s = getenv("EF_TCP_COMBINE_SENDS_MODE")) )
+  if( (s = ci_cfg_getenv("EF_TCP_COMBINE_SENDS_MODE")) )
     opts->tcp_combine_sends_mode = atoi(s);
-  if( (s = getenv("EF_TCP_SEND_NONBLOCK_NO_PACKETS_MODE")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SEND_NONBLOCK_NO_PACKETS_MODE")) )
     opts->tcp_nonblock_no_pkts_mode = atoi(s);
-  if( (s = getenv("EF_TCP_RCVBUF_STRICT")) )
+  if( (s = ci_cfg_getenv("EF_TCP_RCVBUF_STRICT")) )
     opts->tcp_rcvbuf_strict = atoi(s);
-  if( (s = getenv("EF_TCP_RCVBUF_MODE")) )
+  if( (s = ci_cfg_getenv("EF_TCP_RCVBUF_MODE")) )
     opts->tcp_rcvbuf_mode = atoi(s);
-  if( (s = getenv("EF_POLL_ON_DEMAND")) )
+  if( (s = ci_cfg_getenv("EF_POLL_ON_DEMAND")) )
     opts->poll_on_demand = atoi(s);
-  if( (s = getenv("EF_INT_REPRIME")) )
+  if( (s = ci_cfg_getenv("EF_INT_REPRIME")) )
     opts->int_reprime = atoi(s);
-  if( (s = getenv("EF_NONAGLE_INFLIGHT_MAX")) )
+  if( (s = ci_cfg_getenv("EF_NONAGLE_INFLIGHT_MAX")) )
     opts->nonagle_inflight_max = atoi(s);
-  if( (s = getenv("EF_FORCE_TCP_NODELAY")) )
+  if( (s = ci_cfg_getenv("EF_FORCE_TCP_NODELAY")) )
     opts->tcp_force_nodelay = atoi(s);
-  if( (s = getenv("EF_IRQ_CORE")) )
+  if( (s = ci_cfg_getenv("EF_IRQ_CORE")) )
     opts->irq_core = atoi(s);
-  if( (s = getenv("EF_IRQ_CHANNEL")) )
+  if( (s = ci_cfg_getenv("EF_IRQ_CHANNEL")) )
     opts->irq_channel = atoi(s);
-  if( (s = getenv("EF_TCP_LISTEN_HANDOVER")) )
+  if( (s = ci_cfg_getenv("EF_TCP_LISTEN_HANDOVER")) )
     opts->tcp_listen_handover = atoi(s);
-  if( (s = getenv("EF_TCP_CONNECT_HANDOVER")) )
+  if( (s = ci_cfg_getenv("EF_TCP_CONNECT_HANDOVER")) )
     opts->tcp_connect_handover = atoi(s);
-  if( (s = getenv("EF_UDP_CONNECT_HANDOVER")) )
+  if( (s = ci_cfg_getenv("EF_UDP_CONNECT_HANDOVER")) )
     opts->udp_connect_handover = atoi(s);
-  if( (s = getenv("EF_UDP_SEND_UNLOCKED")) )
+  if( (s = ci_cfg_getenv("EF_UDP_SEND_UNLOCKED")) )
     opts->udp_send_unlocked = atoi(s);
-  if( (s = getenv("EF_UDP_SEND_NONBLOCK_NO_PACKETS_MODE")) )
+  if( (s = ci_cfg_getenv("EF_UDP_SEND_NONBLOCK_NO_PACKETS_MODE")) )
     opts->udp_nonblock_no_pkts_mode = atoi(s);
-  if( (s = getenv("EF_UNCONFINE_SYN")) )
+  if( (s = ci_cfg_getenv("EF_UNCONFINE_SYN")) )
     opts->unconfine_syn = atoi(s) != 0;
-  if( (s = getenv("EF_BINDTODEVICE_HANDOVER")) )
+  if( (s = ci_cfg_getenv("EF_BINDTODEVICE_HANDOVER")) )
     opts->bindtodevice_handover = atoi(s) != 0;
-  if( (s = getenv("EF_MCAST_JOIN_BINDTODEVICE")) )
+  if( (s = ci_cfg_getenv("EF_MCAST_JOIN_BINDTODEVICE")) )
     opts->mcast_join_bindtodevice = atoi(s) != 0;
-  if( (s = getenv("EF_MCAST_JOIN_HANDOVER")) )
+  if( (s = ci_cfg_getenv("EF_MCAST_JOIN_HANDOVER")) )
     opts->mcast_join_handover = atoi(s);
 
 #if CI_CFG_ENDPOINT_MOVE
-  if( (s = getenv("EF_TCP_SERVER_LOOPBACK")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SERVER_LOOPBACK")) )
     opts->tcp_server_loopback = atoi(s);
-  if( (s = getenv("EF_TCP_CLIENT_LOOPBACK")) )
+  if( (s = ci_cfg_getenv("EF_TCP_CLIENT_LOOPBACK")) )
     opts->tcp_client_loopback = atoi(s);
   /* Forbid impossible combination of loopback options */
   if( opts->tcp_server_loopback == CITP_TCP_LOOPBACK_OFF &&
@@ -999,52 +1138,52 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->tcp_client_loopback = CITP_TCP_LOOPBACK_OFF;
 #endif
 
-  if( (s = getenv("EF_TCP_RX_CHECKS")) ) {
+  if( (s = ci_cfg_getenv("EF_TCP_RX_CHECKS")) ) {
     unsigned v;
     ci_verify(sscanf(s, "%x", &v) == 1);
     opts->tcp_rx_checks = v;
-    if( (s = getenv("EF_TCP_RX_LOG_FLAGS")) ) {
+    if( (s = ci_cfg_getenv("EF_TCP_RX_LOG_FLAGS")) ) {
       ci_verify(sscanf(s, "%x", &v) == 1);
       opts->tcp_rx_log_flags = v;
     }
   }
 
-  if( (s = getenv("EF_ACCEPTQ_MIN_BACKLOG")) )
+  if( (s = ci_cfg_getenv("EF_ACCEPTQ_MIN_BACKLOG")) )
     opts->acceptq_min_backlog = atoi(s);
-  if( (s = getenv("EF_ACCEPTQ_MAX_BACKLOG")) )
+  if( (s = ci_cfg_getenv("EF_ACCEPTQ_MAX_BACKLOG")) )
     opts->acceptq_max_backlog = atoi(s);
 
-  if ( (s = getenv("EF_TCP_SNDBUF")) )
+  if ( (s = ci_cfg_getenv("EF_TCP_SNDBUF")) )
     opts->tcp_sndbuf_user = atoi(s);
-  if ( (s = getenv("EF_TCP_RCVBUF")) )
+  if ( (s = ci_cfg_getenv("EF_TCP_RCVBUF")) )
     opts->tcp_rcvbuf_user = atoi(s);
-  if ( (s = getenv("EF_UDP_SNDBUF")) )
+  if ( (s = ci_cfg_getenv("EF_UDP_SNDBUF")) )
     opts->udp_sndbuf_user = atoi(s);
-  if ( (s = getenv("EF_UDP_RCVBUF")) )
+  if ( (s = ci_cfg_getenv("EF_UDP_RCVBUF")) )
     opts->udp_rcvbuf_user = atoi(s);
 
-  if( (s = getenv("EF_TCP_SNDBUF_ESTABLISHED_DEFAULT")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SNDBUF_ESTABLISHED_DEFAULT")) )
     opts->tcp_sndbuf_est_def = atoi(s);
-  if( (s = getenv("EF_TCP_RCVBUF_ESTABLISHED_DEFAULT")) )
+  if( (s = ci_cfg_getenv("EF_TCP_RCVBUF_ESTABLISHED_DEFAULT")) )
     opts->tcp_rcvbuf_est_def = atoi(s);
 
-  if ( (s = getenv("EF_RETRANSMIT_THRESHOLD_SYNACK")) )
+  if ( (s = ci_cfg_getenv("EF_RETRANSMIT_THRESHOLD_SYNACK")) )
     opts->retransmit_threshold_synack = atoi(s);
 
-  if ( (s = getenv("EF_RETRANSMIT_THRESHOLD_SYN")) )
+  if ( (s = ci_cfg_getenv("EF_RETRANSMIT_THRESHOLD_SYN")) )
     opts->retransmit_threshold_syn = atoi(s);
 
-  if ( (s = getenv("EF_RETRANSMIT_THRESHOLD")) )
+  if ( (s = ci_cfg_getenv("EF_RETRANSMIT_THRESHOLD")) )
     opts->retransmit_threshold = atoi(s);
 
-  if ( (s = getenv("EF_TCP_BACKLOG_MAX")) ) {
+  if ( (s = ci_cfg_getenv("EF_TCP_BACKLOG_MAX")) ) {
     opts->tcp_backlog_max = atoi(s);
-    if ( getenv("EF_TCP_SYNRECV_MAX") == NULL ) {
+    if ( ci_cfg_getenv("EF_TCP_SYNRECV_MAX") == NULL ) {
       opts->tcp_synrecv_max = opts->tcp_backlog_max *
                               CI_CFG_ASSUME_LISTEN_SOCKS;
     }
   }
-  if ( (s = getenv("EF_TCP_SYNRECV_MAX")) ) {
+  if ( (s = ci_cfg_getenv("EF_TCP_SYNRECV_MAX")) ) {
     opts->tcp_synrecv_max = atoi(s);
   }
   /* Number of aux buffers is tcp_synrecv_max * 2.
@@ -1052,7 +1191,7 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
    * tcp_synrecv_max * 2 / 7.
    * And we need some space for real endpoints. */
   if( opts->tcp_synrecv_max * 4 > opts->max_ep_bufs * 7 ) {
-    if( getenv("EF_TCP_SYNRECV_MAX") == NULL && getenv("EF_MAX_ENDPOINTS") == NULL && getenv("EF_TCP_BACKLOG_MAX") == NULL ) {
+    if( ci_cfg_getenv("EF_TCP_SYNRECV_MAX") == NULL && ci_cfg_getenv("EF_MAX_ENDPOINTS") == NULL && ci_cfg_getenv("EF_TCP_BACKLOG_MAX") == NULL ) {
       /* None have been manually set so warn at lower
        * config warning level. */
       CONFIG_LOG(opts, MORE_CONFIG_WARNINGS, "%s: EF_TCP_SYNRECV_MAX=%d and "
@@ -1087,7 +1226,7 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
                 opts->tcp_synrecv_max * 2 > opts->max_ep_bufs * 7 ?
                 "ERROR" : "WARNING",
                 opts->tcp_synrecv_max, opts->max_ep_bufs);
-      if( getenv("EF_TCP_SYNRECV_MAX") == NULL ) {
+      if( ci_cfg_getenv("EF_TCP_SYNRECV_MAX") == NULL ) {
         CONFIG_LOG(opts, CONFIG_WARNINGS, "EF_TCP_SYNRECV_MAX is set to %d "
                   "based on EF_TCP_BACKLOG_MAX value and assuming up to %d listening "
                   "sockets in the Onload stack",
@@ -1099,85 +1238,85 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     }
   }
 
-  if ( (s = getenv("EF_TCP_INITIAL_CWND")) )
+  if ( (s = ci_cfg_getenv("EF_TCP_INITIAL_CWND")) )
     opts->initial_cwnd = atoi(s);
-  if ( (s = getenv("EF_TCP_LOSS_MIN_CWND")) )
+  if ( (s = ci_cfg_getenv("EF_TCP_LOSS_MIN_CWND")) )
     opts->loss_min_cwnd = atoi(s);
-  if ( (s = getenv("EF_TCP_MIN_CWND")) )
+  if ( (s = ci_cfg_getenv("EF_TCP_MIN_CWND")) )
     opts->min_cwnd = atoi(s);
 #if CI_CFG_TCP_FASTSTART
-  if ( (s = getenv("EF_TCP_FASTSTART_INIT")) )
+  if ( (s = ci_cfg_getenv("EF_TCP_FASTSTART_INIT")) )
     opts->tcp_faststart_init = atoi(s);
-  if ( (s = getenv("EF_TCP_FASTSTART_IDLE")) )
+  if ( (s = ci_cfg_getenv("EF_TCP_FASTSTART_IDLE")) )
     opts->tcp_faststart_idle = atoi(s);
-  if ( (s = getenv("EF_TCP_FASTSTART_LOSS")) )
+  if ( (s = ci_cfg_getenv("EF_TCP_FASTSTART_LOSS")) )
     opts->tcp_faststart_loss = atoi(s);
 #endif
 
-  if ( (s = getenv("EF_RFC_RTO_INITIAL")))
+  if ( (s = ci_cfg_getenv("EF_RFC_RTO_INITIAL")))
     opts->rto_initial = atoi(s);
-  if ( (s = getenv("EF_RFC_RTO_MIN")))
+  if ( (s = ci_cfg_getenv("EF_RFC_RTO_MIN")))
     opts->rto_min = atoi(s);
-  if ( (s = getenv("EF_RFC_RTO_MAX")))
+  if ( (s = ci_cfg_getenv("EF_RFC_RTO_MAX")))
     opts->rto_max = atoi(s);
 
-  if ( (s = getenv("EF_KEEPALIVE_TIME")))
+  if ( (s = ci_cfg_getenv("EF_KEEPALIVE_TIME")))
     opts->keepalive_time = atoi(s);
-  if ( (s = getenv("EF_KEEPALIVE_INTVL")))
+  if ( (s = ci_cfg_getenv("EF_KEEPALIVE_INTVL")))
     opts->keepalive_intvl = atoi(s);
-  if ( (s = getenv("EF_KEEPALIVE_PROBES")))
+  if ( (s = ci_cfg_getenv("EF_KEEPALIVE_PROBES")))
     opts->keepalive_probes = atoi(s);
 
-  if ( (s = getenv("EF_TCP_RST_COOLDOWN")))
+  if ( (s = ci_cfg_getenv("EF_TCP_RST_COOLDOWN")))
     opts->tcp_rst_cooldown = atoi(s);
 
 #ifndef NDEBUG
-  if( (s = getenv("EF_TCP_MAX_SEQERR_MSGS")))
+  if( (s = ci_cfg_getenv("EF_TCP_MAX_SEQERR_MSGS")))
     opts->tcp_max_seqerr_msg = atoi(s);
 #endif
 #if CI_CFG_BURST_CONTROL
-  if ( (s = getenv("EF_BURST_CONTROL_LIMIT")))
+  if ( (s = ci_cfg_getenv("EF_BURST_CONTROL_LIMIT")))
     opts->burst_control_limit = atoi(s);
 #endif
 #if CI_CFG_CONG_AVOID_NOTIFIED
-  if ( (s = getenv("EF_CONG_NOTIFY_THRESH")))
+  if ( (s = ci_cfg_getenv("EF_CONG_NOTIFY_THRESH")))
     opts->cong_notify_thresh = atoi(s);
 #endif
 #if CI_CFG_TAIL_DROP_PROBE
-  if ( (s = getenv("EF_TAIL_DROP_PROBE")))
+  if ( (s = ci_cfg_getenv("EF_TAIL_DROP_PROBE")))
     opts->tail_drop_probe = atoi(s);
 #endif
 #if CI_CFG_CONG_AVOID_SCALE_BACK
-  if ( (s = getenv("EF_CONG_AVOID_SCALE_BACK")))
+  if ( (s = ci_cfg_getenv("EF_CONG_AVOID_SCALE_BACK")))
     opts->cong_avoid_scale_back = atoi(s);
 #endif
 
-  if ( (s = getenv("EF_TCP_TIME_WAIT_ASSASSINATION")))
+  if ( (s = ci_cfg_getenv("EF_TCP_TIME_WAIT_ASSASSINATION")))
     opts->time_wait_assassinate = atoi(s);
 
-  if ( (s = getenv("EF_TPH_MODE")))
+  if ( (s = ci_cfg_getenv("EF_TPH_MODE")))
     opts->tph_mode = atoi(s);
 
   /* Get our netifs to inherit flags if the O/S is being forced to */
   if (CITP_OPTS.accept_force_inherit_nonblock)
     opts->accept_inherit_nonblock = 1;
 
-  if ( (s = getenv("EF_FREE_PACKETS_LOW_WATERMARK")) )
+  if ( (s = ci_cfg_getenv("EF_FREE_PACKETS_LOW_WATERMARK")) )
     opts->free_packets_low = atoi(s);
   if( opts->free_packets_low == 0 )
     opts->free_packets_low = opts->rxq_size / 2;
 
 #if CI_CFG_PIO
-  if ( (s = getenv("EF_PIO")) )
+  if ( (s = ci_cfg_getenv("EF_PIO")) )
     opts->pio = atoi(s);
   if( opts->pio == 0 )
     /* Makes for more efficient checking on fast data path */
     opts->pio_thresh = 0;
-  else if ( (s = getenv("EF_PIO_THRESHOLD")) )
+  else if ( (s = ci_cfg_getenv("EF_PIO_THRESHOLD")) )
     opts->pio_thresh = atoi(s);
 #endif
 
-  if( (s = getenv("EF_RX_TIMESTAMPING")) )
+  if( (s = ci_cfg_getenv("EF_RX_TIMESTAMPING")) )
     opts->rx_timestamping = atoi(s);
 
   static const char* const timestamping_opts[] = { "nic", "trailer", "cpacket", 0 };
@@ -1191,13 +1330,16 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   opts->rx_timestamping_trailer_fmt =
     parse_enum(opts, "EF_RX_TIMESTAMPING_TRAILER_FORMAT", ts_trailer_formats, "cpacket");
 
-  if( (s = getenv("EF_TX_TIMESTAMPING")) )
+  if( (s = ci_cfg_getenv("EF_TX_TIMESTAMPING")) )
     opts->tx_timestamping = atoi(s);
 
-  if( (s = getenv("EF_TIMESTAMPING_REPORTING")) )
+  if( (s = ci_cfg_getenv("EF_TX_TIMESTAMP_RING")) )
+    opts->tx_ts_ring_size = atoi(s);
+
+  if( (s = ci_cfg_getenv("EF_TIMESTAMPING_REPORTING")) )
     opts->timestamping_reporting = atoi(s);
 
-  if( (s = getenv("EF_TCP_TSOPT_MODE")) ) {
+  if( (s = ci_cfg_getenv("EF_TCP_TSOPT_MODE")) ) {
     opts->tcp_tsopt_mode = atoi(s);
     if( !(opts->tcp_tsopt_mode == 2) ) {
       citp_syn_opts &=~ CI_TCPT_FLAG_TSO;
@@ -1206,10 +1348,10 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     }
   }
 
-  if( (s = getenv("EF_USE_DSACK")) )
+  if( (s = ci_cfg_getenv("EF_USE_DSACK")) )
     opts->use_dsack = atoi(s);
 
-  if( (s = getenv("EF_PERIODIC_TIMER_CPU")) ) {
+  if( (s = ci_cfg_getenv("EF_PERIODIC_TIMER_CPU")) ) {
     int cpu = atoi(s);
     if( cpu >= sysconf(_SC_NPROCESSORS_ONLN) ) {
       CONFIG_LOG(opts, CONFIG_WARNINGS, "Value of EF_PERIODIC_TIMER_CPU is "
@@ -1219,38 +1361,38 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
     opts->periodic_timer_cpu = cpu;
   }
 
-  if( (s = getenv("EF_TCP_SYNCOOKIES")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SYNCOOKIES")) )
     opts->tcp_syncookies = atoi(s);
 
-  if( (s = getenv("EF_CLUSTER_IGNORE")) ) {
+  if( (s = ci_cfg_getenv("EF_CLUSTER_IGNORE")) ) {
     ci_log("EF_CLUSTER_IGNORE is deprecated use EF_CLUSTER_SIZE instead");
     opts->cluster_ignore = atoi(s);
   }
-  else if( (s = getenv("EF_CLUSTER_SIZE")) ) {
+  else if( (s = ci_cfg_getenv("EF_CLUSTER_SIZE")) ) {
     opts->cluster_ignore = (atoi(s) == 0);
   }
   else
     opts->cluster_ignore = 1;
 
 #if CI_CFG_TCP_SHARED_LOCAL_PORTS
-  if( (s = getenv("EF_TCP_SHARED_LOCAL_PORTS")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SHARED_LOCAL_PORTS")) )
     opts->tcp_shared_local_ports = atoi(s);
-  if( (s = getenv("EF_TCP_SHARED_LOCAL_PORTS_REUSE_FAST")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SHARED_LOCAL_PORTS_REUSE_FAST")) )
     opts->tcp_shared_local_ports_reuse_fast = atoi(s);
-  if( (s = getenv("EF_TCP_SHARED_LOCAL_PORTS_MAX")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SHARED_LOCAL_PORTS_MAX")) )
     opts->tcp_shared_local_ports_max = atoi(s);
-  if( (s = getenv("EF_TCP_SHARED_LOCAL_PORTS_NO_FALLBACK")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SHARED_LOCAL_PORTS_NO_FALLBACK")) )
     opts->tcp_shared_local_no_fallback = atoi(s) &&
       opts->tcp_shared_local_ports > 0;
-  if( (s = getenv("EF_TCP_SHARED_LOCAL_PORTS_PER_IP")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SHARED_LOCAL_PORTS_PER_IP")) )
     opts->tcp_shared_local_ports_per_ip = atoi(s);
-  if( (s = getenv("EF_TCP_SHARED_LOCAL_PORTS_PER_IP_MAX")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SHARED_LOCAL_PORTS_PER_IP_MAX")) )
     opts->tcp_shared_local_ports_per_ip_max = atoi(s);
-  if( (s = getenv("EF_TCP_SHARED_LOCAL_PORTS_STEP")) )
+  if( (s = ci_cfg_getenv("EF_TCP_SHARED_LOCAL_PORTS_STEP")) )
     opts->tcp_shared_local_ports_step = atoi(s);
 #endif
 
-  if( (s = getenv("EF_HIGH_THROUGHPUT_MODE")) )
+  if( (s = ci_cfg_getenv("EF_HIGH_THROUGHPUT_MODE")) )
     opts->rx_merge_mode = atoi(s);
 
   handle_str_opt(opts, "EF_INTERFACE_WHITELIST", opts->iface_whitelist,
@@ -1266,63 +1408,78 @@ void ci_netif_config_opts_getenv(ci_netif_config_opts* opts)
   opts->multiarch_rx_datapath =
     parse_enum(opts, "EF_MULTIARCH_RX_DATAPATH", multiarch_rx_opts, "ff");
 
-  if( (s = getenv("EF_KERNEL_PACKETS_BATCH_SIZE")) )
+  if( (s = ci_cfg_getenv("EF_KERNEL_PACKETS_BATCH_SIZE")) )
     opts->kernel_packets_batch_size = atoi(s);
 
-  if( (s = getenv("EF_KERNEL_PACKETS_TIMER_USEC")) )
+  if( (s = ci_cfg_getenv("EF_KERNEL_PACKETS_TIMER_USEC")) )
     opts->kernel_packets_timer_usec = atoi(s);
 
   static const char* const tcp_isn_opts[] = { "clocked", "clocked+cache", 0 };
   opts->tcp_isn_mode =
     parse_enum(opts, "EF_TCP_ISN_MODE", tcp_isn_opts, "clocked+cache");
-  if( (s = getenv("EF_TCP_ISN_2MSL")) )
+  if( (s = ci_cfg_getenv("EF_TCP_ISN_2MSL")) )
     opts->tcp_isn_2msl = atoi(s);
-  if( (s = getenv("EF_TCP_ISN_CACHE_SIZE")) )
+  if( (s = ci_cfg_getenv("EF_TCP_ISN_CACHE_SIZE")) )
     opts->tcp_isn_cache_size = atoi(s);
-  if( (s = getenv("EF_TCP_ISN_INCLUDE_PASSIVE")) )
+  if( (s = ci_cfg_getenv("EF_TCP_ISN_INCLUDE_PASSIVE")) )
     opts->tcp_isn_include_passive = atoi(s);
-  if( (s = getenv("EF_TCP_ISN_OFFSET")) )
+  if( (s = ci_cfg_getenv("EF_TCP_ISN_OFFSET")) )
     opts->tcp_isn_offset = atoi(s);
+  if( (s = ci_cfg_getenv("EF_TCP_TIME_WAIT_COMPACT")) )
+    opts->tcp_time_wait_compact = atoi(s);
+  if( (s = ci_cfg_getenv("EF_TCP_LATENCY_HIST")) )
+    opts->tcp_latency_hist = atoi(s);
+
+#if CI_CFG_TCPDUMP
+  if( (s = ci_cfg_getenv("EF_TCPDUMP_RING")) )
+    opts->tcpdump_ring = atoi(s);
+  if( (s = ci_cfg_getenv("EF_TCPDUMP_RING_SNAPLEN")) )
+    opts->tcpdump_ring_snaplen = atoi(s);
+#endif
 
   ci_netif_config_opts_getenv_ef_scalable_filters(opts);
 
 #if CI_CFG_CTPIO
-  if( (s = getenv("EF_CTPIO")) )
+  if( (s = ci_cfg_getenv("EF_CTPIO")) )
     opts->ctpio = atoi(s);
 
   static const char* const ctpio_opts[] = { "sf", "sf-np", "ct", 0 };
   opts->ctpio_mode = parse_enum(opts, "EF_CTPIO_MODE", ctpio_opts, "sf-np");
 
-  if( (s = getenv("EF_CTPIO_MAX_FRAME_LEN")) )
+  if( (s = ci_cfg_getenv("EF_CTPIO_MAX_FRAME_LEN")) )
     opts->ctpio_max_frame_len = atoi(s);
   else if( opts->ctpio_mode == EF_CTPIO_MODE_CT )
     opts->ctpio_max_frame_len = 1518;
   else
     opts->ctpio_max_frame_len = 500;
-  if( (s = getenv("EF_CTPIO_CT_THRESH")) )
+  if( (s = ci_cfg_getenv("EF_CTPIO_CT_THRESH")) )
     opts->ctpio_ct_thresh = atoi(s);
-  if( (s = getenv("EF_CTPIO_SWITCH_BYPASS")) )
+  if( (s = ci_cfg_getenv("EF_CTPIO_SWITCH_BYPASS")) )
     opts->ctpio_switch_bypass = atoi(s);
 #endif
 
-  if( (s = getenv("EF_TCP_EARLY_RETRANSMIT")) )
+  if( (s = ci_cfg_getenv("EF_TCP_EARLY_RETRANSMIT")) )
     opts->tcp_early_retransmit = atoi(s);
 
 #if CI_CFG_IPV6
-  if( (s = getenv("EF_AUTO_FLOWLABELS")) )
+  if( (s = ci_cfg_getenv("EF_AUTO_FLOWLABELS")) )
     opts->auto_flowlabels = atoi(s);
 #endif
 
-  if( (s = getenv("EF_AF_XDP_ZEROCOPY")) )
+  if( (s = ci_cfg_getenv("EF_AF_XDP_ZEROCOPY")) )
     opts->af_xdp_zerocopy = atoi(s);
+  if( (s = ci_cfg_getenv("EF_AF_XDP_BUSY_POLL_BUDGET")) )
+    opts->af_xdp_busy_poll_budget = atoi(s);
+  if( (s = ci_cfg_getenv("EF_AF_XDP_BUSY_POLL_FALLBACK_USEC")) )
+    opts->af_xdp_busy_poll_fallback_usec = atoi(s);
 
-  if( (s = getenv("EF_ICMP_PKTS")) )
+  if( (s = ci_cfg_getenv("EF_ICMP_PKTS")) )
     opts->icmp_msg_max = atoi(s);
 
-  if( (s = getenv("EF_NO_HW")) )
+  if( (s = ci_cfg_getenv("EF_NO_HW")) )
     opts->no_hw = atoi(s);
 
-  if( (s = getenv("EF_DUMP_STACK_ON_EXIT")) )
+  if( (s = ci_cfg_getenv("EF_DUMP_STACK_ON_EXIT")) )
     opts->dump_stack_on_exit = atoi(s);
 }
 
@@ -1353,8 +1510,8 @@ static int
 handle_str_opt(ci_netif_config_opts* opts,
                const char* optname, char* optval_buf, size_t optval_buflen)
 {
- char* s;
-  if( (s = getenv(optname)) ) {
+ const char* s;
+  if( (s = ci_cfg_getenv(optname)) ) {
     if( strlen(s) >= optval_buflen ) {
       CONFIG_LOG(opts, CONFIG_WARNINGS, "Value of %s"
                  "too long - truncating. ", optname);
@@ -1377,7 +1534,7 @@ parse_enum(ci_netif_config_opts* opts,
   const char* value;
   int i;
 
-  if( (value = getenv(name)) == NULL )
+  if( (value = ci_cfg_getenv(name)) == NULL )
     value = default_val;
 
   while( 1 ) {
@@ -1433,7 +1590,7 @@ static int ci_opts_parse_scalable_filters_nic(ci_netif_config_opts* opts,
      * EF_SCALABLE_FILTERS_MODE.
      */
     if( *modestr != '=' )
-      modestr = getenv("EF_SCALABLE_FILTERS_MODE");
+      modestr = ci_cfg_getenv("EF_SCALABLE_FILTERS_MODE");
     else
       ++modestr;
 
@@ -1539,7 +1696,7 @@ ci_netif_config_opts_getenv_ef_scalable_filters(ci_netif_config_opts* opts)
   ci_int32 ifindexes[2] = {};
 
   /* Nothing is interesting unless EF_SCALABLE_FILTERS is set */
-  if( (s = getenv("EF_SCALABLE_FILTERS")) ) {
+  if( (s = ci_cfg_getenv("EF_SCALABLE_FILTERS")) ) {
     int modes[2] = {};
     int cluster_name_len;
     int i;
@@ -1623,17 +1780,17 @@ ci_netif_config_opts_getenv_ef_scalable_filters(ci_netif_config_opts* opts)
     mode = modes[0] | modes[1];
 
     if( mode != CITP_SCALABLE_MODE_NONE ) {
-      if( (s = getenv("EF_SCALABLE_FILTERS_ENABLE")) )
+      if( (s = ci_cfg_getenv("EF_SCALABLE_FILTERS_ENABLE")) )
         enable = atoi(s);
       else
         enable = CITP_SCALABLE_FILTERS_ENABLE;
 
-      if( (s = getenv("EF_SCALABLE_LISTEN_MODE")) )
+      if( (s = ci_cfg_getenv("EF_SCALABLE_LISTEN_MODE")) )
         listen_mode = atoi(s);
 #if CI_CFG_TCP_SHARED_LOCAL_PORTS
       if( mode & CITP_SCALABLE_MODE_ACTIVE )
         active_wilds_need_filter = 0;
-      if( (s = getenv("EF_SCALABLE_ACTIVE_WILDS_NEED_FILTER")) )
+      if( (s = ci_cfg_getenv("EF_SCALABLE_ACTIVE_WILDS_NEED_FILTER")) )
         active_wilds_need_filter = atoi(s);
 #endif
     }
@@ -1644,7 +1801,7 @@ ci_netif_config_opts_getenv_ef_scalable_filters(ci_netif_config_opts* opts)
     /* Stacks cannot be named by EF_NAME in clustered scalable modes. */
     if( enable == CITP_SCALABLE_FILTERS_ENABLE &&
         mode & CITP_SCALABLE_MODE_RSS &&
-        (s = getenv("EF_NAME")) && s[0] != '\0' )
+        (s = ci_cfg_getenv("EF_NAME")) && s[0] != '\0' )
       CONFIG_LOG(opts, CONFIG_WARNINGS,
                  "config: Stacks cannot be named by EF_NAME while in a "
                  "clustered scalable mode.")
@@ -1659,17 +1816,17 @@ ci_netif_config_opts_getenv_ef_scalable_filters(ci_netif_config_opts* opts)
     }
   }
   else {
-    if( (s = getenv("EF_SCALABLE_FILTERS_ENABLE")) )
+    if( (s = ci_cfg_getenv("EF_SCALABLE_FILTERS_ENABLE")) )
       CONFIG_LOG(opts, CONFIG_WARNINGS, "config: EF_SCALABLE_FILTERS_ENABLE "
                  "ignored as no valid config for EF_SCALABLE_FILTERS found.");
     enable = CITP_SCALABLE_FILTERS_DISABLE;
   }
 
   if( enable == CITP_SCALABLE_FILTERS_DISABLE ) {
-    if( (s = getenv("EF_SCALABLE_LISTEN_MODE")) )
+    if( (s = ci_cfg_getenv("EF_SCALABLE_LISTEN_MODE")) )
       CONFIG_LOG(opts, CONFIG_WARNINGS, "config: EF_SCALABLE_LISTEN_MODE "
                  "ignored as no valid config for EF_SCALABLE_FILTERS found.");
-    if( (s = getenv("EF_SCALABLE_ACTIVE_WILDS_NEED_FILTER")) )
+    if( (s = ci_cfg_getenv("EF_SCALABLE_ACTIVE_WILDS_NEED_FILTER")) )
       CONFIG_LOG(opts, CONFIG_WARNINGS,
                  "config: EF_SCALABLE_ACTIVE_WILDS_NEED_FILTER "
                  "ignored as no valid config for EF_SCALABLE_FILTERS found.");
@@ -1706,6 +1863,8 @@ static void netif_tcp_helper_build2(ci_netif* ni)
 #endif
   ni->seq_table =
     (ci_tcp_prev_seq_t*) ((char*) ni->state + ni->state->seq_table_ofs);
+  ni->timewait_table =
+    (ci_tcp_timewait_t*) ((char*) ni->state + ni->state->timewait_table_ofs);
   ni->deferred_pkts =
     (struct oo_deferred_pkt*) ((char*) ni->state +
                                ni->state->deferred_pkts_ofs);
@@ -1728,6 +1887,18 @@ static void netif_tcp_helper_build2(ci_netif* ni)
                      "sw_filters",
                      (void*)((char*) ni->state + ni->state->sw_filter_ofs));
 #endif
+#if CI_CFG_TIMESTAMPING
+  if( ni->state->tx_ts_ring.stride != 0 )
+    oo_ringbuffer_init(&ni->tx_ts_ring, &ni->state->tx_ts_ring, "tx_ts_ring",
+                       (void*)((char*) ni->state + ni->state->tx_ts_ring_ofs));
+#endif
+#if CI_CFG_TCPDUMP
+  if( ni->state->capture.stride != 0 )
+    ci_netif_capture_init(ni, (char*) ni->state + ni->state->capture_ofs,
+                          ni->state->capture.mask + 1,
+                          ni->state->capture.stride,
+                          ni->state->capture.max_snaplen);
+#endif
 }
 
 
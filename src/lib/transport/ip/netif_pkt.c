@@ -137,6 +137,11 @@ ci_ip_pkt_fmt* ci_netif_pkt_alloc_slow_ptrerr(ci_netif* ni, int flags)
 
   ci_assert(ci_netif_is_locked(ni));
 
+  if( flags & CI_PKT_ALLOC_FOR_TCP_TX )
+    CITP_STATS_NETIF_INC(ni, pkt_alloc_slow_tcp_tx);
+  else
+    CITP_STATS_NETIF_INC(ni, pkt_alloc_slow_other);
+
   if( (flags & CI_PKT_ALLOC_USE_NONB) ||
       (ni->packets->n_free == 0 &&
        ni->packets->sets_n == ni->packets->sets_max) )
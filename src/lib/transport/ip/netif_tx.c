@@ -101,6 +101,11 @@ static void __ci_netif_dmaq_shove(ci_netif* ni, int intf_i, int is_fresh)
   int posted_dma = 0;
 #endif
 
+  /* Serialise with senders that do not hold the stack lock.  If one of
+   * them is slow to finish, leave the packets for the next poll. */
+  if( ! ci_netif_tx_claim(ni, intf_i) )
+    return;
+
   do {
     pkt = PKT_CHK(ni, dmaq->head);
     ci_assert(pkt->flags & CI_PKT_FLAG_TX_PENDING);
@@ -152,8 +157,10 @@ static void __ci_netif_dmaq_shove(ci_netif* ni, int intf_i, int is_fresh)
   /* If everything went out by CTPIO, there will be no outstanding DMA
    * descriptors to pushed, and we're finished.  Otherwise, we still need to
    * hit the doorbell for those DMA sends. */
-  if( ! posted_dma )
+  if( ! posted_dma ) {
+    ci_netif_tx_release(ni, intf_i);
     return;
+  }
 
   /* We're doing a DMA send, so there's no point attempting CTPIO now until
    * the TXQ has drained. */
@@ -161,6 +168,7 @@ static void __ci_netif_dmaq_shove(ci_netif* ni, int intf_i, int is_fresh)
 #endif
 
   ef_vi_transmit_push(vi);
+  ci_netif_tx_release(ni, intf_i);
   CITP_STATS_NETIF_INC(ni, tx_dma_doorbells);
 }
 
@@ -222,7 +230,7 @@ void __ci_netif_send(ci_netif* netif, ci_ip_pkt_fmt* pkt)
   dmaq = ci_netif_dmaq(netif, intf_i);
   vi = ci_netif_vi(netif, intf_i);
 
-  if( oo_pktq_is_empty(dmaq) ) {
+  if( oo_pktq_is_empty(dmaq) && ci_netif_tx_claim(netif, intf_i) ) {
 #if CI_CFG_PIO
     /* pio_thresh is set to zero if PIO disabled on this stack, so don't
      * need to check NI_OPTS().pio here
@@ -241,6 +249,7 @@ void __ci_netif_send(ci_netif* netif, ci_ip_pkt_fmt* pkt)
             ci_assert(pkt->pio_addr == -1);
             pkt->pio_addr = offset;
             pkt->pio_order = order;
+            ci_netif_tx_release(netif, intf_i);
             return;
           }
           else {
@@ -285,6 +294,7 @@ void __ci_netif_send(ci_netif* netif, ci_ip_pkt_fmt* pkt)
       ci_netif_ctpio_desist(netif, intf_i);
       CITP_STATS_NETIF_INC(netif, tx_dma_doorbells);
     }
+    ci_netif_tx_release(netif, intf_i);
     if( rc == 0 ) {
       LOG_AT(ci_analyse_pkt(oo_ether_hdr(pkt), pkt->buf_len));
       LOG_DT(ci_hex_dump(ci_log_fn, oo_ether_hdr(pkt), pkt->buf_len, 0));
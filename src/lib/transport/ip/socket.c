@@ -141,7 +141,8 @@ void ci_sock_cmn_dump(ci_netif* ni, ci_sock_cmn* s, const char* pf,
   if( s->b.ready_lists_in_use != 0 ) {
     ci_uint32 tmp, i;
     CI_READY_LIST_EACH(s->b.ready_lists_in_use, tmp, i)
-      logger(log_arg, "%s  epoll3: ready_list_id %d", pf, i);
+      logger(log_arg, "%s  epoll3: ready_list_id %d%s", pf, i,
+             (s->b.ready_lists_excl & (1 << i)) ? " exclusive" : "");
   }
 }
 
@@ -78,6 +78,8 @@ int ci_tcp_add_fin(ci_tcp_state* ts, ci_netif* netif)
   LOG_TC(log(FNTS_FMT "sendq_num=%d cork=%d", FNTS_PRI_ARGS(netif, ts),
              sendq->num, !!(ts->s.s_aflags & CI_SOCK_AFLAG_CORK)));
 
+  ci_tcp_send_nolock_block(netif, ts);
+
   if( sendq->num ) {
     /* Bang the fin on the end of the send queue. */
     pkt = PKT_CHK(netif, sendq->tail);
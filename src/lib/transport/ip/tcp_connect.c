@@ -819,13 +819,18 @@ __ci_tcp_prev_seq_lookup(ci_netif* ni, const ci_tcp_prev_seq_t* ts_prev_seq)
 }
 
 
-ci_uint32 ci_tcp_prev_seq_lookup(ci_netif* ni, const ci_tcp_state* ts)
+ci_uint32 ci_tcp_prev_seq_lookup_tuple(ci_netif* ni,
+                                       ci_addr_t laddr, unsigned lport,
+                                       ci_addr_t raddr, unsigned rport)
 {
-  ci_tcp_prev_seq_t ts_prev_seq;
+  ci_tcp_prev_seq_t key;
   ci_tcp_prev_seq_t* prev_seq;
   ci_uint32 seq_no;
-  ci_tcp_prev_seq_from_ts(ni, ts, &ts_prev_seq);
-  prev_seq = __ci_tcp_prev_seq_lookup(ni, &ts_prev_seq);
+  key.laddr = laddr;
+  key.raddr = raddr;
+  key.lport = lport;
+  key.rport = rport;
+  prev_seq = __ci_tcp_prev_seq_lookup(ni, &key);
   if( prev_seq == NULL )
     return 0;
   seq_no = prev_seq->seq_no;
@@ -835,6 +840,15 @@ ci_uint32 ci_tcp_prev_seq_lookup(ci_netif* ni, const ci_tcp_state* ts)
 }
 
 
+ci_uint32 ci_tcp_prev_seq_lookup(ci_netif* ni, const ci_tcp_state* ts)
+{
+  return ci_tcp_prev_seq_lookup_tuple(ni, tcp_ipx_laddr(ts),
+                                      tcp_lport_be16(ts),
+                                      tcp_ipx_raddr(ts),
+                                      tcp_rport_be16(ts));
+}
+
+
 void ci_tcp_prev_seq_remember(ci_netif* ni, ci_tcp_state* ts)
 {
   ci_tcp_prev_seq_t ts_prev_seq;
@@ -903,6 +917,9 @@ static int ci_tcp_connect_ul_start(ci_netif *ni, ci_tcp_state* ts, ci_fd_t fd,
    * other counters, because no real send was possible. */
   ts->send_prequeue = OO_PP_ID_NULL;
   ci_assert_equal(oo_atomic_read(&ts->send_prequeue_in), 0);
+  ci_assert_equal(ts->send_nolock, OO_PP_ID_NULL);
+  ts->send_nolock_gate = CI_TCP_SEND_NOLOCK_CLOSED;
+  ts->send_nolock_owner = 0;
 
   /* Now that we know the outgoing route, set the MTU related values.
    * Note, even these values are speculative since the real MTU
@@ -1404,7 +1421,8 @@ complete_deferred_bind(ci_netif* netif, ci_sock_cmn* s, ci_fd_t fd)
 
 
 static int
-ci_tcp_retrieve_addr(ci_netif* netif, const struct sockaddr* serv_addr,
+ci_tcp_retrieve_addr(ci_netif* netif, ci_sock_cmn* s,
+                     const struct sockaddr* serv_addr,
                      ci_addr_t* dst_addr, ci_uint16* dst_port)
 {
   /* Address family is validated to be AF_INET or AF_INET6 earlier. */
@@ -1416,7 +1434,16 @@ ci_tcp_retrieve_addr(ci_netif* netif, const struct sockaddr* serv_addr,
   /* Only perform DNAT off of init_net */
   if( netif->cplane_init_net != NULL ) {
     ci_addr_sh_t dnat_addr = CI_ADDR_SH_FROM_ADDR(*dst_addr);
-    rc = cp_svc_check_dnat(netif->cplane_init_net, &dnat_addr, dst_port);
+    ci_uint32 flow_hash;
+    /* Until the socket has a local port there is no flow to be consistent
+     * for, so spread connections pseudo-randomly. */
+    if( sock_lport_be16(s) != 0 )
+      flow_hash = onload_hash3(sock_ipx_laddr(s), sock_lport_be16(s),
+                               *dst_addr, *dst_port, IPPROTO_TCP);
+    else
+      flow_hash = ci_frc64_get() >> 4;
+    rc = cp_svc_check_dnat(netif->cplane_init_net, &dnat_addr, dst_port,
+                           flow_hash);
     *dst_addr = CI_ADDR_FROM_ADDR_SH(dnat_addr);
   }
   return rc;
@@ -1524,7 +1551,7 @@ int ci_tcp_connect(citp_socket* ep, const struct sockaddr* serv_addr,
     /* Af first, check that address family and length is OK. */
     ci_tcp_validate_sa(s->domain, serv_addr, addrlen)
     /* Check for NAT. */
-    || (dnat = ci_tcp_retrieve_addr(ep->netif, serv_addr, &dst_addr,
+    || (dnat = ci_tcp_retrieve_addr(ep->netif, s, serv_addr, &dst_addr,
                                     &dst_port)) < 0
     /* rfc793 p54 if the foreign socket is unspecified return          */
     /* "error: foreign socket unspecified" (EINVAL), but keep it to OS */
@@ -2156,6 +2183,8 @@ int ci_tcp_listen(citp_socket* ep, ci_fd_t fd, int backlog)
     }
   } 
 
+  /* Listening state overlays the latency histogram pointers. */
+  ci_tcp_lat_hist_free(netif, ts);
   ci_tcp_set_slow_state(netif, ts, CI_TCP_LISTEN);
   tls = SOCK_TO_TCP_LISTEN(&ts->s);
 
@@ -783,6 +783,12 @@ void ci_tcp_state_dump(ci_netif* ni, ci_tcp_state* ts,
          SEQ_SUB(ts->snd_max, tcp_snd_nxt(ts)));
   if( ts->snd_delegated != 0 )
     logger(log_arg, "%s  snd delegated=%d", pf, ts->snd_delegated);
+  if( ts->send_nolock_gate != CI_TCP_SEND_NOLOCK_CLOSED ||
+      ts->send_nolock != OO_PP_ID_NULL )
+    logger(log_arg, "%s  snd nolock: gate=%s owner=%u unmerged=%d", pf,
+           ts->send_nolock_gate == CI_TCP_SEND_NOLOCK_IDLE ? "open" :
+           ts->send_nolock_gate == CI_TCP_SEND_NOLOCK_BUSY ? "busy" : "closed",
+           ts->send_nolock_owner, ts->send_nolock != OO_PP_ID_NULL);
   logger(log_arg, "%s  snd: cwnd=%d+%d used=%d ssthresh=%d bytes_acked=%d %s",
          pf, ts->cwnd, ts->cwnd_extra, tcp_cwnd_used(ts),
          ts->ssthresh, ts->bytes_acked, congstate_str(ts));
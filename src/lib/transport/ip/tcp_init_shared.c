@@ -55,6 +55,9 @@ static void ci_tcp_state_connected_opts_init(ci_netif* netif, ci_tcp_state* ts)
 
   ts->send_prequeue = CI_ILL_END;
   oo_atomic_set(&ts->send_prequeue_in, 0);
+  ts->send_nolock = OO_PP_ID_NULL;
+  ts->send_nolock_gate = CI_TCP_SEND_NOLOCK_CLOSED;
+  ts->send_nolock_owner = 0;
   ts->send_in = 0;
   ts->send_out = 0;
 
@@ -84,6 +87,8 @@ static void ci_tcp_state_connected_opts_init(ci_netif* netif, ci_tcp_state* ts)
 static void ci_tcp_state_tcb_init_fixed(ci_netif* netif, ci_tcp_state* ts,
                                         int from_cache)
 {
+  int i;
+
   /* SO_RCVLOWAT */
   ts->s.so.rcvlowat = 1;
 
@@ -99,6 +104,8 @@ static void ci_tcp_state_tcb_init_fixed(ci_netif* netif, ci_tcp_state* ts,
                        CI_IP_DFLT_TTL, CI_IP_DFLT_TOS);
 
   ts->pmtus = OO_PP_NULL;
+  for( i = 0; i < CI_TCP_LAT_HIST_N; ++i )
+    ts->lat_hist[i] = OO_P_NULL;
 
   ts->s.laddr = ip4_addr_any;
   TS_IPX_TCP(ts)->tcp_source_be16 = 0;
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+/**************************************************************************\
+*//*! \file
+**  \brief  Per-connection latency histograms (EF_TCP_LATENCY_HIST)
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* Each established connection gets one auxiliary buffer per histogram
+ * kind.  Samples are taken with the stack's frc clock at the points
+ * described next to CI_TCP_LAT_HIST_*; see ci_tcp_lat_hist_record().
+ * This file allocates and frees the histograms and turns them into text
+ * for onload_stackdump.
+ */
+
+#include "ip_internal.h"
+
+#define LPF "TCP LAT "
+
+
+/* Samples below 2^shift cycles go to bucket 0.  Receive and send
+ * latencies start at about a third of a microsecond on current hardware;
+ * round trips start at about 2us.  Both ranges then cover 11 powers of
+ * two before the overflow bucket.
+ */
+#define LAT_HIST_SHIFT_RXTX  10
+#define LAT_HIST_SHIFT_RTT   13
+
+
+static const char* const lat_hist_names[CI_TCP_LAT_HIST_N] = {
+  [CI_TCP_LAT_HIST_RX]  = "rx",
+  [CI_TCP_LAT_HIST_TX]  = "tx",
+  [CI_TCP_LAT_HIST_RTT] = "rtt",
+};
+
+
+void ci_tcp_lat_hist_init(ci_netif* ni, ci_tcp_state* ts)
+{
+  int kind;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  for( kind = 0; kind < CI_TCP_LAT_HIST_N; ++kind ) {
+    ci_tcp_lat_hist* h;
+    if( OO_P_IS_NULL(ts->lat_hist[kind]) ) {
+      oo_p p = ci_ni_aux_alloc(ni, CI_TCP_AUX_TYPE_LAT_HIST);
+      if( OO_P_IS_NULL(p) )
+        break;
+      ts->lat_hist[kind] = p;
+    }
+    /* A socket that is reconnected keeps its buffers but starts afresh. */
+    h = ci_ni_aux_p2lat_hist(ni, ts->lat_hist[kind]);
+    memset(h, 0, sizeof(*h));
+    h->kind = kind;
+    h->shift = kind == CI_TCP_LAT_HIST_RTT ? LAT_HIST_SHIFT_RTT :
+                                             LAT_HIST_SHIFT_RXTX;
+  }
+
+  if( kind < CI_TCP_LAT_HIST_N ) {
+    LOG_U(ci_log(LNT_FMT "no aux buffers for latency histograms",
+                 LNT_PRI_ARGS(ni, ts)));
+    ci_tcp_lat_hist_free(ni, ts);
+  }
+}
+
+
+void ci_tcp_lat_hist_free(ci_netif* ni, ci_tcp_state* ts)
+{
+  int kind;
+
+  for( kind = 0; kind < CI_TCP_LAT_HIST_N; ++kind )
+    if( OO_P_NOT_NULL(ts->lat_hist[kind]) ) {
+      ci_tcp_lat_hist_aux_free(ni, ci_ni_aux_p2lat_hist(ni,
+                                                        ts->lat_hist[kind]));
+      ts->lat_hist[kind] = OO_P_NULL;
+    }
+}
+
+
+/* Returns the upper limit in cycles of the bucket holding the sample at
+ * [permille]/1000 of the distribution, or the largest sample if that is
+ * in the overflow bucket.  Returns 0 if the histogram is empty.
+ */
+ci_uint64 ci_tcp_lat_hist_percentile(const ci_tcp_lat_hist* h,
+                                     unsigned permille)
+{
+  ci_uint64 n = 0, seen = 0, want;
+  int i;
+
+  for( i = 0; i < CI_TCP_LAT_HIST_BUCKETS; ++i )
+    n += h->count[i];
+  if( n == 0 )
+    return 0;
+
+  want = (n * permille + 999) / 1000;
+  for( i = 0; i < CI_TCP_LAT_HIST_BUCKETS - 1; ++i ) {
+    seen += h->count[i];
+    if( seen >= want )
+      return CI_MIN(ci_tcp_lat_hist_bucket_limit(h, i), (ci_uint64) h->max);
+  }
+  return h->max;
+}
+
+
+void ci_tcp_lat_hist_dump(ci_netif* ni, ci_tcp_state* ts,
+                          oo_dump_log_fn_t logger, void* log_arg)
+{
+  int kind, i;
+
+  if( OO_P_IS_NULL(ts->lat_hist[0]) )
+    return;
+
+  logger(log_arg, "%s: "NTS_FMT, __FUNCTION__, NTS_PRI_ARGS(ni, ts));
+  for( kind = 0; kind < CI_TCP_LAT_HIST_N; ++kind ) {
+    const ci_tcp_lat_hist* h = ci_ni_aux_p2lat_hist(ni, ts->lat_hist[kind]);
+    char buf[CI_TCP_LAT_HIST_BUCKETS * 24];
+    int len = 0;
+    ci_uint64 n = 0;
+
+    for( i = 0; i < CI_TCP_LAT_HIST_BUCKETS; ++i ) {
+      n += h->count[i];
+      if( h->count[i] == 0 )
+        continue;
+      if( i < CI_TCP_LAT_HIST_BUCKETS - 1 )
+        len += ci_scnprintf(buf + len, sizeof(buf) - len, " <%u:%u",
+                            (unsigned) ci_tcp_lat_hist_cycles2ns(ni,
+                                       ci_tcp_lat_hist_bucket_limit(h, i)),
+                            h->count[i]);
+      else
+        len += ci_scnprintf(buf + len, sizeof(buf) - len, " >:%u",
+                            h->count[i]);
+    }
+    buf[len] = '\0';
+
+    logger(log_arg, "  %s: n=%llu p50=%llu p99=%llu p99.9=%llu max=%llu (ns)",
+           lat_hist_names[kind], (unsigned long long) n,
+           (unsigned long long) ci_tcp_lat_hist_cycles2ns(ni,
+                                  ci_tcp_lat_hist_percentile(h, 500)),
+           (unsigned long long) ci_tcp_lat_hist_cycles2ns(ni,
+                                  ci_tcp_lat_hist_percentile(h, 990)),
+           (unsigned long long) ci_tcp_lat_hist_cycles2ns(ni,
+                                  ci_tcp_lat_hist_percentile(h, 999)),
+           (unsigned long long) ci_tcp_lat_hist_cycles2ns(ni, h->max));
+    if( len > 0 )
+      logger(log_arg, "   %s", buf);
+  }
+}
+
+/*! \cidoxg_end */
@@ -242,6 +242,11 @@ static void __ci_tcp_state_free(ci_netif *ni, ci_tcp_state *ts)
 #endif
   ci_assert_equal(__ci_tcp_rx_buf_count(ni, ts), 0);
 
+  /* The histograms are kept until the socket is freed, rather than
+   * dropped, because a receiver holding only the socket lock may still be
+   * recording into them. */
+  ci_tcp_lat_hist_free(ni, ts);
+
 #if CI_CFG_FD_CACHING
   /* Clear any cache link - it's possible that this socket is on the
    * the connected list.  Now that we're closed there's no need, as we
@@ -329,6 +334,9 @@ void ci_tcp_set_established_state(ci_netif* ni, ci_tcp_state* ts)
   ts->s.rx_errno = 0;
   ts->tcpflags |= CI_TCPT_FLAG_WAS_ESTAB;
 
+  if( NI_OPTS(ni).tcp_latency_hist )
+    ci_tcp_lat_hist_init(ni, ts);
+
   /* ?? HACK: Reset window sizes to a suitable value (if app hasn't already
   ** modified them).  The defaults are too small, but we need to stick with
   ** them at socket creation time because some apps (e.g. netperf) modify
@@ -617,6 +625,7 @@ void ci_ip_queue_drop(ci_netif* netif, ci_ip_pkt_queue *qu)
 
 static void ci_tcp_tx_drop_queues(ci_netif* ni, ci_tcp_state* ts)
 {
+  ci_tcp_send_nolock_block(ni, ts);
   ci_tcp_retrans_drop(ni, ts);
   ci_tcp_sendmsg_enqueue_prequeue(ni, ts, CI_TRUE);
   ci_tcp_sendq_drop(ni, ts);
@@ -1318,6 +1327,7 @@ void ci_tcp_perform_deferred_socket_work(ci_netif* ni, ci_tcp_state* ts)
    */
   aflags = ts->s.s_aflags & interesting;
   ci_rmb();
+  ci_tcp_send_nolock_merge(ni, ts);
   ci_tcp_sendmsg_enqueue_prequeue_deferred(ni, ts);
 
   if( aflags ) {
@@ -38,6 +38,7 @@ struct tcp_recv_info {
   int msg_flags;
   struct onload_zc_recv_args* zc_args;
   size_t controllen;
+  ci_uint64 rx_frc;   /* arrival of first packet, for EF_TCP_LATENCY_HIST */
 #ifdef __KERNEL__
   ci_addr_spc_t addr_spc;
 #endif
@@ -361,6 +362,10 @@ ci_tcp_recvmsg_get_impl(struct tcp_recv_info *rinf)
   }
   initial_recv1_extract = ts->recv1_extract;
 
+  if(CI_UNLIKELY( OO_P_NOT_NULL(ts->lat_hist[CI_TCP_LAT_HIST_RX]) ) &&
+     rinf->rx_frc == 0 )
+    rinf->rx_frc = pkt->tstamp_frc;
+
   /* If we carry on here when in error then we'd be ignoring them. */
   ci_assert_ge(rinf->rc, 0);
 
@@ -476,7 +481,8 @@ static int ci_tcp_recvmsg_spin(ci_netif* ni, ci_tcp_state* ts,
   ci_uint64 now_frc;
   ci_uint64 schedule_frc = start_frc;
   citp_signal_info* si = citp_signal_get_specific_inited();
-  ci_uint64 max_spin = ts->s.b.spin_cycles;
+  ci_uint64 max_spin = citp_waitable_spin_budget(ni, &ts->s.b,
+                                                 ts->s.b.spin_cycles);
   int rc, spin_limit_by_so = 0;
 
   /* Cache the next expected packet buffer to save work within the loop.
@@ -515,9 +521,9 @@ static int ci_tcp_recvmsg_spin(ci_netif* ni, ci_tcp_state* ts,
       }
 
       if( ni->state->poll_work_outstanding ||
-          ci_netif_need_poll_spinning(ni, now_frc) ) {
+          ci_netif_need_poll_claimed(ni, intf_i, now_frc) ) {
         if( ci_netif_trylock(ni) ) {
-          ci_netif_poll(ni);
+          ci_netif_poll_claimed(ni, intf_i);
           ci_netif_unlock(ni);
         }
         if( tcp_rcv_usr(ts) )
@@ -598,6 +604,7 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
   ci_uint64             start_frc = 0; /* suppress compiler warning */
 #ifndef __KERNEL__
   unsigned              tcp_recv_spin = 0;
+  int                   spin_adapt = 0;
 #endif
   ci_uint32             timeout = ts->s.so.rcvtimeo_msec;
   struct tcp_recv_info  rinf;
@@ -613,6 +620,7 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
   rinf.msg_flags = 0;
   rinf.copier = copier;
   rinf.zc_args = zc_args;
+  rinf.rx_frc = 0;
 #ifdef __KERNEL__
   rinf.addr_spc = addr_spc;
   rinf.controllen = 0;
@@ -647,6 +655,8 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
 #ifndef __KERNEL__
   tcp_recv_spin = 
     oo_per_thread_get()->spinstate & (1 << ONLOAD_SPIN_TCP_RECV);
+  /* Learn from the first wait of this call only. */
+  spin_adapt = tcp_recv_spin && NI_OPTS(ni).spin_adapt;
 #endif
   ci_frc64(&start_frc);
 
@@ -745,12 +755,21 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
         rinf.rc = rc2;
         goto unlock_out;
       }
+      if( spin_adapt ) {
+        ci_uint64 now_frc;
+        ci_frc64(&now_frc);
+        citp_waitable_spin_adapt_record(ni, &ts->s.b, now_frc - start_frc, 1);
+        spin_adapt = 0;
+      }
       goto poll_recv_queue;
     }
 
     tcp_recv_spin = 0;
     if( timeout ) {
-      ci_uint32 spin_ms = NI_OPTS(ni).spin_usec >> 10;
+      ci_uint64 now_frc;
+      ci_uint32 spin_ms;
+      ci_frc64(&now_frc);
+      spin_ms = (now_frc - start_frc) / IPTIMER_STATE(ni)->khz;
       if( spin_ms < timeout )
         timeout -= spin_ms;
       else {
@@ -784,6 +803,14 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
                         sleep_seq, &timeout);
     if( rc2 == 0 )
       rc2 = ci_sock_lock(ni, &ts->s.b);
+#ifndef __KERNEL__
+    if( rc2 == 0 && spin_adapt && tcp_rcv_usr(ts) ) {
+      ci_uint64 now_frc;
+      ci_frc64(&now_frc);
+      citp_waitable_spin_adapt_record(ni, &ts->s.b, now_frc - start_frc, 0);
+      spin_adapt = 0;
+    }
+#endif
     if( rc2 < 0 ) {
       /* If we've received anything at all, we must say how much. */
       if( rinf.rc ) {
@@ -919,6 +946,13 @@ static inline int ci_tcp_recvmsg_impl(const ci_tcp_recvmsg_args* a,
   goto unlock_out;
 
  success_unlock_out:
+  if(CI_UNLIKELY( rinf.rx_frc != 0 )) {
+    ci_uint64 now_frc;
+    ci_frc64(&now_frc);
+    if( now_frc > rinf.rx_frc )
+      ci_tcp_lat_hist_record(ni, ts, CI_TCP_LAT_HIST_RX,
+                             now_frc - rinf.rx_frc);
+  }
 #ifndef __KERNEL__
   ci_tcp_recv_fill_msgname(ts, (struct sockaddr*) a->msg->msg_name,
                            &a->msg->msg_namelen);  /*!\TODO fixme remove cast*/
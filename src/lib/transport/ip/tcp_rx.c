@@ -1428,6 +1428,7 @@ static void ci_tcp_rx_free_acked_bufs(ci_netif* netif, ci_tcp_state* ts,
 {
   struct ci_netif_poll_state* ps = rxp->poll_state;
   ci_ip_pkt_queue* rtq = &ts->retrans;
+  ci_uint64 lat_sent_frc = 0;
 #if CI_CFG_TIMESTAMPING
   oo_pkt_p ts_q_pending = ts->timestamp_q_pending;
   unsigned ts_q_bufs = 0;
@@ -1471,9 +1472,16 @@ static void ci_tcp_rx_free_acked_bufs(ci_netif* netif, ci_tcp_state* ts,
 
     ci_assert(p->refcount > 0);
 
+    /* Only packets whose single transmission has completed give an RTT
+     * sample; see ci_netif_tx_pkt_complete_lat_hist(). */
+    if(CI_UNLIKELY( p->tx_lat_frc != 0 ) &&
+       ! (p->flags & (CI_PKT_FLAG_TX_PENDING | CI_PKT_FLAG_RTQ_RETRANS)) )
+      lat_sent_frc = p->tx_lat_frc;
+
 #if CI_CFG_TIMESTAMPING
     if( p->flags & CI_PKT_FLAG_TX_TIMESTAMPED &&
-        onload_timestamping_want_tx_nic(ts->s.timestamping_flags) ) {
+        onload_timestamping_want_tx_nic(ts->s.timestamping_flags) &&
+        ! (ts->s.timestamping_flags & ONLOAD_SOF_TIMESTAMPING_TX_RING) ) {
       ci_udp_recv_q_put_pending(netif, &ts->timestamp_q, p);
       if( OO_PP_IS_NULL(ts_q_pending) ) {
         if( p->flags & CI_PKT_FLAG_TX_PENDING)
@@ -1511,6 +1519,15 @@ static void ci_tcp_rx_free_acked_bufs(ci_netif* netif, ci_tcp_state* ts,
   }
 #endif
 
+  if(CI_UNLIKELY( lat_sent_frc != 0 ) &&
+     OO_P_NOT_NULL(ts->lat_hist[CI_TCP_LAT_HIST_RTT]) ) {
+    ci_uint64 now_frc;
+    ci_frc64(&now_frc);
+    if( now_frc > lat_sent_frc )
+      ci_tcp_lat_hist_record(netif, ts, CI_TCP_LAT_HIST_RTT,
+                             now_frc - lat_sent_frc);
+  }
+
   /* Make sure reap will happen in a timely manner if we've added
    * packets to the timestamp queue 
    */
@@ -4500,6 +4517,7 @@ int ci_tcp_rx_deliver_to_conn(ci_sock_cmn* s, void* opaque_arg)
   ci_netif* ni = rxp->ni;
   int not_fast;
 
+  ci_tcp_send_nolock_merge(ni, ts);
   CHECK_TS(ni, ts);
 
   ci_assert(CI_IPX_ADDR_EQ(RX_PKT_DADDR(pkt),
@@ -4514,6 +4532,9 @@ int ci_tcp_rx_deliver_to_conn(ci_sock_cmn* s, void* opaque_arg)
    */
   ci_netif_put_on_post_poll(ni, &ts->s.b);
 
+  if( rxp->poll_state != NULL )
+    rxp->poll_state->rx_sock_cache = SC_SP(s);
+
   CI_IP_SOCK_STATS_ADD_RXBYTE( ts, pkt->pf.tcp_rx.pay_len );
   ++ts->stats.rx_pkts;
 
@@ -4659,6 +4680,38 @@ int ci_tcp_rx_deliver_to_conn(ci_sock_cmn* s, void* opaque_arg)
 }
 
 
+/* When RX batching is enabled, consecutive packets of a flow are delivered
+ * back-to-back, so the socket matched by the previous packet is very likely
+ * to be the right one for this packet too.  Check that it still is, using
+ * the same criteria as the filter-table match, so that the lookup can be
+ * skipped.  Sockets that are closed or have been reused for another
+ * connection fail the check, so a stale cache entry is harmless.
+ */
+static ci_sock_cmn*
+ci_tcp_rx_batch_cached_sock(ci_netif* ni, struct ci_netif_poll_state* ps,
+                            ci_ip_pkt_fmt* pkt, ci_tcp_hdr* tcp)
+{
+  ci_ip4_hdr* ip4 = oo_ip_hdr(pkt);
+  ci_sock_cmn* s;
+
+  if( ps == NULL || ! ps->rx_batch || OO_SP_IS_NULL(ps->rx_sock_cache) )
+    return NULL;
+
+  s = SP_TO_SOCK(ni, ps->rx_sock_cache);
+  if( (s->b.state & CI_TCP_STATE_TCP) &&
+      (s->b.state & CI_TCP_STATE_TCP_CONN) &&
+      ((sock_laddr_be32(s) - ip4->ip_daddr_be32) |
+       (sock_lport_be16(s) - tcp->tcp_dest_be16) |
+       (sock_raddr_be32(s) - ip4->ip_saddr_be32) |
+       (sock_rport_be16(s) - tcp->tcp_source_be16)) == 0 &&
+      /* Sockets bound to a device take the full lookup path, which also
+       * checks the interface. */
+      s->rx_bind2dev_ifindex == CI_IFID_BAD )
+    return s;
+  return NULL;
+}
+
+
 static int ci_tcp_rx_deliver_to_listen(ci_sock_cmn* s, void* opaque_arg)
 {
   ciip_tcp_rx_pkt* rxp = opaque_arg;
@@ -4792,6 +4845,9 @@ void ci_tcp_handle_rx(ci_netif* netif, struct ci_netif_poll_state* ps,
     if(CI_LIKELY( rxp.pkt == NULL ))
       return;
 
+    if( ci_tcp_timewait_rx(netif, &rxp, daddr, saddr) )
+      return;
+
     ci_netif_filter_for_each_match_ip6(netif,
                                        &daddr, tcp->tcp_dest_be16,
                                        NULL, 0, IPPROTO_TCP, pkt->intf_i,
@@ -4811,6 +4867,13 @@ void ci_tcp_handle_rx(ci_netif* netif, struct ci_netif_poll_state* ps,
   else
 #endif
   {
+    ci_sock_cmn* s = ci_tcp_rx_batch_cached_sock(netif, ps, pkt, tcp);
+    if( s != NULL ) {
+      CITP_STATS_NETIF_INC(netif, rx_batch_sock_cache_hits);
+      ci_tcp_rx_deliver_to_conn(s, &rxp);
+      return;
+    }
+
     ci_netif_filter_for_each_match(netif,
                                    ip4->ip_daddr_be32, tcp->tcp_dest_be16,
                                    ip4->ip_saddr_be32, tcp->tcp_source_be16,
@@ -4820,6 +4883,9 @@ void ci_tcp_handle_rx(ci_netif* netif, struct ci_netif_poll_state* ps,
     if(CI_LIKELY( rxp.pkt == NULL ))
       return;
 
+    if( ci_tcp_timewait_rx(netif, &rxp, daddr, saddr) )
+      return;
+
     ci_netif_filter_for_each_match(netif,
                                    ip4->ip_daddr_be32, tcp->tcp_dest_be16,
                                    0, 0, IPPROTO_TCP, pkt->intf_i, pkt->vlan,
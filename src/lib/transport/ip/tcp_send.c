@@ -16,6 +16,7 @@
 #include "ip_internal.h"
 #include "tcp_tx.h"
 #include "ip_tx.h"
+#include "netif_tx.h"
 
 #if !defined(__KERNEL__)
 #include <sys/socket.h>
@@ -175,6 +176,10 @@ int ci_tcp_sendmsg_fill_pkt(ci_netif* ni, ci_tcp_state* ts,
   ci_assert(pkt);
   ci_assert(! ci_iovec_ptr_is_empty_proper(piov));
   ci_tcp_tx_pkt_init(pkt, hdrlen, maxlen);
+  if(CI_UNLIKELY( OO_P_NOT_NULL(ts->lat_hist[CI_TCP_LAT_HIST_TX]) )) {
+    ci_frc64(&pkt->tx_lat_frc);
+    pkt->pf.tcp_tx.sock_id = ts->s.b.bufid;
+  }
   oo_pkt_filler_init(&sinf->pf, pkt,
                      (uint8_t*) oo_tx_l3_hdr(pkt) + hdrlen);
 
@@ -942,8 +947,10 @@ ci_tcp_tmpl_update(ci_netif* ni, ci_tcp_state* ts,
 
   ci_assert_ge(pkt->pio_addr, 0);
 
+  ci_tcp_send_nolock_block(ni, ts);
   if( ci_ip_queue_is_empty(&ts->send) && ef_vi_transmit_space(vi) > 0 &&
-      ci_tcp_inflight(ts) + ts->smss < CI_MIN(ts->cwnd, tcp_snd_wnd(ts)) ) {
+      ci_tcp_inflight(ts) + ts->smss < CI_MIN(ts->cwnd, tcp_snd_wnd(ts)) &&
+      ci_netif_tx_claim(ni, pkt->intf_i) ) {
     /* Sendq is empty, TXQ is not full, and send window allows us to
      * send the requested amount of data, so go ahead and send
      */
@@ -985,6 +992,7 @@ ci_tcp_tmpl_update(ci_netif* ni, ci_tcp_state* ts,
      * the TXQ */
     rc = ef_vi_transmit_pio(vi, pkt->pio_addr, pkt->pay_len, OO_PKT_ID(pkt));
     ci_assert_equal(rc, 0);
+    ci_netif_tx_release(ni, pkt->intf_i);
 
     /* Update tcp state machinery state */
     tcp_snd_nxt(ts) = pkt->pf.tcp_tx.end_seq;
@@ -1044,6 +1052,8 @@ static int ci_tcp_sendmsg_enqueue(ci_netif* ni, ci_tcp_state* ts,
   ci_assert(ci_netif_is_locked(ni));
   ci_assert_equal(ts->s.tx_errno, 0);
 
+  ci_tcp_send_nolock_block(ni, ts);
+
   do {
     pkt = reverse_list;
     reverse_list = (ci_ip_pkt_fmt *)CI_USER_PTR_GET(pkt->pf.tcp_tx.next);
@@ -1139,6 +1149,8 @@ void ci_tcp_sendmsg_enqueue_prequeue(ci_netif* ni, ci_tcp_state* ts,
     return;
   }
 
+  ci_tcp_send_nolock_block(ni, ts);
+
   /* Reverse the list. */
   send_list = OO_PP_NULL;
   do {
@@ -1280,6 +1292,61 @@ void ci_tcp_sendmsg_enqueue_prequeue_deferred(ci_netif* ni, ci_tcp_state* ts)
 }
 
 
+/* Move the packets that were sent without the stack lock (see
+ * ci_tcp_sendmsg_nolock()) onto the retransmit queue, and do the
+ * bookkeeping that ci_tcp_tx_advance_to() would have done for them.
+ */
+void __ci_tcp_send_nolock_merge(ci_netif* ni, ci_tcp_state* ts)
+{
+  ci_ip_pkt_fmt* pkt;
+  oo_pkt_p id, next, send_list;
+  int n_pkts = 0;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  /* Grab the list atomically: a sender may be adding to it right now. */
+  do {
+    OO_PP_INIT(ni, id, ts->send_nolock);
+    if( OO_PP_IS_NULL(id) )
+      return;
+  } while( ci_cas32_fail(&ts->send_nolock, OO_PP_ID(id), OO_PP_ID_NULL) );
+
+  /* Reverse the list into sequence order. */
+  send_list = OO_PP_NULL;
+  do {
+    pkt = PKT_CHK(ni, id);
+    id = pkt->next;
+    pkt->next = send_list;
+    send_list = OO_PKT_P(pkt);
+    ++n_pkts;
+  }
+  while( OO_PP_NOT_NULL(id) );
+
+  for( id = send_list; OO_PP_NOT_NULL(id); id = next ) {
+    pkt = PKT_CHK(ni, id);
+    next = pkt->next;
+    CI_TCP_STATS_INC_OUT_SEGS(ni);
+    CI_IP_SOCK_STATS_ADD_TXBYTE(ts, TX_PKT_LEN(pkt));
+    ci_ip_queue_enqueue(ni, &ts->retrans, pkt);
+  }
+
+  ni->state->n_async_pkts -= n_pkts;
+  ts->send_in += n_pkts;
+  ts->send_out += n_pkts;
+
+  /* The sender read the ACK field without the lock, so we leave the
+   * delayed ACK state alone: at worst we send an ACK we did not need to.
+   */
+  ci_tcp_kalive_check_and_clear(ni, ts);
+  if( ! (ts->s.b.state & CI_TCP_STATE_NO_TIMERS) )
+    ci_tcp_rto_check_and_set(ni, ts);
+
+  LOG_TV(ci_log("%s: "NT_FMT "merged %d packets retrans.num=%d snd_nxt=%x",
+                __FUNCTION__, NT_PRI_ARGS(ni, ts), n_pkts, ts->retrans.num,
+                tcp_snd_nxt(ts)));
+}
+
+
 ci_inline void ci_tcp_sendmsg_free_unused_pkts(ci_netif* ni, 
                                                struct tcp_send_info* sinf)
 {
@@ -1846,6 +1913,235 @@ ci_tcp_send_fill_pkts(ci_netif* ni, ci_tcp_state* ts,
   while( --n_pkts > 0 );
 }
 
+#ifndef __KERNEL__
+
+/* Can the data in [fill_list] go out straight away without the lock?  This
+ * is called without the lock, and again once the socket's nolock gate is
+ * held so that no lock holder can be changing the send sequence.
+ */
+ci_inline int ci_tcp_send_nolock_may_send(ci_netif* ni, ci_tcp_state* ts,
+                                          int bytes)
+{
+  if( ts->s.b.state != CI_TCP_ESTABLISHED || ts->s.tx_errno != 0 ||
+      ts->snd_delegated != 0 || ts->congstate != CI_TCP_CONG_OPEN ||
+      ci_ip_queue_not_empty(&ts->send) ||
+      OO_ACCESS_ONCE(ts->send_prequeue) != OO_PP_ID_NULL ||
+      SEQ_LT(tcp_snd_una(ts), tcp_snd_up(ts)) )
+    return 0;
+
+  /* Nagle */
+  if( ci_tcp_is_inflight(ts) &&
+      ( ! (ts->s.s_aflags & CI_SOCK_AFLAG_NODELAY) ||
+        ts->retrans.num >= NI_OPTS(ni).nonagle_inflight_max ) )
+    return 0;
+
+  /* Congestion and receive windows */
+  return ci_tcp_inflight(ts) + bytes <= ts->cwnd &&
+         SEQ_LE(tcp_enq_nxt(ts) + bytes, ts->snd_max);
+}
+
+
+/* Send the final chunk of a send() without the stack lock, when another
+ * thread holds it.  The packets are pushed to the NIC by DMA under the
+ * interface's TX claim, and are left on [ts->send_nolock] for a lock
+ * holder to move onto the retransmit queue.  Anything that needs the lock,
+ * such as backing off CTPIO, is left for the lock holder too.
+ *
+ * Returns 1 if the data was sent, else 0 and the caller should fall back
+ * to the prequeue.
+ */
+static int ci_tcp_sendmsg_nolock(ci_netif* ni, ci_tcp_state* ts,
+                                 struct tcp_send_info* sinf)
+{
+  ci_ip_cached_hdrs* ipcache = &ts->s.pkt;
+  ci_netif_state_nic_t* nsn;
+  ci_ip_pkt_fmt *pkt, *next, *head = NULL;
+  int bytes = sinf->fill_list_bytes;
+  int hdrlen = ts->outgoing_hdrs_len;
+  int intf_i, n_pkts = 0, tx_bytes = 0;
+  ci_uint32 owner;
+  unsigned seq, now;
+  ci_uint32 ack_be32;
+  ci_uint16 window_be16;
+  oo_pkt_p send_list;
+  ef_vi* vi;
+
+  if( ! NI_OPTS(ni).tcp_send_nolock ||
+      sinf->total_unsent != bytes ||
+      (sinf->fill_list->flags & CI_PKT_FLAG_TX_MORE) )
+    return 0;
+
+  /* Only the plain IPv4 DMA path is handled here. */
+  intf_i = ipcache->intf_i;
+  if( ipcache_af(ipcache) != AF_INET ||
+      (ipcache->flags & CI_IP_CACHE_IS_LOCALROUTE) ||
+      ipcache->status != retrrc_success ||
+      ! oo_cp_ipcache_is_valid(ni, ipcache) ||
+      (unsigned) intf_i >= CI_CFG_MAX_INTERFACES )
+    return 0;
+  nsn = &ni->state->nic[intf_i];
+  vi = ci_netif_vi(ni, intf_i);
+  if( (nsn->oo_vi_flags & OO_VI_FLAGS_TX_CTPIO_ONLY) ||
+      vi->nic_type.arch == EF_VI_ARCH_AF_XDP )
+    return 0;
+#if CI_CFG_PORT_STRIPING
+  if( ts->tcpflags & CI_TCPT_FLAG_STRIPE )
+    return 0;
+#endif
+#if CI_CFG_TCPDUMP
+  if( ni->state->dump_intf[intf_i] == OO_INTF_I_DUMP_ALL )
+    return 0;
+#endif
+#if CI_CFG_TIMESTAMPING
+  if( onload_timestamping_want_tx_nic(ts->s.timestamping_flags) )
+    return 0;
+#endif
+  /* The packets must not need their option space or length fixed up. */
+  for( pkt = sinf->fill_list; pkt;
+       pkt = CI_USER_PTR_GET(pkt->pf.tcp_tx.next) )
+    if( pkt->pf.tcp_tx.start_seq != hdrlen ||
+        pkt->pf.tcp_tx.end_seq > tcp_eff_mss(ts) ||
+        (pkt->flags & CI_PKT_FLAG_INDIRECT) )
+      return 0;
+
+  if( ! ci_tcp_send_nolock_may_send(ni, ts, bytes) )
+    return 0;
+  owner = oo_per_thread_get()->tid;
+  if( ! ci_tcp_send_nolock_enter(ts, owner) )
+    return 0;
+  if( ! ci_tcp_send_nolock_may_send(ni, ts, bytes) )
+    goto out_gate;
+
+  /* Prep the packets as ci_tcp_sendmsg_enqueue() does, and finish them off
+   * as ci_tcp_tx_advance_to() does.
+   */
+  seq = tcp_enq_nxt(ts) + bytes;
+  send_list = OO_PP_NULL;
+  pkt = sinf->fill_list;
+  do {
+    next = CI_USER_PTR_GET(pkt->pf.tcp_tx.next);
+    seq -= pkt->pf.tcp_tx.end_seq;
+    ci_tcp_sendmsg_prep_pkt(ni, ts, pkt, seq);
+    pkt->next = send_list;
+    send_list = OO_PKT_P(pkt);
+    ++n_pkts;
+    pkt = next;
+  }
+  while( pkt );
+  ci_assert_equal(seq, tcp_enq_nxt(ts));
+
+  now = ci_tcp_time_now(ni);
+  ack_be32 = CI_BSWAP_BE32(tcp_rcv_nxt(ts));
+  window_be16 = TS_IPX_TCP(ts)->tcp_window_be16;
+  head = PKT_CHK(ni, send_list);
+  for( pkt = head; ; pkt = PKT_CHK(ni, pkt->next) ) {
+    ci_tcp_hdr* tcp = TX_PKT_IPX_TCP(AF_INET, pkt);
+    ci_uint8* opt = CI_TCP_HDR_OPTS(tcp);
+    if( ts->tcpflags & CI_TCPT_FLAG_TSO )
+      ci_tcp_tx_opt_tso(&opt, now, ts->tsrecent);
+    tcp->tcp_seq_be32 = CI_BSWAP_BE32(pkt->pf.tcp_tx.start_seq);
+    tcp->tcp_ack_be32 = ack_be32;
+    tcp->tcp_window_be16 = window_be16;
+    ci_tcp_ipx_hdr_init(AF_INET, oo_tx_ipx_hdr(AF_INET, pkt),
+                        oo_tx_l3_len(pkt));
+    ci_ip_set_mac_and_port(ni, ipcache, pkt);
+    if( OO_PP_IS_NULL(pkt->next) ) {
+      if( pkt->flags & CI_PKT_FLAG_TX_PSH )
+        tcp->tcp_flags |= CI_TCP_FLAG_PSH;
+      break;
+    }
+  }
+
+  /* The route may have changed while we were copying the headers. */
+  if( ! oo_cp_ipcache_is_valid(ni, ipcache) || ipcache->intf_i != intf_i )
+    goto out_undo;
+  if( ! ci_netif_tx_claim_spins(ni, intf_i, owner, CI_NETIF_TX_CLAIM_SPINS) )
+    goto out_busy;
+  /* If we took so long that the lock holder has taken the gate back, the
+   * send sequence is no longer ours. */
+  if( ! ci_tcp_send_nolock_held(ts, owner) ) {
+    ci_netif_tx_unclaim(ni, intf_i, owner);
+    goto out_undo;
+  }
+  if( oo_pktq_not_empty(&nsn->dmaq) ||
+      ef_vi_transmit_space(vi) <= n_pkts * CI_IP_PKT_SEGMENTS_MAX ) {
+    ci_netif_tx_unclaim(ni, intf_i, owner);
+    goto out_busy;
+  }
+
+  tcp_snd_nxt(ts) = tcp_enq_nxt(ts) = seq + bytes;
+
+  for( pkt = head; ; pkt = PKT_CHK(ni, pkt->next) ) {
+    ef_iovec iov[CI_IP_PKT_SEGMENTS_MAX];
+    int iov_len, rc;
+
+    ci_netif_pkt_hold(ni, pkt);
+    pkt->flags |= CI_PKT_FLAG_TX_PENDING;
+    tx_bytes += TX_PKT_LEN(pkt);
+    iov_len = ci_netif_pkt_to_iovec(ni, pkt, iov,
+                                    sizeof(iov) / sizeof(iov[0]));
+    ci_assert_gt(iov_len, 0);
+    rc = ef_vi_transmitv_init(vi, iov, iov_len, OO_PKT_ID(pkt));
+    ci_assert_equal(rc, 0);
+    (void) rc;
+    if( OO_PP_IS_NULL(pkt->next) )
+      break;
+  }
+
+  /* Hand the packets over to the lock holder, newest first.  This must be
+   * done before the doorbell: the lock holder merges them whenever it
+   * finds them, and they have to be on the retransmit queue by the time it
+   * sees an ACK for them.
+   */
+  send_list = OO_PP_NULL;
+  for( pkt = head; pkt; pkt = next ) {
+    next = OO_PP_IS_NULL(pkt->next) ? NULL : PKT_CHK(ni, pkt->next);
+    pkt->next = send_list;
+    send_list = OO_PKT_P(pkt);
+  }
+  do
+    OO_PP_INIT(ni, head->next, ts->send_nolock);
+  while( ci_cas32_fail(&ts->send_nolock, OO_PP_ID(head->next),
+                       OO_PP_ID(send_list)) );
+
+  /* The next poll folds these into tx_dmaq_insert_seq before it handles
+   * the completions.  Bytes first, so that they are never behind.
+   */
+  nsn->tx_nolock_bytes += tx_bytes;
+  ci_wmb();
+  nsn->tx_nolock_pkts += n_pkts;
+  ef_vi_transmit_push(vi);
+  CITP_STATS_NETIF_INC(ni, tx_dma_doorbells);
+  ci_netif_tx_unclaim(ni, intf_i, owner);
+
+  ci_tcp_send_nolock_leave(ts, owner);
+  CITP_STATS_NETIF_INC(ni, tcp_send_nolock);
+
+  ci_assert_equal(sinf->stack_locked, 0);
+  if( ci_netif_lock_or_defer_work(ni, &ts->s.b) )
+    sinf->stack_locked = 1;
+  return 1;
+
+ out_busy:
+  CITP_STATS_NETIF_INC(ni, tcp_send_nolock_ring_busy);
+ out_undo:
+  /* Put the packets back as they were filled, for the prequeue. */
+  for( pkt = head; ; pkt = PKT_CHK(ni, pkt->next) ) {
+    pkt->pf.tcp_tx.end_seq -= pkt->pf.tcp_tx.start_seq;
+    pkt->pf.tcp_tx.start_seq = hdrlen;
+    if( OO_PP_IS_NULL(pkt->next) )
+      break;
+  }
+ out_gate:
+  ci_tcp_send_nolock_leave(ts, owner);
+  return 0;
+}
+
+#else
+# define ci_tcp_sendmsg_nolock(ni, ts, sinf)  0
+#endif
+
+
 /* returns 1 if data sent, 0 otherwise */
 static int ci_tcp_send_via_prequeue(ci_netif* ni, ci_tcp_state* ts,
                                     struct tcp_send_info* sinf)
@@ -2099,8 +2395,10 @@ int ci_tcp_sendmsg(ci_netif* ni, ci_tcp_state* ts,
         if ( ! (sinf.fill_list->flags & CI_PKT_FLAG_TX_MORE) )
           sinf.fill_list->flags |= CI_PKT_FLAG_TX_PSH;
 
-      /* Couldn't get the netif lock, so enqueue packets on the prequeue. */
-      if( ! ci_tcp_send_via_prequeue(ni, ts, &sinf) ) {
+      /* Couldn't get the netif lock, so send without it if we can, or
+       * else enqueue packets on the prequeue. */
+      if( ! ci_tcp_sendmsg_nolock(ni, ts, &sinf) &&
+          ! ci_tcp_send_via_prequeue(ni, ts, &sinf) ) {
         ci_tcp_sendmsg_handle_tx_errno(ni, ts, flags, &sinf);
         if( sinf.set_errno ) CI_SET_ERROR(sinf.rc, sinf.rc);
         return sinf.rc;
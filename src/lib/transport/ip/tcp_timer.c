@@ -452,6 +452,8 @@ void ci_tcp_timeout_rto(ci_netif* netif, ci_tcp_state* ts)
   unsigned max_retrans;
   int seq_used;
 
+  ci_tcp_send_nolock_merge(netif, ts);
+
   if( CI_CFG_TAIL_DROP_PROBE &&
       (ts->tcpflags & CI_TCPT_FLAG_TAIL_DROP_TIMING) ) {
     ci_tcp_timeout_taildrop(netif, ts);
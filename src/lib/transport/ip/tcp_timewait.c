@@ -0,0 +1,369 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+/**************************************************************************\
+*//*! \file
+**  \brief  Compact TIME_WAIT table (EF_TCP_TIME_WAIT_COMPACT)
+*//*
+\**************************************************************************/
+
+/*! \cidoxg_lib_transport_ip */
+
+/* An orphaned connection in TIME_WAIT has nothing left to do but ACK
+ * retransmitted FINs and refuse old duplicates, and it can do that without
+ * a full ci_tcp_state.  This file keeps the handful of fields that are
+ * needed in an open-addressed hash table laid out like the table of
+ * previously-used sequence numbers in tcp_connect.c, so that the endpoint
+ * can go back on the free list at once.  Segments that miss the software
+ * filter table are looked up here before being offered to listeners.
+ */
+
+#include "ip_internal.h"
+
+#if OO_DO_STACK_POLL
+
+#define LPF "tcp_timewait: "
+
+#define TCP_TIMEWAIT_DEPTH_LIMIT 16
+
+
+ci_inline ci_uint32
+ci_tcp_timewait_hash1(ci_netif* ni, const ci_tcp_timewait_t* tw)
+{
+  return onload_hash1(ni->state->timewait_table_entries_n - 1,
+                      tw->laddr, tw->lport, tw->raddr, tw->rport,
+                      IPPROTO_TCP);
+}
+
+
+ci_inline ci_uint32
+ci_tcp_timewait_hash2(ci_netif* ni, const ci_tcp_timewait_t* tw)
+{
+  return onload_hash2(tw->laddr, tw->lport, tw->raddr, tw->rport,
+                      IPPROTO_TCP);
+}
+
+
+ci_inline ci_uint32
+ci_tcp_timewait_next(ci_netif* ni, ci_uint32 hash, ci_uint32 hash2)
+{
+  return (hash + hash2) & (ni->state->timewait_table_entries_n - 1);
+}
+
+
+ci_inline int /*bool*/
+ci_tcp_timewait_match(const ci_tcp_timewait_t* a, const ci_tcp_timewait_t* b)
+{
+  return CI_IPX_ADDR_EQ(a->laddr, b->laddr) && a->lport == b->lport &&
+         CI_IPX_ADDR_EQ(a->raddr, b->raddr) && a->rport == b->rport;
+}
+
+
+ci_inline int /*bool*/
+ci_tcp_timewait_expired(ci_netif* ni, const ci_tcp_timewait_t* tw)
+{
+  return ci_ip_time_before(tw->expiry, ci_ip_time_now(ni));
+}
+
+
+/* Remove the route_count references along the look-up path of [key] up to
+ * and including [entry]. */
+static void
+__ci_tcp_timewait_free(ci_netif* ni, const ci_tcp_timewait_t* key,
+                       const ci_tcp_timewait_t* entry)
+{
+  ci_uint32 hash = ci_tcp_timewait_hash1(ni, key);
+  ci_uint32 hash2 = 0;
+  int depth = 0;
+
+  do {
+    ci_tcp_timewait_t* tw = &ni->timewait_table[hash];
+    ci_assert_lt(hash, ni->state->timewait_table_entries_n);
+
+    ci_assert_gt(tw->route_count, 0);
+    --tw->route_count;
+
+    if( tw == entry )
+      return;
+    if( hash2 == 0 )
+      hash2 = ci_tcp_timewait_hash2(ni, key);
+    hash = ci_tcp_timewait_next(ni, hash, hash2);
+    depth++;
+    ci_assert_le(depth, TCP_TIMEWAIT_DEPTH_LIMIT);
+    if(CI_UNLIKELY( depth > TCP_TIMEWAIT_DEPTH_LIMIT )) {
+      LOG_U(ci_log("%s: reached search depth", __FUNCTION__));
+      break;
+    }
+  } while( 1 );
+}
+
+
+static void ci_tcp_timewait_free(ci_netif* ni, ci_tcp_timewait_t* tw)
+{
+  __ci_tcp_timewait_free(ni, tw, tw);
+  tw->laddr = addr_any;
+}
+
+
+static ci_tcp_timewait_t*
+ci_tcp_timewait_lookup(ci_netif* ni, const ci_tcp_timewait_t* key)
+{
+  ci_uint32 hash = ci_tcp_timewait_hash1(ni, key);
+  ci_uint32 hash2 = 0;
+  int depth;
+
+  for( depth = 0; depth < TCP_TIMEWAIT_DEPTH_LIMIT; ++depth ) {
+    ci_tcp_timewait_t* tw = &ni->timewait_table[hash];
+    ci_assert_lt(hash, ni->state->timewait_table_entries_n);
+
+    if( CI_TCP_TIMEWAIT_IS_TERMINAL(*tw) )
+      return NULL;
+    if( ci_tcp_timewait_match(tw, key) )
+      return tw;
+
+    if( hash2 == 0 )
+      hash2 = ci_tcp_timewait_hash2(ni, key);
+    hash = ci_tcp_timewait_next(ni, hash, hash2);
+  }
+
+  return NULL;
+}
+
+
+/* Insert [from] into the table.  If there are no free or expired entries
+ * within the search depth then the one that is closest to expiry is
+ * purged, so insertion always succeeds. */
+static void ci_tcp_timewait_insert(ci_netif* ni, const ci_tcp_timewait_t* from)
+{
+  ci_uint32 hash;
+  ci_uint32 hash2 = 0;
+  ci_tcp_timewait_t* oldest = NULL;
+  ci_tcp_timewait_t* tw = NULL;
+  int depth;
+
+  hash = ci_tcp_timewait_hash1(ni, from);
+
+  for( depth = 0; depth < TCP_TIMEWAIT_DEPTH_LIMIT; ++depth ) {
+    tw = &ni->timewait_table[hash];
+    ci_assert_lt(hash, ni->state->timewait_table_entries_n);
+
+    ci_assert_impl(CI_TCP_TIMEWAIT_IS_TERMINAL(*tw),
+                   CI_TCP_TIMEWAIT_IS_FREE(*tw));
+    ++tw->route_count;
+
+    if( CI_TCP_TIMEWAIT_IS_FREE(*tw) )
+      break;
+    if( ci_tcp_timewait_expired(ni, tw) ) {
+      ci_tcp_timewait_free(ni, tw);
+      CITP_STATS_NETIF_INC(ni, tcp_time_wait_compact_expiries);
+      break;
+    }
+    if( oldest == NULL || ci_ip_time_before(tw->expiry, oldest->expiry) )
+      oldest = tw;
+
+    if( hash2 == 0 )
+      hash2 = ci_tcp_timewait_hash2(ni, from);
+    hash = ci_tcp_timewait_next(ni, hash, hash2);
+  }
+
+  if( depth >= TCP_TIMEWAIT_DEPTH_LIMIT ) {
+    ci_assert_equal(depth, TCP_TIMEWAIT_DEPTH_LIMIT);
+    ci_assert(oldest);
+    /* Roll back the route counts taken above, purge the oldest entry and
+     * try again: this time there is a free entry on the path. */
+    __ci_tcp_timewait_free(ni, from, tw);
+    ci_tcp_timewait_free(ni, oldest);
+    CITP_STATS_NETIF_INC(ni, tcp_time_wait_compact_purgations);
+    ci_tcp_timewait_insert(ni, from);
+    return;
+  }
+
+  tw->laddr = from->laddr;
+  tw->raddr = from->raddr;
+  tw->lport = from->lport;
+  tw->rport = from->rport;
+  tw->snd_nxt = from->snd_nxt;
+  tw->rcv_nxt = from->rcv_nxt;
+  tw->tsrecent = from->tsrecent;
+  tw->expiry = from->expiry;
+  tw->rcv_wnd_be16 = from->rcv_wnd_be16;
+  tw->flags = from->flags;
+  CITP_STATS_NETIF_INC(ni, tcp_time_wait_compact_insertions);
+}
+
+
+/* Record [ts], which is an orphan in TIME_WAIT, in the compact table.  The
+ * caller then drops [ts] as usual. */
+void ci_tcp_timewait_compact(ci_netif* ni, ci_tcp_state* ts)
+{
+  ci_tcp_timewait_t tw;
+  ci_tcp_timewait_t* old;
+
+  ci_assert(ci_netif_is_locked(ni));
+  ci_assert_equal(ts->s.b.state, CI_TCP_TIME_WAIT);
+  ci_assert(ts->tcpflags & CI_TCPT_FLAG_TW_COMPACT);
+  ci_assert_gt(ni->state->timewait_table_entries_n, 0);
+
+  tw.laddr = tcp_ipx_laddr(ts);
+  tw.raddr = tcp_ipx_raddr(ts);
+  tw.lport = tcp_lport_be16(ts);
+  tw.rport = tcp_rport_be16(ts);
+  tw.snd_nxt = tcp_snd_nxt(ts);
+  tw.rcv_nxt = tcp_rcv_nxt(ts);
+  tw.tsrecent = ts->tsrecent;
+  tw.rcv_wnd_be16 = TS_IPX_TCP(ts)->tcp_window_be16;
+  tw.route_count = 0;
+  tw.flags = 0;
+  if( ts->tcpflags & CI_TCPT_FLAG_TSO )
+    tw.flags |= CI_TCP_TIMEWAIT_FLAG_TSO;
+  if( ts->tcpflags & CI_TCPT_FLAG_SEQNO_REMEMBERED )
+    tw.flags |= CI_TCP_TIMEWAIT_FLAG_SEQNO_REMEMBERED;
+  /* The handover happens at most a tick or so after TIME_WAIT was entered,
+   * so a full 2MSL from now is what the endpoint would have waited. */
+  tw.expiry = ci_ip_time_now(ni) + NI_CONF(ni).tconst_2msl_time;
+
+  /* A stale record for the same four-tuple would shadow the new one. */
+  if( (old = ci_tcp_timewait_lookup(ni, &tw)) != NULL )
+    ci_tcp_timewait_free(ni, old);
+
+  LOG_TC(log(LNT_FMT "TIME_WAIT compacted snd_nxt=%08x rcv_nxt=%08x",
+             LNT_PRI_ARGS(ni, ts), tw.snd_nxt, tw.rcv_nxt));
+  ci_tcp_timewait_insert(ni, &tw);
+}
+
+
+/* Handle a segment that did not match any socket in the filter table.
+ * Returns true if it belonged to a compacted TIME_WAIT connection and has
+ * been consumed; otherwise the caller goes on to look for a listener. */
+int ci_tcp_timewait_rx(ci_netif* ni, ciip_tcp_rx_pkt* rxp,
+                       ci_addr_t laddr, ci_addr_t raddr)
+{
+  ci_ip_pkt_fmt* pkt = rxp->pkt;
+  ci_tcp_hdr* tcp = rxp->tcp;
+  ci_tcp_timewait_t key;
+  ci_tcp_timewait_t* tw;
+  int paylen;
+
+  if( ni->state->timewait_table_entries_n == 0 )
+    return 0;
+
+  key.laddr = laddr;
+  key.raddr = raddr;
+  key.lport = tcp->tcp_dest_be16;
+  key.rport = tcp->tcp_source_be16;
+  if( (tw = ci_tcp_timewait_lookup(ni, &key)) == NULL )
+    return 0;
+
+  if( ci_tcp_timewait_expired(ni, tw) ) {
+    ci_tcp_timewait_free(ni, tw);
+    CITP_STATS_NETIF_INC(ni, tcp_time_wait_compact_expiries);
+    return 0;
+  }
+
+  CITP_STATS_NETIF_INC(ni, tcp_time_wait_compact_hits);
+  if( ci_tcp_parse_options(ni, rxp, NULL) < 0 ) {
+    ci_netif_pkt_release_rx(ni, pkt);
+    return 1;
+  }
+
+  if( tcp->tcp_flags & CI_TCP_FLAG_RST ) {
+    /* Only an in-window RST may end TIME_WAIT early, as in
+     * handle_rx_rst(). */
+    if( NI_OPTS(ni).time_wait_assassinate && SEQ_EQ(rxp->seq, tw->rcv_nxt) )
+      ci_tcp_timewait_free(ni, tw);
+    ci_netif_pkt_release_rx(ni, pkt);
+    return 1;
+  }
+
+  if( tcp->tcp_flags & CI_TCP_FLAG_SYN ) {
+    /*! rfc1122 p88 4.2.2.13 reopening with SYN; as for the full endpoint in
+     * handle_rx_minor_states(), accept a newer sequence number or, with
+     * PAWS, a newer timestamp. */
+    if( SEQ_LT(tw->rcv_nxt, rxp->seq) ||
+        ((tw->flags & CI_TCP_TIMEWAIT_FLAG_TSO) &&
+         (rxp->flags & CI_TCPT_FLAG_TSO) &&
+         TIME_GE(rxp->timestamp, tw->tsrecent)) ) {
+      int af_space = CI_IS_ADDR_IP6(laddr) ? AF_SPACE_FLAG_IP6 :
+                                             AF_SPACE_FLAG_IP4;
+      oo_sp sock_id = ci_netif_listener_lookup(ni, af_space, laddr,
+                                               tcp->tcp_dest_be16);
+      if( OO_SP_NOT_NULL(sock_id) &&
+          SP_TO_SOCK(ni, sock_id)->b.state == CI_TCP_LISTEN ) {
+        LOG_TV(log(LPF "SYN in compact TIME_WAIT, recycling connection"));
+        ci_tcp_timewait_free(ni, tw);
+        CITP_STATS_NETIF_INC(ni, tcp_time_wait_compact_reopens);
+        return 0;
+      }
+      LOG_U(log(LPF "no matching listener for SYN in TIME_WAIT"));
+    }
+    else {
+      LOG_U(log(LPF "SYN in TIME_WAIT has old SEQ - staying in TIME_WAIT"));
+    }
+  }
+
+  if( tcp->tcp_flags & CI_TCP_FLAG_FIN ) {
+    /* Our last ACK was lost: restart 2MSL, as the endpoint would. */
+    tw->expiry = ci_ip_time_now(ni) + NI_CONF(ni).tconst_2msl_time;
+  }
+
+  /* Pure ACKs can be generated by the peer if we retransmitted our FIN, so
+   * don't answer those.  Anything else gets an ACK restating where we
+   * are. */
+  paylen = pkt->pf.tcp_rx.pay_len - CI_TCP_HDR_LEN(tcp);
+  if( paylen > 0 ||
+      (tcp->tcp_flags & CI_TCP_FLAG_MASK) != CI_TCP_FLAG_ACK ) {
+    CITP_STATS_NETIF_INC(ni, tcp_time_wait_compact_acks);
+    ci_tcp_timewait_reply_ack(ni, rxp, tw);
+  }
+  else {
+    ci_netif_pkt_release_rx(ni, pkt);
+  }
+  return 1;
+}
+
+
+/* An active open wants to reuse this four-tuple.  If it is in the compact
+ * table, remove it and return the sequence number to continue from, as
+ * __ci_netif_active_wild_pool_get() does for a full TIME_WAIT endpoint.
+ * Returns 0 if there is no live record. */
+ci_uint32 ci_tcp_timewait_reuse(ci_netif* ni, ci_addr_t laddr, unsigned lport,
+                                ci_addr_t raddr, unsigned rport)
+{
+  ci_tcp_timewait_t key;
+  ci_tcp_timewait_t* tw;
+  ci_uint32 seq;
+  int remembered;
+
+  if( ni->state->timewait_table_entries_n == 0 )
+    return 0;
+
+  key.laddr = laddr;
+  key.raddr = raddr;
+  key.lport = lport;
+  key.rport = rport;
+  if( (tw = ci_tcp_timewait_lookup(ni, &key)) == NULL )
+    return 0;
+
+  seq = tw->snd_nxt + NI_OPTS(ni).tcp_isn_offset;
+  if( seq == 0 )
+    seq = 1;
+  remembered = tw->flags & CI_TCP_TIMEWAIT_FLAG_SEQNO_REMEMBERED;
+  if( ci_tcp_timewait_expired(ni, tw) ) {
+    ci_tcp_timewait_free(ni, tw);
+    CITP_STATS_NETIF_INC(ni, tcp_time_wait_compact_expiries);
+    return 0;
+  }
+  ci_tcp_timewait_free(ni, tw);
+
+  /* The sequence-number table must not hold a stale entry for a four-tuple
+   * that we are reusing from TIME_WAIT; see ci_tcp_connect_ul_start(). */
+  if( remembered ) {
+    ci_uint32 table_seq = ci_tcp_prev_seq_lookup_tuple(ni, laddr, lport,
+                                                       raddr, rport);
+    if( table_seq != 0 )
+      ci_assert_equal(seq, table_seq);
+  }
+  return seq;
+}
+
+#endif
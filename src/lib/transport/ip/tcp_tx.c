@@ -81,9 +81,11 @@ ci_inline void ci_ip_tcp_list_to_dmaq(ci_netif* ni, ci_tcp_state* ts,
   if( n == 1 && oo_pktq_is_empty(dmaq) &&
       ! ci_netif_may_ctpio(ni, tail_pkt->intf_i, tail_pkt->pay_len) &&
       (ni->state->nic[tail_pkt->intf_i].oo_vi_flags & OO_VI_FLAGS_PIO_EN) ) {
-    if( tail_pkt->pay_len <= NI_OPTS(ni).pio_thresh ) {
+    if( tail_pkt->pay_len <= NI_OPTS(ni).pio_thresh &&
+        ci_netif_tx_claim(ni, tail_pkt->intf_i) ) {
       if( (offset = ci_pio_buddy_alloc(ni, buddy, order)) >= 0 ) {
         if(CI_UNLIKELY( ts->tcpflags & CI_TCPT_FLAG_MSG_WARM )) {
+          ci_netif_tx_release(ni, tail_pkt->intf_i);
           __ci_netif_dmaq_insert_prep_pkt_warm_undo(ni, tail_pkt);
           ci_pio_buddy_free(ni, &ni->state->nic[tail_pkt->intf_i].pio_buddy,
                             offset, order);
@@ -91,6 +93,7 @@ ci_inline void ci_ip_tcp_list_to_dmaq(ci_netif* ni, ci_tcp_state* ts,
         }
         rc = ef_vi_transmit_copy_pio(vi, offset, PKT_START(tail_pkt),
                                      tail_pkt->buf_len, OO_PKT_ID(pkt));
+        ci_netif_tx_release(ni, tail_pkt->intf_i);
         if( rc == 0 ) {
           CITP_STATS_NETIF_INC(ni, pio_pkts);
           ci_assert(tail_pkt->pio_addr == -1);
@@ -105,6 +108,7 @@ ci_inline void ci_ip_tcp_list_to_dmaq(ci_netif* ni, ci_tcp_state* ts,
         }
       }
       else {
+        ci_netif_tx_release(ni, tail_pkt->intf_i);
         CI_DEBUG(CITP_STATS_NETIF_INC(ni, no_pio_busy));
       }
     }
@@ -664,6 +668,7 @@ void ci_tcp_enqueue_no_data(ci_tcp_state* ts, ci_netif* netif,
   pkt->flags &= CI_PKT_FLAG_NONB_POOL;
   ASSERT_VALID_PKT(netif, pkt);
 
+  ci_tcp_send_nolock_block(netif, ts);
   pkt->pf.tcp_tx.start_seq = tcp_enq_nxt(ts);
   tcp_enq_nxt(ts) += 1;
   pkt->pf.tcp_tx.end_seq = tcp_enq_nxt(ts);
@@ -1526,6 +1531,9 @@ void ci_tcp_tx_advance_to(ci_netif* ni, ci_tcp_state* ts,
       }
       ci_tcp_rto_set_with_timeout(ni, ts, timeout);
     }
+
+    /* With the send queue drained, later sends may go without the lock. */
+    ci_tcp_send_nolock_open(ni, ts);
   }
 
   /* congestion window validation rfc2861 */
@@ -1691,36 +1699,29 @@ int ci_tcp_reset_untrusted(ci_netif *netif, ci_tcp_state *ts)
 }
 #endif
 
-void
-ci_tcp_reply_with_rst(ci_netif* netif, const struct oo_sock_cplane* sock_cp,
-                      ciip_tcp_rx_pkt* rxp)
+/* Turn the received segment [rxp] into the start of a reply to its sender,
+ * for use when there is no socket to send from.  The addresses and ports are
+ * swapped and there is room for [optlen] bytes of TCP options; the caller
+ * fills in the rest of the TCP header and passes the packet to
+ * ci_tcp_reply_send().  Returns NULL if out of packet buffers.
+ */
+static ci_ip_pkt_fmt* ci_tcp_reply_init(ci_netif* netif, ciip_tcp_rx_pkt* rxp,
+                                        int optlen)
 {
-  /* If the incoming seg has an ACK, use that as the seq no, otherwise use
-  ** 0.  Calculate a proper ACK from the incoming seg.  A consequence of this
-  ** is that this function is invalid for synchronised TCP states.
-  */
-  /*! ?? \TODO Check for dodgy source IP (to avoid broadcasting, for
-  ** example).
-  */
   ci_ip_pkt_fmt* pkt = rxp->pkt;
   ci_tcp_hdr rtcp;
-  ci_uint32 rtcp_endseq;
   int af = oo_pkt_af(pkt);
   ci_ipx_hdr_t rip;
   ci_tcp_hdr* tcp;
   ci_ipx_hdr_t* ip;
 
-  ci_assert(netif);
-  ASSERT_VALID_PKT(netif, pkt);
-
   /* Remember some of the RX packet's properties before the packet becomes
    * invalid in the course of ci_netif_pkt_rx_to_tx(). */
   rtcp = *rxp->tcp;
   rip = *oo_ipx_hdr(pkt);
-  rtcp_endseq = pkt->pf.tcp_rx.end_seq;
 
   if( (pkt = ci_netif_pkt_rx_to_tx(netif, pkt)) == NULL )
-    return;
+    return NULL;
 
   /* Initialise headers, swapping addressing info around.  Ensure fields
   ** are fully kosher.  (Don't trust what they sent!)
@@ -1753,12 +1754,73 @@ ci_tcp_reply_with_rst(ci_netif* netif, const struct oo_sock_cplane* sock_cp,
   }
 #endif
 
+  CI_TCP_HDR_SET_LEN(tcp, sizeof(*tcp) + optlen);
+  tcp->tcp_check_be16 = 0;
+  ci_tcp_ipx_hdr_init(af, ip, CI_IPX_HDR_SIZE(af) + sizeof(*tcp) + optlen);
+  pkt->buf_len = pkt->pay_len =
+    oo_tx_ether_hdr_size(pkt) + CI_IPX_HDR_SIZE(af) + sizeof(*tcp) + optlen;
+  return pkt;
+}
+
+
+static void ci_tcp_reply_send(ci_netif* netif,
+                              const struct oo_sock_cplane* sock_cp,
+                              ci_ip_pkt_fmt* pkt)
+{
+  if( pkt->intf_i == OO_INTF_I_LOOPBACK ) {
+    ci_netif_pkt_hold(netif, pkt);
+    ci_ip_local_send(netif, pkt, pkt->pf.tcp_tx.lo.rx_sock,
+                     pkt->pf.tcp_tx.lo.tx_sock);
+  }
+  else {
+    /* ?? TODO: should we respect here SO_BINDTODEVICE? */
+    ci_ip_cached_hdrs ipcache;
+    ci_ip_cache_init(&ipcache, oo_pkt_af(pkt));
+    ci_ip_send_pkt_lookup(netif, NULL, pkt, &ipcache);
+    ci_ip_send_pkt_send(netif, sock_cp, pkt, &ipcache);
+  }
+  CI_TCP_STATS_INC_OUT_SEGS(netif);
+  ci_netif_pkt_release(netif, pkt);
+}
+
+
+void
+ci_tcp_reply_with_rst(ci_netif* netif, const struct oo_sock_cplane* sock_cp,
+                      ciip_tcp_rx_pkt* rxp)
+{
+  /* If the incoming seg has an ACK, use that as the seq no, otherwise use
+  ** 0.  Calculate a proper ACK from the incoming seg.  A consequence of this
+  ** is that this function is invalid for synchronised TCP states.
+  */
+  /*! ?? \TODO Check for dodgy source IP (to avoid broadcasting, for
+  ** example).
+  */
+  ci_ip_pkt_fmt* pkt = rxp->pkt;
+  ci_uint8 rtcp_flags;
+  ci_uint32 rtcp_ack_be32;
+  ci_uint32 rtcp_endseq;
+  int af = oo_pkt_af(pkt);
+  ci_tcp_hdr* tcp;
+  ci_ipx_hdr_t* ip;
+
+  ci_assert(netif);
+  ASSERT_VALID_PKT(netif, pkt);
+
+  rtcp_flags = rxp->tcp->tcp_flags;
+  rtcp_ack_be32 = rxp->tcp->tcp_ack_be32;
+  rtcp_endseq = pkt->pf.tcp_rx.end_seq;
+
+  if( (pkt = ci_tcp_reply_init(netif, rxp, 0)) == NULL )
+    return;
+  ip = oo_tx_ipx_hdr(af, pkt);
+  tcp = ipx_hdr_data(af, ip);
+
   /* rfc793 p63-p75 describes ACK flag for RST generation
   ** if ACK flag set then use that as SEQ otherwise
   ** use 0 and fill out the ACK field of the reset segment
   */
-  if( (rtcp.tcp_flags & CI_TCP_FLAG_ACK) ) {
-    tcp->tcp_seq_be32 = rtcp.tcp_ack_be32;
+  if( (rtcp_flags & CI_TCP_FLAG_ACK) ) {
+    tcp->tcp_seq_be32 = rtcp_ack_be32;
     tcp->tcp_flags = CI_TCP_FLAG_RST;
     tcp->tcp_ack_be32 = 0;
   } else {
@@ -1766,10 +1828,7 @@ ci_tcp_reply_with_rst(ci_netif* netif, const struct oo_sock_cplane* sock_cp,
     tcp->tcp_flags = CI_TCP_FLAG_RST | CI_TCP_FLAG_ACK;
     tcp->tcp_ack_be32 = CI_BSWAP_BE32(rtcp_endseq);
   }
-  CI_TCP_HDR_SET_LEN(tcp, sizeof(*tcp));
   tcp->tcp_window_be16 = 0;
-  tcp->tcp_check_be16 = 0;
-  ci_tcp_ipx_hdr_init(af, ip, CI_IPX_HDR_SIZE(af) + sizeof(ci_tcp_hdr));
 
   LOG_TR(log(LN_FMT "RSTACK "IPX_FMT":%u->"IPX_FMT":%u s=%08x a=%08x",
              LN_PRI_ARGS(netif), IPX_ARG(AF_IP(ipx_hdr_saddr(af, ip))),
@@ -1779,26 +1838,44 @@ ci_tcp_reply_with_rst(ci_netif* netif, const struct oo_sock_cplane* sock_cp,
              (unsigned) CI_BSWAP_BE32(tcp->tcp_seq_be32),
              (unsigned) CI_BSWAP_BE32(tcp->tcp_ack_be32)));
 
-  pkt->buf_len = pkt->pay_len = 
-    oo_tx_ether_hdr_size(pkt) + CI_IPX_HDR_SIZE(af) + sizeof(ci_tcp_hdr);
-  if( pkt->intf_i == OO_INTF_I_LOOPBACK ) {
-    ci_netif_pkt_hold(netif, pkt);
-    ci_ip_local_send(netif, pkt, pkt->pf.tcp_tx.lo.rx_sock,
-                     pkt->pf.tcp_tx.lo.tx_sock);
-  }
-  else {
-    /* ?? TODO: should we respect here SO_BINDTODEVICE? */
-    ci_ip_cached_hdrs ipcache;
-    ci_ip_cache_init(&ipcache, af);
-    ci_ip_send_pkt_lookup(netif, NULL, pkt, &ipcache);
-    ci_ip_send_pkt_send(netif, sock_cp, pkt, &ipcache);
-  }
-  CI_TCP_STATS_INC_OUT_SEGS(netif);
-  ci_netif_pkt_release(netif, pkt);
+  ci_tcp_reply_send(netif, sock_cp, pkt);
   CI_TCP_STATS_INC_OUT_RSTS( netif );
 }
 
 
+void ci_tcp_timewait_reply_ack(ci_netif* netif, ciip_tcp_rx_pkt* rxp,
+                               const ci_tcp_timewait_t* tw)
+{
+  ci_ip_pkt_fmt* pkt;
+  int af = oo_pkt_af(rxp->pkt);
+  int optlen = (tw->flags & CI_TCP_TIMEWAIT_FLAG_TSO) ? 12 : 0;
+  ci_tcp_hdr* tcp;
+  ci_uint8* opt;
+
+  if( (pkt = ci_tcp_reply_init(netif, rxp, optlen)) == NULL )
+    return;
+  tcp = TX_PKT_IPX_TCP(af, pkt);
+
+  tcp->tcp_flags = CI_TCP_FLAG_ACK;
+  tcp->tcp_seq_be32 = CI_BSWAP_BE32(tw->snd_nxt);
+  tcp->tcp_ack_be32 = CI_BSWAP_BE32(tw->rcv_nxt);
+  tcp->tcp_window_be16 = tw->rcv_wnd_be16;
+  opt = CI_TCP_HDR_OPTS(tcp);
+  if( optlen )
+    ci_tcp_tx_opt_tso(&opt, ci_tcp_time_now(netif), tw->tsrecent);
+
+  LOG_TR(log(LN_FMT "TIME_WAIT ACK "IPX_FMT":%u->"IPX_FMT":%u s=%08x a=%08x",
+             LN_PRI_ARGS(netif),
+             IPX_ARG(AF_IP(ipx_hdr_saddr(af, oo_tx_ipx_hdr(af, pkt)))),
+             (unsigned) CI_BSWAP_BE16(tcp->tcp_source_be16),
+             IPX_ARG(AF_IP(ipx_hdr_daddr(af, oo_tx_ipx_hdr(af, pkt)))),
+             (unsigned) CI_BSWAP_BE16(tcp->tcp_dest_be16),
+             tw->snd_nxt, tw->rcv_nxt));
+
+  ci_tcp_reply_send(netif, NULL, pkt);
+}
+
+
 void ci_tcp_send_zwin_probe(ci_netif* netif, ci_tcp_state* ts)
 {
   /*
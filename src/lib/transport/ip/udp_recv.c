@@ -527,6 +527,7 @@ struct recvmsg_spinstate {
   uint32_t poison;
   const volatile uint32_t* future;
   citp_signal_info* si;
+  int spin_adapt;  /* record this call's wait for EF_SPIN_ADAPT */
 #endif
 };
 
@@ -627,9 +628,9 @@ ci_udp_recvmsg_socklocked_spin(ci_netif* ni, ci_udp_state* us,
       }
 #endif
       if( ni->state->poll_work_outstanding ||
-          ci_netif_need_poll_spinning(ni, now_frc) )
+          ci_netif_need_poll_claimed(ni, us->future_intf_i, now_frc) )
         if( ci_netif_trylock(ni) ) {
-          ci_netif_poll(ni);
+          ci_netif_poll_claimed(ni, us->future_intf_i);
           ci_netif_unlock(ni);
 #ifndef __KERNEL__
           spin_state->future = &spin_state->poison;
@@ -650,7 +651,8 @@ ci_udp_recvmsg_socklocked_spin(ci_netif* ni, ci_udp_state* us,
     }
 
     if( spin_state->timeout ) {
-      ci_uint32 spin_ms = NI_OPTS(ni).spin_usec >> 10;
+      ci_uint32 spin_ms = (now_frc - spin_state->start_frc) /
+                          IPTIMER_STATE(ni)->khz;
       if( spin_ms < spin_state->timeout )
         spin_state->timeout -= spin_ms;
       else {
@@ -717,8 +719,19 @@ ci_udp_recvmsg_common(ci_udp_recv_info *rinf
 
  check_ul_recv_q:
   rc = ci_udp_recvmsg_get(rinf, &piov CI_KERNEL_ARG(addr_spc));
-  if( rc >= 0 )
+  if( rc >= 0 ) {
+#ifndef __KERNEL__
+    if( spin_state.spin_adapt ) {
+      /* [do_spin] is cleared once the spin has run out. */
+      ci_uint64 now_frc;
+      ci_frc64(&now_frc);
+      citp_waitable_spin_adapt_record(ni, &us->s.b,
+                                      now_frc - spin_state.start_frc,
+                                      spin_state.do_spin);
+    }
+#endif
     goto out;
+  }
 
   /* User-level receive queue is empty. */
 
@@ -779,7 +792,9 @@ ci_udp_recvmsg_common(ci_udp_recv_info *rinf
       spin_state.poison = CI_PKT_RX_POISON;
       spin_state.future = &spin_state.poison;
       spin_state.schedule_frc = spin_state.start_frc;
-      spin_state.max_spin = us->s.b.spin_cycles;
+      spin_state.max_spin = citp_waitable_spin_budget(ni, &us->s.b,
+                                                      us->s.b.spin_cycles);
+      spin_state.spin_adapt = NI_OPTS(ni).spin_adapt != 0;
       if( us->s.so.rcvtimeo_msec ) {
         ci_uint64 max_so_spin = (ci_uint64)us->s.so.rcvtimeo_msec *
             IPTIMER_STATE(ni)->khz;
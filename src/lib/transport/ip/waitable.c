@@ -22,8 +22,11 @@ void citp_waitable_reinit(ci_netif* ni, citp_waitable* w)
 {
   /* Reinitialise fields between separate uses. */
   w->sleep_seq.all = 0;
+  w->epoll_excl_seq = CI_SB_EPOLL_EXCL_SEQ_NONE;
   w->sigown = 0;
   w->spin_cycles = ni->state->sock_spin_cycles;
+  memset(&w->spin_adapt, 0, sizeof(w->spin_adapt));
+  w->spin_adapt.budget_usec = CI_SPIN_ADAPT_NO_BUDGET;
 }
 
 
@@ -36,6 +39,9 @@ void citp_waitable_init(ci_netif* ni, citp_waitable* w, int id)
   w->sb_aflags = CI_SB_AFLAG_ORPHAN | CI_SB_AFLAG_NOT_READY;
   w->epoll = OO_PP_NULL;
   w->ready_lists_in_use = 0;
+  w->ready_lists_excl = 0;
+  w->ready_list_excl_last = 0;
+  w->epoll_excl_seq = CI_SB_EPOLL_EXCL_SEQ_NONE;
 
   oo_p_dllink_init(ni, oo_p_dllink_sb(ni, w, &w->post_poll_link));
 
@@ -366,6 +372,23 @@ static void citp_waitable_dump2(ci_netif* ni, citp_waitable* w, const char* pf,
   else
     logger(log_arg, "%s  ul_poll: %"CI_PRIu64" spin cycles %u usec", pf,
          w->spin_cycles, oo_cycles64_to_usec(ni, w->spin_cycles));
+
+  if( NI_OPTS(ni).spin_adapt &&
+      w->spin_adapt.hits + w->spin_adapt.misses != 0 ) {
+    const ci_spin_adapt* sa = &w->spin_adapt;
+    char budget[16];
+    if( sa->budget_usec == CI_SPIN_ADAPT_NO_BUDGET )
+      strcpy(budget, "full");
+    else
+      snprintf(budget, sizeof(budget), "%uus", sa->budget_usec);
+    logger(log_arg, "%s  spin_adapt: budget=%s mean_wait=%uns hits=%u "
+           "misses=%u", pf, budget, sa->ewma_ns, sa->hits, sa->misses);
+    logger(log_arg, "%s  spin_adapt: waits <1us:%u <2:%u <4:%u <8:%u <16:%u "
+           "<32:%u <64:%u <128:%u <256:%u <512:%u <1024:%u more:%u", pf,
+           sa->count[0], sa->count[1], sa->count[2], sa->count[3],
+           sa->count[4], sa->count[5], sa->count[6], sa->count[7],
+           sa->count[8], sa->count[9], sa->count[10], sa->count[11]);
+  }
 }
 
 
@@ -450,6 +473,79 @@ void citp_waitable_print_to_logger(ci_netif* ni, citp_waitable* w,
 
 #ifndef __KERNEL__
 
+/* Samples seen before the histogram is trusted to choose a spin time, and
+ * the total at which the counts are halved so that the choice follows
+ * changes in the traffic. */
+#define CI_SPIN_ADAPT_MIN_SAMPLES  16
+#define CI_SPIN_ADAPT_DECAY        1024
+
+void ci_spin_adapt_record(ci_spin_adapt* sa, ci_uint32 khz,
+                          unsigned percentile, ci_uint64 wait_cycles, int hit)
+{
+  ci_uint64 ns = wait_cycles * 1000000 / khz;
+  unsigned usec, total, want, seen;
+  int i;
+
+  /* Anything past a few seconds is as good as "forever" here, and keeps
+   * the multiplication above from overflowing on the next call. */
+  if( wait_cycles >= (ci_uint64) khz * 4000 )
+    ns = 0xffffffff;
+  usec = ns / 1000;
+
+  i = usec == 0 ? 0 : ci_log2_le(usec) + 1;
+  if( i >= CI_SPIN_ADAPT_BUCKETS )
+    i = CI_SPIN_ADAPT_BUCKETS - 1;
+  ++sa->count[i];
+
+  if( ns > sa->ewma_ns )
+    sa->ewma_ns += ((ci_uint32) ns - sa->ewma_ns) >> 3;
+  else
+    sa->ewma_ns -= (sa->ewma_ns - (ci_uint32) ns) >> 3;
+
+  if( hit )
+    ++sa->hits;
+  else
+    ++sa->misses;
+
+  total = 0;
+  for( i = 0; i < CI_SPIN_ADAPT_BUCKETS; ++i )
+    total += sa->count[i];
+  if( total >= CI_SPIN_ADAPT_DECAY ) {
+    total = 0;
+    for( i = 0; i < CI_SPIN_ADAPT_BUCKETS; ++i )
+      total += (sa->count[i] >>= 1);
+  }
+
+  /* Spin for the upper limit of the first bucket that takes us to the
+   * target percentile.  If that is the overflow bucket then the waits are
+   * too long to learn from, and we spin for as long as we are allowed. */
+  sa->budget_usec = CI_SPIN_ADAPT_NO_BUDGET;
+  if( total < CI_SPIN_ADAPT_MIN_SAMPLES )
+    return;
+  want = (total * percentile + 99) / 100;
+  seen = 0;
+  for( i = 0; i < CI_SPIN_ADAPT_BUCKETS - 1; ++i ) {
+    seen += sa->count[i];
+    if( seen >= want ) {
+      sa->budget_usec = 1u << i;
+      break;
+    }
+  }
+}
+
+
+void citp_waitable_spin_adapt_record(ci_netif* ni, citp_waitable* w,
+                                     ci_uint64 wait_cycles, int hit)
+{
+  ci_spin_adapt_record(&w->spin_adapt, IPTIMER_STATE(ni)->khz,
+                       NI_OPTS(ni).spin_adapt, wait_cycles, hit);
+  if( hit )
+    CITP_STATS_NETIF_INC(ni, spin_adapt_hits);
+  else
+    CITP_STATS_NETIF_INC(ni, spin_adapt_misses);
+}
+
+
 void citp_waitable_wakeup(ci_netif* ni, citp_waitable* w)
 {
   oo_waitable_wake_t op;
@@ -471,8 +567,10 @@ citp_waitable_wake_epoll3_not_in_poll(ci_netif* ni, citp_waitable* sb)
   if( sb->ready_lists_in_use != 0 ) {
     ci_sb_epoll_state* epoll = ci_ni_aux_p2epoll(ni, sb->epoll);
     ci_uint32 tmp, i;
+    ci_uint32 lists = ci_sb_epoll_ready_lists(sb);
 
-    CI_READY_LIST_EACH(sb->ready_lists_in_use, tmp, i) {
+    ci_sb_epoll_excl_advance(sb);
+    CI_READY_LIST_EACH(lists, tmp, i) {
       struct oo_p_dllink_state link = ci_sb_epoll_ready_link(ni, epoll, i);
       oo_p_dllink_del(ni, link);
       oo_p_dllink_add_tail(ni,
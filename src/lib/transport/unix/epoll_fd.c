@@ -179,6 +179,61 @@ citp_ul_epoll_member_to_fdi(struct citp_epoll_member* eitem)
 }
 
 
+/* Make sure that [fd] has a slot in the fd map. */
+static int citp_epoll_fd_map_reserve(struct citp_epoll_fd* ep, int fd)
+{
+  struct citp_epoll_member** map;
+  int size;
+
+  if(CI_LIKELY( fd < ep->fd_map_size ))
+    return 0;
+
+  size = CI_MAX(CI_MAX(fd + 1, ep->fd_map_size * 2), 64);
+  map = realloc(ep->fd_map, size * sizeof(*map));
+  if( map == NULL )
+    return -1;
+  memset(map + ep->fd_map_size, 0,
+         (size - ep->fd_map_size) * sizeof(*map));
+  ep->fd_map = map;
+  ep->fd_map_size = size;
+  return 0;
+}
+
+ci_inline void citp_epoll_fd_map_set(struct citp_epoll_fd* ep,
+                                     struct citp_epoll_member* eitem)
+{
+  ci_assert_lt(eitem->fd, ep->fd_map_size);
+  ep->fd_map[eitem->fd] = eitem;
+}
+
+ci_inline void citp_epoll_fd_map_clear(struct citp_epoll_fd* ep,
+                                       struct citp_epoll_member* eitem)
+{
+  if( eitem->fd < ep->fd_map_size && ep->fd_map[eitem->fd] == eitem )
+    ep->fd_map[eitem->fd] = NULL;
+}
+
+ci_inline struct citp_epoll_member*
+citp_epoll_fd_map_get(struct citp_epoll_fd* ep, const citp_fdinfo* fd_fdi)
+{
+  struct citp_epoll_member* eitem;
+
+  if( fd_fdi->fd >= ep->fd_map_size )
+    return NULL;
+  eitem = ep->fd_map[fd_fdi->fd];
+  if( eitem == NULL || eitem->fdi_seq != fd_fdi->seq )
+    return NULL;
+  return eitem;
+}
+
+static void citp_epoll_free_eitem(struct citp_epoll_fd* ep,
+                                  struct citp_epoll_member* eitem)
+{
+  citp_epoll_fd_map_clear(ep, eitem);
+  CI_FREE_OBJ(eitem);
+}
+
+
 #if CI_CFG_EPOLL3
 static void
 citp_epoll_set_home_stack(struct citp_epoll_fd* ep, ci_netif* ni)
@@ -240,33 +295,210 @@ static int citp_epoll_sb_state_alloc(citp_socket* sock)
 }
 
 static void citp_epoll_sb_state_set(struct citp_epoll_member* eitem,
-                                    struct citp_epoll_fd* ep,
+                                    ci_netif* ni, int ready_list,
                                     citp_socket* sock)
 {
   ci_sb_epoll_state* epoll;
   struct oo_p_dllink_state link;
 
   ci_assert(OO_PP_NOT_NULL(sock->s->b.epoll));
+  ci_assert_equal(sock->netif, ni);
 
-  epoll = ci_ni_aux_p2epoll(sock->netif, sock->s->b.epoll);
-  link = ci_sb_epoll_ready_link(ep->home_stack, epoll, ep->ready_list);
+  epoll = ci_ni_aux_p2epoll(ni, sock->s->b.epoll);
+  link = ci_sb_epoll_ready_link(ni, epoll, ready_list);
 
   /* This epoll set owns the ready list id, so it must be free in the
    * socket */
-  ci_assert_nflags(sock->s->b.ready_lists_in_use, 1 << ep->ready_list);
-  OO_P_DLLINK_ASSERT_EMPTY(ep->home_stack, link);
+  ci_assert_nflags(sock->s->b.ready_lists_in_use, 1 << ready_list);
+  OO_P_DLLINK_ASSERT_EMPTY(ni, link);
 
-  CI_USER_PTR_SET(epoll->e[ep->ready_list].eitem, eitem);
+  CI_USER_PTR_SET(epoll->e[ready_list].eitem, eitem);
 
   /* Tell others that we are in the list */
-  ci_netif_lock(ep->home_stack);
-  sock->s->b.ready_lists_in_use |= 1 << ep->ready_list;
-  oo_p_dllink_add_tail(ep->home_stack,
-                       oo_p_dllink_ptr(ep->home_stack,
-                                       &ep->home_stack->state->
-                                            unready_lists[ep->ready_list]),
+  ci_netif_lock(ni);
+  sock->s->b.ready_lists_in_use |= 1 << ready_list;
+  if( eitem->epoll_data.events & EPOLLEXCLUSIVE )
+    sock->s->b.ready_lists_excl |= 1 << ready_list;
+  else
+    sock->s->b.ready_lists_excl &=~ (1 << ready_list);
+  oo_p_dllink_add_tail(ni,
+                       oo_p_dllink_ptr(ni,
+                                       &ni->state->unready_lists[ready_list]),
                        link);
-  ci_netif_unlock(ep->home_stack);
+  ci_netif_unlock(ni);
+}
+
+
+/* Find the other stack slot for [ni], claiming a ready list in [ni] if
+ * this epoll set does not have one yet.  Returns -1 if there is none to be
+ * had, in which case the socket stays on [oo_sockets].
+ */
+static int citp_epoll_other_stack_get(struct citp_epoll_fd* ep, ci_netif* ni)
+{
+  struct citp_epoll_other_stack* os;
+  struct oo_epoll1_set_home_arg op;
+  int i, free_i = -1, n_free = 0;
+
+  for( i = 0; i < CITP_EPOLL_OTHER_STACKS_MAX; i++ ) {
+    if( ep->other_stacks[i].ni == ni )
+      return i;
+    if( free_i < 0 && ep->other_stacks[i].ni == NULL )
+      free_i = i;
+  }
+  if( free_i < 0 )
+    return -1;
+
+  /* There are only a few ready lists in each stack, and they are worth more
+   * to an epoll set that would make this stack its home.  Leave one free.
+   */
+  for( i = 0; i < CI_CFG_N_READY_LISTS; i++ )
+    if( ! ((ni->state->ready_lists_in_use >> i) & 1) )
+      ++n_free;
+  if( n_free < 2 )
+    return -1;
+
+  os = &ep->other_stacks[free_i];
+  os->ready_list = ci_netif_get_ready_list(ni);
+  if( os->ready_list < 0 )
+    return -1;
+
+  /* Let the driver put the ready list if we never get to. */
+  op.sockfd = ci_netif_get_driver_handle(ni);
+  op.ready_list = os->ready_list;
+  if( ci_sys_ioctl(ep->epfd_os, OO_EPOLL1_IOC_ADD_OTHER_READY_LIST,
+                   &op) != 0 ) {
+    ci_netif_put_ready_list(ni, os->ready_list);
+    os->ready_list = -1;
+    return -1;
+  }
+
+  Log_POLL(ci_log("%s: other stack %s using ready list %d", __FUNCTION__,
+                  ni->state->pretty_name, os->ready_list));
+
+  citp_netif_add_ref(ni);
+  os->ni = ni;
+  os->sockets_n = 0;
+  ci_dllist_init(&os->sockets);
+  ci_dllist_init(&os->not_ready_sockets);
+  ep->other_stacks_n++;
+  return free_i;
+}
+
+
+/* Releasing the ready list unhooks any sockets that are still on it, so
+ * after this the members (if any) can simply be freed.
+ */
+static void citp_epoll_other_stack_put(struct citp_epoll_fd* ep, int i,
+                                       int fdt_locked)
+{
+  struct citp_epoll_other_stack* os = &ep->other_stacks[i];
+  struct oo_epoll1_set_home_arg op;
+  struct citp_epoll_member* eitem;
+
+  ci_assert(os->ni);
+  op.sockfd = ci_netif_get_driver_handle(os->ni);
+  op.ready_list = os->ready_list;
+  ci_sys_ioctl(ep->epfd_os, OO_EPOLL1_IOC_DEL_OTHER_READY_LIST, &op);
+  ci_netif_put_ready_list(os->ni, os->ready_list);
+  while( ci_dllist_not_empty(&os->sockets) ) {
+    eitem = EITEM_FROM_DLLINK(ci_dllist_pop(&os->sockets));
+    citp_epoll_free_eitem(ep, eitem);
+  }
+  while( ci_dllist_not_empty(&os->not_ready_sockets) ) {
+    eitem = EITEM_FROM_DLLINK(ci_dllist_pop(&os->not_ready_sockets));
+    citp_epoll_free_eitem(ep, eitem);
+  }
+  citp_netif_release_ref(os->ni, fdt_locked);
+  os->ni = NULL;
+  os->ready_list = -1;
+  os->sockets_n = 0;
+  ep->other_stacks_n--;
+}
+
+
+/* Other stacks are not released as soon as their last member goes, because
+ * that can happen while polling, where we cannot drop a stack reference.
+ */
+static void citp_epoll_put_idle_other_stacks(struct citp_epoll_fd* ep,
+                                             int fdt_locked)
+{
+  int i;
+
+  for( i = 0; i < CITP_EPOLL_OTHER_STACKS_MAX; i++ )
+    if( ep->other_stacks[i].ni != NULL &&
+        ep->other_stacks[i].sockets_n == 0 )
+      citp_epoll_other_stack_put(ep, i, fdt_locked);
+}
+
+
+/* Move a member from [oo_sockets] onto the ready list that this set owns
+ * in the socket's stack, if it can get one.
+ */
+static void citp_epoll_try_attach_other(struct citp_epoll_fd* ep,
+                                        struct citp_epoll_member* eitem,
+                                        citp_socket* sock)
+{
+  struct citp_epoll_other_stack* os;
+  int i;
+
+  ci_assert_equal(CITP_OPTS.ul_epoll, 3);
+  ci_assert(eitem->item_list == &ep->oo_sockets);
+  ci_assert_lt(eitem->other_stack, 0);
+
+  if( citp_epoll_sb_state_alloc(sock) != 0 )
+    return;
+  if( (i = citp_epoll_other_stack_get(ep, sock->netif)) < 0 )
+    return;
+  os = &ep->other_stacks[i];
+  /* The same socket may be in the set more than once via dup()ed fds, but
+   * only one eitem can use the ready list link.
+   */
+  if( sock->s->b.ready_lists_in_use & (1 << os->ready_list) )
+    return;
+
+  eitem->other_stack = i;
+  eitem->sock_id = W_SP(&sock->s->b);
+  ci_dllist_remove(&eitem->dllink);
+  eitem->item_list = &os->sockets;
+  /* As with home sockets, start it out as potentially ready. */
+  ci_dllist_push(&os->sockets, &eitem->dllink);
+  os->sockets_n++;
+
+  citp_epoll_sb_state_set(eitem, os->ni, os->ready_list, sock);
+}
+
+
+/* Take a member out of its other stack, unhooking it from the socket if the
+ * socket still refers to it.  The socket buffer may by now belong to
+ * somebody else, in which case the eitem pointer won't match.
+ */
+static void citp_epoll_detach_other(struct citp_epoll_fd* ep,
+                                    struct citp_epoll_member* eitem)
+{
+  struct citp_epoll_other_stack* os = &ep->other_stacks[eitem->other_stack];
+  ci_netif* ni = os->ni;
+  citp_waitable* w;
+
+  ci_assert(ni);
+  ci_assert_gt(os->sockets_n, 0);
+
+  ci_dllist_remove(&eitem->dllink);
+  ci_netif_lock(ni);
+  w = SP_TO_WAITABLE(ni, eitem->sock_id);
+  if( w->ready_lists_in_use & (1 << os->ready_list) ) {
+    ci_sb_epoll_state* epoll = ci_ni_aux_p2epoll(ni, w->epoll);
+    if( CI_USER_PTR_GET(epoll->e[os->ready_list].eitem) == eitem ) {
+      struct oo_p_dllink_state link =
+              ci_sb_epoll_ready_link(ni, epoll, os->ready_list);
+      w->ready_lists_in_use &=~ (1 << os->ready_list);
+      oo_p_dllink_del(ni, link);
+      oo_p_dllink_init(ni, link);
+    }
+  }
+  ci_netif_unlock(ni);
+
+  eitem->other_stack = -1;
+  os->sockets_n--;
 }
 
 
@@ -278,8 +510,10 @@ citp_epoll_promote_to_home(struct citp_epoll_member* eitem, citp_fdinfo* fd_fdi,
   /* Sockets from the oo_sockets list are added to the OS epoll set.
    * We'll handle it when deleting them, see citp_epoll_ctl_onload_del().
    */
+  ci_assert_lt(eitem->other_stack, 0);
   ci_dllist_remove_safe(&eitem->dllink);
   ep->oo_sockets_n--;
+  citp_epoll_fd_map_clear(ep, eitem);
   eitem->item_list = &ep->oo_stack_sockets;
   eitem->ready_list_id = ep->ready_list;
   eitem->flags &=~ CITP_EITEM_FLAG_POLL_END;
@@ -287,7 +521,7 @@ citp_epoll_promote_to_home(struct citp_epoll_member* eitem, citp_fdinfo* fd_fdi,
 
   ci_dllist_push(&ep->oo_stack_sockets, &eitem->dllink);
 
-  citp_epoll_sb_state_set(eitem, ep, sock);
+  citp_epoll_sb_state_set(eitem, ep->home_stack, ep->ready_list, sock);
 }
 
 static void
@@ -469,14 +703,63 @@ static void citp_epoll_update_eitems_epoll_fd(ci_dllist *list, int epoll_fd,
 }
 #endif
 
-static void citp_epoll_purge_other_socks(struct citp_epoll_fd* ep)
+/* Remove a non-home member from whichever list it is on.  The caller
+ * either frees it or puts it on another list.
+ */
+static void citp_epoll_remove_other(struct citp_epoll_fd* ep,
+                                    struct citp_epoll_member* eitem)
+{
+#if CI_CFG_EPOLL3
+  ci_assert_lt(eitem->ready_list_id, 0);
+  if( eitem->other_stack >= 0 )
+    citp_epoll_detach_other(ep, eitem);
+  else
+#endif
+    ci_dllist_remove(&eitem->dllink);
+  ep->oo_sockets_n--;
+}
+
+/* Free a non-home member whose fd has been closed or reused.  We have to
+ * ensure that all the hooks (on_handover, on_close) have been properly
+ * processed, so we leave it alone if something has been queued to the
+ * epoll lock.
+ */
+static void citp_epoll_reap_other(struct citp_epoll_fd* ep,
+                                  struct citp_epoll_member* eitem)
+{
+  if( ep->lock.lock & OO_WQLOCK_WORK_BITS )
+    return;
+#if CI_CFG_EPOLL3
+  if( ! ci_dllink_is_self_linked(&eitem->dead_stack_link) ||
+      eitem->ready_list_id >= 0 )
+    return;
+#endif
+
+  Log_POLL(ci_log("%s: auto remove fd %d from epoll set",
+                  __FUNCTION__, eitem->fd));
+  citp_epoll_remove_other(ep, eitem);
+  citp_epoll_free_eitem(ep, eitem);
+}
+
+static void citp_epoll_purge_other_socks(struct citp_epoll_fd* ep,
+                                         int fdt_locked)
 {
   struct citp_epoll_member* eitem;
   struct citp_epoll_member* next_eitem;
+#if CI_CFG_EPOLL3
+  int i;
+
+  for( i = 0; i < CITP_EPOLL_OTHER_STACKS_MAX; i++ )
+    if( ep->other_stacks[i].ni != NULL )
+      citp_epoll_other_stack_put(ep, i, fdt_locked);
+#endif
   CI_DLLIST_FOR_EACH3(struct citp_epoll_member, eitem,
                       dllink, &ep->oo_sockets, next_eitem) {
     CI_FREE_OBJ(eitem);
   }
+  free(ep->fd_map);
+  ep->fd_map = NULL;
+  ep->fd_map_size = 0;
 }
 
 static void citp_epoll_dtor(citp_fdinfo* fdi, int fdt_locked)
@@ -521,7 +804,7 @@ static void citp_epoll_dtor(citp_fdinfo* fdi, int fdt_locked)
   ci_assert(ci_dllist_is_empty(&ep->dead_stack_sockets));
 #endif
 
-  citp_epoll_purge_other_socks(ep);
+  citp_epoll_purge_other_socks(ep, fdt_locked);
 
   if( ! fdt_locked )  CITP_FDTABLE_LOCK();
   ci_tcp_helper_close_no_trampoline(ep->shared->epfd);
@@ -622,6 +905,9 @@ int citp_epoll_create(int size, int flags)
   int            fd;
   int            shared_fd;
   int            rc;
+#if CI_CFG_EPOLL3
+  int            i;
+#endif
 
   if( (epi = CI_ALLOC_OBJ(citp_epoll_fdi)) == NULL )
     goto fail0;
@@ -677,6 +963,18 @@ int citp_epoll_create(int size, int flags)
 #endif
   ci_dllist_init(&ep->oo_sockets);
   ep->oo_sockets_n = 0;
+#if CI_CFG_EPOLL3
+  for( i = 0; i < CITP_EPOLL_OTHER_STACKS_MAX; i++ ) {
+    ep->other_stacks[i].ni = NULL;
+    ep->other_stacks[i].ready_list = -1;
+    ep->other_stacks[i].sockets_n = 0;
+    ci_dllist_init(&ep->other_stacks[i].sockets);
+    ci_dllist_init(&ep->other_stacks[i].not_ready_sockets);
+  }
+  ep->other_stacks_n = 0;
+#endif
+  ep->fd_map = NULL;
+  ep->fd_map_size = 0;
   ci_dllist_init(&ep->dead_sockets);
   oo_atomic_set(&ep->refcount, 1);
   ep->epfd_syncs_needed = 0;
@@ -748,7 +1046,6 @@ ci_inline int
 citp_epoll_find(struct citp_epoll_fd* ep, const citp_fdinfo* fd_fdi,
                 struct citp_epoll_member** eitem_out, int epoll_fd)
 {
-  struct citp_epoll_member* eitem_next;
 #if CI_CFG_EPOLL3
   citp_socket* sock;
   ci_sb_epoll_state* epoll;
@@ -793,11 +1090,12 @@ citp_epoll_find(struct citp_epoll_fd* ep, const citp_fdinfo* fd_fdi,
 
 out:
 #endif
-  CI_DLLIST_FOR_EACH3(struct citp_epoll_member, *eitem_out,
-                      dllink, &ep->oo_sockets, eitem_next) {
-    if( (*eitem_out)->fd == fd_fdi->fd && (*eitem_out)->fdi_seq == fd_fdi->seq )
-      return EPOLL_NON_STACK_EITEM;
-  }
+  /* Everything else, including sockets in our other stacks, is found via
+   * the fd map.
+   */
+  *eitem_out = citp_epoll_fd_map_get(ep, fd_fdi);
+  if( *eitem_out != NULL && (*eitem_out)->item_list != &ep->dead_sockets )
+    return EPOLL_NON_STACK_EITEM;
   *eitem_out = NULL;
   return -1;
 }
@@ -806,12 +1104,10 @@ out:
 ci_inline struct citp_epoll_member*
 citp_epoll_find_dead(struct citp_epoll_fd* ep, const citp_fdinfo* fd_fdi)
 {
-  struct citp_epoll_member* eitem;
-  CI_DLLIST_FOR_EACH2(struct citp_epoll_member, eitem,
-                      dllink, &ep->dead_sockets)
-    if( eitem->fd == fd_fdi->fd && eitem->fdi_seq == fd_fdi->seq )
-      break;
-  return eitem;
+  struct citp_epoll_member* eitem = citp_epoll_fd_map_get(ep, fd_fdi);
+  if( eitem != NULL && eitem->item_list == &ep->dead_sockets )
+    return eitem;
+  return NULL;
 }
 
 
@@ -821,10 +1117,12 @@ static void citp_eitem_init(struct citp_epoll_member* eitem,
   eitem->epoll_data = *event;
   eitem->epoll_data.events |= EPOLLERR | EPOLLHUP;
   citp_eitem_reset_epollet(eitem, fd_fdi);
+  eitem->excl_seq = CI_SB_EPOLL_EXCL_SEQ_NONE;
   eitem->fd = fd_fdi->fd;
   eitem->fdi_seq = fd_fdi->seq;
 #if CI_CFG_EPOLL3
   eitem->ready_list_id = -1;
+  eitem->other_stack = -1;
   ci_dllink_self_link(&eitem->dead_stack_link);
 #endif
   eitem->flags = 0;
@@ -850,7 +1148,7 @@ static void citp_epoll_ctl_onload_add_home(struct citp_epoll_member* eitem,
   fd_fdi->epoll_fd = epoll_fd;
   fd_fdi->epoll_fd_seq = epoll_fd_seq;
 
-  citp_epoll_sb_state_set(eitem, ep, sock);
+  citp_epoll_sb_state_set(eitem, ep->home_stack, ep->ready_list, sock);
 }
 #endif
 
@@ -861,6 +1159,16 @@ static void citp_epoll_ctl_onload_add_other(struct citp_epoll_member* eitem,
                                             citp_fdinfo* fd_fdi, int epoll_fd,
                                             ci_uint64 epoll_fd_seq)
 {
+  struct citp_epoll_member* old = ep->fd_map[eitem->fd];
+
+  /* Anything still in the map under this fd belongs to a file that has
+   * since been closed, so we can be rid of it now rather than waiting for
+   * it to be noticed by a wait.
+   */
+  if( old != NULL && old->item_list != &ep->dead_sockets )
+    citp_epoll_reap_other(ep, old);
+  citp_epoll_fd_map_set(ep, eitem);
+
   eitem->item_list = &ep->oo_sockets;
   eitem->flags &=~ CITP_EITEM_FLAG_POLL_END;
   ci_dllist_push(&ep->oo_sockets, &eitem->dllink);
@@ -916,6 +1224,11 @@ static int citp_epoll_ctl_onload_add_new(struct citp_epoll_member** eitem_out,
   citp_socket* sock = NULL;
   ci_netif* ni;
 
+  if( citp_epoll_fd_map_reserve(ep, fd_fdi->fd) != 0 ) {
+    errno = ENOMEM;
+    return -1;
+  }
+
   *eitem_out = CI_ALLOC_OBJ(struct citp_epoll_member);
   if( *eitem_out == NULL ) {
     errno = ENOMEM;
@@ -988,6 +1301,13 @@ static int citp_epoll_ctl_onload_add_new(struct citp_epoll_member** eitem_out,
     citp_epoll_ctl_onload_add_other(*eitem_out, ep, sync_kernel, fd_fdi,
                                     epoll_fd, epoll_fd_seq);
     CITP_STATS_NETIF_INC(ni, epoll_add_non_home);
+#if CI_CFG_EPOLL3
+    /* Still registered with the kernel, but at user level we only need to
+     * look at it when its stack says that it may be ready.
+     */
+    if( CITP_OPTS.ul_epoll == 3 && ep->home_stack != ni )
+      citp_epoll_try_attach_other(ep, *eitem_out, sock);
+#endif
   }
 
   return 0;
@@ -1018,11 +1338,18 @@ static void citp_epoll_ctl_onload_readd(struct citp_epoll_member* eitem,
     ++ep->epfd_syncs_needed;
   ci_dllist_remove(&eitem->dllink);
 
+  eitem->item_list = &ep->oo_sockets;
   ci_dllist_push(&ep->oo_sockets, &eitem->dllink);
   ep->oo_sockets_n++;
 
   if( ci_cas32_succeed(&fd_fdi->epoll_fd, -1, epoll_fd) )
     fd_fdi->epoll_fd_seq = epoll_fd_seq;
+
+#if CI_CFG_EPOLL3
+  if( CITP_OPTS.ul_epoll == 3 && citp_fdinfo_is_socket(fd_fdi) &&
+      fdi_to_socket(fd_fdi)->netif != ep->home_stack )
+    citp_epoll_try_attach_other(ep, eitem, fdi_to_socket(fd_fdi));
+#endif
 }
 
 
@@ -1033,7 +1360,12 @@ static int citp_epoll_ctl_onload_add(struct citp_epoll_member** eitem_out,
                                      int epoll_fd, ci_uint64 epoll_fd_seq)
 {
   int rc = 0;
-  if( *eitem_out == NULL ) {
+  if( (event->events & EPOLLEXCLUSIVE) &&
+      (event->events & ~CITP_EPOLL_EXCL_ALLOWED_EVENTS) ) {
+    errno = EINVAL;
+    rc = -1;
+  }
+  else if( *eitem_out == NULL ) {
     *eitem_out = citp_epoll_find_dead(ep, fd_fdi);
     if( *eitem_out == NULL ) {
       rc = citp_epoll_ctl_onload_add_new(eitem_out, ep, fd_fdi, sync_kernel,
@@ -1060,6 +1392,11 @@ static int citp_epoll_ctl_onload_mod(struct citp_epoll_member* eitem,
 {
   int rc = 0;
   if(CI_LIKELY( eitem != NULL )) {
+    /* As for the kernel, EPOLLEXCLUSIVE can only be given at ADD time. */
+    if( (event->events | eitem->epoll_data.events) & EPOLLEXCLUSIVE ) {
+      errno = EINVAL;
+      return -1;
+    }
     eitem->epoll_data = *event;
     eitem->epoll_data.events |= EPOLLERR | EPOLLHUP;
     citp_eitem_reset_epollet(eitem, fd_fdi);
@@ -1128,13 +1465,13 @@ static int citp_epoll_ctl_onload_del(struct citp_epoll_member* eitem,
     else
 #endif
     {
-      ci_dllist_remove(&eitem->dllink);
-      ep->oo_sockets_n--;
+      citp_epoll_remove_other(ep, eitem);
       if( eitem->epfd_event.events == EP_NOT_REGISTERED ) {
         *sync_kernel = 0;
-        CI_FREE_OBJ(eitem);
+        citp_epoll_free_eitem(ep, eitem);
       }
       else if( ! *sync_kernel ) {
+        eitem->item_list = &ep->dead_sockets;
         ci_dllist_push(&ep->dead_sockets, &eitem->dllink);
         ++ep->epfd_syncs_needed;
       }
@@ -1220,7 +1557,7 @@ static int citp_epoll_ctl_onload2(struct citp_epoll_fd* ep, int op,
       eitem->epfd_event = eitem->epoll_data;
     }
     else {
-      CI_FREE_OBJ(eitem);
+      citp_epoll_free_eitem(ep, eitem);
     }
   }
   else {
@@ -1236,6 +1573,8 @@ static int citp_epoll_ctl_onload2(struct citp_epoll_fd* ep, int op,
 #if CI_CFG_EPOLL3
   if( ci_dllist_not_empty(&ep->dead_stack_sockets) )
     citp_epoll_cleanup_dead_home_socks(ep, fdt_locked);
+  if( ep->other_stacks_n != 0 )
+    citp_epoll_put_idle_other_stacks(ep, fdt_locked);
 #endif
 
   return rc;
@@ -1451,11 +1790,39 @@ static void citp_ul_epoll_ctl_sync_fd(int epfd, struct citp_epoll_fd* ep,
                  rc, errno));
 }
 
-static void citp_ul_epoll_ctl_sync(struct citp_epoll_fd* ep, int epfd)
+/* Returns true once [epfd_syncs_needed] runs out. */
+static int citp_ul_epoll_ctl_sync_list(struct citp_epoll_fd* ep, int epfd,
+                                       ci_dllist* list)
 {
   struct citp_epoll_member* eitem;
   struct citp_epoll_member* eitem_tmp;
+
+  CI_DLLIST_FOR_EACH3(struct citp_epoll_member, eitem,
+                      dllink, list, eitem_tmp)
+    if( ! citp_eitem_is_synced(eitem) ) {
+      if( citp_ul_epoll_member_to_fdi(eitem) ) {
+        Log_POLL(ci_log("%s(): sync %d", __func__, eitem->fd));
+        citp_ul_epoll_ctl_sync_fd(epfd, ep, eitem);
+        eitem->flags |= CITP_EITEM_FLAG_OS_SYNC;
+      }
+      else {
+        citp_epoll_remove_other(ep, eitem);
+        citp_epoll_free_eitem(ep, eitem);
+      }
+      if( --ep->epfd_syncs_needed == 0 )
+        /* This early exit may help us avoid iterating over the whole list. */
+        return 1;
+    }
+  return 0;
+}
+
+static void citp_ul_epoll_ctl_sync(struct citp_epoll_fd* ep, int epfd)
+{
+  struct citp_epoll_member* eitem;
   int rc;
+#if CI_CFG_EPOLL3
+  int i;
+#endif
 
   Log_POLL(ci_log("%s(%d): epfd_syncs_needed=%d", __FUNCTION__, epfd,
                   ep->epfd_syncs_needed));
@@ -1475,27 +1842,24 @@ static void citp_ul_epoll_ctl_sync(struct citp_epoll_fd* ep, int epfd)
         Log_E(ci_log("%s: ERROR: sys_epoll_ctl(%d, DEL, %d) failed (%d,%d)",
                      __FUNCTION__, epfd, eitem->fd, rc, errno));
     }
-    CI_FREE_OBJ(eitem);
+    citp_epoll_free_eitem(ep, eitem);
   }
 
-  CI_DLLIST_FOR_EACH3(struct citp_epoll_member, eitem,
-                      dllink, &ep->oo_sockets, eitem_tmp)
-    if( ! citp_eitem_is_synced(eitem) ) {
-      if( citp_ul_epoll_member_to_fdi(eitem) ) {
-        Log_POLL(ci_log("%s(): sync %d", __func__, eitem->fd));
-        citp_ul_epoll_ctl_sync_fd(epfd, ep, eitem);
-        eitem->flags |= CITP_EITEM_FLAG_OS_SYNC;
-      }
-      else {
-        ci_dllist_remove(&eitem->dllink);
-        ep->oo_sockets_n--;
-        CI_FREE_OBJ(eitem);
-      }
-      if( --ep->epfd_syncs_needed == 0 )
-        /* This early exit may help us avoid iterating over the whole list. */
-        break;
-    }
+  if( citp_ul_epoll_ctl_sync_list(ep, epfd, &ep->oo_sockets) )
+    goto out;
+#if CI_CFG_EPOLL3
+  for( i = 0; i < CITP_EPOLL_OTHER_STACKS_MAX && ep->other_stacks_n; i++ ) {
+    if( ep->other_stacks[i].ni == NULL )
+      continue;
+    if( citp_ul_epoll_ctl_sync_list(ep, epfd,
+                                    &ep->other_stacks[i].sockets) ||
+        citp_ul_epoll_ctl_sync_list(ep, epfd,
+                                    &ep->other_stacks[i].not_ready_sockets) )
+      break;
+  }
+#endif
 
+ out:
   /* epfd_syncs_needed can be an overestimate, because changes can cancel
    * and members can be removed.
    */
@@ -1550,34 +1914,30 @@ static int citp_ul_epoll_one(struct oo_ul_epoll_state*__restrict__ eps,
    * If it's not closing then we should be able to tell by looking at whether
    * it's on the dead list - home sockets are bunged here when they're closed.
    */
-  if( ! (eps->ep->lock.lock & OO_WQLOCK_WORK_BITS)
+  /* Members of other stacks are reaped by their caller, as it needs to know
+   * that the eitem has gone.
+   */
 #if CI_CFG_EPOLL3
-      &&
-      ci_dllink_is_self_linked(&eitem->dead_stack_link) &&
-      eitem->ready_list_id < 0
+  if( eitem->other_stack < 0 )
 #endif
-      ) {
-    Log_POLL(ci_log("%s: auto remove fd %d from epoll set",
-                    __FUNCTION__, eitem->fd));
-
-    ci_dllist_remove(&eitem->dllink);
-    eps->ep->oo_sockets_n--;
-    CI_FREE_OBJ(eitem);
-  }
+    citp_epoll_reap_other(eps->ep, eitem);
 
   return stored_event;
 }
 
 
 #if CI_CFG_EPOLL3
-static void citp_epoll_get_ready_list(struct oo_ul_epoll_state*
-                                      __restrict__ eps)
+/* Move the sockets on ready list [id] of [ni] to the tail of [sockets],
+ * returning the last one moved, if any.
+ */
+static struct citp_epoll_member*
+citp_epoll_take_ready_list(struct oo_ul_epoll_state* __restrict__ eps,
+                           ci_netif* ni, int id, ci_dllist* sockets)
 {
-  ci_netif* ni = eps->ep->home_stack;
   struct oo_p_dllink_state ready_list =
-      oo_p_dllink_ptr(ni, &ni->state->ready_lists[eps->ep->ready_list]);
+      oo_p_dllink_ptr(ni, &ni->state->ready_lists[id]);
   struct oo_p_dllink_state unready_list =
-      oo_p_dllink_ptr(ni, &ni->state->unready_lists[eps->ep->ready_list]);
+      oo_p_dllink_ptr(ni, &ni->state->unready_lists[id]);
   struct oo_p_dllink_state lnk, tmp;
   struct citp_epoll_member* eitem = NULL;
   int stack_locked = 0;
@@ -1593,10 +1953,9 @@ static void citp_epoll_get_ready_list(struct oo_ul_epoll_state*
     ci_netif_lock(ni);
   oo_p_dllink_for_each_safe(ni, lnk, tmp, ready_list) {
     ci_sb_epoll_state* epoll;
-    epoll = CI_CONTAINER(ci_sb_epoll_state,
-                         e[eps->ep->ready_list].ready_link, lnk.l);
+    epoll = CI_CONTAINER(ci_sb_epoll_state, e[id].ready_link, lnk.l);
 
-    eitem = CI_USER_PTR_GET(epoll->e[eps->ep->ready_list].eitem);
+    eitem = CI_USER_PTR_GET(epoll->e[id].eitem);
     oo_p_dllink_del(ni, lnk);
     oo_p_dllink_add_tail(ni, unready_list, lnk);
     ci_assert(eitem);
@@ -1607,15 +1966,26 @@ static void citp_epoll_get_ready_list(struct oo_ul_epoll_state*
      * number of sockets.
      */
     eitem->flags &=~ CITP_EITEM_FLAG_POLL_END;
-    ci_dllist_push_tail(&eps->ep->oo_stack_sockets,
-                        &((struct citp_epoll_member*)eitem)->dllink);
+    ci_dllist_push_tail(sockets, &((struct citp_epoll_member*)eitem)->dllink);
   }
+  ci_netif_unlock(ni);
+  return eitem;
+}
+
+
+static void citp_epoll_get_ready_list(struct oo_ul_epoll_state*
+                                      __restrict__ eps)
+{
+  struct citp_epoll_member* eitem;
+
+  eitem = citp_epoll_take_ready_list(eps, eps->ep->home_stack,
+                                     eps->ep->ready_list,
+                                     &eps->ep->oo_stack_sockets);
   if( eitem ) {
     /* mark that when we remove this item from ready list we shall poll
      * other as well as os fds */
     eitem->flags |= CITP_EITEM_FLAG_POLL_END;
   }
-  ci_netif_unlock(ni);
 }
 
 
@@ -1674,6 +2044,65 @@ static void citp_epoll_poll_ul_home_stack(struct oo_ul_epoll_state*
 
   citp_epoll_poll_home_socks(eps);
 }
+
+
+static void
+citp_epoll_poll_other_stack_socks(struct oo_ul_epoll_state* __restrict__ eps,
+                                  struct citp_epoll_other_stack* os)
+{
+  struct citp_epoll_member* eitem;
+  ci_dllink *next, *last;
+  int is_last;
+
+  if( ci_dllist_is_empty(&os->sockets) )
+    return;
+
+  last = ci_dllist_last(&os->sockets);
+  next = ci_dllist_start(&os->sockets);
+  do {
+    eitem = CI_CONTAINER(struct citp_epoll_member, dllink, next);
+    next = next->next;
+    is_last = &eitem->dllink == last;
+    /* The stack keeps putting this socket on our ready list until we unhook
+     * it, which citp_ul_epoll_one() would not do for a closed fd.
+     */
+    if(CI_UNLIKELY( citp_ul_epoll_member_to_fdi(eitem) == NULL ))
+      citp_epoll_reap_other(eps->ep, eitem);
+    else if( ! citp_ul_epoll_one(eps, eitem) ) {
+      ci_dllist_remove(&eitem->dllink);
+      ci_dllist_push(&os->not_ready_sockets, &eitem->dllink);
+    }
+  } while( eps->events < eps->events_top && ! is_last );
+}
+
+
+/* Poll the members in the stacks where we own a ready list.  As for the
+ * home stack, only the sockets that the stack has put on the ready list
+ * (and those that were ready last time) are looked at.
+ */
+static void citp_epoll_poll_other_stacks(struct oo_ul_epoll_state*
+                                         __restrict__ eps)
+{
+  struct citp_epoll_fd* ep = eps->ep;
+  int i;
+
+  for( i = 0; i < CITP_EPOLL_OTHER_STACKS_MAX; i++ )
+    if( ep->other_stacks[i].ni != NULL && ep->other_stacks[i].sockets_n != 0 )
+      citp_epoll_take_ready_list(eps, ep->other_stacks[i].ni,
+                                 ep->other_stacks[i].ready_list,
+                                 &ep->other_stacks[i].sockets);
+
+  if( citp_fdtable_not_mt_safe() )
+    CITP_FDTABLE_LOCK_RD();
+  for( i = 0;
+       i < CITP_EPOLL_OTHER_STACKS_MAX && eps->events < eps->events_top;
+       i++ )
+    if( ep->other_stacks[i].ni != NULL )
+      citp_epoll_poll_other_stack_socks(eps, &ep->other_stacks[i]);
+  if( citp_fdtable_not_mt_safe() )
+    CITP_FDTABLE_UNLOCK_RD();
+  FDTABLE_ASSERT_VALID();
+}
 #endif
 
 
@@ -1684,6 +2113,14 @@ static void citp_epoll_poll_ul_other(struct oo_ul_epoll_state* __restrict__ eps)
 
   ci_assert( eps->events < eps->events_top );
 
+#if CI_CFG_EPOLL3
+  if( eps->ep->other_stacks_n != 0 ) {
+    citp_epoll_poll_other_stacks(eps);
+    if( eps->events == eps->events_top )
+      return;
+  }
+#endif
+
   if( ci_dllist_not_empty(&eps->ep->oo_sockets) ) {
     if( citp_fdtable_not_mt_safe() )
       CITP_FDTABLE_LOCK_RD();
@@ -1801,10 +2238,13 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
   struct citp_epoll_fd* ep = fdi_to_epoll(fdi);
   struct oo_ul_epoll_state eps;
   ci_uint64 base_poll_start_frc, poll_start_frc;
+  ci_uint64 spin_cycles = citp.spin_cycles;
+  ci_spin_adapt* spin_adapt = NULL;
   int rc = 0, rc_os = 0;
   sigset_t sigsaved;
   int pwait_was_spinning = 0;
   int have_spin = 0;
+  int waited = 0;
 
   ci_assert_ge(timeout_hr, 0);
   ci_assert_le(timeout_hr, OO_EPOLL_MAX_TIMEOUT_FRC);
@@ -1835,6 +2275,7 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
 #if CI_CFG_EPOLL3
        ci_dllist_is_empty(&ep->oo_stack_sockets) &&
        ci_dllist_is_empty(&ep->oo_stack_not_ready_sockets) &&
+       ep->other_stacks_n == 0 &&
 #endif
        ci_dllist_is_empty(&ep->oo_sockets)) ||
       maxevents <= 0 || events == NULL ) {
@@ -1890,6 +2331,13 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
   if( eps.ul_epoll_spin ) {
     eps.ul_epoll_spin |=
       oo_per_thread_get()->spinstate & (1 << ONLOAD_SPIN_SO_BUSY_POLL);
+    /* With EF_SPIN_ADAPT, spin only as long as this thread's recent waits
+     * suggest is worthwhile. */
+    if( CITP_OPTS.ul_spin_adapt ) {
+      spin_adapt = &oo_per_thread_get()->epoll_spin_adapt;
+      spin_cycles = ci_spin_adapt_budget(spin_adapt, citp.cpu_khz,
+                                         spin_cycles);
+    }
   }
 
   if(CI_UNLIKELY( eps.phase )) {
@@ -2016,6 +2464,9 @@ int citp_epoll_wait(citp_fdinfo* fdi, struct epoll_event*__restrict__ events,
       citp_epoll_find_timeout(&timeout_hr, &poll_start_frc);
       ordering->next_timeout_hr = timeout_hr;
     }
+    if( waited && spin_adapt != NULL )
+      ci_spin_adapt_record(spin_adapt, citp.cpu_khz, CITP_OPTS.ul_spin_adapt,
+                           eps.this_poll_frc - base_poll_start_frc, 1);
 
     Log_VPOLL(ci_log("%s(%d): return %d ul + %d kernel",
                      __FUNCTION__, fdi->fd, rc, rc_os));
@@ -2032,7 +2483,9 @@ no_events:
   }
 
   /* Blocking.  Shall we spin? */
-  if( KEEP_POLLING(eps.ul_epoll_spin, eps.this_poll_frc, base_poll_start_frc) ) {
+  waited = 1;
+  if( KEEP_POLLING_FOR(eps.ul_epoll_spin, eps.this_poll_frc,
+                       base_poll_start_frc, spin_cycles) ) {
     if( !pwait_was_spinning && sigmask != NULL) {
       if( ep->avoid_spin_once ) {
         eps.ul_epoll_spin = 0;
@@ -2220,6 +2673,10 @@ no_events:
     citp_epoll_find_timeout(&timeout_hr, &poll_start_frc);
     ordering->next_timeout_hr = timeout_hr;
   }
+  /* Record the waits that spinning did not cover. */
+  if( rc > 0 && waited && spin_adapt != NULL )
+    ci_spin_adapt_record(spin_adapt, citp.cpu_khz, CITP_OPTS.ul_spin_adapt,
+                         ci_frc64_get() - base_poll_start_frc, 0);
 
   Log_VPOLL(ci_log("%s(%d): to kernel => %d (%d)", __FUNCTION__, fdi->fd,
                    rc, errno));
@@ -2250,11 +2707,9 @@ citp_epoll_hook_start(struct citp_epoll_fd* ep, citp_fdinfo* fd_fdi,
   }
 #endif
 
-  CI_DLLIST_FOR_EACH2(struct citp_epoll_member, eitem,
-                      dllink, &ep->oo_sockets) {
-    if( eitem->fd == fd_fdi->fd && eitem->fdi_seq == fd_fdi->seq )
-      return eitem;
-  }
+  eitem = citp_epoll_fd_map_get(ep, fd_fdi);
+  if( eitem != NULL && eitem->item_list != &ep->dead_sockets )
+    return eitem;
 
   Log_POLL(ci_log("%s: epoll_fd=%d fd=%d not in epoll u/l set",
                   __FUNCTION__, fd_fdi->epoll_fd, fd_fdi->fd));
@@ -2291,6 +2746,14 @@ void citp_epoll_on_move_do(citp_fdinfo* epoll_fdi, citp_fdinfo* fd_fdi,
     /* Would be nice to move into the home stack if that's where we're moved
      * to, but not bothering for now.
      */
+#if CI_CFG_EPOLL3
+    if( eitem->other_stack >= 0 ) {
+      /* The socket has left the stack whose ready list it was on. */
+      citp_epoll_detach_other(ep, eitem);
+      eitem->item_list = &ep->oo_sockets;
+      ci_dllist_push(&ep->oo_sockets, &eitem->dllink);
+    }
+#endif
     eitem->fdi_seq = new_fdi->seq;
   }
 #if CI_CFG_EPOLL3
@@ -2307,6 +2770,7 @@ void citp_epoll_on_move_do(citp_fdinfo* epoll_fdi, citp_fdinfo* fd_fdi,
     eitem->item_list = &ep->oo_sockets;
     ci_dllist_push(&ep->oo_sockets, &eitem->dllink);
     ep->oo_sockets_n++;
+    citp_epoll_fd_map_set(ep, eitem);
 
     eitem->fdi_seq = new_fdi->seq;
     eitem->epfd_event.events = EP_NOT_REGISTERED;
@@ -2343,8 +2807,7 @@ static void citp_epoll_on_handover_do(citp_fdinfo* epoll_fdi,
   else
 #endif
   {
-    ep->oo_sockets_n--;
-    ci_dllist_remove(&eitem->dllink);
+    citp_epoll_remove_other(ep, eitem);
   }
 
   if( fd_fdi->protocol->type == CITP_PASSTHROUGH_FD )
@@ -2359,7 +2822,7 @@ static void citp_epoll_on_handover_do(citp_fdinfo* epoll_fdi,
   if( rc != 0 )
     Log_E(ci_log("%s: ERROR: epoll_ctl(%d, ADD, %d, ev) failed (%d)",
                  __FUNCTION__, epoll_fdi->fd, fd_fdi->fd, errno));
-  CI_FREE_OBJ(eitem);
+  citp_epoll_free_eitem(ep, eitem);
 
   if( ep->epfd_syncs_needed )
     citp_ul_epoll_ctl_sync(ep, epoll_fdi->fd);
@@ -2529,6 +2992,7 @@ citp_ul_epoll_store_event(struct oo_ul_epoll_state*__restrict__ eps,
   ci_assert(eitem->item_list == &eps->ep->oo_sockets
 #if CI_CFG_EPOLL3
             || eitem->item_list == &eps->ep->oo_stack_sockets
+            || eitem->other_stack >= 0
 #endif
             );
   ci_dllist_remove_safe(&eitem->dllink);
@@ -2544,6 +3008,27 @@ citp_ul_epoll_store_event(struct oo_ul_epoll_state*__restrict__ eps,
 }
 
 
+/* EPOLLEXCLUSIVE: only one of the epoll sets that have the socket with
+ * EPOLLEXCLUSIVE reports each event.  The sets race to claim the socket's
+ * [sleep_seq] value in [epoll_excl_seq]; the winner goes on reporting the
+ * event (level-triggered) until [sleep_seq] moves on.
+ */
+static int
+citp_ul_epoll_claim_excl(struct citp_epoll_member* eitem, ci_uint64 sleep_seq,
+                         volatile ci_uint64* sleep_seq_p)
+{
+  citp_waitable* w = CI_CONTAINER(citp_waitable, sleep_seq.all, sleep_seq_p);
+  ci_uint64 claimed = w->epoll_excl_seq;
+
+  if( claimed == sleep_seq )
+    return eitem->excl_seq == sleep_seq;
+  if( ! ci_cas64u_succeed(&w->epoll_excl_seq, claimed, sleep_seq) )
+    return 0;
+  eitem->excl_seq = sleep_seq;
+  return 1;
+}
+
+
 int
 citp_ul_epoll_find_events(struct oo_ul_epoll_state*__restrict__ eps,
                           struct citp_epoll_member*__restrict__ eitem,
@@ -2573,6 +3058,10 @@ citp_ul_epoll_find_events(struct oo_ul_epoll_state*__restrict__ eps,
     eitem->reported_sleep_seq = polled_sleep_seq;
   }
 
+  if( report != 0 && (eitem->epoll_data.events & EPOLLEXCLUSIVE) &&
+      ! citp_ul_epoll_claim_excl(eitem, sleep_seq, sleep_seq_p) )
+    report = 0;
+
   /* If we have some events to report, we should always report
    * the full mask of events. */
   if( report != 0 ) {
@@ -2668,11 +3157,87 @@ static void citp_epoll_get_ordering_limit(ci_netif* ni,
 }
 
 
-static int citp_epoll_ordering_compare(const void* a, const void* b)
+/* Find the ordering limit across all the stacks in the set.  Data in any
+ * of them may be earlier than the data we are about to return, so the
+ * limit is the earliest of the per-stack limits.  Comparing timestamps
+ * across stacks relies on the NIC clocks being synchronised, as is already
+ * the case for the interfaces of a single stack.
+ */
+static void citp_epoll_get_ordering_limits(ci_netif** stacks, int n_stacks,
+                                           struct timespec* limit_out)
+{
+  struct timespec ts;
+  int i;
+
+  if( n_stacks == 0 )
+    return;
+  citp_epoll_get_ordering_limit(stacks[0], limit_out);
+  for( i = 1; i < n_stacks; i++ ) {
+    citp_epoll_get_ordering_limit(stacks[i], &ts);
+    if( citp_timespec_compare(&ts, limit_out) < 0 )
+      *limit_out = ts;
+  }
+}
+
+
+static void citp_epoll_release_stacks(ci_netif** stacks, int n_stacks)
+{
+  int i;
+  for( i = 0; i < n_stacks; i++ )
+    citp_netif_release_ref(stacks[i], 0);
+}
+
+
+/* The ready sockets are kept in a binary min-heap keyed on the timestamp
+ * of their next data.  We usually return far fewer events than there are
+ * ready sockets, so building the heap and popping the events we return is
+ * O(n + k log n), where sorting the lot would be O(n log n).
+ */
+ci_inline int citp_epoll_ordering_before(const struct citp_ordering_info* a,
+                                         const struct citp_ordering_info* b)
+{
+  return citp_timespec_compare(&a->oo_event.ts, &b->oo_event.ts) < 0;
+}
+
+
+static void citp_epoll_ordering_sift_down(struct citp_ordering_info* heap,
+                                          int n, int i)
 {
-  return citp_timespec_compare(
-                          &((const struct citp_ordering_info*)a)->oo_event.ts,
-                          &((const struct citp_ordering_info*)b)->oo_event.ts);
+  struct citp_ordering_info tmp = heap[i];
+  int child;
+
+  while( (child = 2 * i + 1) < n ) {
+    if( child + 1 < n &&
+        citp_epoll_ordering_before(&heap[child + 1], &heap[child]) )
+      ++child;
+    if( ! citp_epoll_ordering_before(&heap[child], &tmp) )
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = tmp;
+}
+
+
+static void citp_epoll_ordering_heapify(struct citp_ordering_info* heap,
+                                        int n)
+{
+  int i;
+  for( i = n / 2 - 1; i >= 0; i-- )
+    citp_epoll_ordering_sift_down(heap, n, i);
+}
+
+
+/* Remove the head of the heap of [n] entries, returning it in [head_out]. */
+static void citp_epoll_ordering_pop(struct citp_ordering_info* heap, int n,
+                                    struct citp_ordering_info* head_out)
+{
+  ci_assert_gt(n, 0);
+  *head_out = heap[0];
+  if( --n > 0 ) {
+    heap[0] = heap[n];
+    citp_epoll_ordering_sift_down(heap, n, 0);
+  }
 }
 
 
@@ -2686,23 +3251,24 @@ citp_epoll_sort_results(struct epoll_event*__restrict__ events,
 {
   int i;
   int ordered_events = 0;
+  int heap_n = ready_socks;
+  struct citp_ordering_info cur;
   struct timespec next;
   struct timespec* next_data_limit;
   if( ready_socks < maxevents )
     maxevents = ready_socks;
 
   /* Update ordering info to point at the corresponding event, so that we know
-   * which event it corresponds to after sorting.
+   * which event it corresponds to after reordering.
    */
   for( i = 0; i < ready_socks; i++ )
     ordering_info[i].event = &wait_events[i];
 
-  /* Sort list of ready sockets based on timestamp of next available data. */
-  qsort(ordering_info, ready_socks, sizeof(*ordering_info),
-        citp_epoll_ordering_compare);
+  /* Heap of ready sockets, keyed on timestamp of next available data. */
+  citp_epoll_ordering_heapify(ordering_info, ready_socks);
 
-  /* Working from head of list, copy ordered data into output array, stopping
-   * when any of the following conditions are true:
+  /* Taking the earliest socket each time, copy ordered data into output
+   * array, stopping when any of the following conditions are true:
    * - we have filled the output event array (i == maxevents)
    * - the timestamp for the current event is after the limit
    * - a ready socket has additional data that is earlier than the next socket's
@@ -2713,39 +3279,42 @@ citp_epoll_sort_results(struct epoll_event*__restrict__ events,
   Log_VPOLL(ci_log("%s: maxevents=%d limit %lus %dns", __func__, maxevents,
                    (unsigned long)limit->tv_sec, (int)limit->tv_nsec));
   for( i = 0; i < maxevents; i++ ) {
+    citp_epoll_ordering_pop(ordering_info, heap_n--, &cur);
+
     /* If this event has a valid timestamp, then get ordering data for it. */
-    if( ordering_info[i].oo_event.ts.tv_sec != 0 ) {
+    if( cur.oo_event.ts.tv_sec != 0 ) {
       Log_VPOLL(ci_log("%s: ev=%d ts %lus %dns", __func__, i,
-                       (unsigned long)ordering_info[i].oo_event.ts.tv_sec,
-                       (int)ordering_info[i].oo_event.ts.tv_nsec));
+                       (unsigned long)cur.oo_event.ts.tv_sec,
+                       (int)cur.oo_event.ts.tv_nsec));
       /* If this event is after the limit, stop here. */
-      if( citp_timespec_compare(limit, &ordering_info[i].oo_event.ts) < 0 )
+      if( citp_timespec_compare(limit, &cur.oo_event.ts) < 0 )
         break;
 
       /* If there is another ready socket then use the start of their data
-       * to bound the amount we claim as available from this socket.
+       * to bound the amount we claim as available from this socket.  The
+       * next one is now at the head of the heap.
        */
-      if( (i + 1) < ready_socks && ordering_info[i + 1].oo_event.ts.tv_sec &&
-          citp_timespec_compare(&ordering_info[i + 1].oo_event.ts, limit) < 0 )
-        next_data_limit = &ordering_info[i + 1].oo_event.ts;
+      if( heap_n > 0 && ordering_info[0].oo_event.ts.tv_sec &&
+          citp_timespec_compare(&ordering_info[0].oo_event.ts, limit) < 0 )
+        next_data_limit = &ordering_info[0].oo_event.ts;
       else
         next_data_limit = limit;
 
       /* Get the number of bytes available in order, and the timestamp of the
        * first data that is after that.
        */
-      if( ordering_info[i].fdi )
-        citp_fdinfo_get_ops(ordering_info[i].fdi)->ordered_data(
-                                       ordering_info[i].fdi, next_data_limit,
-                                       &next, &ordering_info[i].oo_event.bytes);
+      if( cur.fdi )
+        citp_fdinfo_get_ops(cur.fdi)->ordered_data(cur.fdi, next_data_limit,
+                                                   &next,
+                                                   &cur.oo_event.bytes);
 
       /* If we have more data then don't let us return anything beyond that. */
       if( next.tv_sec && citp_timespec_compare(&next, limit) < 0 )
         *limit = next;
     }
 
-    memcpy(&events[i], ordering_info[i].event, sizeof(struct epoll_event));
-    memcpy(&oo_events[i], &ordering_info[i].oo_event,
+    memcpy(&events[i], cur.event, sizeof(struct epoll_event));
+    memcpy(&oo_events[i], &cur.oo_event,
            sizeof(struct onload_ordered_epoll_event));
     ordered_events++;
   }
@@ -2766,6 +3335,13 @@ int citp_epoll_ordered_wait(citp_fdinfo* fdi,
   citp_fdinfo* sock_fdi = NULL;
   citp_sock_fdi* sock_epi;
   ci_netif* ni;
+#if CI_CFG_EPOLL3
+  ci_netif* stacks[1 + CITP_EPOLL_OTHER_STACKS_MAX];
+  int i;
+#else
+  ci_netif* stacks[1];
+#endif
+  int n_stacks;
   struct timespec limit_ts = {0, 0};
   struct citp_ordered_wait wait;
   int n_socks;
@@ -2779,6 +3355,7 @@ int citp_epoll_ordered_wait(citp_fdinfo* fdi,
 
  new_stack:
   ni = NULL;
+  n_stacks = 0;
 
   CITP_EPOLL_EP_LOCK(ep);
 
@@ -2828,9 +3405,17 @@ int citp_epoll_ordered_wait(citp_fdinfo* fdi,
   }
 
 #if CI_CFG_EPOLL3
-  if( ep->home_stack ) {
-    ni = ep->home_stack;
-    citp_netif_add_ref(ni);
+  /* The first stack is the one we poll as part of the wait; the limit is
+   * taken across all of them. */
+  if( ep->home_stack )
+    stacks[n_stacks++] = ep->home_stack;
+  for( i = 0; i < CITP_EPOLL_OTHER_STACKS_MAX; i++ )
+    if( ep->other_stacks[i].ni != NULL && ep->other_stacks[i].sockets_n != 0 )
+      stacks[n_stacks++] = ep->other_stacks[i].ni;
+  for( i = 0; i < n_stacks; i++ )
+    citp_netif_add_ref(stacks[i]);
+  if( n_stacks != 0 ) {
+    ni = stacks[0];
   }
   else
 #endif
@@ -2854,6 +3439,7 @@ int citp_epoll_ordered_wait(citp_fdinfo* fdi,
           sock_epi = fdi_to_sock_fdi(sock_fdi);
           ni = sock_epi->sock.netif;
           citp_netif_add_ref(ni);
+          stacks[n_stacks++] = ni;
           break;
         }
       }
@@ -2867,7 +3453,7 @@ int citp_epoll_ordered_wait(citp_fdinfo* fdi,
   CITP_EPOLL_EP_UNLOCK(ep, 0);
 
  again:
-  citp_epoll_get_ordering_limit(ni, &limit_ts);
+  citp_epoll_get_ordering_limits(stacks, n_stacks, &limit_ts);
 
   wait.ordering_info = ep->ordering_info;
   wait.poll_again = 0;
@@ -2888,7 +3474,7 @@ int citp_epoll_ordered_wait(citp_fdinfo* fdi,
     citp_reenter_lib(lib_context);
     if( ni == NULL )
       goto new_stack;
-    citp_epoll_get_ordering_limit(ni, &limit_ts);
+    citp_epoll_get_ordering_limits(stacks, n_stacks, &limit_ts);
 
     rc = citp_epoll_wait(fdi, ep->wait_events, &wait, n_socks,
                          0, sigmask, NULL, lib_context);
@@ -2913,15 +3499,13 @@ int citp_epoll_ordered_wait(citp_fdinfo* fdi,
       citp_reenter_lib(lib_context);
       timeout_hr = wait.next_timeout_hr;
       Log_VPOLL(ci_log("%s: all events vanished.  Stack change?", __FUNCTION__));
-      if( ni )
-        citp_netif_release_ref(ni, 0);
+      citp_epoll_release_stacks(stacks, n_stacks);
       goto new_stack;
     }
   }
 
 out:
-  if( ni )
-    citp_netif_release_ref(ni, 0);
+  citp_epoll_release_stacks(stacks, n_stacks);
   return rc;
 }
 #endif /* CI_CFG_TIMESTAMPING */
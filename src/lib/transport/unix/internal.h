@@ -76,7 +76,7 @@ typedef struct {
  * CITP_INIT_MAX may contains some post-init actions.
  */
 #define CITP_INIT_ALL   CITP_INIT_PROTO
-#define CITP_INIT_MAX   CITP_INIT_SIGNALS
+#define CITP_INIT_MAX   CITP_INIT_SYSCALL_DISPATCH
 
   char			process_path[128];
   char*			process_name;
@@ -523,6 +523,38 @@ extern void exit_lock_all_stacks(void);
 extern bool have_active_netifs(void);
 
 
+/**********************************************************************
+ ** Syscall User Dispatch (syscall_dispatch.c).
+ */
+
+/* Arms the calling thread if EF_SYSCALL_DISPATCH is set. */
+extern int citp_syscall_dispatch_init(void) CI_HF;
+
+#if CI_CFG_SYSCALL_USER_DISPATCH
+/* Non-zero once raw system calls are being trapped. */
+extern int citp_syscall_dispatch_enabled CI_HV;
+
+/* Re-arm the calling thread, which has a valid selector, e.g. after fork
+ * or a failed exec. */
+extern void citp_syscall_dispatch_arm_thread(void) CI_HF;
+
+/* Re-arm the only thread of a forked child. */
+extern void citp_syscall_dispatch_fork_child(void) CI_HF;
+
+/* sigaction() for SIGSYS while raw system calls are trapped: records the
+ * application's handler, to which we chain other SIGSYS signals. */
+extern int citp_syscall_dispatch_sigaction(const struct sigaction* act,
+                                           struct sigaction* oldact) CI_HF;
+
+/* pthread_create() for new threads that must be armed. */
+extern int
+citp_syscall_dispatch_pthread_create(pthread_t* thread,
+                                     const pthread_attr_t* attr,
+                                     void* (*start_routine)(void*),
+                                     void* arg) CI_HF;
+#endif
+
+
 /**********************************************************************
  ** Misc.
  */
@@ -43,11 +43,13 @@ LIB_SRCS	:=			\
 		wqlock.c		\
 		poll_select.c		\
 		passthrough_fd.c	\
+		syscall_dispatch.c	\
 		utils.c
 
 MMAKE_OBJ_PREFIX := ci_tp_unix_
 LIB_OBJS	:= $(LIB_SRCS:%.c=$(MMAKE_OBJ_PREFIX)%.o)
 LIB_OBJS	+= $(MMAKE_OBJ_PREFIX)vfork_intercept.o
+LIB_OBJS	+= $(MMAKE_OBJ_PREFIX)syscall_dispatch_clone.o
 
 MMAKE_CFLAGS 	+= -DONLOAD_EXT_VERSION_MAJOR=$(ONLOAD_EXT_VERSION_MAJOR)
 MMAKE_CFLAGS 	+= -DONLOAD_EXT_VERSION_MINOR=$(ONLOAD_EXT_VERSION_MINOR)
@@ -159,6 +159,12 @@ static void citp_netif_child_fork_hook(void)
 #if CI_CFG_FD_CACHING
   citp.pid = getpid();
 #endif
+  __oo_per_thread_get()->tid = ci_sys_syscall(__NR_gettid);
+#if CI_CFG_SYSCALL_USER_DISPATCH
+  /* Syscall User Dispatch is not inherited by the child. */
+  if( citp_syscall_dispatch_enabled )
+    citp_syscall_dispatch_fork_child();
+#endif
 
   /* We can't just use CITP_UNLOCK since we are not allowed to call
    * non-async-safe functions from the child hook.
@@ -304,6 +304,52 @@ int onload_timestamping_request(int fd, unsigned flags)
 }
 
 
+int onload_tx_timestamp_ring(int fd, struct onload_tx_ts_ring* ring,
+                             uint32_t* sock_key_out)
+{
+#if CI_CFG_TIMESTAMPING
+  citp_fdinfo* fdi;
+  int rc;
+  citp_lib_context_t lib_context;
+
+  citp_enter_lib(&lib_context);
+
+  if( (fdi = citp_fdtable_lookup(fd)) != NULL ) {
+    if( citp_fdinfo_is_socket(fdi) ) {
+      citp_socket* ep = fdi_to_socket(fdi);
+      ci_netif* ni = ep->netif;
+
+      if( ni->tx_ts_ring.data != NULL ) {
+        const struct oo_ringbuffer_state* state = ni->tx_ts_ring.state;
+        ring->write = &state->write;
+        ring->records = (const void*) ni->tx_ts_ring.data;
+        ring->mask = state->mask;
+        ring->read = state->write;
+        ring->lost = 0;
+        *sock_key_out = OO_SP_TO_INT(SC_SP(ep->s));
+        rc = 0;
+      }
+      else {
+        rc = -ENOENT;
+      }
+    }
+    else {
+      rc = -ENOTTY;
+    }
+    citp_fdinfo_release_ref(fdi, 0);
+  }
+  else {
+    rc = -ENOTTY;
+  }
+
+  citp_exit_lib(&lib_context, 0);
+  return rc;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+
 static int oo_extensions_version_check(void)
 {
   static unsigned int* oev;
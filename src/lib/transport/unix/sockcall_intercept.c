@@ -2806,6 +2806,26 @@ OO_INTERCEPT(long, syscall,
 #endif
 
 
+#if CI_CFG_SYSCALL_USER_DISPATCH
+/* New threads do not inherit Syscall User Dispatch, so they must be armed
+ * as they start. */
+OO_INTERCEPT(int, pthread_create,
+             (pthread_t* thread, const pthread_attr_t* attr,
+              void* (*start_routine)(void*), void* arg))
+{
+  if( CI_UNLIKELY(citp.init_level < CITP_INIT_ALL) ) {
+    citp_do_init(CITP_INIT_BASIC_SYSCALLS);
+    return ci_sys_pthread_create(thread, attr, start_routine, arg);
+  }
+
+  if( citp_syscall_dispatch_enabled )
+    return citp_syscall_dispatch_pthread_create(thread, attr,
+                                                start_routine, arg);
+  return ci_sys_pthread_create(thread, attr, start_routine, arg);
+}
+#endif
+
+
 OO_INTERCEPT(void, _exit, (int status))
 {
   Log_CALL(ci_log("%s(%d)", __func__, status));
@@ -2834,6 +2854,17 @@ OO_INTERCEPT(void, _exit, (int status))
  * sigaction() does not use fdtable.  Other sync methods are used here.
  */
 
+static int citp_sigaction(int signum, const struct sigaction* act,
+                          struct sigaction* oldact)
+{
+#if CI_CFG_SYSCALL_USER_DISPATCH
+  /* SIGSYS is ours while raw system calls are trapped. */
+  if( signum == SIGSYS && citp_syscall_dispatch_enabled )
+    return citp_syscall_dispatch_sigaction(act, oldact);
+#endif
+  return oo_do_sigaction(signum, act, oldact);
+}
+
 OO_INTERCEPT(int, sigaction,
              (int signum, const struct sigaction *act,
               struct sigaction* oldact))
@@ -2850,7 +2881,7 @@ OO_INTERCEPT(int, sigaction,
     Log_CALL(ci_log("\tnew "OO_PRINT_SIGACTION_FMT,
                     OO_PRINT_SIGACTION_ARG(act)));
 
-  rc = oo_do_sigaction(signum, act, oldact);
+  rc = citp_sigaction(signum, act, oldact);
 
   Log_CALL_RESULT(rc);
   if( rc == 0 && oldact != NULL )
@@ -2876,7 +2907,7 @@ OO_INTERCEPT(int, siginterrupt,
 
   Log_CALL(ci_log("%s(%d, %d)", __FUNCTION__, sig, flag));
 
-  rc = oo_do_sigaction(sig, NULL, &act);
+  rc = citp_sigaction(sig, NULL, &act);
   if( rc < 0 )
     goto out;
 
@@ -2889,7 +2920,7 @@ OO_INTERCEPT(int, siginterrupt,
     sigdelset(&oo_sigintr, sig);
   }
 
-  rc = oo_do_sigaction(sig, &act, NULL);
+  rc = citp_sigaction(sig, &act, NULL);
   if( rc < 0 )
     goto out;
 
@@ -2920,7 +2951,7 @@ OO_INTERCEPT(__sighandler_t, signal,
     return SIG_ERR;
   act.sa_flags = sigismember (&oo_sigintr, sig) ? 0 : SA_RESTART;
 
-  if( oo_do_sigaction(sig, &act, &oact) < 0 )
+  if( citp_sigaction(sig, &act, &oact) < 0 )
     return SIG_ERR;
 
   Log_CALL_RESULT_PTR(oact.sa_handler);
@@ -2947,7 +2978,7 @@ OO_INTERCEPT(__sighandler_t, sysv_signal,
     return SIG_ERR;
   act.sa_flags = SA_ONESHOT | SA_NOMASK | SA_INTERRUPT;
 
-  if( oo_do_sigaction(sig, &act, &oact) < 0 )
+  if( citp_sigaction(sig, &act, &oact) < 0 )
     return SIG_ERR;
 
   Log_CALL_RESULT_PTR(oact.sa_handler);
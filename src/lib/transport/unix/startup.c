@@ -83,6 +83,9 @@ static void __oo_per_thread_init_thread(struct oo_per_thread* pt)
 
   oo_stackname_thread_init(&pt->stackname);
 
+  pt->tid = ci_sys_syscall(__NR_gettid);
+  memset(&pt->epoll_spin_adapt, 0, sizeof(pt->epoll_spin_adapt));
+  pt->epoll_spin_adapt.budget_usec = CI_SPIN_ADAPT_NO_BUDGET;
   pt->spinstate = 0;
   if( CITP_OPTS.udp_recv_spin )
     pt->spinstate |= (1 << ONLOAD_SPIN_UDP_RECV);
@@ -168,6 +171,7 @@ static void citp_dump_opts(citp_opts_t *o)
   DUMP_OPT_INT("EF_SO_BUSY_POLL_SPIN",  so_busy_poll_spin);
   DUMP_OPT_INT("EF_UL_EPOLL",	        ul_epoll);
   DUMP_OPT_INT("EF_EPOLL_SPIN",	        ul_epoll_spin);
+  DUMP_OPT_INT("EF_SPIN_ADAPT",	        ul_spin_adapt);
   DUMP_OPT_INT("EF_EPOLL_CTL_FAST",     ul_epoll_ctl_fast);
   DUMP_OPT_INT("EF_EPOLL_CTL_HANDOFF",  ul_epoll_ctl_handoff);
   DUMP_OPT_INT("EF_EPOLL_MT_SAFE",      ul_epoll_mt_safe);
@@ -251,7 +255,7 @@ static int get_env_opt_int(const char* name, int old_val, int hex)
 { const char* s;
   int new_val;
   char dummy;
-  if( (s = getenv(name)) ) {
+  if( (s = ci_cfg_getenv(name)) ) {
     if( sscanf(s, hex ? "%x %c" : "%d %c", &new_val, &dummy) == 1 )
       /*! TODO: should use option value range checking here */
       return new_val;
@@ -273,9 +277,9 @@ static int get_env_opt_int(const char* name, int old_val, int hex)
  */
 static void get_env_opt_port_list(ci_uint64* opt, const char* name)
 {
-  char *s;
+  const char *s;
   unsigned v;
-  if( (s = getenv(name)) ) {
+  if( (s = ci_cfg_getenv(name)) ) {
     /* The memory used for this list is never freed, as we need it
      * persist until the process terminates 
      */
@@ -343,7 +347,7 @@ static void citp_opts_getenv(citp_opts_t* opts)
   opts->log_via_ioctl = 3;
   GET_ENV_OPT_INT("EF_LOG_VIA_IOCTL",	log_via_ioctl);
 
-  if( (s = getenv("EF_LOG_FILE")) && opts->log_via_ioctl == 3) {
+  if( (s = ci_cfg_getenv("EF_LOG_FILE")) && opts->log_via_ioctl == 3) {
     opts->log_via_ioctl = 0;
     citp_log_to_file(s);
   } else if( opts->log_via_ioctl == 3 ) {
@@ -364,20 +368,21 @@ static void citp_opts_getenv(citp_opts_t* opts)
       ci_log_options |= CI_LOG_TIME;
     citp_setup_logging_change(citp_log_fn_ul);
   }
-  if( getenv("EF_LOG_THREAD") )
+  if( ci_cfg_getenv("EF_LOG_THREAD") )
     ci_log_options |= CI_LOG_TID;
 
 
-  if( getenv("EF_POLL_NONBLOCK_FAST_LOOPS") &&
-      ! getenv("EF_POLL_NONBLOCK_FAST_USEC") )
+  if( ci_cfg_getenv("EF_POLL_NONBLOCK_FAST_LOOPS") &&
+      ! ci_cfg_getenv("EF_POLL_NONBLOCK_FAST_USEC") )
     log("ERROR: EF_POLL_NONBLOCK_FAST_LOOPS is deprecated, use"
         " EF_POLL_NONBLOCK_FAST_USEC instead");
 
-  if( getenv("EF_POLL_FAST_LOOPS") && ! getenv("EF_POLL_FAST_USEC") )
+  if( ci_cfg_getenv("EF_POLL_FAST_LOOPS") &&
+      ! ci_cfg_getenv("EF_POLL_FAST_USEC") )
     log("ERROR: EF_POLL_FAST_LOOPS is deprecated, use"
         " EF_POLL_FAST_USEC instead");
 
-  if( (s = getenv("EF_POLL_USEC")) && atoi(s) ) {
+  if( (s = ci_cfg_getenv("EF_POLL_USEC")) && atoi(s) ) {
     /* Any changes to the behaviour triggered by this meta
      * option must also be made to the extensions API option
      * ONLOAD_SPIN_MIMIC_EF_POLL
@@ -396,7 +401,7 @@ static void citp_opts_getenv(citp_opts_t* opts)
     opts->stack_lock_buzz = 1;
   }
 
-  if( (s = getenv("EF_BUZZ_USEC")) && atoi(s) ) {
+  if( (s = ci_cfg_getenv("EF_BUZZ_USEC")) && atoi(s) ) {
     opts->sock_lock_buzz = 1;
     opts->stack_lock_buzz = 1;
   }
@@ -430,6 +435,7 @@ static void citp_opts_getenv(citp_opts_t* opts)
   GET_ENV_OPT_INT("EF_SO_BUSY_POLL_SPIN", so_busy_poll_spin);
   GET_ENV_OPT_INT("EF_UL_EPOLL",        ul_epoll);
   GET_ENV_OPT_INT("EF_EPOLL_SPIN",      ul_epoll_spin);
+  GET_ENV_OPT_INT("EF_SPIN_ADAPT",      ul_spin_adapt);
   GET_ENV_OPT_INT("EF_EPOLL_CTL_FAST",  ul_epoll_ctl_fast);
   GET_ENV_OPT_INT("EF_EPOLL_CTL_HANDOFF",ul_epoll_ctl_handoff);
   GET_ENV_OPT_INT("EF_EPOLL_MT_SAFE",   ul_epoll_mt_safe);
@@ -445,17 +451,18 @@ static void citp_opts_getenv(citp_opts_t* opts)
   GET_ENV_OPT_INT("EF_SA_ONSTACK_INTERCEPT",	sa_onstack_intercept);
   GET_ENV_OPT_INT("EF_ACCEPT_INHERIT_NONBLOCK",	accept_force_inherit_nonblock);
   GET_ENV_OPT_INT("EF_VFORK_MODE",	vfork_mode);
+  GET_ENV_OPT_INT("EF_SYSCALL_DISPATCH",	syscall_dispatch);
   GET_ENV_OPT_INT("EF_PIPE",        ul_pipe);
   GET_ENV_OPT_INT("EF_SYNC_CPLANE_AT_CREATE",	sync_cplane);
 
-  if( (s = getenv("EF_FORK_NETIF")) && sscanf(s, "%x", &v) == 1 ) {
+  if( (s = ci_cfg_getenv("EF_FORK_NETIF")) && sscanf(s, "%x", &v) == 1 ) {
     opts->fork_netif = CI_MIN(v, CI_UNIX_FORK_NETIF_BOTH);
   }
-  if( (s = getenv("EF_NETIF_DTOR")) && sscanf(s, "%x", &v) == 1 ) {
+  if( (s = ci_cfg_getenv("EF_NETIF_DTOR")) && sscanf(s, "%x", &v) == 1 ) {
     opts->netif_dtor = CI_MIN(v, CITP_NETIF_DTOR_ALL);
   }
 
-  if( (s = getenv("EF_SIGNALS_NOPOSTPONE")) ) {
+  if( (s = ci_cfg_getenv("EF_SIGNALS_NOPOSTPONE")) ) {
     opts->signals_no_postpone = 0;
     while( sscanf(s, "%u", &v) == 1 ) {
       opts->signals_no_postpone |= (1ULL << (v-1));
@@ -468,7 +475,7 @@ static void citp_opts_getenv(citp_opts_t* opts)
   /* SIGONLOAD is used internally, and should not be postponed. */
   opts->signals_no_postpone |= (1ULL << (SIGONLOAD-1));
 
-  if( (s = getenv("EF_CLUSTER_NAME")) ) {
+  if( (s = ci_cfg_getenv("EF_CLUSTER_NAME")) ) {
     strncpy(opts->cluster_name, s, CI_CFG_CLUSTER_NAME_LEN);
     opts->cluster_name[CI_CFG_CLUSTER_NAME_LEN] = '\0';
   }
@@ -526,9 +533,9 @@ static void citp_opts_validate_env(void)
   char** env_name;
   int i;
   int len;
-  char* s;
+  const char* s;
   
-  s = getenv("EF_VALIDATE_ENV");
+  s = ci_cfg_getenv("EF_VALIDATE_ENV");
   if( s ) {
     char* s_end;
     long v;
@@ -577,13 +584,13 @@ citp_transport_init(void)
   citp_opts_validate_env();
 
   CITP_OPTS.load_env = 1;
-  if( (s = getenv("EF_LOAD_ENV")) )
+  if( (s = ci_cfg_getenv("EF_LOAD_ENV")) )
     CITP_OPTS.load_env = atoi(s);
   if( CITP_OPTS.load_env )
     citp_opts_getenv(&CITP_OPTS);
 
   /* NB. We only look at EF_CONFIG_DUMP if EF_LOAD_ENV. */
-  if( CITP_OPTS.load_env && getenv("EF_CONFIG_DUMP") ) {
+  if( CITP_OPTS.load_env && ci_cfg_getenv("EF_CONFIG_DUMP") ) {
     citp_dump_opts(&CITP_OPTS);
     citp_dump_config();
     /* ?? ci_netif_config_opts_dump(&citp.netif_opts); */
@@ -40,3 +40,6 @@ STARTUP_ITEM(CITP_INIT_PROTO, citp_transport_register)
 
 /* Intercept signals which may have been installed in earlier init stages */
 STARTUP_ITEM(CITP_INIT_SIGNALS, oo_init_signals)
+
+/* Trap raw system calls; this takes SIGSYS from the signal intercepts */
+STARTUP_ITEM(CITP_INIT_SYSCALL_DISPATCH, citp_syscall_dispatch_init)
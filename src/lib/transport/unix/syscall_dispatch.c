@@ -0,0 +1,694 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+/**************************************************************************\
+*//*! \file
+**  \brief  Interception of raw system calls with Syscall User Dispatch
+*//*
+\**************************************************************************/
+
+/* Onload intercepts the libc entry points, so it does not see system calls
+ * that an application makes with a syscall instruction of its own, as the
+ * Go runtime does.  With EF_SYSCALL_DISPATCH=1 we ask the kernel to raise
+ * SIGSYS for every system call made from outside libc's text, and the
+ * handler below routes the socket and fd calls to the same onload_*
+ * entry points that the libc intercepts use, and issues everything else
+ * unchanged.
+ *
+ * Whether a thread traps is controlled by a selector byte in its
+ * per-thread state, which the kernel reads on each system call from
+ * outside libc.  The handler opens the selector for its own duration, so
+ * that Onload may make system calls freely, and closes it again on the
+ * way out.  The arming does not survive fork() or thread creation, so we
+ * re-arm from the fork hook and from an intercept of pthread_create().
+ * Threads created by a raw clone() arm themselves on the way out of
+ * citp_sud_clone(), with a selector that we set aside for them.
+ *
+ * A few system calls cannot just be forwarded from within a signal
+ * handler; see citp_sud_dispatch() and citp_sud_rt_sigreturn().
+ */
+
+#include "internal.h"
+#include <onload/ul/per_thread.h>
+
+#if CI_CFG_SYSCALL_USER_DISPATCH
+
+#include <dlfcn.h>
+#include <link.h>
+#include <sched.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#ifndef PR_SET_SYSCALL_USER_DISPATCH
+# define PR_SET_SYSCALL_USER_DISPATCH  59
+#endif
+#ifndef PR_SYS_DISPATCH_OFF
+# define PR_SYS_DISPATCH_OFF           0
+#endif
+#ifndef PR_SYS_DISPATCH_ON
+# define PR_SYS_DISPATCH_ON            1
+#endif
+#ifndef SYSCALL_DISPATCH_FILTER_ALLOW
+# define SYSCALL_DISPATCH_FILTER_ALLOW 0
+#endif
+#ifndef SYSCALL_DISPATCH_FILTER_BLOCK
+# define SYSCALL_DISPATCH_FILTER_BLOCK 1
+#endif
+#ifndef SYS_USER_DISPATCH
+# define SYS_USER_DISPATCH             2
+#endif
+
+
+int citp_syscall_dispatch_enabled;
+
+static struct {
+  /* Executable text of libc, from which system calls do not trap. */
+  unsigned long libc_start;
+  unsigned long libc_len;
+  /* Our own text: system calls made by Onload itself are passed through. */
+  unsigned long self_start;
+  unsigned long self_len;
+  /* The application's SIGSYS action, for signals that are not ours. */
+  struct sigaction app_sigsys;
+} citp_sud;
+
+
+/* The kernel's struct sigaction, as passed to rt_sigaction. */
+struct citp_sud_ksigaction {
+  void*         handler;
+  unsigned long flags;
+  void*         restorer;
+  unsigned long mask;
+};
+
+#define CITP_SUD_SIGSYS_MASK  (1ul << (SIGSYS - 1))
+
+
+/* A thread created by a raw clone() may have no per-thread state of ours,
+ * or may share it with the thread that cloned it, so its selector lives
+ * here and is found by thread id.  Slots of threads that have gone are
+ * reclaimed when we run out.  The layout must match the offsets in
+ * syscall_dispatch_clone.S. */
+struct citp_sud_clone_thread {
+  ci_int32 tid;       /* 0 if free; -1 until the thread fills it in */
+  char     selector;
+};
+
+#define CITP_SUD_CLONE_THREADS_MAX  256
+
+static struct citp_sud_clone_thread
+  citp_sud_clone_threads[CITP_SUD_CLONE_THREADS_MAX];
+/* Number of slots that are not free. */
+static volatile ci_uint32 citp_sud_clone_threads_n;
+
+
+/* Registers of a thread created by a raw clone() with a new stack, and
+ * what it needs to arm itself.  The layout must match the offsets in
+ * syscall_dispatch_clone.S. */
+struct citp_sud_clone_frame {
+  unsigned long rip, rsp;
+  unsigned long rbx, rbp, r12, r13, r14, r15;
+  unsigned long rdi, rsi, rdx, r8, r9, r10;
+  struct citp_sud_clone_thread* thread;  /* NULL not to arm */
+  unsigned long libc_start, libc_len;
+  /* The application's signal mask; the child inherits the handler's,
+   * in which SIGSYS is blocked. */
+  unsigned long sigmask;
+};
+
+extern long citp_sud_clone(unsigned long flags, void* frame, int* ptid,
+                           int* ctid, unsigned long tls) CI_HF;
+
+
+/* System calls that we hand to onload_syscall().  Everything else is made
+ * directly. */
+static const ci_uint8 citp_sud_route[] = {
+  [__NR_socket] = 1,
+  [__NR_bind] = 1,
+  [__NR_listen] = 1,
+  [__NR_accept] = 1,
+  [__NR_accept4] = 1,
+  [__NR_connect] = 1,
+  [__NR_shutdown] = 1,
+  [__NR_getsockname] = 1,
+  [__NR_getpeername] = 1,
+  [__NR_getsockopt] = 1,
+  [__NR_setsockopt] = 1,
+  [__NR_recvfrom] = 1,
+  [__NR_recvmsg] = 1,
+  [__NR_recvmmsg] = 1,
+  [__NR_sendto] = 1,
+  [__NR_sendmsg] = 1,
+  [__NR_sendmmsg] = 1,
+  [__NR_select] = 1,
+  [__NR_poll] = 1,
+  [__NR_ppoll] = 1,
+  [__NR_splice] = 1,
+  [__NR_read] = 1,
+  [__NR_write] = 1,
+  [__NR_readv] = 1,
+  [__NR_writev] = 1,
+  [__NR_close] = 1,
+  [__NR_fcntl] = 1,
+  [__NR_ioctl] = 1,
+  [__NR_dup] = 1,
+  [__NR_dup2] = 1,
+  [__NR_dup3] = 1,
+  [__NR_socketpair] = 1,
+  [__NR_pipe] = 1,
+  [__NR_pipe2] = 1,
+  [__NR_epoll_create] = 1,
+  [__NR_epoll_create1] = 1,
+  [__NR_epoll_ctl] = 1,
+  [__NR_epoll_wait] = 1,
+  [__NR_epoll_pwait] = 1,
+#if CI_LIBC_HAS_epoll_pwait2
+  [__NR_epoll_pwait2] = 1,
+#endif
+};
+
+
+/* Make a system call without going through libc, and without touching
+ * errno. */
+ci_inline long citp_sud_raw(long nr, long a, long b, long c,
+                            long d, long e, long f)
+{
+  register long r10 __asm__("r10") = d;
+  register long r8 __asm__("r8") = e;
+  register long r9 __asm__("r9") = f;
+  long rc;
+  __asm__ __volatile__("syscall"
+                       : "=a" (rc)
+                       : "0" (nr), "D" (a), "S" (b), "d" (c),
+                         "r" (r10), "r" (r8), "r" (r9)
+                       : "rcx", "r11", "memory");
+  return rc;
+}
+
+
+static void citp_sud_arm(char* selector)
+{
+  prctl(PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON,
+        citp_sud.libc_start, citp_sud.libc_len, selector);
+}
+
+
+static struct citp_sud_clone_thread* citp_sud_clone_thread_find(pid_t tid)
+{
+  int i;
+
+  for( i = 0; i < CITP_SUD_CLONE_THREADS_MAX; ++i )
+    if( citp_sud_clone_threads[i].tid == tid )
+      return &citp_sud_clone_threads[i];
+  return NULL;
+}
+
+
+/* The selector that the kernel was given for the calling thread. */
+static char* citp_sud_selector(void)
+{
+  struct citp_sud_clone_thread* t;
+
+  /* libc's syscall() does not trap, however the selector is set. */
+  if( citp_sud_clone_threads_n != 0 &&
+      (t = citp_sud_clone_thread_find(ci_sys_syscall(__NR_gettid))) )
+    return &t->selector;
+  return &__oo_per_thread_get()->sud_selector;
+}
+
+
+static struct citp_sud_clone_thread* citp_sud_clone_thread_alloc(void)
+{
+  struct citp_sud_clone_thread* t;
+  ci_int32 tid;
+  int i;
+
+  for( i = 0; i < CITP_SUD_CLONE_THREADS_MAX; ++i ) {
+    t = &citp_sud_clone_threads[i];
+    tid = t->tid;
+    if( tid == 0 && ci_cas32_succeed(&t->tid, 0, -1) ) {
+      ci_atomic32_inc(&citp_sud_clone_threads_n);
+      break;
+    }
+  }
+  if( i == CITP_SUD_CLONE_THREADS_MAX ) {
+    /* tkill() rather than tgkill(): the thread need not share our
+     * thread group. */
+    for( i = 0; i < CITP_SUD_CLONE_THREADS_MAX; ++i ) {
+      t = &citp_sud_clone_threads[i];
+      tid = t->tid;
+      if( tid > 0 &&
+          citp_sud_raw(__NR_tkill, tid, 0, 0, 0, 0, 0) == -ESRCH &&
+          ci_cas32_succeed(&t->tid, tid, -1) )
+        break;
+    }
+    if( i == CITP_SUD_CLONE_THREADS_MAX )
+      return NULL;
+  }
+  t->selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+  return t;
+}
+
+
+static void citp_sud_clone_thread_free(struct citp_sud_clone_thread* t)
+{
+  t->tid = 0;
+  ci_atomic32_dec(&citp_sud_clone_threads_n);
+}
+
+
+static long citp_sud_clone_call(ucontext_t* uc, char* selector)
+{
+  greg_t* regs = uc->uc_mcontext.gregs;
+  unsigned long flags = regs[REG_RDI];
+  unsigned long stack = regs[REG_RSI];
+  struct citp_sud_clone_frame* frame;
+  struct citp_sud_clone_thread* t;
+  long rc;
+
+  if( stack == 0 ) {
+    /* The child would run on this stack, and so would tear up the signal
+     * frame that we are about to return through.  Give it a copy.  This
+     * makes a vfork() into a fork(), which callers must tolerate.
+     *
+     * The child's selector is its copy of ours, unless it would not find
+     * that by the same means: it has a new TLS, or ours is in a slot. */
+    flags &= ~(CLONE_VM | CLONE_VFORK);
+    t = NULL;
+    if( ((flags & CLONE_SETTLS) ||
+         selector != &__oo_per_thread_get()->sud_selector) &&
+        (t = citp_sud_clone_thread_alloc()) == NULL )
+      return -EAGAIN;
+    rc = citp_sud_raw(__NR_clone, flags, 0, regs[REG_RDX], regs[REG_R10],
+                      regs[REG_R8], 0);
+    if( rc == 0 && t != NULL ) {
+      t->tid = ci_sys_syscall(__NR_gettid);
+      citp_sud_arm(&t->selector);
+    }
+    else if( rc == 0 ) {
+      citp_sud_arm(selector);
+    }
+    else if( t != NULL ) {
+      /* The child, if any, has a copy of its own. */
+      citp_sud_clone_thread_free(t);
+    }
+    return rc;
+  }
+
+  /* The new thread starts in citp_sud_clone(), which arms it and puts it
+   * where the application expects it. */
+  t = citp_sud_clone_thread_alloc();
+  if( t == NULL )
+    return -EAGAIN;
+  frame = (void*) ((stack - sizeof(*frame)) & ~15ul);
+  frame->rip = regs[REG_RIP];
+  frame->rsp = stack;
+  frame->rbx = regs[REG_RBX];
+  frame->rbp = regs[REG_RBP];
+  frame->r12 = regs[REG_R12];
+  frame->r13 = regs[REG_R13];
+  frame->r14 = regs[REG_R14];
+  frame->r15 = regs[REG_R15];
+  frame->rdi = regs[REG_RDI];
+  frame->rsi = regs[REG_RSI];
+  frame->rdx = regs[REG_RDX];
+  frame->r8 = regs[REG_R8];
+  frame->r9 = regs[REG_R9];
+  frame->r10 = regs[REG_R10];
+  frame->thread = t;
+  frame->libc_start = citp_sud.libc_start;
+  frame->libc_len = citp_sud.libc_len;
+  memcpy(&frame->sigmask, &uc->uc_sigmask, sizeof(frame->sigmask));
+  rc = citp_sud_clone(flags, frame, (int*) regs[REG_RDX],
+                      (int*) regs[REG_R10], regs[REG_R8]);
+  /* Without CLONE_VM the child armed itself with its own copy. */
+  if( rc < 0 || ! (flags & CLONE_VM) )
+    citp_sud_clone_thread_free(t);
+  return rc;
+}
+
+
+static long citp_sud_execve(long nr, long a, long b, long c, long d, long e,
+                            char* selector)
+{
+  long rc;
+
+  /* Don't leave the new image with a selector at a stale address. */
+  prctl(PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_OFF, 0, 0, 0);
+  if( nr == __NR_execve ) {
+    /* Via Onload, so that the new image is accelerated too. */
+    rc = onload_execve((const char*) a, (char* const*) b, (char* const*) c);
+    if( rc < 0 )
+      rc = -errno;
+  }
+  else {
+    rc = citp_sud_raw(nr, a, b, c, d, e, 0);
+  }
+  citp_sud_arm(selector);
+  return rc;
+}
+
+
+static long citp_sud_rt_sigaction(int sig,
+                                  const struct citp_sud_ksigaction* act,
+                                  struct citp_sud_ksigaction* oldact,
+                                  unsigned long sigsetsize)
+{
+  struct citp_sud_ksigaction kact;
+  struct sigaction* app = &citp_sud.app_sigsys;
+
+  if( sig != SIGSYS ) {
+    /* A handler that blocks SIGSYS cannot make raw system calls: the
+     * kernel would reset SIGSYS to its default action and kill us. */
+    if( act != NULL && (act->mask & CITP_SUD_SIGSYS_MASK) ) {
+      kact = *act;
+      kact.mask &= ~CITP_SUD_SIGSYS_MASK;
+      act = &kact;
+    }
+    return citp_sud_raw(__NR_rt_sigaction, sig, (long) act, (long) oldact,
+                        sigsetsize, 0, 0);
+  }
+
+  if( sigsetsize != sizeof(kact.mask) )
+    return -EINVAL;
+  if( act != NULL )
+    kact = *act;
+  if( oldact != NULL ) {
+    oldact->handler = app->sa_handler;
+    oldact->flags = app->sa_flags;
+    oldact->restorer = app->sa_restorer;
+    memcpy(&oldact->mask, &app->sa_mask, sizeof(oldact->mask));
+  }
+  if( act != NULL ) {
+    app->sa_handler = kact.handler;
+    app->sa_flags = kact.flags;
+    app->sa_restorer = kact.restorer;
+    sigemptyset(&app->sa_mask);
+    memcpy(&app->sa_mask, &kact.mask, sizeof(kact.mask));
+  }
+  return 0;
+}
+
+
+static long citp_sud_rt_sigprocmask(long how, const unsigned long* set,
+                                    long oldset, long sigsetsize)
+{
+  unsigned long mask;
+
+  /* SIGSYS must stay deliverable, as for citp_sud_rt_sigaction(). */
+  if( set != NULL && how != SIG_UNBLOCK &&
+      (*set & CITP_SUD_SIGSYS_MASK) ) {
+    mask = *set & ~CITP_SUD_SIGSYS_MASK;
+    set = &mask;
+  }
+  return citp_sud_raw(__NR_rt_sigprocmask, how, (long) set, oldset,
+                      sigsetsize, 0, 0);
+}
+
+
+static long citp_sud_dispatch(const siginfo_t* info, ucontext_t* uc,
+                              char* selector)
+{
+  greg_t* regs = uc->uc_mcontext.gregs;
+  long nr = info->si_syscall;
+  long a = regs[REG_RDI];
+  long b = regs[REG_RSI];
+  long c = regs[REG_RDX];
+  long d = regs[REG_R10];
+  long e = regs[REG_R8];
+  long f = regs[REG_R9];
+  long rc;
+
+  if( (unsigned long) info->si_call_addr - citp_sud.self_start <
+      citp_sud.self_len )
+    return citp_sud_raw(nr, a, b, c, d, e, f);
+
+  if( (unsigned long) nr < sizeof(citp_sud_route) && citp_sud_route[nr] ) {
+    rc = onload_syscall(nr, a, b, c, d, e, f);
+    return rc == -1 ? -errno : rc;
+  }
+
+  switch( nr ) {
+  case __NR_clone:
+    return citp_sud_clone_call(uc, selector);
+  case __NR_clone3:
+    /* Callers fall back to clone(), which we can handle. */
+    return -ENOSYS;
+  case __NR_fork:
+  case __NR_vfork:
+    /* As for clone() without a stack, vfork() becomes fork().  The fork
+     * hooks re-arm the child. */
+    rc = fork();
+    return rc < 0 ? -errno : rc;
+  case __NR_execve:
+  case __NR_execveat:
+    return citp_sud_execve(nr, a, b, c, d, e, selector);
+  case __NR_exit_group:
+    /* Via Onload, so that we tidy up as for _exit(). */
+    onload__exit(a);
+    return 0;  /* not reached */
+  case __NR_rt_sigaction:
+    return citp_sud_rt_sigaction(a, (void*) b, (void*) c, d);
+  case __NR_rt_sigprocmask:
+    return citp_sud_rt_sigprocmask(a, (void*) b, c, d);
+  default:
+    return citp_sud_raw(nr, a, b, c, d, e, f);
+  }
+}
+
+
+/* An application's signal handler may return through a restorer of its
+ * own rather than libc's, as the Go runtime's do, and then its
+ * rt_sigreturn traps.  Made from here, it would unwind the SIGSYS frame
+ * rather than the application's.  So we copy the application's frame over
+ * ours, and returning from the SIGSYS handler resumes where the
+ * application's signal interrupted it. */
+static void citp_sud_rt_sigreturn(ucontext_t* uc)
+{
+  /* Where the kernel would look for it: the handler's return has popped
+   * the return address, leaving the stack pointer at the ucontext. */
+  const ucontext_t* app = (const ucontext_t*) uc->uc_mcontext.gregs[REG_RSP];
+
+  uc->uc_flags = app->uc_flags;
+  uc->uc_stack = app->uc_stack;
+  memcpy(uc->uc_mcontext.gregs, app->uc_mcontext.gregs,
+         sizeof(uc->uc_mcontext.gregs));
+  /* The FP state stays in the application's frame, which is intact. */
+  uc->uc_mcontext.fpregs = app->uc_mcontext.fpregs;
+  /* The kernel's sigset is one word; libc's sigset_t is larger, and the
+   * rest of it is not part of the kernel's frame. */
+  memcpy(&uc->uc_sigmask, &app->uc_sigmask, sizeof(unsigned long));
+}
+
+
+/* Pass on a SIGSYS that was not raised by Syscall User Dispatch, e.g. by
+ * seccomp. */
+static void citp_sud_chain(int sig, siginfo_t* info, void* context)
+{
+  struct sigaction* app = &citp_sud.app_sigsys;
+  struct sigaction dfl;
+  sigset_t set;
+
+  if( app->sa_flags & SA_SIGINFO ) {
+    app->sa_sigaction(sig, info, context);
+  }
+  else if( app->sa_handler == SIG_DFL ) {
+    memset(&dfl, 0, sizeof(dfl));
+    dfl.sa_handler = SIG_DFL;
+    ci_sys_sigaction(SIGSYS, &dfl, NULL);
+    sigemptyset(&set);
+    sigaddset(&set, SIGSYS);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+    raise(SIGSYS);
+  }
+  else if( app->sa_handler != SIG_IGN ) {
+    app->sa_handler(sig);
+  }
+}
+
+
+static void citp_sud_sigsys(int sig, siginfo_t* info, void* context)
+{
+  greg_t* regs = ((ucontext_t*) context)->uc_mcontext.gregs;
+  char* selector;
+  int saved_errno;
+
+  if( info->si_code != SYS_USER_DISPATCH ) {
+    citp_sud_chain(sig, info, context);
+    return;
+  }
+  if( info->si_syscall == __NR_rt_sigreturn ) {
+    /* Leaves the selector closed, as it was when the application's signal
+     * arrived. */
+    citp_sud_rt_sigreturn(context);
+    return;
+  }
+
+  selector = citp_sud_selector();
+  *selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+  ci_compiler_barrier();
+  saved_errno = errno;
+  regs[REG_RAX] = citp_sud_dispatch(info, context, selector);
+  errno = saved_errno;
+  ci_compiler_barrier();
+  *selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+}
+
+
+void citp_syscall_dispatch_arm_thread(void)
+{
+  citp_sud_arm(&__oo_per_thread_get()->sud_selector);
+}
+
+
+void citp_syscall_dispatch_fork_child(void)
+{
+  /* The threads that had slots were all in the parent. */
+  memset(citp_sud_clone_threads, 0, sizeof(citp_sud_clone_threads));
+  citp_sud_clone_threads_n = 0;
+  citp_syscall_dispatch_arm_thread();
+}
+
+
+static void citp_sud_arm_new_thread(void)
+{
+  struct citp_sud_clone_thread* t;
+
+  /* A raw clone() child that has gone may have had our thread id. */
+  if( citp_sud_clone_threads_n != 0 &&
+      (t = citp_sud_clone_thread_find(ci_sys_syscall(__NR_gettid))) )
+    citp_sud_clone_thread_free(t);
+  __oo_per_thread_get()->sud_selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+  citp_syscall_dispatch_arm_thread();
+}
+
+
+struct citp_sud_thread {
+  void* (*start_routine)(void*);
+  void* arg;
+};
+
+static void* citp_sud_thread_start(void* p)
+{
+  struct citp_sud_thread t = *(struct citp_sud_thread*) p;
+  free(p);
+  citp_sud_arm_new_thread();
+  return t.start_routine(t.arg);
+}
+
+int citp_syscall_dispatch_pthread_create(pthread_t* thread,
+                                         const pthread_attr_t* attr,
+                                         void* (*start_routine)(void*),
+                                         void* arg)
+{
+  struct citp_sud_thread* t = malloc(sizeof(*t));
+  int rc;
+
+  if( t == NULL )
+    return EAGAIN;
+  t->start_routine = start_routine;
+  t->arg = arg;
+  rc = ci_sys_pthread_create(thread, attr, citp_sud_thread_start, t);
+  if( rc != 0 )
+    free(t);
+  return rc;
+}
+
+
+int citp_syscall_dispatch_sigaction(const struct sigaction* act,
+                                    struct sigaction* oldact)
+{
+  struct sigaction new_act;
+
+  if( act != NULL )
+    new_act = *act;
+  if( oldact != NULL )
+    *oldact = citp_sud.app_sigsys;
+  if( act != NULL )
+    citp_sud.app_sigsys = new_act;
+  return 0;
+}
+
+
+struct citp_sud_text {
+  unsigned long addr;
+  unsigned long start;
+  unsigned long len;
+};
+
+static int citp_sud_find_text(struct dl_phdr_info* info, size_t size,
+                              void* arg)
+{
+  struct citp_sud_text* text = arg;
+  int i;
+
+  for( i = 0; i < info->dlpi_phnum; ++i ) {
+    const ElfW(Phdr)* ph = &info->dlpi_phdr[i];
+    unsigned long start = info->dlpi_addr + ph->p_vaddr;
+    if( ph->p_type == PT_LOAD && (ph->p_flags & PF_X) &&
+        text->addr - start < ph->p_memsz ) {
+      text->start = start;
+      text->len = ph->p_memsz;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+int citp_syscall_dispatch_init(void)
+{
+  struct citp_sud_text libc_text = {}, self_text = {};
+  struct sigaction act;
+
+  /* See syscall_dispatch_clone.S */
+  CI_BUILD_ASSERT(offsetof(struct citp_sud_clone_frame, thread) == 112);
+  CI_BUILD_ASSERT(offsetof(struct citp_sud_clone_thread, selector) == 4);
+
+  if( ! CITP_OPTS.syscall_dispatch )
+    return 0;
+
+  /* libc is whatever is next to provide prctl(), which we don't define. */
+  libc_text.addr = (unsigned long) dlsym(RTLD_NEXT, "prctl");
+  self_text.addr = (unsigned long) citp_syscall_dispatch_init;
+  if( libc_text.addr == 0 ||
+      ! dl_iterate_phdr(citp_sud_find_text, &libc_text) ||
+      ! dl_iterate_phdr(citp_sud_find_text, &self_text) ) {
+    Log_E(log("%s: cannot find libc text; EF_SYSCALL_DISPATCH ignored",
+              __func__));
+    return 0;
+  }
+  citp_sud.libc_start = libc_text.start;
+  citp_sud.libc_len = libc_text.len;
+  citp_sud.self_start = self_text.start;
+  citp_sud.self_len = self_text.len;
+
+  memset(&act, 0, sizeof(act));
+  act.sa_sigaction = citp_sud_sigsys;
+  act.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  if( ci_sys_sigaction(SIGSYS, &act, &citp_sud.app_sigsys) < 0 )
+    return 0;
+
+  __oo_per_thread_get()->sud_selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+  if( prctl(PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON,
+            citp_sud.libc_start, citp_sud.libc_len,
+            &__oo_per_thread_get()->sud_selector) < 0 ) {
+    Log_E(log("%s: PR_SET_SYSCALL_USER_DISPATCH failed (errno=%d); "
+              "EF_SYSCALL_DISPATCH ignored", __func__, errno));
+    ci_sys_sigaction(SIGSYS, &citp_sud.app_sigsys, NULL);
+    return 0;
+  }
+  citp_syscall_dispatch_enabled = 1;
+  return 0;
+}
+
+#else
+
+int citp_syscall_dispatch_init(void)
+{
+  return 0;
+}
+
+#endif /* CI_CFG_SYSCALL_USER_DISPATCH */
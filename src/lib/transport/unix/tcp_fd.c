@@ -2221,6 +2221,7 @@ citp_tcp_ds_prepare(citp_fdinfo* fdi, int size, unsigned flags,
    * flushed, and also to prevent various sequence numbers changing under our
    * feet. */
   ci_netif_lock(ni);
+  ci_tcp_send_nolock_block(ni, ts);
   if( ci_tcp_sendq_not_empty(ts) ) {
     rc = ONLOAD_DELEGATED_SEND_RC_SENDQ_BUSY;
     goto unlock_out;
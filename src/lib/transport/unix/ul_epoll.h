@@ -108,12 +108,15 @@ struct citp_epoll_member {
 #if CI_CFG_EPOLL3
   ci_dllink             dead_stack_link; /*!< Link for dead stack list */
   int                   ready_list_id;
+  int                   other_stack; /*!< Index in [other_stacks] or -1 */
+  oo_sp                 sock_id;     /*!< Socket, if [other_stack] >= 0 */
 #endif
   struct epoll_event    epoll_data;
   struct epoll_event    epfd_event; /*!< event synchronised to kernel */
   ci_uint64             fdi_seq;    /*!< fdi->seq */
   int                   fd;         /*!< Onload fd */
   ci_sleep_seq_t        reported_sleep_seq;
+  ci_uint64             excl_seq;   /*!< sleep_seq claimed (EPOLLEXCLUSIVE) */
 
   int                   flags;
 /*!< indicates after which eitem on ready list socket we should look
@@ -125,6 +128,16 @@ struct citp_epoll_member {
 };
 
 
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+/* Events that may be used together with EPOLLEXCLUSIVE, as for the kernel */
+#define CITP_EPOLL_EXCL_ALLOWED_EVENTS                                   \
+  (EPOLLIN | EPOLLOUT | EPOLLRDNORM | EPOLLWRNORM | EPOLLRDBAND |        \
+   EPOLLWRBAND | EPOLLERR | EPOLLHUP | EPOLLWAKEUP | EPOLLET | EPOLLEXCLUSIVE)
+
+
 enum {
   EPOLL_PHASE_DONE_ACCELERATED = 1,
   EPOLL_PHASE_DONE_OTHER = 2,
@@ -132,6 +145,27 @@ enum {
 
 #define EPOLL_STACK_EITEM 1
 #define EPOLL_NON_STACK_EITEM 2
+
+#if CI_CFG_EPOLL3
+/* Maximum number of non-home stacks for which an epoll set will claim a
+ * ready list of its own.  The epoll driver tracks the same number. */
+#define CITP_EPOLL_OTHER_STACKS_MAX OO_EPOLL1_OTHER_STACKS_MAX
+
+/*! A non-home stack in which this epoll set owns a ready list.  The
+ * members from this stack are polled at user level by draining the ready
+ * list in the same way as for the home stack, but unlike home members they
+ * are also registered with the kernel epoll set, which is used to block.
+ */
+struct citp_epoll_other_stack {
+  ci_netif*             ni;         /*!< NULL if this slot is free */
+  int                   ready_list;
+  int                   sockets_n;
+  /* Members which may be ready and members known not to be */
+  ci_dllist             sockets;
+  ci_dllist             not_ready_sockets;
+};
+#endif
+
 /*! Data associated with each epoll epfd.  */
 struct citp_epoll_fd {
   /* epoll_create() parameter */
@@ -162,10 +196,25 @@ struct citp_epoll_fd {
   ci_dllist epi_list;
 #endif
 
-  /* List of onload sockets in non-home stack (struct citp_epoll_member) */
+  /* List of onload sockets in non-home stack (struct citp_epoll_member)
+   * which are not in any of [other_stacks].  [oo_sockets_n] counts all the
+   * non-home members, including those in [other_stacks].
+   */
   ci_dllist             oo_sockets;
   int                   oo_sockets_n;
 
+#if CI_CFG_EPOLL3
+  struct citp_epoll_other_stack other_stacks[CITP_EPOLL_OTHER_STACKS_MAX];
+  int                   other_stacks_n;
+#endif
+
+  /* Non-home members indexed by fd, so that epoll_ctl() and the hooks can
+   * find them without walking the lists.  A slot may hold a stale member
+   * whose fd has been reused; fdi_seq tells them apart.
+   */
+  struct citp_epoll_member** fd_map;
+  int                   fd_map_size;
+
   /* List of deleted sockets (struct citp_epoll_member) */
   ci_dllist             dead_sockets;
   ci_dllist             dead_stack_sockets;
@@ -19,8 +19,10 @@
 
 #define OO_POLL_MAX_OSP    16
 
+#define KEEP_POLLING_FOR(what, now, start, spin_cycles)                 \
+  (what && (((now) = ci_frc64_get()) - (start) < (spin_cycles)))
 #define KEEP_POLLING(what, now, start)                                  \
-  (what && (((now) = ci_frc64_get()) - (start) < citp.spin_cycles))
+  KEEP_POLLING_FOR(what, now, start, citp.spin_cycles)
 
 
 struct oo_ul_poll_state {
@@ -103,6 +103,12 @@ cp_unit_nl_handle_route_msg(struct cp_session*, in_addr_t dest,
 			    in_addr_t gateway, int ifindex, int iif_ifindex,
 			    uint32_t nlmsg_pid, uint32_t nlmsg_seq);
 
+extern struct nlmsghdr*
+cp_unit_nl_build_neigh_msg(char* buf, int ifindex, int type,
+                           int state, in_addr_t dest, const uint8_t* macaddr,
+                           int reachable_ms, uint32_t nlmsg_pid,
+                           uint32_t nlmsg_seq);
+
 extern void
 cp_unit_nl_handle_neigh_msg(struct cp_session* s, int ifindex, int type,
                             int state, in_addr_t dest, const uint8_t* macaddr,
@@ -205,17 +205,16 @@ cp_unit_nl_handle_route_msg(struct cp_session* s, in_addr_t dest,
 }
 
 
-/* This function fabricates a netlink message simulating the message
- * that the kernel generates in response to the addition or removal of
- * a neighbour, and passes it to the control plane. */
-void
-cp_unit_nl_handle_neigh_msg(struct cp_session* s, int ifindex, int type,
-                            int state, in_addr_t dest, const uint8_t* macaddr,
-                            int reachable_ms, uint32_t nlmsg_pid,
-                            uint32_t nlmsg_seq)
+/* This function fabricates in the buffer a netlink message simulating the
+ * message that the kernel generates in response to the addition or removal
+ * of a neighbour. */
+struct nlmsghdr*
+cp_unit_nl_build_neigh_msg(char* buf, int ifindex, int type,
+                           int state, in_addr_t dest, const uint8_t* macaddr,
+                           int reachable_ms, uint32_t nlmsg_pid,
+                           uint32_t nlmsg_seq)
 {
   struct nlmsghdr* nlh;
-  char buf[MNL_SOCKET_BUFFER_SIZE];
   struct ndmsg* ndm;
 
   CP_TEST(ifindex != 0);
@@ -250,6 +249,24 @@ cp_unit_nl_handle_neigh_msg(struct cp_session* s, int ifindex, int type,
     mnl_attr_put(nlh, NDA_CACHEINFO, sizeof(struct nda_cacheinfo), &cacheinfo);
   }
 
+  return nlh;
+}
+
+
+/* This function fabricates a neighbour message as above, and passes it to
+ * the control plane. */
+void
+cp_unit_nl_handle_neigh_msg(struct cp_session* s, int ifindex, int type,
+                            int state, in_addr_t dest, const uint8_t* macaddr,
+                            int reachable_ms, uint32_t nlmsg_pid,
+                            uint32_t nlmsg_seq)
+{
+  char buf[MNL_SOCKET_BUFFER_SIZE];
+  struct nlmsghdr* nlh = cp_unit_nl_build_neigh_msg(buf, ifindex, type, state,
+                                                    dest, macaddr,
+                                                    reachable_ms, nlmsg_pid,
+                                                    nlmsg_seq);
+
   /* Pass the message to the control plane. */
   cp_nl_net_handle_msg(s, nlh, nlh->nlmsg_len);
 }
@@ -31,6 +31,7 @@ void cp_unit_init_session(struct cp_session* s)
     .fwd_ln2 = 8,
     .svc_arrays_max = 64,
     .svc_ep_max = 1024,
+    .svc_maglev_max = 8,
   };
   s->bond_max = 64;
   s->mac_max_ln2 = 10;
@@ -51,6 +51,56 @@ static int cp_mac_rows_used(struct cp_session* s)
   return occupied;
 }
 
+/* Exercise --neigh-refresh: the neighbour of an actively-used route is
+ * re-resolved when it goes stale or disappears. */
+static void test_neigh_refresh(struct cp_session* s, int ifindex)
+{
+  const uint8_t macaddr[] = {0x00, 0x0f, 0x53, 0x00, 0x00, 0x01};
+  in_addr_t dest = A("1.2.1.1");
+  cicp_mac_rowid_t macid;
+
+  cp_unit_insert_route(s, A("1.2.0.0"), 16, A("1.2.3.4"), ifindex);
+  cp_unit_insert_resolution(s, dest, 0, A("1.2.3.4"), 0, ifindex);
+  cp_unit_insert_neighbour(s, ifindex, dest, macaddr);
+  macid = cp_mac_find_row(s, AF_INET, CI_ADDR_FROM_IP4(dest), ifindex);
+  CP_TEST(CICP_MAC_ROWID_IS_VALID(macid));
+
+  /* The mode is off by default. */
+  cp_unit_nl_handle_neigh_msg(s, ifindex, RTM_NEWNEIGH, NUD_STALE, dest,
+                              macaddr, 0, CP_UNIT_NL_PID, 0);
+  cp_fwd_timer(s);
+  cmp_ok(s->stats.neigh_refresh.stale, "==", 0,
+         "No refresh without --neigh-refresh");
+
+  s->flags |= CP_SESSION_NEIGH_REFRESH;
+  cp_fwd_timer(s);
+  cmp_ok(s->stats.neigh_refresh.stale, "==", 1, "Stale neighbour refreshed");
+  ok(s->mac[macid].flags & CP_MAC_ROW_FLAG_REFRESHING,
+     "Neighbour is marked as being refreshed");
+  cp_fwd_timer(s);
+  cmp_ok(s->stats.neigh_refresh.stale, "==", 1,
+         "Refresh is requested once only");
+
+  /* The kernel goes through DELAY and PROBE to REACHABLE. */
+  cp_unit_nl_handle_neigh_msg(s, ifindex, RTM_NEWNEIGH, NUD_PROBE, dest,
+                              macaddr, 0, CP_UNIT_NL_PID, 0);
+  ok(s->mac[macid].flags & CP_MAC_ROW_FLAG_REFRESHING,
+     "Still refreshing while probing");
+  cp_unit_insert_neighbour(s, ifindex, dest, macaddr);
+  cmp_ok(s->stats.neigh_refresh.confirmed, "==", 1,
+         "Refreshed neighbour confirmed");
+  ok(! (s->mac[macid].flags & CP_MAC_ROW_FLAG_REFRESHING),
+     "Refresh is complete");
+
+  /* A route in use with the neighbour gone is resolved again. */
+  cp_unit_remove_neighbour(s, ifindex, dest, macaddr);
+  cp_fwd_timer(s);
+  cmp_ok(s->stats.neigh_refresh.missing, "==", 1,
+         "Missing neighbour resolved");
+
+  s->flags &=~ CP_SESSION_NEIGH_REFRESH;
+}
+
 int main(void)
 {
   cp_unit_init();
@@ -121,6 +171,8 @@ int main(void)
   cmp_ok(cp_mac_find_row(&s, AF_INET, CI_ADDR_FROM_IP4(mcast_ip), 1), "==",
          CICP_MAC_ROWID_BAD, "Multicast entry was not inserted");
 
+  test_neigh_refresh(&s, ETHO0_IFINDEX);
+
   done_testing();
 
   return 0;
@@ -331,6 +331,77 @@ void test_resolutions(void)
 }
 
 
+/* Count the fwd entries whose destination lies in the given /8. */
+static int count_fwd_rows_in(struct cp_session* s, in_addr_t net)
+{
+  struct cp_fwd_table* fwd_table = &cp_fwd_state_get(s, 0)->fwd_table;
+  cicp_mac_rowid_t id;
+  int count = 0;
+
+  for( id = 0; id <= fwd_table->mask; ++id ) {
+    struct cp_fwd_row* fwd = cp_get_fwd_by_id(fwd_table, id);
+    if( fwd->flags & CICP_FWD_FLAG_OCCUPIED &&
+        (fwd->key.dst.ip4 & htonl(0xff000000)) == net )
+      ++count;
+  }
+  return count;
+}
+
+
+void test_partial_refresh(void)
+{
+  struct cp_session s;
+  init_session(&s, NULL);
+  insert_test_routes(&s);
+  insert_test_resolutions(&s);
+
+  /* Settle whatever the initial route inserts have asked for. */
+  cp_fwd_cache_refresh(&s);
+  cmp_ok(s.flags & (CP_SESSION_FLAG_FWD_REFRESH_NEEDED |
+                    CP_SESSION_FLAG_FWD_REFRESH_PARTIAL), "==", 0,
+         "no fwd refresh pending");
+
+  int all_rows = count_fwd_rows_in(&s, A("1.0.0.0")) +
+                 count_fwd_rows_in(&s, A("2.0.0.0")) +
+                 count_fwd_rows_in(&s, A("16.0.0.0"));
+  cmp_ok(all_rows, "==", N_EXPECTED_ROWS, "saw all fwd entries");
+
+  /* A route which does not overlap any fwd entry re-resolves nothing. */
+  int resolved = s.stats.fwd.refresh_resolved;
+  int partial = s.stats.fwd.refresh_partial;
+  cp_unit_insert_gateway(&s, A("9.9.9.8"), A("200.0.0.0"), 8, ETHO1_IFINDEX);
+  ok(s.flags & CP_SESSION_FLAG_FWD_REFRESH_PARTIAL, "partial refresh queued");
+  ok(~s.flags & CP_SESSION_FLAG_FWD_REFRESH_NEEDED, "no full refresh queued");
+  cp_fwd_cache_refresh(&s);
+  cmp_ok(s.stats.fwd.refresh_partial, "==", partial + 1,
+         "partial refresh done");
+  cmp_ok(s.stats.fwd.refresh_resolved, "==", resolved,
+         "unrelated route re-resolves no fwd entries");
+
+  /* A more specific route for 2.0.0.0/8 re-resolves the entries in that
+   * subnet only. */
+  int rows_2 = count_fwd_rows_in(&s, A("2.0.0.0"));
+  CP_TEST(rows_2 > 0);
+  resolved = s.stats.fwd.refresh_resolved;
+  cp_unit_insert_gateway(&s, A("9.9.9.9"), A("2.0.0.0"), 24, ETHO1_IFINDEX);
+  cp_fwd_cache_refresh(&s);
+  cmp_ok(s.stats.fwd.refresh_resolved - resolved, "==", rows_2,
+         "overlapping route re-resolves covered fwd entries only");
+  cmp_ok(count_fwd_rows_in(&s, A("1.0.0.0")) +
+         count_fwd_rows_in(&s, A("16.0.0.0")), "==", all_rows - rows_2,
+         "unrelated fwd entries are kept");
+
+  /* The end of a dump refreshes everything. */
+  all_rows = count_fwd_rows_in(&s, A("1.0.0.0")) +
+             count_fwd_rows_in(&s, A("2.0.0.0")) +
+             count_fwd_rows_in(&s, A("16.0.0.0"));
+  resolved = s.stats.fwd.refresh_resolved;
+  cp_nl_dump_all_done(&s);
+  cmp_ok(s.stats.fwd.refresh_resolved - resolved, "==", all_rows,
+         "dump re-resolves all fwd entries");
+}
+
+
 void test_route_resolve(void)
 {
   struct cp_session s;
@@ -575,6 +646,7 @@ int main(void)
   cp_unit_init();
   test_inserts();
   test_resolutions();
+  test_partial_refresh();
   test_route_resolve();
 
 #ifdef CAN_TEST_ONLOAD_CPLANE_CALLS
@@ -14,6 +14,7 @@
 
 static const int ITERATIONS = 1000000;
 static const int TABLE_VALIDITY_CHECKS = 1000;
+static const int STORM_BATCHES = 10000;
 static const int IFINDEX = 1;
 static const int IFHWPORTS = 0x01;
 
@@ -244,6 +245,103 @@ static bool check_fwd_table_validity(struct cp_session* s)
 }
 
 
+/* Simulate a neighbour storm, such as the one caused by a flapping ECMP
+ * next hop: the kernel sends lots of updates for a few neighbours, and the
+ * control plane reads them in batches and skips the superseded ones.  The
+ * same messages are fed one by one to a reference session, and the MAC
+ * tables of the two sessions must stay the same. */
+#define STORM_NEIGHS 4
+#define STORM_MSG_SIZE 256
+/* Neighbour updates for the loopback interface are ignored, so we can't use
+ * IFINDEX here. */
+#define STORM_IFINDEX 2
+
+static bool mac_rows_match(struct cp_session* s, struct cp_session* s_ref,
+                           in_addr_t dest)
+{
+  ci_addr_t addr = CI_ADDR_FROM_IP4(dest);
+  cicp_mac_rowid_t id = cp_mac_find_row(s, AF_INET, addr, STORM_IFINDEX);
+  cicp_mac_rowid_t id_ref = cp_mac_find_row(s_ref, AF_INET, addr,
+                                            STORM_IFINDEX);
+
+  if( id == CICP_MAC_ROWID_BAD || id_ref == CICP_MAC_ROWID_BAD )
+    return id == id_ref;
+
+  cicp_mac_row_t* mr = &s->mac[id];
+  cicp_mac_row_t* mr_ref = &s_ref->mac[id_ref];
+  return mr->state == mr_ref->state && mr->flags == mr_ref->flags &&
+         (! (mr->state & NUD_VALID) ||
+          memcmp(mr->mac, mr_ref->mac, sizeof(mr->mac)) == 0);
+}
+
+static bool neigh_storm(void)
+{
+  static const int states[] = {
+    NUD_REACHABLE, NUD_STALE, NUD_DELAY, NUD_PROBE, NUD_INCOMPLETE, NUD_FAILED,
+  };
+  static char bufs[CP_NL_BATCH_MAX][STORM_MSG_SIZE];
+  struct iovec iov[CP_NL_BATCH_MAX];
+  struct mmsghdr msgs[CP_NL_BATCH_MAX];
+  struct cp_session s, s_ref;
+  const char mac[] = {0x00, 0x0f, 0x53, 0x00, 0x00, 0x00};
+  bool storm_ok = true;
+  int b, i, k;
+
+  cp_unit_init_session(&s);
+  cp_unit_init_session(&s_ref);
+  cp_unit_nl_handle_link_msg(&s, RTM_NEWLINK, STORM_IFINDEX, IFHWPORTS,
+                             "ethO0", mac);
+  cp_unit_nl_handle_link_msg(&s_ref, RTM_NEWLINK, STORM_IFINDEX, IFHWPORTS,
+                             "ethO0", mac);
+
+  for( b = 0; b < STORM_BATCHES && storm_ok; b++ ) {
+    int n = 1 + rand() % CP_NL_BATCH_MAX;
+
+    memset(msgs, 0, sizeof(msgs));
+    for( i = 0; i < n; i++ ) {
+      in_addr_t dest = htonl(0x0a000001 + rand() % STORM_NEIGHS);
+      int type = (rand() & 7) ? RTM_NEWNEIGH : RTM_DELNEIGH;
+      int state = states[rand() % (sizeof(states) / sizeof(states[0]))];
+      uint8_t neigh_mac[] = {0x00, 0x0f, 0x53, 0x01, 0x00, rand() & 3};
+      struct nlmsghdr* nlh;
+
+      nlh = cp_unit_nl_build_neigh_msg(bufs[i], STORM_IFINDEX, type, state,
+                                       dest, neigh_mac,
+                                       state == NUD_REACHABLE, 0, 0);
+      CP_TEST(nlh->nlmsg_len <= STORM_MSG_SIZE);
+      cp_nl_net_handle_msg(&s_ref, nlh, nlh->nlmsg_len);
+
+      iov[i].iov_base = nlh;
+      iov[i].iov_len = STORM_MSG_SIZE;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_len = nlh->nlmsg_len;
+    }
+    cp_nl_net_handle_batch(&s, msgs, n);
+
+    for( k = 0; k < STORM_NEIGHS; k++ ) {
+      if( ! mac_rows_match(&s, &s_ref, htonl(0x0a000001 + k)) ) {
+        diag("MAC entry %d differs after batch %d", k, b);
+        storm_ok = false;
+      }
+    }
+    cp_time_elapse(s.khz);
+  }
+
+  if( s.stats.nl_batch.coalesced == 0 ) {
+    diag("No neighbour updates were coalesced");
+    storm_ok = false;
+  }
+  diag("%d neighbour updates in %d batches, %d coalesced",
+       s.stats.nl_batch.datagrams, s.stats.nl_batch.batches,
+       s.stats.nl_batch.coalesced);
+
+  cp_unit_destroy_session(&s);
+  cp_unit_destroy_session(&s_ref);
+  return storm_ok;
+}
+
+
 int main(void)
 {
   cp_unit_init();
@@ -268,9 +366,11 @@ int main(void)
 
   generate_random_route_table(&s);
 
-  /* Too much output slows down the JUnit formatter, so keep to one test point.
-   */
-  plan(1);
+  /* Too much output slows down the JUnit formatter, so keep to one test point
+   * per scenario. */
+  plan(2);
+
+  ok(neigh_storm(), "Survived neighbour storm");
 
   int i;
   for( i = 0; i < ITERATIONS; ++i ) {
@@ -92,6 +92,26 @@ static int find_dll_array_mismatch(struct cp_mibs* mib, cicp_mac_rowid_t rowid)
 }
 
 
+/* Stands in for the hash of the i'th flow. */
+static ci_uint32 flow_hash(unsigned i)
+{
+  return i * 2654435761u;
+}
+
+
+/* Returns the element_id of the backend that [hash] is DNATed to. */
+static cicp_rowid_t
+dnat_element(struct oo_cplane_handle* h, struct cp_mibs* mib,
+             ci_addr_sh_t addr, ci_uint16 port, ci_uint32 hash)
+{
+  cicp_mac_rowid_t id_b;
+  CP_TEST(cp_svc_check_dnat(h, &addr, &port, hash) > 0);
+  id_b = cp_svc_find_match(mib, addr, port);
+  CP_TEST(CICP_MAC_ROWID_IS_VALID(id_b));
+  return mib->svc_ep_table[id_b].u.backend.element_id;
+}
+
+
 static cicp_mac_rowid_t
 fill_table(struct cp_session *s, ci_addr_sh_t first_addr, ci_uint16 first_port,
            size_t svc_arrays_max, size_t per_svc_ep_max,
@@ -765,7 +785,7 @@ void test_svc_load_balancing(void)
   for( i = 0; i < 100 * n_backends; ++i ) {
     ci_addr_sh_t dnat_addr = addr;
     ci_uint16 dnat_port = port;
-    cp_svc_check_dnat(&h, &dnat_addr, &dnat_port);
+    cp_svc_check_dnat(&h, &dnat_addr, &dnat_port, flow_hash(i));
     id_b = cp_svc_find_match(mib, dnat_addr, dnat_port);
     ci_assert( CICP_MAC_ROWID_IS_VALID(id_b) );
     count_b[mib->svc_ep_table[id_b].u.backend.element_id]++;
@@ -780,6 +800,171 @@ void test_svc_load_balancing(void)
 }
 
 
+void test_svc_maglev(void)
+{
+  /* Enough to use a few backend arrays */
+  const unsigned n_backends = 3 * CP_SVC_BACKENDS_PER_ARRAY;
+  const unsigned n_flows = 20 * n_backends;
+  ci_addr_sh_t addr = CI_ADDR_SH_FROM_IP4(0x01010101);
+  ci_addr_sh_t addr_b = CI_ADDR_SH_FROM_IP4(0x12121212);
+  ci_uint16 port = 80;
+  struct cp_session s;
+  struct oo_cplane_handle h;
+  struct cp_mibs *mib;
+  cicp_mac_rowid_t id, id_b;
+  struct cp_svc_endpoint before[n_flows];
+  unsigned count_b[n_backends];
+  unsigned i, min, max, moved, lost, stale;
+  ci_uint16 del_port;
+
+  cp_unit_init_session(&s);
+  cp_unit_init_cp_handle(&h, &s);
+
+  id = cp_svc_add(&s, addr, port);
+  ok(CICP_MAC_ROWID_IS_VALID(id), "Added service");
+  for( i = 0; i < n_backends; ++i ) {
+    id_b = cp_svc_backend_add(&s, id, addr_b, port + i);
+    CP_TEST(CICP_MAC_ROWID_IS_VALID(id_b));
+    count_b[i] = 0;
+  }
+  cp_mibs_verify_identical(&s, false);
+
+  mib = cp_get_active_mib(&s);
+  cmp_ok(mib->svc_maglev[mib->svc_ep_table[id].u.service.maglev_id].
+           n_backends, "==", n_backends, "Maglev table built");
+
+  /* A flow always goes to the same backend, and flows are spread evenly. */
+  moved = 0;
+  for( i = 0; i < n_flows; ++i ) {
+    ci_addr_sh_t dnat_addr = addr;
+    cicp_rowid_t e = dnat_element(&h, mib, addr, port, flow_hash(i));
+    if( e != dnat_element(&h, mib, addr, port, flow_hash(i)) )
+      moved++;
+    count_b[e]++;
+    before[i].port = port;
+    cp_svc_check_dnat(&h, &dnat_addr, &before[i].port, flow_hash(i));
+    before[i].addr = dnat_addr;
+  }
+  cmp_ok(moved, "==", 0, "Flows are mapped consistently");
+  min = max = count_b[0];
+  for( i = 1; i < n_backends; ++i ) {
+    min = CI_MIN(min, count_b[i]);
+    max = CI_MAX(max, count_b[i]);
+  }
+  cmp_ok(min, ">", 0, "Every backend is selected");
+  cmp_ok(max, "<", 4 * n_flows / n_backends, "No backend is overloaded");
+
+  /* Remove a backend from the middle of the chain.  This moves the tail
+   * backend into its place in the arrays, but flows that were not on the
+   * removed backend should almost all stay where they were. */
+  del_port = port + 1 + n_backends / 2;
+  cp_svc_backend_del(&s, id, addr_b, del_port);
+  cp_mibs_verify_identical(&s, false);
+  mib = cp_get_active_mib(&s);
+  moved = lost = stale = 0;
+  for( i = 0; i < n_flows; ++i ) {
+    ci_addr_sh_t dnat_addr = addr;
+    ci_uint16 dnat_port = port;
+    cp_svc_check_dnat(&h, &dnat_addr, &dnat_port, flow_hash(i));
+    if( dnat_port == del_port )
+      stale++;
+    if( before[i].port == del_port )
+      lost++;
+    else if( dnat_port != before[i].port )
+      moved++;
+  }
+  cmp_ok(stale, "==", 0, "No flows go to the removed backend");
+  cmp_ok(lost, ">", 0, "Some flows were on the removed backend");
+  cmp_ok(moved, "<", n_flows / 20, "Few other flows moved on removal");
+
+  /* Adding it back should restore most flows to where they started. */
+  cp_svc_backend_add(&s, id, addr_b, del_port);
+  mib = cp_get_active_mib(&s);
+  moved = 0;
+  for( i = 0; i < n_flows; ++i ) {
+    ci_addr_sh_t dnat_addr = addr;
+    ci_uint16 dnat_port = port;
+    cp_svc_check_dnat(&h, &dnat_addr, &dnat_port, flow_hash(i));
+    if( dnat_port != before[i].port )
+      moved++;
+  }
+  cmp_ok(moved, "<", n_flows / 20, "Few flows moved on re-adding");
+
+  cp_unit_destroy_session(&s);
+}
+
+
+void test_svc_maglev_exhausted(void)
+{
+  ci_addr_sh_t addr_b = CI_ADDR_SH_FROM_IP4(0x12121212);
+  ci_uint16 port = 80;
+  struct cp_session s;
+  struct oo_cplane_handle h;
+  struct cp_mibs *mib;
+  int n_svcs;
+  cicp_mac_rowid_t id[64];
+  cicp_mac_rowid_t id_b;
+  int i, j, n_tables;
+
+  cp_unit_init_session(&s);
+  cp_unit_init_cp_handle(&h, &s);
+  mib = cp_get_active_mib(&s);
+  n_svcs = mib->dim->svc_maglev_max + 2;
+  CP_TEST(n_svcs <= (int) (sizeof(id) / sizeof(id[0])));
+  CP_TEST(n_svcs <= mib->dim->svc_arrays_max);
+
+  /* A service with one backend does not need a table. */
+  id[0] = cp_svc_add(&s, CI_ADDR_SH_FROM_IP4(0x01010100), port);
+  CP_TEST(CICP_MAC_ROWID_IS_VALID(id[0]));
+  cp_svc_backend_add(&s, id[0], addr_b, port);
+  mib = cp_get_active_mib(&s);
+  ok(!CICP_ROWID_IS_VALID(mib->svc_ep_table[id[0]].u.service.maglev_id),
+     "Single-backend service has no Maglev table");
+
+  /* Give more services two backends than there are tables. */
+  for( i = 1; i < n_svcs; ++i ) {
+    id[i] = cp_svc_add(&s, CI_ADDR_SH_FROM_IP4(0x01010100 + i), port);
+    CP_TEST(CICP_MAC_ROWID_IS_VALID(id[i]));
+    for( j = 0; j < 2; ++j ) {
+      id_b = cp_svc_backend_add(&s, id[i], addr_b, port + 100 * i + j);
+      CP_TEST(CICP_MAC_ROWID_IS_VALID(id_b));
+    }
+  }
+  cp_mibs_verify_identical(&s, false);
+  mib = cp_get_active_mib(&s);
+  n_tables = 0;
+  for( i = 1; i < n_svcs; ++i )
+    if( CICP_ROWID_IS_VALID(mib->svc_ep_table[id[i]].u.service.maglev_id) )
+      n_tables++;
+  cmp_ok(n_tables, "==", mib->dim->svc_maglev_max, "All tables in use");
+  ok(!CICP_ROWID_IS_VALID(
+       mib->svc_ep_table[id[n_svcs - 1]].u.service.maglev_id),
+     "Service beyond the limit has no Maglev table");
+
+  /* Services without a table still get their backends. */
+  for( i = 0; i < 16; ++i ) {
+    ci_addr_sh_t addr = CI_ADDR_SH_FROM_IP4(0x01010100 + n_svcs - 1);
+    ci_uint16 dnat_port = port;
+    CP_TEST(cp_svc_check_dnat(&h, &addr, &dnat_port, i) > 0);
+    CP_TEST(dnat_port == port + 100 * (n_svcs - 1) ||
+            dnat_port == port + 100 * (n_svcs - 1) + 1);
+  }
+
+  /* Dropping back to one backend releases the table for reuse. */
+  cp_svc_backend_del(&s, id[1], addr_b, port + 100 + 1);
+  mib = cp_get_active_mib(&s);
+  ok(!CICP_ROWID_IS_VALID(mib->svc_ep_table[id[1]].u.service.maglev_id),
+     "Table released on dropping to one backend");
+  cp_svc_backend_add(&s, id[n_svcs - 1], addr_b, port + 100 * n_svcs);
+  cp_mibs_verify_identical(&s, false);
+  mib = cp_get_active_mib(&s);
+  ok(CICP_ROWID_IS_VALID(
+       mib->svc_ep_table[id[n_svcs - 1]].u.service.maglev_id),
+     "Released table is reused");
+
+  cp_unit_destroy_session(&s);
+}
+
 
 int main(void)
 {
@@ -802,6 +987,8 @@ int main(void)
   test_svc_hash_table_full();
   test_svc_erase();
   test_svc_load_balancing();
+  test_svc_maglev();
+  test_svc_maglev_exhausted();
 
   done_testing();
 }
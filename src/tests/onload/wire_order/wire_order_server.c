@@ -64,6 +64,8 @@ static void usage(void)
   fprintf(stderr, "  -p <port>             - port number to listen on\n");
   fprintf(stderr, "  -l <listenq size>     - Set size of listenq\n");
   fprintf(stderr, "  -m <max epoll events> - Maximum number of epoll events\n");
+  fprintf(stderr, "  -S <stacks>           - Spread UDP sockets over this many "
+                  "stacks\n");
   exit(1);
 }
 
@@ -117,6 +119,38 @@ static int my_epoll_add(int epoll_fd, int fd, enum epoll_desc_type type,
 }
 
 
+/* Events must come back in timestamp order, within a call and from one
+ * call to the next.  Events without a timestamp carry no ordering.
+ */
+static void check_ordering(const struct onload_ordered_epoll_event* ev)
+{
+  static struct timespec last;
+
+  if( ev->ts.tv_sec == 0 )
+    return;
+  if( ev->ts.tv_sec < last.tv_sec ||
+      (ev->ts.tv_sec == last.tv_sec && ev->ts.tv_nsec < last.tv_nsec) ) {
+    fprintf(stderr, "ERROR: event at %ld.%09ld after %ld.%09ld\n",
+            (long)ev->ts.tv_sec, ev->ts.tv_nsec,
+            (long)last.tv_sec, last.tv_nsec);
+    exit(1);
+  }
+  last = ev->ts;
+}
+
+
+/* Put subsequent sockets in stack number [i] of [n]. */
+static void use_stack(int i, int n)
+{
+  char name[16];
+
+  if( n <= 1 )
+    return;
+  snprintf(name, sizeof(name), "wo%d", i % n);
+  TRY(onload_set_stackname(ONLOAD_ALL_THREADS, ONLOAD_SCOPE_GLOBAL, name));
+}
+
+
 static int my_epoll_del(int fd, struct epoll_desc* epoll_desc)
 {
   --epoll_fd_cnt;
@@ -131,6 +165,7 @@ int main(int argc, char* argv[])
   int cfg_port = DEFAULT_PORT;
   int cfg_listen_backlog = DEFAULT_LISTEN_BACKLOG;
   int cfg_max_events = DEFAULT_MAX_EPOLL_EVENTS;
+  int cfg_n_stacks = 1;
   uint32_t cfg_flags = 0;
   int32_t cfg_n_socks;
   int n_socks_ready = 0;
@@ -140,7 +175,7 @@ int main(int argc, char* argv[])
   struct onload_ordered_epoll_event* ordered_evs;
   struct epoll_desc* epoll_desc;
 
-  while( (c = getopt(argc, argv, "p:l:m:")) != -1 )
+  while( (c = getopt(argc, argv, "p:l:m:S:")) != -1 )
     switch( c ) {
     case 'p':
       cfg_port = atoi(optarg);
@@ -151,6 +186,9 @@ int main(int argc, char* argv[])
     case 'm':
       cfg_max_events = atoi(optarg);
       break;
+    case 'S':
+      cfg_n_stacks = atoi(optarg);
+      break;
     case '?':
       usage();
       fallthrough;
@@ -183,11 +221,18 @@ int main(int argc, char* argv[])
 
   if( cfg_flags & WIRE_ORDER_CFG_FLAGS_UDP ) {
     TRY(my_epoll_add(epoll_fd, reply_sock, EPOLL_DESC_TYPE_REPLY, EPOLLIN));
+    /* The data sockets may be spread across several stacks, in which case
+     * onload_ordered_epoll_wait() has to merge their data by timestamp. */
+    if( cfg_n_stacks > 1 )
+      TRY(onload_stackname_save());
     for( i = 0; i < cfg_n_socks; i++ ) {
+      use_stack(i, cfg_n_stacks);
       TRY(sock = socket(AF_INET, SOCK_DGRAM, 0));
       TRY(my_bind(sock, cfg_port++));
       TRY(my_epoll_add(epoll_fd, sock, EPOLL_DESC_TYPE_OTHER, EPOLLIN));
     }
+    if( cfg_n_stacks > 1 )
+      TRY(onload_stackname_restore());
     TRY(wire_order_server_ready(reply_sock));
   }
 
@@ -199,6 +244,7 @@ int main(int argc, char* argv[])
     for( i = 0; i < n_epoll_evs; ++i ) {
       epoll_desc = epoll_evs[i].data.ptr;
       assert(epoll_desc);
+      check_ordering(&ordered_evs[i]);
       switch( epoll_desc->type ) {
       case EPOLL_DESC_TYPE_REPLY:
         TRY(my_epoll_del(sock, epoll_desc));
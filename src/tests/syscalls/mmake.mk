@@ -13,9 +13,10 @@ close		:= $(patsubst %,$(AppPattern),close)
 sendfile	:= $(patsubst %,$(AppPattern),sendfile)
 sendfile_clnt	:= $(patsubst %,$(AppPattern),sendfile_clnt)
 splice		:= $(patsubst %,$(AppPattern),splice)
+sud_bench	:= $(patsubst %,$(AppPattern),sud_bench)
 
 TARGETS	:= $(read) $(write) $(writev) $(printf) $(ci_log) $(dup) $(streams) \
-	   $(execve) $(close) $(splice)
+	   $(execve) $(close) $(splice) $(sud_bench)
 
 ifeq ($(GNU),1)
 TARGETS	+= $(sendfile) $(sendfile_clnt)
@@ -32,6 +33,9 @@ $(ci_log): ci_log.o $(CITOOLS_LIB_DEPEND)
 $(dup): dup.o $(CITOOLS_LIB_DEPEND) $(CIAPP_LIB_DEPEND) $(LINK_CIUL_LIB_DEPEND)
 	libs="$(LINK_CIAPP_LIB) $(LINK_CIUL_LIB) $(LINK_CITOOLS_LIB) -ldl -lrt"; $(MMakeLinkCApp)
 
+$(sud_bench): sud_bench.o
+	libs="-ldl"; $(MMakeLinkCApp)
+
 $(streams): streams.o $(CITOOLS_LIB_DEPEND) $(CIAPP_LIB_DEPEND)
 	libs="$(LINK_CIAPP_LIB) $(LINK_CITOOLS_LIB) -ldl -lrt"; $(MMakeLinkCApp)
 
@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+/**************************************************************************\
+*//*! \file
+**  \brief  Cost of system calls trapped by Syscall User Dispatch
+*//*
+\**************************************************************************/
+
+/* Times getppid() made via libc and made with a syscall instruction of our
+ * own.  Run under onload with EF_SYSCALL_DISPATCH=1 to see what Onload's
+ * interception adds to each raw system call; the libc figure is
+ * unaffected.  With --self, arms Syscall User Dispatch here with a trivial
+ * SIGSYS handler instead, to show the cost of the kernel mechanism alone
+ * and of a closed (ALLOW) selector.
+ *
+ * Without --self it also takes signals through a handler installed with a
+ * raw rt_sigaction() and a restorer outside libc, as the Go runtime does,
+ * so that the restorer's rt_sigreturn traps.  This fails if the signal
+ * does not return to the right place.
+ */
+
+/*! \cidoxg_tests_syscalls */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <ucontext.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#ifndef SA_RESTORER
+# define SA_RESTORER                   0x04000000
+#endif
+#ifndef PR_SET_SYSCALL_USER_DISPATCH
+# define PR_SET_SYSCALL_USER_DISPATCH  59
+# define PR_SYS_DISPATCH_ON            1
+# define SYSCALL_DISPATCH_FILTER_ALLOW 0
+# define SYSCALL_DISPATCH_FILTER_BLOCK 1
+#endif
+
+#if defined(__x86_64__)
+
+static volatile char selector;
+static unsigned long libc_start, libc_len;
+static volatile int n_signals;
+
+/* The kernel's struct sigaction, as passed to rt_sigaction. */
+struct ksigaction {
+  void*         handler;
+  unsigned long flags;
+  void*         restorer;
+  unsigned long mask;
+};
+
+/* A signal restorer of our own, outside libc.  15 is __NR_rt_sigreturn. */
+extern void raw_restorer(void);
+__asm__(".pushsection .text\n"
+        ".type raw_restorer, @function\n"
+        "raw_restorer:\n"
+        "\tmovq $15, %rax\n"
+        "\tsyscall\n"
+        "\thlt\n"
+        ".popsection\n");
+
+
+static long raw_getppid(void)
+{
+  long rc;
+  __asm__ __volatile__("syscall" : "=a" (rc) : "0" ((long) __NR_getppid)
+                       : "rcx", "r11", "memory");
+  return rc;
+}
+
+
+static long raw_syscall4(long nr, long a, long b, long c, long d)
+{
+  register long r10 __asm__("r10") = d;
+  long rc;
+  __asm__ __volatile__("syscall"
+                       : "=a" (rc)
+                       : "0" (nr), "D" (a), "S" (b), "d" (c), "r" (r10)
+                       : "rcx", "r11", "memory");
+  return rc;
+}
+
+
+static void raw_handler(int sig)
+{
+  ++n_signals;
+}
+
+
+static int raw_sigaction(int sig, void (*handler)(int))
+{
+  struct ksigaction act = {
+    .handler = handler,
+    .flags = SA_RESTORER,
+    .restorer = raw_restorer,
+  };
+  long rc = raw_syscall4(__NR_rt_sigaction, sig, (long) &act, 0,
+                         sizeof(act.mask));
+  if( rc < 0 ) {
+    fprintf(stderr, "rt_sigaction: %s\n", strerror(-rc));
+    return -1;
+  }
+  return 0;
+}
+
+
+static void sigsys(int sig, siginfo_t* info, void* context)
+{
+  ucontext_t* uc = context;
+  selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+  uc->uc_mcontext.gregs[REG_RAX] = syscall(info->si_syscall);
+  selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+}
+
+
+static int find_text(struct dl_phdr_info* info, size_t size, void* arg)
+{
+  unsigned long addr = (unsigned long) arg;
+  int i;
+
+  for( i = 0; i < info->dlpi_phnum; ++i ) {
+    const ElfW(Phdr)* ph = &info->dlpi_phdr[i];
+    unsigned long start = info->dlpi_addr + ph->p_vaddr;
+    if( ph->p_type == PT_LOAD && (ph->p_flags & PF_X) &&
+        addr - start < ph->p_memsz ) {
+      libc_start = start;
+      libc_len = ph->p_memsz;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+static int arm_self(void)
+{
+  struct sigaction act;
+
+  if( ! dl_iterate_phdr(find_text, dlsym(RTLD_DEFAULT, "getppid")) ) {
+    fprintf(stderr, "cannot find libc text\n");
+    return -1;
+  }
+  memset(&act, 0, sizeof(act));
+  act.sa_sigaction = sigsys;
+  act.sa_flags = SA_SIGINFO;
+  sigaction(SIGSYS, &act, NULL);
+  selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+  if( prctl(PR_SET_SYSCALL_USER_DISPATCH, PR_SYS_DISPATCH_ON,
+            libc_start, libc_len, &selector) < 0 ) {
+    perror("PR_SET_SYSCALL_USER_DISPATCH");
+    return -1;
+  }
+  return 0;
+}
+
+
+static double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+#define TIME(name, iters, call)                                         \
+  do {                                                                  \
+    double _t = now_ns();                                               \
+    int _i;                                                             \
+    for( _i = 0; _i < (iters); ++_i )                                   \
+      (call);                                                           \
+    printf("%-24s %8.1f ns/call\n", (name), (now_ns() - _t) / (iters)); \
+  } while( 0 )
+
+
+int main(int argc, char* argv[])
+{
+  int iters = 1000000;
+  int self = 0;
+  int i;
+
+  for( i = 1; i < argc; ++i ) {
+    if( ! strcmp(argv[i], "--self") )
+      self = 1;
+    else
+      iters = atoi(argv[i]);
+  }
+  if( iters <= 0 ) {
+    fprintf(stderr, "usage: %s [--self] [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  if( self && arm_self() < 0 )
+    return 1;
+
+  TIME("libc getppid", iters, getppid());
+  TIME("raw getppid", iters, raw_getppid());
+  if( self ) {
+    selector = SYSCALL_DISPATCH_FILTER_BLOCK;
+    TIME("raw getppid (trapped)", iters, raw_getppid());
+    selector = SYSCALL_DISPATCH_FILTER_ALLOW;
+  }
+  else {
+    /* The trivial handler of --self cannot unwind a trapped rt_sigreturn,
+     * so this is only for Onload's. */
+    if( raw_sigaction(SIGUSR1, raw_handler) < 0 )
+      return 1;
+    TIME("raw-restorer signal", iters, kill(getpid(), SIGUSR1));
+    if( n_signals != iters ) {
+      fprintf(stderr, "handled %d of %d signals\n", n_signals, iters);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#else
+
+int main(void)
+{
+  fprintf(stderr, "Syscall User Dispatch is supported only on x86-64\n");
+  return 1;
+}
+
+#endif
+
+/*! \cidoxg_end */
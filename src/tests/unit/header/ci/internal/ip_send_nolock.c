@@ -0,0 +1,332 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/ip.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/* The TX claims and socket send gates of EF_TCP_SEND_NOLOCK */
+
+#define SENDER       42u
+#define SENDER2      43u
+#define SEND_ITERS   100000
+
+static ci_netif_state state;
+static ci_netif ni_s;
+static ci_netif* ni = &ni_s;
+static ci_tcp_state ts_s;
+static ci_tcp_state* ts = &ts_s;
+
+static ci_uint32 claim(void)
+{
+  return state.nic[0].tx_claim;
+}
+
+/* Dependencies */
+static int merged;
+
+void __ci_tcp_send_nolock_merge(ci_netif* ni_, ci_tcp_state* ts_)
+{
+  CHECK(ni_, ==, ni);
+  CHECK(ts_, ==, ts);
+  /* Nobody may be sending while the lock holder takes the packets. */
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_CLOSED);
+  CHECK(claim(), !=, SENDER);
+  ts->send_nolock = OO_PP_ID_NULL;
+  ++merged;
+}
+
+static void init(void)
+{
+  memset(&state, 0, sizeof(state));
+  memset(ts, 0, sizeof(*ts));
+  ni->state = &state;
+  state.opts.tcp_send_nolock = 1;
+  state.lock.lock = CI_EPLOCK_LOCKED;
+  *(ci_int32*)&state.nic_n = 1;
+  ts->send_nolock = OO_PP_ID_NULL;
+  ts->send_nolock_gate = CI_TCP_SEND_NOLOCK_CLOSED;
+  merged = 0;
+}
+
+
+static void test_claim_off(void)
+{
+  init();
+  state.opts.tcp_send_nolock = 0;
+  state.nic[0].tx_claim = SENDER;
+
+  /* Nobody else posts to the ring, so there is nothing to claim. */
+  CHECK_TRUE(ci_netif_tx_claim(ni, 0));
+  CHECK(claim(), ==, SENDER);
+  ci_netif_tx_release(ni, 0);
+  CHECK(claim(), ==, SENDER);
+}
+
+static void test_claim_release(void)
+{
+  init();
+
+  CHECK_TRUE(ci_netif_tx_claim(ni, 0));
+  CHECK(claim(), ==, CI_NETIF_TX_OWNER_LOCKED);
+  ci_netif_tx_release(ni, 0);
+  CHECK(claim(), ==, 0);
+
+  CHECK_TRUE(ci_netif_tx_claim_spins(ni, 0, SENDER, 1));
+  CHECK(claim(), ==, SENDER);
+  CHECK_FALSE(ci_netif_tx_claim_spins(ni, 0, SENDER2, 1));
+  ci_netif_tx_unclaim(ni, 0, SENDER2);
+  CHECK(claim(), ==, SENDER);
+  ci_netif_tx_unclaim(ni, 0, SENDER);
+  CHECK(claim(), ==, 0);
+}
+
+static void test_claim_contended(void)
+{
+  init();
+  state.nic[0].tx_claim = SENDER;
+
+  /* The lock holder gives up, however often it tries. */
+  CHECK_FALSE(ci_netif_tx_claim(ni, 0));
+  CHECK_FALSE(ci_netif_tx_claim(ni, 0));
+  CHECK(claim(), ==, SENDER);
+
+  ci_netif_tx_unclaim(ni, 0, SENDER);
+  CHECK_TRUE(ci_netif_tx_claim(ni, 0));
+  ci_netif_tx_release(ni, 0);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 0);
+}
+
+static void test_claim_reap(void)
+{
+  init();
+  state.nic[0].tx_claim = SENDER;
+
+  /* Only the owner's claim is released. */
+  CHECK_FALSE(ci_netif_tx_claim_reap(ni, 0, SENDER2));
+  CHECK(claim(), ==, SENDER);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 0);
+  CHECK_TRUE(ci_netif_tx_claim_reap(ni, 0, SENDER));
+  CHECK(claim(), ==, 0);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 1);
+  CHECK_FALSE(ci_netif_tx_claim_reap(ni, 0, SENDER));
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 1);
+
+  CHECK_TRUE(ci_netif_tx_claim(ni, 0));
+  ci_netif_tx_unclaim(ni, 0, SENDER);
+  CHECK(claim(), ==, CI_NETIF_TX_OWNER_LOCKED);
+  ci_netif_tx_release(ni, 0);
+}
+
+static void* reaper(void* arg)
+{
+  usleep(10000);
+  if( arg == NULL )
+    CHECK_TRUE(ci_netif_tx_claim_reap(ni, 0, SENDER));
+  else
+    CHECK_TRUE(ci_tcp_send_nolock_reap(ni, ts, SENDER));
+  return NULL;
+}
+
+static void test_claim_wait(void)
+{
+  pthread_t thread;
+
+  init();
+  ci_netif_tx_claim_wait(ni, 0);
+  CHECK(claim(), ==, CI_NETIF_TX_OWNER_LOCKED);
+  ci_netif_tx_release(ni, 0);
+
+  /* One left by a lock holder that died with it is ours now. */
+  state.nic[0].tx_claim = CI_NETIF_TX_OWNER_LOCKED;
+  ci_netif_tx_claim_wait(ni, 0);
+  CHECK(claim(), ==, CI_NETIF_TX_OWNER_LOCKED);
+  ci_netif_tx_release(ni, 0);
+  CHECK(claim(), ==, 0);
+
+  /* A sender's is waited for until it is released on its behalf. */
+  state.nic[0].tx_claim = SENDER;
+  pthread_create(&thread, NULL, reaper, NULL);
+  ci_netif_tx_claim_wait(ni, 0);
+  CHECK(claim(), ==, CI_NETIF_TX_OWNER_LOCKED);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 1);
+  ci_netif_tx_release(ni, 0);
+  pthread_join(thread, NULL);
+}
+
+static void test_gate(void)
+{
+  init();
+
+  CHECK_FALSE(ci_tcp_send_nolock_enter(ts, SENDER));
+
+  ts->s.b.state = CI_TCP_ESTABLISHED;
+  ts->send_prequeue = OO_PP_ID_NULL;
+  ci_ip_queue_init(&ts->send);
+  ci_tcp_send_nolock_open(ni, ts);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_IDLE);
+
+  CHECK_TRUE(ci_tcp_send_nolock_enter(ts, SENDER));
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_BUSY);
+  CHECK(ts->send_nolock_owner, ==, SENDER);
+  CHECK_TRUE(ci_tcp_send_nolock_held(ts, SENDER));
+  CHECK_FALSE(ci_tcp_send_nolock_held(ts, SENDER2));
+  CHECK_FALSE(ci_tcp_send_nolock_enter(ts, SENDER2));
+
+  ci_tcp_send_nolock_leave(ts, SENDER2);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_BUSY);
+  ci_tcp_send_nolock_leave(ts, SENDER);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_IDLE);
+  CHECK(ts->send_nolock_owner, ==, 0);
+
+  ci_tcp_send_nolock_block(ni, ts);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_CLOSED);
+  CHECK_FALSE(ci_tcp_send_nolock_enter(ts, SENDER));
+  ci_tcp_send_nolock_block(ni, ts);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_CLOSED);
+
+  /* Not while anything is queued ahead. */
+  ts->tcpflags |= CI_TCPT_FLAG_FIN_PENDING;
+  ci_tcp_send_nolock_open(ni, ts);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_CLOSED);
+}
+
+static volatile int sender_in, sender_done;
+
+static void* slow_sender(void* arg)
+{
+  CHECK_TRUE(ci_tcp_send_nolock_enter(ts, SENDER));
+  sender_in = 1;
+  usleep(10000);
+  ts->send_nolock = 1;
+  sender_done = 1;
+  ci_tcp_send_nolock_leave(ts, SENDER);
+  return NULL;
+}
+
+static void test_gate_contended(void)
+{
+  pthread_t thread;
+
+  init();
+  ts->send_nolock_gate = CI_TCP_SEND_NOLOCK_IDLE;
+  sender_in = sender_done = 0;
+
+  pthread_create(&thread, NULL, slow_sender, NULL);
+  while( ! sender_in )
+    ci_spinloop_pause();
+  ci_tcp_send_nolock_block(ni, ts);
+  CHECK_TRUE(sender_done);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_CLOSED);
+  CHECK(merged, ==, 1);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 0);
+  pthread_join(thread, NULL);
+}
+
+static void test_gate_reap(void)
+{
+  init();
+  ts->send_nolock_gate = CI_TCP_SEND_NOLOCK_IDLE;
+
+  CHECK_FALSE(ci_tcp_send_nolock_reap(ni, ts, SENDER));
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_IDLE);
+
+  CHECK_TRUE(ci_tcp_send_nolock_enter(ts, SENDER));
+  CHECK_FALSE(ci_tcp_send_nolock_reap(ni, ts, SENDER2));
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_BUSY);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 0);
+
+  /* The gate is left closed for the lock holder to open. */
+  CHECK_TRUE(ci_tcp_send_nolock_reap(ni, ts, SENDER));
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_CLOSED);
+  CHECK(ts->send_nolock_owner, ==, 0);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 1);
+  CHECK_FALSE(ci_tcp_send_nolock_enter(ts, SENDER2));
+
+  /* Should the owner turn up after all, it finds it has lost the gate. */
+  CHECK_FALSE(ci_tcp_send_nolock_held(ts, SENDER));
+  ci_tcp_send_nolock_leave(ts, SENDER);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_CLOSED);
+}
+
+static void test_gate_dead_sender(void)
+{
+  pthread_t thread;
+
+  init();
+  ts->send_nolock_gate = CI_TCP_SEND_NOLOCK_IDLE;
+
+  /* The sender dies after handing its packets over, with the gate. */
+  CHECK_TRUE(ci_tcp_send_nolock_enter(ts, SENDER));
+  ts->send_nolock = 1;
+  pthread_create(&thread, NULL, reaper, ts);
+  ci_tcp_send_nolock_block(ni, ts);
+  CHECK(ts->send_nolock_gate, ==, CI_TCP_SEND_NOLOCK_CLOSED);
+  CHECK(merged, ==, 1);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 1);
+  pthread_join(thread, NULL);
+}
+
+static int in_ring, ring_overlaps, ring_posts;
+
+static void post(void)
+{
+  if( in_ring++ )
+    ++ring_overlaps;
+  ++ring_posts;
+  --in_ring;
+}
+
+static void* claiming_sender(void* arg)
+{
+  int i;
+  for( i = 0; i < SEND_ITERS; ++i ) {
+    while( ! ci_netif_tx_claim_spins(ni, 0, SENDER, CI_NETIF_TX_CLAIM_SPINS) )
+      ;
+    post();
+    ci_netif_tx_unclaim(ni, 0, SENDER);
+  }
+  return NULL;
+}
+
+static void test_claim_exclusive(void)
+{
+  pthread_t thread;
+  int i;
+
+  init();
+  in_ring = ring_overlaps = ring_posts = 0;
+
+  pthread_create(&thread, NULL, claiming_sender, NULL);
+  for( i = 0; i < SEND_ITERS; ++i ) {
+    while( ! ci_netif_tx_claim(ni, 0) )
+      ;
+    post();
+    ci_netif_tx_release(ni, 0);
+  }
+  pthread_join(thread, NULL);
+
+  CHECK(ring_overlaps, ==, 0);
+  CHECK(ring_posts, ==, 2 * SEND_ITERS);
+  CHECK(claim(), ==, 0);
+  CHECK(state.stats.tcp_send_nolock_reclaims, ==, 0);
+}
+
+int main(void)
+{
+  TEST_RUN(test_claim_off);
+  TEST_RUN(test_claim_release);
+  TEST_RUN(test_claim_contended);
+  TEST_RUN(test_claim_reap);
+  TEST_RUN(test_claim_wait);
+  TEST_RUN(test_gate);
+  TEST_RUN(test_gate_contended);
+  TEST_RUN(test_gate_reap);
+  TEST_RUN(test_gate_dead_sender);
+  TEST_RUN(test_claim_exclusive);
+  TEST_END();
+}
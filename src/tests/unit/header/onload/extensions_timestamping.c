@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Functions under test */
+#include <onload/extensions_timestamping.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+#define RING_SIZE 8
+
+/* The writer's side of the ring, as oo_ringbuffer_write() does it */
+static struct onload_tx_ts_record records[RING_SIZE];
+static uint32_t write_i;
+
+static void ring_put(uint32_t id)
+{
+  struct onload_tx_ts_record rec = {
+    .sock_key = 3,
+    .id = id,
+    .len = 100,
+    .flags = ONLOAD_TX_TS_RECORD_TCP,
+    .timestamp = { .sec = 1000 + id, .nsec = id },
+  };
+  records[write_i & (RING_SIZE - 1)] = rec;
+  write_i++;
+}
+
+static void ring_view(struct onload_tx_ts_ring* ring)
+{
+  ring->write = &write_i;
+  ring->records = records;
+  ring->mask = RING_SIZE - 1;
+  ring->read = write_i;
+  ring->lost = 0;
+}
+
+static void test_tx_ts_ring_empty(void)
+{
+  struct onload_tx_ts_ring ring;
+  struct onload_tx_ts_record rec;
+
+  write_i = 0xfffffffe;
+  ring_put(1);
+  ring_view(&ring);
+  CHECK(onload_tx_timestamp_ring_next(&ring, &rec), ==, 0);
+  CHECK(ring.lost, ==, 0);
+}
+
+static void test_tx_ts_ring_in_order(void)
+{
+  struct onload_tx_ts_ring ring;
+  struct onload_tx_ts_record rec;
+  uint32_t id;
+
+  /* Start just before the index wraps */
+  write_i = 0xfffffffd;
+  ring_view(&ring);
+  for( id = 0; id < RING_SIZE - 1; ++id )
+    ring_put(id);
+
+  for( id = 0; id < RING_SIZE - 1; ++id ) {
+    CHECK(onload_tx_timestamp_ring_next(&ring, &rec), ==, 1);
+    CHECK(rec.id, ==, id);
+    CHECK(rec.sock_key, ==, 3);
+    CHECK(rec.timestamp.sec, ==, 1000 + id);
+  }
+  CHECK(onload_tx_timestamp_ring_next(&ring, &rec), ==, 0);
+  CHECK(ring.lost, ==, 0);
+
+  ring_put(RING_SIZE);
+  CHECK(onload_tx_timestamp_ring_next(&ring, &rec), ==, 1);
+  CHECK(rec.id, ==, RING_SIZE);
+}
+
+static void test_tx_ts_ring_overrun(void)
+{
+  struct onload_tx_ts_ring ring;
+  struct onload_tx_ts_record rec;
+  uint32_t id;
+
+  write_i = 0xfffffffa;
+  ring_view(&ring);
+  for( id = 0; id < 3 * RING_SIZE; ++id )
+    ring_put(id);
+
+  /* The oldest readable record is the one after the slot which the writer
+   * will overwrite next. */
+  for( id = 2 * RING_SIZE + 1; id < 3 * RING_SIZE; ++id ) {
+    CHECK(onload_tx_timestamp_ring_next(&ring, &rec), ==, 1);
+    CHECK(rec.id, ==, id);
+  }
+  CHECK(onload_tx_timestamp_ring_next(&ring, &rec), ==, 0);
+  CHECK(ring.lost, ==, 2 * RING_SIZE + 1);
+}
+
+int main(void) {
+  TEST_RUN(test_tx_ts_ring_empty);
+  TEST_RUN(test_tx_ts_ring_in_order);
+  TEST_RUN(test_tx_ts_ring_overrun);
+  TEST_END();
+}
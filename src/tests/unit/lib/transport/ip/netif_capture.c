@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/ip.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+#define N_INSNS(prog)  (sizeof(prog) / sizeof(prog[0]))
+
+/* The start of an IPv4/TCP frame to port 80, with a 20 byte IP header. */
+static const ci_uint8 frame[] = {
+  0x00, 0x0f, 0x53, 0x00, 0x00, 0x01,  0x00, 0x0f, 0x53, 0x00, 0x00, 0x02,
+  0x08, 0x00,
+  0x45, 0x00, 0x00, 0x3c,  0x73, 0x63, 0x40, 0x00,  0x40, 0x06, 0x9e, 0x66,
+  0x0a, 0x78, 0x0a, 0x02,  0x0a, 0x78, 0x0a, 0x01,
+  0xc3, 0x50, 0x00, 0x50,
+};
+
+/* "ip" as compiled by libpcap with snaplen 96 */
+static const struct oo_capture_insn prog_ip[] = {
+  { 0x28, 0, 0, 12 },           /* ldh [12] */
+  { 0x15, 0, 1, 0x800 },        /* jeq #0x800, 0, 1 */
+  { 0x06, 0, 0, 96 },           /* ret #96 */
+  { 0x06, 0, 0, 0 },            /* ret #0 */
+};
+
+static void test_ethertype(void)
+{
+  ci_uint8 arp[sizeof(frame)];
+
+  CHECK(oo_capture_filter_run(prog_ip, N_INSNS(prog_ip), frame,
+                              sizeof(frame), 1500), ==, 96);
+
+  memcpy(arp, frame, sizeof(arp));
+  arp[13] = 0x06;
+  CHECK(oo_capture_filter_run(prog_ip, N_INSNS(prog_ip), arp,
+                              sizeof(arp), 1500), ==, 0);
+
+  /* An empty program accepts nothing. */
+  CHECK(oo_capture_filter_run(prog_ip, 0, frame, sizeof(frame), 1500),
+        ==, 0);
+}
+
+static void test_tcp_port(void)
+{
+  /* "tcp dst port 80", with the IP header length taken from the packet */
+  static const struct oo_capture_insn prog[] = {
+    { 0x28, 0, 0, 12 },         /* ldh [12] */
+    { 0x15, 0, 6, 0x800 },      /* jeq #0x800, 0, 6 */
+    { 0x30, 0, 0, 23 },         /* ldb [23] */
+    { 0x15, 0, 4, 6 },          /* jeq #6, 0, 4 */
+    { 0xb1, 0, 0, 14 },         /* ldxb 4*([14]&0xf) */
+    { 0x48, 0, 0, 16 },         /* ldh [x + 16] */
+    { 0x15, 0, 1, 80 },         /* jeq #80, 0, 1 */
+    { 0x06, 0, 0, 65535 },      /* ret #65535 */
+    { 0x06, 0, 0, 0 },          /* ret #0 */
+  };
+  ci_uint8 other[sizeof(frame)];
+
+  CHECK(oo_capture_filter_run(prog, N_INSNS(prog), frame,
+                              sizeof(frame), 1500), ==, 65535);
+
+  memcpy(other, frame, sizeof(other));
+  other[37] = 81;
+  CHECK(oo_capture_filter_run(prog, N_INSNS(prog), other,
+                              sizeof(other), 1500), ==, 0);
+
+  /* The port is beyond what we were given, so the load fails. */
+  CHECK(oo_capture_filter_run(prog, N_INSNS(prog), frame,
+                              sizeof(frame) - 1, 1500), ==, 0);
+}
+
+static void test_len(void)
+{
+  static const struct oo_capture_insn prog[] = {
+    { 0x80, 0, 0, 0 },          /* ld #len */
+    { 0x16, 0, 0, 0 },          /* ret a */
+  };
+
+  CHECK(oo_capture_filter_run(prog, N_INSNS(prog), frame,
+                              sizeof(frame), 1234), ==, 1234);
+}
+
+static void test_bad_programs(void)
+{
+  static const struct oo_capture_insn jump_past_end[] = {
+    { 0x15, 5, 5, 0 },          /* jeq #0, 5, 5 */
+    { 0x06, 0, 0, 1 },          /* ret #1 */
+  };
+  static const struct oo_capture_insn ja_past_end[] = {
+    { 0x05, 0, 0, 0xffffffff }, /* ja +0xffffffff */
+    { 0x06, 0, 0, 1 },          /* ret #1 */
+  };
+  static const struct oo_capture_insn div_zero[] = {
+    { 0x00, 0, 0, 7 },          /* ld #7 */
+    { 0x3c, 0, 0, 0 },          /* div x */
+    { 0x06, 0, 0, 1 },          /* ret #1 */
+  };
+  static const struct oo_capture_insn bad_mem[] = {
+    { 0x02, 0, 0, 16 },         /* st M[16] */
+    { 0x06, 0, 0, 1 },          /* ret #1 */
+  };
+  static const struct oo_capture_insn bad_ind[] = {
+    { 0x01, 0, 0, 0xffffffff }, /* ldx #0xffffffff */
+    { 0x50, 0, 0, 2 },          /* ldb [x + 2] */
+    { 0x06, 0, 0, 1 },          /* ret #1 */
+  };
+  static const struct oo_capture_insn no_ret[] = {
+    { 0x00, 0, 0, 7 },          /* ld #7 */
+  };
+  static const struct oo_capture_insn bad_op[] = {
+    { 0xf4, 0, 0, 0 },          /* alu with undefined op */
+    { 0x06, 0, 0, 1 },          /* ret #1 */
+  };
+
+#define TEST(prog) \
+  CHECK(oo_capture_filter_run(prog, N_INSNS(prog), frame, \
+                              sizeof(frame), 1500), ==, 0)
+  TEST(jump_past_end);
+  TEST(ja_past_end);
+  TEST(div_zero);
+  TEST(bad_mem);
+  TEST(bad_ind);
+  TEST(no_ret);
+  TEST(bad_op);
+#undef TEST
+}
+
+int main(void)
+{
+  TEST_RUN(test_ethertype);
+  TEST_RUN(test_tcp_port);
+  TEST_RUN(test_len);
+  TEST_RUN(test_bad_programs);
+  TEST_END();
+}
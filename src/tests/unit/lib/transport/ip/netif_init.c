@@ -24,6 +24,8 @@ int (*ci_sys_close)(int);
 ssize_t (*ci_sys_read)(int, void*, size_t);
 int (*ci_sys_execvpe)(const char *, char *const [], char *const []);
 
+extern char** environ;
+
 /* Parametrised test case */
 static void test_ci_netif_set_rxq_limit_(
     int rxq_limit, int rxq_min, int max_rx_packets, int nic_n, int vi_cap,
@@ -81,9 +83,45 @@ static void test_ci_netif_set_rxq_limit(void)
   TEST(1000, 2000, 1000, 2, 2047, -ENOMEM, 33);
 }
 
+static void test_ci_cfg_getenv(void)
+{
+  char** saved_environ = environ;
+  char* test_environ[] = {
+    "PATH=/bin",
+    "EF_POLL_USEC=100",
+    "EF_POLL=7",
+    "EF_EMPTY=",
+    "EF_NO_VALUE",
+    "EF_POLL_USEC=200",
+    NULL
+  };
+
+  environ = test_environ;
+  ci_cfg_env_scan();
+
+  CHECK(strcmp(ci_cfg_getenv("EF_POLL_USEC"), "100"), ==, 0);
+  CHECK(strcmp(ci_cfg_getenv("EF_POLL"), "7"), ==, 0);
+  CHECK(strcmp(ci_cfg_getenv("EF_EMPTY"), ""), ==, 0);
+  CHECK_TRUE(ci_cfg_getenv("EF_NO_VALUE") == NULL);
+  CHECK_TRUE(ci_cfg_getenv("EF_POLL_U") == NULL);
+  CHECK_TRUE(ci_cfg_getenv("EF_SPIN_USEC") == NULL);
+  /* Names outside the EF_ namespace go to getenv() */
+  CHECK(strcmp(ci_cfg_getenv("PATH"), "/bin"), ==, 0);
+
+  /* The values are our own copies of what was there at the scan */
+  test_environ[1] = "EF_POLL_USEC=300";
+  CHECK(strcmp(ci_cfg_getenv("EF_POLL_USEC"), "100"), ==, 0);
+  ci_cfg_env_scan();
+  CHECK(strcmp(ci_cfg_getenv("EF_POLL_USEC"), "300"), ==, 0);
+
+  environ = saved_environ;
+  ci_cfg_env_scan();
+}
+
 int main(void)
 {
   TEST_RUN(test_ci_netif_set_rxq_limit);
+  TEST_RUN(test_ci_cfg_getenv);
   TEST_END();
 }
 
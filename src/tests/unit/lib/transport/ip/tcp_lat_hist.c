@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/ip.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+#define SHIFT 10
+#define LAST  (CI_TCP_LAT_HIST_BUCKETS - 1)
+
+static ci_tcp_lat_hist hist;
+
+static ci_tcp_lat_hist* hist_init(void)
+{
+  memset(&hist, 0, sizeof(hist));
+  hist.shift = SHIFT;
+  return &hist;
+}
+
+static void hist_add(ci_tcp_lat_hist* h, ci_uint64 v, unsigned n)
+{
+  h->count[ci_tcp_lat_hist_bucket(h, v)] += n;
+  if( v > h->max )
+    h->max = CI_MIN(v, (ci_uint64) 0xffffffffu);
+}
+
+static void test_bucket(void)
+{
+  ci_tcp_lat_hist* h = hist_init();
+
+  CHECK(ci_tcp_lat_hist_bucket(h, 0), ==, 0);
+  CHECK(ci_tcp_lat_hist_bucket(h, (1 << SHIFT) - 1), ==, 0);
+  /* Each power of two is split in half. */
+  CHECK(ci_tcp_lat_hist_bucket(h, 1 << SHIFT), ==, 1);
+  CHECK(ci_tcp_lat_hist_bucket(h, (3 << SHIFT) / 2 - 1), ==, 1);
+  CHECK(ci_tcp_lat_hist_bucket(h, (3 << SHIFT) / 2), ==, 2);
+  CHECK(ci_tcp_lat_hist_bucket(h, (2 << SHIFT) - 1), ==, 2);
+  CHECK(ci_tcp_lat_hist_bucket(h, 2 << SHIFT), ==, 3);
+  CHECK(ci_tcp_lat_hist_bucket(h, 3 << SHIFT), ==, 4);
+  /* Everything too big goes to the last bucket. */
+  CHECK(ci_tcp_lat_hist_bucket(h, 1ull << 40), ==, LAST);
+  CHECK(ci_tcp_lat_hist_bucket(h, ~0ull), ==, LAST);
+}
+
+static void test_bucket_limit(void)
+{
+  ci_tcp_lat_hist* h = hist_init();
+  int i;
+
+  CHECK(ci_tcp_lat_hist_bucket_limit(h, 0), ==, 1 << SHIFT);
+  CHECK(ci_tcp_lat_hist_bucket_limit(h, 1), ==, (3 << SHIFT) / 2);
+  CHECK(ci_tcp_lat_hist_bucket_limit(h, 2), ==, 2 << SHIFT);
+  CHECK(ci_tcp_lat_hist_bucket_limit(h, LAST), ==, 0);
+
+  /* The limits are exactly where the buckets change. */
+  for( i = 0; i < LAST; ++i ) {
+    ci_uint64 limit = ci_tcp_lat_hist_bucket_limit(h, i);
+    CHECK(ci_tcp_lat_hist_bucket(h, limit - 1), ==, i);
+    CHECK(ci_tcp_lat_hist_bucket(h, limit), ==, i + 1);
+  }
+}
+
+static void test_percentile_empty(void)
+{
+  ci_tcp_lat_hist* h = hist_init();
+
+  CHECK(ci_tcp_lat_hist_percentile(h, 500), ==, 0);
+  CHECK(ci_tcp_lat_hist_percentile(h, 999), ==, 0);
+}
+
+static void test_percentile(void)
+{
+  ci_tcp_lat_hist* h = hist_init();
+
+  /* 989 fast samples, 10 slower, one slower still. */
+  hist_add(h, 100, 989);
+  hist_add(h, 5 << SHIFT, 10);
+  hist_add(h, 20 << SHIFT, 1);
+
+  CHECK(ci_tcp_lat_hist_percentile(h, 500), ==, 1 << SHIFT);
+  CHECK(ci_tcp_lat_hist_percentile(h, 989), ==, 1 << SHIFT);
+  CHECK(ci_tcp_lat_hist_percentile(h, 990), ==, 6 << SHIFT);
+  CHECK(ci_tcp_lat_hist_percentile(h, 999), ==, 6 << SHIFT);
+  /* The top bucket's limit is beyond the largest sample. */
+  CHECK(ci_tcp_lat_hist_percentile(h, 1000), ==, 20 << SHIFT);
+}
+
+static void test_percentile_rounds_up(void)
+{
+  ci_tcp_lat_hist* h = hist_init();
+
+  /* With 3 samples, p50 wants the second one. */
+  hist_add(h, 100, 1);
+  hist_add(h, 2 << SHIFT, 1);
+  hist_add(h, 4 << SHIFT, 1);
+  CHECK(ci_tcp_lat_hist_percentile(h, 500), ==, 3 << SHIFT);
+  CHECK(ci_tcp_lat_hist_percentile(h, 1), ==, 1 << SHIFT);
+}
+
+static void test_percentile_overflow(void)
+{
+  ci_tcp_lat_hist* h = hist_init();
+
+  hist_add(h, 100, 1);
+  hist_add(h, 1ull << 40, 1);
+  CHECK(ci_tcp_lat_hist_percentile(h, 500), ==, 1 << SHIFT);
+  /* Samples in the last bucket are reported as the saturated maximum. */
+  CHECK(ci_tcp_lat_hist_percentile(h, 999), ==, 0xffffffffu);
+}
+
+int main(void)
+{
+  TEST_RUN(test_bucket);
+  TEST_RUN(test_bucket_limit);
+  TEST_RUN(test_percentile_empty);
+  TEST_RUN(test_percentile);
+  TEST_RUN(test_percentile_rounds_up);
+  TEST_RUN(test_percentile_overflow);
+  TEST_END();
+}
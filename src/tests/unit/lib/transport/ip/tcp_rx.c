@@ -69,6 +69,21 @@ ci_netif_filter_for_each_match(ci_netif* ni,
   return 0;
 }
 
+static int timewait_count;
+
+int ci_tcp_timewait_rx(ci_netif* ni, ciip_tcp_rx_pkt* rxp,
+                       ci_addr_t laddr, ci_addr_t raddr)
+{
+  CHECK(ni, ==, expect_ni);
+  CHECK(rxp->pkt, ==, expect_pkt);
+  CHECK(rxp->tcp, ==, expect_tcp);
+  /* Looked up after the established connections, before the listeners */
+  CHECK(filter_count, ==, 1);
+  ++timewait_count;
+
+  return 0;
+}
+
 int ci_netif_pkt_pass_to_kernel(ci_netif* ni, ci_ip_pkt_fmt* pkt)
 {
   CHECK(ni, ==, expect_ni);
@@ -92,6 +107,7 @@ static void test_ci_tcp_handle_rx(void)
   expect_pkt = pkt;
   expect_tcp = tcp;
   filter_count = 0;
+  timewait_count = 0;
 
   /* pre: netif must have a valid state */
   netif->state = ns;
@@ -123,6 +139,9 @@ static void test_ci_tcp_handle_rx(void)
   /* post: filter matches were attempted thrice */
   CHECK(filter_count, ==, 3);
 
+  /* post: the compact TIME_WAIT table was consulted once */
+  CHECK(timewait_count, ==, 1);
+
   STATE_FREE(netif);
   STATE_FREE(ns);
   STATE_FREE(ps);
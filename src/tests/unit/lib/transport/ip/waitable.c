@@ -0,0 +1,170 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-2-Clause */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+
+/* Functions under test */
+#include <ci/internal/ip.h>
+
+/* Test infrastructure */
+#include "unit_test.h"
+
+/* EF_SPIN_ADAPT's record of waits and choice of spin time */
+
+/* Dependencies */
+void ci_log_dump_fn(void* unused, const char* fmt, ...)
+{
+}
+
+#define KHZ        1000000  /* 1000 cycles per microsecond */
+#define US(us)     ((ci_uint64) (us) * 1000)
+#define LAST       (CI_SPIN_ADAPT_BUCKETS - 1)
+
+static ci_spin_adapt sa;
+
+static void init(void)
+{
+  memset(&sa, 0, sizeof(sa));
+  sa.budget_usec = CI_SPIN_ADAPT_NO_BUDGET;
+}
+
+static void record(unsigned percentile, ci_uint64 wait, int n)
+{
+  while( n-- )
+    ci_spin_adapt_record(&sa, KHZ, percentile, wait, 1);
+}
+
+static void test_bucket(void)
+{
+  init();
+
+  record(90, 0, 1);
+  record(90, US(1) - 1, 1);
+  CHECK(sa.count[0], ==, 2);
+  /* Bucket i holds waits below 2^i us. */
+  record(90, US(1), 1);
+  CHECK(sa.count[1], ==, 1);
+  record(90, US(2), 1);
+  record(90, US(4) - 1, 1);
+  CHECK(sa.count[2], ==, 2);
+  record(90, US(1 << (LAST - 1)), 1);
+  CHECK(sa.count[LAST], ==, 1);
+  /* Everything longer goes in the last bucket, however long. */
+  record(90, US(1000000), 1);
+  record(90, ~0ull, 1);
+  CHECK(sa.count[LAST], ==, 3);
+}
+
+static void test_warm_up(void)
+{
+  init();
+
+  /* Spin in full until there is enough to go on. */
+  record(90, US(3), 15);
+  CHECK(sa.budget_usec, ==, CI_SPIN_ADAPT_NO_BUDGET);
+  record(90, US(3), 1);
+  CHECK(sa.budget_usec, ==, 4);
+}
+
+static void test_percentile(void)
+{
+  init();
+
+  /* 15 waits under 4us and one of 100us. */
+  record(90, US(3), 15);
+  record(90, US(100), 1);
+  CHECK(sa.budget_usec, ==, 4);
+
+  /* The percentile is rounded up to whole waits: 99% of 17 is all 17. */
+  record(99, US(100), 1);
+  CHECK(sa.budget_usec, ==, 128);
+  record(50, US(3), 1);
+  CHECK(sa.budget_usec, ==, 4);
+
+  /* Waits too long to learn from mean spinning for as long as allowed. */
+  record(100, US(1000000), 1);
+  CHECK(sa.budget_usec, ==, CI_SPIN_ADAPT_NO_BUDGET);
+}
+
+static void test_decay(void)
+{
+  int i, total;
+
+  init();
+  record(90, 0, 1000);
+  record(90, US(3), 23);
+  CHECK(sa.count[0], ==, 1000);
+
+  /* Counts are halved on reaching 1024. */
+  record(90, US(3), 1);
+  CHECK(sa.count[0], ==, 500);
+  CHECK(sa.count[2], ==, 12);
+  for( i = total = 0; i < CI_SPIN_ADAPT_BUCKETS; ++i )
+    total += sa.count[i];
+  CHECK(total, ==, 512);
+
+  /* So newer waits come to outweigh the old. */
+  record(90, US(3), 1000);
+  CHECK(sa.budget_usec, ==, 4);
+}
+
+static void test_ewma(void)
+{
+  init();
+
+  ci_spin_adapt_record(&sa, KHZ, 90, US(8), 1);
+  CHECK(sa.ewma_ns, ==, 1000);
+  ci_spin_adapt_record(&sa, KHZ, 90, US(8), 0);
+  CHECK(sa.ewma_ns, ==, 1875);
+  ci_spin_adapt_record(&sa, KHZ, 90, 0, 0);
+  CHECK(sa.ewma_ns, ==, 1641);
+  CHECK(sa.hits, ==, 1);
+  CHECK(sa.misses, ==, 2);
+}
+
+static void test_budget(void)
+{
+  init();
+
+  CHECK(ci_spin_adapt_budget(&sa, KHZ, US(50)), ==, US(50));
+  sa.budget_usec = 4;
+  CHECK(ci_spin_adapt_budget(&sa, KHZ, US(50)), ==, US(4));
+  /* EF_SPIN_USEC is still the limit. */
+  CHECK(ci_spin_adapt_budget(&sa, KHZ, US(2)), ==, US(2));
+}
+
+static void test_waitable(void)
+{
+  static ci_netif_state state;
+  static citp_waitable w;
+  ci_netif ni;
+
+  memset(&w, 0, sizeof(w));
+  ni.state = &state;
+  state.iptimer_state.khz = KHZ;
+
+  /* Off, the full spin is used whatever has been seen. */
+  w.spin_adapt.budget_usec = 4;
+  state.opts.spin_adapt = 0;
+  CHECK(citp_waitable_spin_budget(&ni, &w, US(50)), ==, US(50));
+  state.opts.spin_adapt = 90;
+  CHECK(citp_waitable_spin_budget(&ni, &w, US(50)), ==, US(4));
+
+  citp_waitable_spin_adapt_record(&ni, &w, US(3), 1);
+  citp_waitable_spin_adapt_record(&ni, &w, US(3), 0);
+  CHECK(w.spin_adapt.count[2], ==, 2);
+  CHECK(w.spin_adapt.hits, ==, 1);
+  CHECK(w.spin_adapt.misses, ==, 1);
+  CHECK(state.stats.spin_adapt_hits, ==, 1);
+  CHECK(state.stats.spin_adapt_misses, ==, 1);
+}
+
+int main(void)
+{
+  TEST_RUN(test_bucket);
+  TEST_RUN(test_warm_up);
+  TEST_RUN(test_percentile);
+  TEST_RUN(test_decay);
+  TEST_RUN(test_ewma);
+  TEST_RUN(test_budget);
+  TEST_RUN(test_waitable);
+  TEST_END();
+}
@@ -21,10 +21,15 @@ UNIT_TEST_WRAPPER ?=
 # There are no restrictions on the path name, but it is helpful if it matches
 # the header under test.
 ALL_UNIT_TESTS := \
+  header/ci/internal/ip_send_nolock \
   header/ci/internal/ip_timestamp \
+  header/onload/extensions_timestamping \
   header/transport/unix/ul_epoll \
+  lib/transport/ip/netif_capture \
   lib/transport/ip/netif_init \
+  lib/transport/ip/tcp_lat_hist \
   lib/transport/ip/tcp_rx \
+  lib/transport/ip/waitable \
   lib/ciul/checksum \
   lib/ciul/efct_vi \
   lib/ciul/efct_ubufs \
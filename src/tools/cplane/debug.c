@@ -73,6 +73,9 @@ void cp_mibs_verify_identical(struct cp_session* s, bool llap_only)
       ci_assert_equal(a->eps[j].port, b->eps[j].port);
     }
   }
+  for( i = 0; i < s->mib[0].dim->svc_maglev_max; i++ )
+    ci_assert(!memcmp(&s->mib[0].svc_maglev[i], &s->mib[1].svc_maglev[i],
+                      sizeof(struct cp_svc_maglev_table)));
   for( i = 0; i < s->mib[0].dim->svc_ep_max; i++ ) {
     struct cp_svc_ep_dllist* a = &s->mib[0].svc_ep_table[i];
     struct cp_svc_ep_dllist* b = &s->mib[1].svc_ep_table[i];
@@ -26,8 +26,10 @@ CP_UNIT_EXTERN void cp_nl_dump_all_done(struct cp_session* s)
 {
   /* We have to refresh fwd cache because we do not dump the route and
    * rule tables. */
-  if( ! (s->flags & CP_SESSION_FLAG_FWD_REFRESHED) )
+  if( ! (s->flags & CP_SESSION_FLAG_FWD_REFRESHED) ) {
+    s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED;
     cp_fwd_cache_refresh(s);
+  }
   s->flags &=~ CP_SESSION_FLAG_FWD_REFRESHED;
 }
 
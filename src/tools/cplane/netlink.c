@@ -1352,6 +1352,17 @@ neigh_handle(struct cp_session* s, uint16_t nlmsg_type,
 
       mr->state = ndmsg->ndm_state;
 
+      if( mr->flags & CP_MAC_ROW_FLAG_REFRESHING ) {
+        /* We've asked for this entry to be re-resolved; account for the
+         * outcome.  DELAY, PROBE, INCOMPLETE are in-progress states. */
+        if( ndmsg->ndm_state & (NUD_REACHABLE | NUD_PERMANENT) )
+          s->stats.neigh_refresh.confirmed++;
+        else if( ndmsg->ndm_state & NUD_FAILED )
+          s->stats.neigh_refresh.failed++;
+        if( ! (ndmsg->ndm_state & (NUD_DELAY | NUD_PROBE | NUD_INCOMPLETE)) )
+          mr->flags &=~ CP_MAC_ROW_FLAG_REFRESHING;
+      }
+
       if( !(old_state & NUD_VALID) != !(ndmsg->ndm_state & NUD_VALID) ||
           memcmp(mr->mac, mac, sizeof(mac)) != 0 ||
           old_flag_failed != (mr->flags & CP_MAC_ROW_FLAG_FAILED) ) {
@@ -1548,11 +1559,13 @@ cp_nl_net_handle_msg(struct cp_session* s, struct nlmsghdr* nlhdr,
         cp_nl_route_table_update(s, nlhdr, rtm,
                                  NLMSG_PAYLOAD(nlhdr, sizeof(struct rtmsg)));
 
-        /* We need to refresh fwd cache if it is a new route.
-         * We always refresh fwd cache during full dump.
-         * So we do not check if it is a new route or re-dump of existing
-         * route; let's refresh in any case. */
-        s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED;
+        /* We always refresh the whole fwd cache during full dump, so we do
+         * not check if it is a new route or re-dump of existing route.
+         * Outside of a dump, cp_nl_route_table_update() has asked for the
+         * entries covered by the route to be refreshed if it has really
+         * changed. */
+        if( s->state != CP_DUMP_IDLE )
+          s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED;
         break;
       bad_newroute:
         ci_log("ERROR: unknown address family %d or unexpected source "
@@ -1565,8 +1578,9 @@ cp_nl_net_handle_msg(struct cp_session* s, struct nlmsghdr* nlhdr,
         /* Maintain our mirror of the route tables */
         cp_nl_route_table_update(s, nlhdr, NLMSG_DATA(nlhdr),
                                  NLMSG_PAYLOAD(nlhdr, sizeof(struct rtmsg)));
-        s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED |
-                    CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED;
+        if( s->state != CP_DUMP_IDLE )
+          s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED |
+                      CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED;
         break;
 
       case RTM_NEWADDR:
@@ -1591,12 +1605,194 @@ cp_nl_net_handle_msg(struct cp_session* s, struct nlmsghdr* nlhdr,
 }
 
 
+/* Find the neighbour described by a RTM_NEWNEIGH or RTM_DELNEIGH message. */
+static void
+nl_neigh_key(struct nlmsghdr* nlhdr, int* af, int* ifindex, ci_addr_t* addr)
+{
+  struct ndmsg* ndmsg = NLMSG_DATA(nlhdr);
+  size_t bytes = NLMSG_PAYLOAD(nlhdr, sizeof(struct ndmsg));
+
+  *af = ndmsg->ndm_family;
+  *ifindex = ndmsg->ndm_ifindex;
+  *addr = addr_any;
+  RTA_LOOP(ndmsg, attr, bytes) {
+    if( (attr->rta_type & NLA_TYPE_MASK) == NDA_DST ) {
+      if( *af == AF_INET6 )
+        memcpy(addr->ip6, (uint8_t*)RTA_DATA(attr), sizeof(addr->ip6));
+      else
+        *addr = CI_ADDR_FROM_IP4(*((uint32_t *)RTA_DATA(attr)));
+    }
+  }
+}
+
+/* Each neighbour notification carries the full state of the neighbour, so
+ * if a batch has several of them for the same neighbour, only the last one
+ * matters.  Neighbour storms are typically made of such repeated updates,
+ * and each of them costs a MAC table update and a walk over the fwd table,
+ * so we turn the superseded ones into NLMSG_NOOP.
+ *
+ * The exception is NUD_FAILED: neigh_handle() looks at the previous state
+ * to interpret it, so the message preceding a NUD_FAILED one is kept. */
+static void
+nl_batch_coalesce_neigh(struct cp_session* s, struct mmsghdr* msgs, int n)
+{
+  struct {
+    int af;
+    int ifindex;
+    ci_addr_t addr;
+    bool keep_prev;
+  } seen[CP_NL_BATCH_MAX * 4];
+  int n_seen = 0;
+  int i, j;
+
+  /* Go backwards, so that the first message for any neighbour we see is the
+   * one to keep. */
+  for( i = n - 1; i >= 0; i-- ) {
+    struct nlmsghdr* nlhdr;
+    ssize_t bytes = msgs[i].msg_len;
+
+    for( nlhdr = msgs[i].msg_hdr.msg_iov->iov_base; NLMSG_OK(nlhdr, bytes);
+         nlhdr = NLMSG_NEXT(nlhdr, bytes) ) {
+      int af, ifindex;
+      ci_addr_t addr;
+      bool failed;
+
+      if( nlhdr->nlmsg_type != RTM_NEWNEIGH &&
+          nlhdr->nlmsg_type != RTM_DELNEIGH )
+        continue;
+      if( nlhdr->nlmsg_len < NLMSG_LENGTH(sizeof(struct ndmsg)) )
+        continue;
+      nl_neigh_key(nlhdr, &af, &ifindex, &addr);
+      failed = nlhdr->nlmsg_type == RTM_NEWNEIGH &&
+               ((struct ndmsg*)NLMSG_DATA(nlhdr))->ndm_state == NUD_FAILED;
+
+      for( j = 0; j < n_seen; j++ ) {
+        if( seen[j].af == af && seen[j].ifindex == ifindex &&
+            CI_IPX_ADDR_EQ(seen[j].addr, addr) )
+          break;
+      }
+      if( j < n_seen && ! seen[j].keep_prev ) {
+        nlhdr->nlmsg_type = NLMSG_NOOP;
+        ++s->stats.nl_batch.coalesced;
+      }
+      else if( j < n_seen ) {
+        seen[j].keep_prev = failed;
+      }
+      else if( n_seen < sizeof(seen) / sizeof(seen[0]) ) {
+        seen[n_seen].af = af;
+        seen[n_seen].ifindex = ifindex;
+        seen[n_seen].addr = addr;
+        seen[n_seen].keep_prev = failed;
+        n_seen++;
+      }
+    }
+  }
+}
+
+/* Handle a batch of datagrams read from the netlink socket, i.e.
+ * everything that the kernel has had to tell us since the previous batch. */
+CP_UNIT_EXTERN void
+cp_nl_net_handle_batch(struct cp_session* s, struct mmsghdr* msgs, int n)
+{
+  int i;
+
+  ++s->stats.nl_batch.batches;
+  s->stats.nl_batch.datagrams += n;
+  if( n > s->stats.nl_batch.hiwat )
+    s->stats.nl_batch.hiwat = n;
+
+  nl_batch_coalesce_neigh(s, msgs, n);
+  for( i = 0; i < n; i++ )
+    cp_nl_net_handle_msg(s, msgs[i].msg_hdr.msg_iov->iov_base,
+                         msgs[i].msg_len);
+}
+
+/* Read a batch of datagrams from the netlink socket.  Returns the number of
+ * datagrams read, 0 if the first pending datagram is too large for the
+ * batch buffers, or -1 with errno set. */
+static int nl_net_recv_batch(struct cp_session* s)
+{
+  struct cp_nl_batch* batch = s->nl_batch;
+  char small_buf[1];
+  ssize_t bytes;
+  int i, n;
+
+  if( batch == NULL ) {
+    batch = s->nl_batch = malloc(sizeof(*batch));
+    if( batch == NULL )
+      return 0;
+    for( i = 0; i < CP_NL_BATCH_MAX; i++ ) {
+      batch->iov[i].iov_base = batch->buf[i];
+      batch->iov[i].iov_len = CP_NL_BATCH_BUF_SIZE;
+    }
+  }
+
+  /* FIONREAD does not work for netlink sockets, so we use MSG_PEEK. */
+  bytes = recv(s->sock_net, &small_buf, sizeof(small_buf),
+               MSG_PEEK | MSG_TRUNC);
+  if( bytes <= 0 )
+    return -1;
+  if( bytes > CP_NL_BATCH_BUF_SIZE )
+    return 0;
+
+  memset(batch->msgs, 0, sizeof(batch->msgs));
+  for( i = 0; i < CP_NL_BATCH_MAX; i++ ) {
+    batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+    batch->msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  n = recvmmsg(s->sock_net, batch->msgs, CP_NL_BATCH_MAX, MSG_DONTWAIT,
+               NULL);
+  if( n <= 0 )
+    return -1;
+
+  for( i = 0; i < n; i++ ) {
+    if( batch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC ) {
+      /* The tail of this datagram is lost.  NLMSG_OK() will make us ignore
+       * the incomplete message, and the dump will restore whatever it
+       * was about. */
+      ++s->stats.nl_batch.truncated;
+      batch->msgs[i].msg_len = CI_MIN(batch->msgs[i].msg_len,
+                                      CP_NL_BATCH_BUF_SIZE);
+      CI_RLLOG(10, "Netlink datagram truncated to %d bytes; re-dumping",
+               CP_NL_BATCH_BUF_SIZE);
+      s->flags |= CP_SESSION_NL_RESYNC_NEEDED;
+    }
+  }
+  return n;
+}
+
 void nl_net_handle(struct cp_session* s, struct cp_epoll_state* state)
 {
   ssize_t bytes;
+  int n;
+
+  for( ; ; ) {
+    /* Dump replies are read one by one: they come in response to our own
+     * requests, so there is no storm to deal with, and they may be larger
+     * than the batch buffers. */
+    if( s->state == CP_DUMP_IDLE &&
+        (n = nl_net_recv_batch(s)) != 0 ) {
+      if( n < 0 )
+        break;
+      cp_nl_net_handle_batch(s, s->nl_batch->msgs, n);
+    }
+    else {
+      bytes = cp_sock_recv(s, s->sock_net);
+      if( bytes <= 0 )
+        break;
+      cp_nl_net_handle_msg(s, s->buf, bytes);
+    }
+  }
+
+  /* The kernel has dropped some notifications: our state will be restored
+   * by the next dump. */
+  if( errno == ENOBUFS )
+    ++s->stats.nl_batch.overrun;
 
-  while ( (bytes = cp_sock_recv(s, s->sock_net)) > 0 )
-    cp_nl_net_handle_msg(s, s->buf, bytes);
+  if( s->flags & CP_SESSION_NL_RESYNC_NEEDED && s->state == CP_DUMP_IDLE ) {
+    s->flags &=~ CP_SESSION_NL_RESYNC_NEEDED;
+    cp_dump_init(s);
+  }
 }
 
 
@@ -256,16 +256,21 @@ typedef struct {
  *
  * Think of it as a sort of heuristic. */
 #define CP_MAC_ROW_FLAG_REFERENCED 2
+/* We have asked the kernel to re-resolve this entry on behalf of an
+ * actively-used fwd entry (see --neigh-refresh), and are waiting for the
+ * outcome. */
+#define CP_MAC_ROW_FLAG_REFRESHING 4
 
     /* frc when this MAC entry must be re-confirmed if possible;
      * valid in NUD_REACHABLE state only. */
     ci_uint64     frc_reconfirm;
 } cicp_mac_row_t;
 
-#define CP_MAC_ROW_FLAGS_FMT "%s%s"
+#define CP_MAC_ROW_FLAGS_FMT "%s%s%s"
 #define CP_MAC_ROW_FLAGS_ARGS(flags) \
   ((flags) & CP_MAC_ROW_FLAG_FAILED) ? "FAILED " : "", \
-  ((flags) & CP_MAC_ROW_FLAG_REFERENCED) ? "referenced " : ""
+  ((flags) & CP_MAC_ROW_FLAG_REFERENCED) ? "referenced " : "", \
+  ((flags) & CP_MAC_ROW_FLAG_REFRESHING) ? "refreshing " : ""
 
 #ifndef NUD_VALID
 /* Linux defines this in net/neighbour.h for in-kernel code, but we need it
@@ -354,6 +359,27 @@ struct cp_stats {
 };
 
 
+/* Netlink notifications are read with recvmmsg() in batches of up to
+ * CP_NL_BATCH_MAX datagrams.  The kernel does not build datagrams larger
+ * than 32KiB unless a single message needs more, so the larger ones are
+ * read one by one with cp_sock_recv(). */
+#define CP_NL_BATCH_MAX      16
+#define CP_NL_BATCH_BUF_SIZE 32768
+struct cp_nl_batch {
+  struct mmsghdr msgs[CP_NL_BATCH_MAX];
+  struct iovec iov[CP_NL_BATCH_MAX];
+  char buf[CP_NL_BATCH_MAX][CP_NL_BATCH_BUF_SIZE];
+};
+
+/* Per-backend state used while populating a service's Maglev table. */
+struct cp_svc_maglev_perm {
+  ci_uint32 offset;
+  ci_uint32 skip;
+  ci_uint32 next;
+  ci_uint32 pos;
+};
+
+
 /*
  *** The main server structure ***
  */
@@ -394,6 +420,9 @@ struct cp_session {
   /* Buffer to read netlink messages */
   size_t buf_size;
   void* buf;
+  /* Buffers to read netlink notifications in batches; allocated on first
+   * use. */
+  struct cp_nl_batch* nl_batch;
 
   /* Netlink socket name */
   struct sockaddr_nl sock_net_name;
@@ -433,6 +462,9 @@ struct cp_session {
 /* Debug mode: do not listen for netlink updates, rely on periodic table
  * dump. */
 #define CP_SESSION_NO_LISTEN              0x40
+/* Some netlink notifications have been lost; dump everything again as soon
+ * as we are idle. */
+#define CP_SESSION_NL_RESYNC_NEEDED       0x80
 /* At next refresh of the fwd table, remove any entries whose prefix lengths do
  * not match those implied by the route tables. */
 #define CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED 0x100
@@ -443,6 +475,9 @@ struct cp_session {
 #define CP_SESSION_USER_DUMP_REFRESH     0x400
 /* User asked for lightweight sync with OS */
 #define CP_SESSION_USER_OS_SYNC          0x800
+/* Need to re-resolve the fwd entries covered by the prefixes in
+ * fwd_refresh_pfx[].  Subsumed by CP_SESSION_FLAG_FWD_REFRESH_NEEDED. */
+#define CP_SESSION_FLAG_FWD_REFRESH_PARTIAL 0x1000
 /* disable IPv6 support */
 #define CP_SESSION_NO_IPV6               0x2000
 /* Kernel compiled without CONFIG_IPV6_SUBTREES - no source address
@@ -463,6 +498,8 @@ struct cp_session {
 #define CP_SESSION_LADDR_USE_PREF_SRC  0x100000
 /* Track XDP programs and tell Onload about them */
 #define CP_SESSION_TRACK_XDP           0x200000
+/* Re-resolve neighbours of actively-used fwd entries before they expire */
+#define CP_SESSION_NEIGH_REFRESH       0x400000
 
   /* Netlink is dumping a table: */
   enum cp_dump_state state;
@@ -519,8 +556,22 @@ struct cp_session {
    */
   struct cp_fwd_state __fwd_state[CP_MAX_INSTANCES];
 
+  /* Destination prefixes of the routes changed since the last fwd cache
+   * refresh; valid when CP_SESSION_FLAG_FWD_REFRESH_PARTIAL is set.  If
+   * the array overflows we fall back to refreshing everything. */
+#define CP_FWD_REFRESH_PFX_MAX 16
+  struct {
+    int af;
+    struct cp_ip_with_prefix dst;
+  } fwd_refresh_pfx[CP_FWD_REFRESH_PFX_MAX];
+  int fwd_refresh_pfx_n;
+
   /* Which service backend arrays are in use? */
   cp_row_mask_t service_used;
+  /* Which service Maglev tables are in use? */
+  cp_row_mask_t svc_maglev_used;
+  /* Scratch space for building Maglev tables, CP_SVC_MAGLEV_SIZE entries */
+  struct cp_svc_maglev_perm* svc_maglev_perm;
 
   /* Private per-llap-entry data */
   struct cp_llap_priv* llap_priv;
@@ -765,6 +816,8 @@ cp_get_fwd_data_scratch(struct cp_fwd_row* r)
                               void* mib_mem);
   void cp_nl_net_handle_msg(struct cp_session*, struct nlmsghdr*,
                             ssize_t bytes);
+  void cp_nl_net_handle_batch(struct cp_session*, struct mmsghdr* msgs,
+                              int n);
   void init_ipp_list(struct cp_ip_prefix_list*, cicp_rowid_t size);
   ci_uint64 cp_frc64_get(void);
   void cp_nl_dump_all_done(struct cp_session*);
@@ -867,6 +920,8 @@ cp_nl_route_table_update(struct cp_session* s, struct nlmsghdr* nlhdr,
 void cp_fwd_req_do(struct cp_session* s, int req_id,
                    struct cp_fwd_key* key);
 void cp_fwd_cache_refresh(struct cp_session*);
+void cp_fwd_cache_refresh_prefix(struct cp_session*, int af,
+                                 const struct cp_ip_with_prefix* dst);
 void cp_fwd_llap_update(struct cp_session* s, struct cp_mibs* mib,
                         cicp_rowid_t llap_id,
                         cicp_hwport_mask_t old_rx_hwports);
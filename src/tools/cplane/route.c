@@ -605,9 +605,10 @@ cp_nl_route_table_update(struct cp_session* s, struct nlmsghdr* nlhdr,
     changed = cp_route_add(s, table_id, &route, af);
 
  out:
-  if( changed )
-    s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED |
-                CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED;
+  if( changed ) {
+    cp_fwd_cache_refresh_prefix(s, af, &route.dst);
+    s->flags |= CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED;
+  }
 }
 
 static struct cp_route *
@@ -1697,18 +1698,39 @@ fwd_prefix_update(ci_ipx_pfx_t* mask, int pfx)
   bw_or_192((uint64_t*)mask->ip6, x);
 }
 
+/* Could the route lookup for this fwd entry be affected by a change to
+ * the routes for any of the prefixes queued by
+ * cp_fwd_cache_refresh_prefix()?  That is the case iff the entry's
+ * destination prefix and the changed prefix overlap. */
+static bool
+fwd_row_needs_refresh(struct cp_session* s, struct cp_fwd_row* fwd)
+{
+  int af = fwd_key2af(&fwd->key);
+  int row_pfx = fwd->key_ext.dst_prefix;
+  int i;
+
+  if( af == AF_INET )
+    row_pfx -= 96;
+
+  for( i = 0; i < s->fwd_refresh_pfx_n; i++ ) {
+    if( s->fwd_refresh_pfx[i].af != af )
+      continue;
+    if( cp_ipx_ippl_pfx_match(af, fwd->key.dst,
+                              s->fwd_refresh_pfx[i].dst.addr,
+                              CI_MIN(row_pfx,
+                                     s->fwd_refresh_pfx[i].dst.prefix)) )
+      return true;
+  }
+  return false;
+}
+
 static void
-fwd_cache_refresh(struct cp_session* s, struct cp_fwd_state* fwd_state)
+fwd_cache_refresh(struct cp_session* s, struct cp_fwd_state* fwd_state,
+                  bool full, bool prefix_check)
 {
   struct cp_fwd_table* fwd_table = &fwd_state->fwd_table;
   cicp_mac_rowid_t id = -1;
 
-  s->flags &=~ CP_SESSION_FLAG_FWD_REFRESH_NEEDED;
-  /* We should refresh all the fwd cache at the end of dump process.  But
-   * there is no need to do it more than once during the dump. */
-  if( s->state != CP_DUMP_IDLE )
-    s->flags |= CP_SESSION_FLAG_FWD_REFRESHED;
-
   /* While we're iterating over the whole fwd table, we take the opportunity to
    * update the masks of in-use prefixes. */
   ci_ipx_pfx_t src_prefixes = {};
@@ -1728,20 +1750,22 @@ fwd_cache_refresh(struct cp_session* s, struct cp_fwd_state* fwd_state)
     fwd_prefix_update(&src_prefixes, fwd->key_ext.src_prefix);
     fwd_prefix_update(&dst_prefixes, fwd->key_ext.dst_prefix);
 
-    fwd_resolve(s, fwd_key2af(&fwd->key), &fwd->key, id);
+    /* Entries not covered by a changed route keep their current data and
+     * version, so the clients using them need not notice anything. */
+    if( full || fwd_row_needs_refresh(s, fwd) ) {
+      fwd_resolve(s, fwd_key2af(&fwd->key), &fwd->key, id);
+      ++s->stats.fwd.refresh_resolved;
+    }
 
     /* If there has been a change in the routing tables, it's possible that
      * this entry now has incorrect prefix lengths, meaning that we might end
      * up inserting a conflicting entry.  Delete this entry to avoid that
      * problem.
      */
-    if( s->flags & CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED &&
-        ! fwd_row_prefixes_correct(s, fwd) )
+    if( prefix_check && ! fwd_row_prefixes_correct(s, fwd) )
       fwd_row_del(s, fwd_state, &fwd->key, id);
   }
 
-  s->flags &=~ CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED;
-
 #ifndef NDEBUG
   /* We might be about to remove some prefixes from the mask, but we don't
    * expect to be adding any. */
@@ -1759,11 +1783,55 @@ fwd_cache_refresh(struct cp_session* s, struct cp_fwd_state* fwd_state)
 }
 
 
+/* Re-resolve the fwd entries.  Everything is refreshed unless the only
+ * reason for refresh is a set of route changes queued by
+ * cp_fwd_cache_refresh_prefix(), in which case only the entries overlapping
+ * the changed prefixes are re-resolved. */
 void cp_fwd_cache_refresh(struct cp_session* s)
 {
   struct cp_fwd_state* fwd_state = NULL;
+  bool full = (s->flags & CP_SESSION_FLAG_FWD_REFRESH_NEEDED) ||
+              ! (s->flags & CP_SESSION_FLAG_FWD_REFRESH_PARTIAL);
+  bool prefix_check = s->flags & CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED;
+
+  s->flags &=~ (CP_SESSION_FLAG_FWD_REFRESH_NEEDED |
+                CP_SESSION_FLAG_FWD_REFRESH_PARTIAL |
+                CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED);
+  /* We should refresh all the fwd cache at the end of dump process.  But
+   * there is no need to do it more than once during the dump. */
+  if( s->state != CP_DUMP_IDLE )
+    s->flags |= CP_SESSION_FLAG_FWD_REFRESHED;
+
+  if( ! full )
+    ++s->stats.fwd.refresh_partial;
+
   while( (fwd_state = cp_fwd_state_iterate_mapped(s, fwd_state)) != NULL )
-    fwd_cache_refresh(s, fwd_state);
+    fwd_cache_refresh(s, fwd_state, full, prefix_check);
+
+  s->fwd_refresh_pfx_n = 0;
+}
+
+
+/* Note that the routes for the given destination prefix have changed.
+ * Outside of a dump we remember the prefix so that the next refresh can be
+ * limited to the fwd entries it covers; otherwise, or if too many prefixes
+ * are pending, we ask for the full refresh. */
+void cp_fwd_cache_refresh_prefix(struct cp_session* s, int af,
+                                 const struct cp_ip_with_prefix* dst)
+{
+  if( s->flags & CP_SESSION_FLAG_FWD_REFRESH_NEEDED )
+    return;
+
+  if( s->state != CP_DUMP_IDLE ||
+      s->fwd_refresh_pfx_n == CP_FWD_REFRESH_PFX_MAX ) {
+    s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED;
+    return;
+  }
+
+  s->fwd_refresh_pfx[s->fwd_refresh_pfx_n].af = af;
+  s->fwd_refresh_pfx[s->fwd_refresh_pfx_n].dst = *dst;
+  s->fwd_refresh_pfx_n++;
+  s->flags |= CP_SESSION_FLAG_FWD_REFRESH_PARTIAL;
 }
 
 
@@ -2548,6 +2616,46 @@ static void ci_frc_update2(uint64_t* p_a, uint64_t* p_b)
     *p_b = *p_a;
 }
 
+/* With --neigh-refresh, ask the kernel to re-resolve the neighbour of an
+ * actively-used fwd entry before Linux garbage-collects it.  Onload traffic
+ * bypasses the kernel, so Linux does not see the neighbour in use: it stays
+ * STALE and eventually disappears, sending Onload down the ARP slow path.
+ */
+static void
+fwd_row_neigh_refresh(struct cp_session* s, struct cp_fwd_state* fwd_state,
+                      cicp_mac_rowid_t id, struct cp_fwd_row* fwd)
+{
+  cicp_mac_row_t* mac = cp_get_mac_p(s, fwd_key2af(&fwd->key));
+  cicp_mac_rowid_t macid = fwd_state->priv_rows[id].macid;
+  struct cp_fwd_data* data;
+
+  if( (fwd->flags & (CICP_FWD_FLAG_STALE | CICP_FWD_FLAG_FIXED_MAC |
+                     CICP_FWD_FLAG_ERROR)) ||
+      ! (fwd->flags & CICP_FWD_FLAG_DATA_VALID) )
+    return;
+  data = cp_get_fwd_data_current(fwd);
+  if( data->base.ifindex == CI_IFID_BAD ||
+      data->base.ifindex == CI_IFID_LOOP || data->hwports == 0 )
+    return;
+
+  if( ! CICP_MAC_ROWID_IS_VALID(macid) ) {
+    /* The neighbour has gone away under our feet.  Failed entries are
+     * handled by fwd_mac_update(). */
+    if( ! (data->flags & CICP_FWD_DATA_FLAG_ARP_MASK) ) {
+      s->stats.neigh_refresh.missing++;
+      arp_request_update(s, fwd_state, id);
+    }
+  }
+  else if( mac[macid].state == NUD_STALE &&
+           ! (mac[macid].flags & CP_MAC_ROW_FLAG_REFRESHING) ) {
+    /* Do it once per neighbour; the flag is dropped by neigh_handle() when
+     * the kernel tells us the outcome. */
+    mac[macid].flags |= CP_MAC_ROW_FLAG_REFRESHING;
+    s->stats.neigh_refresh.stale++;
+    arp_request_update(s, fwd_state, id);
+  }
+}
+
 /* Set CICP_FWD_FLAG_STALE when necessary.
  * Refresh PMTU.
  */
@@ -2593,6 +2701,9 @@ fwd_row_refresh(struct cp_session* s, struct cp_fwd_state* fwd_state,
                    CICP_FWD_RW_FLAG_ARP_NEED_REFRESH);
   }
 
+  if( s->flags & CP_SESSION_NEIGH_REFRESH )
+    fwd_row_neigh_refresh(s, fwd_state, id, fwd);
+
   if( fwd->flags & CICP_FWD_FLAG_MTU_EXPIRES )
     fwd_resolve(s, af, &fwd->key, id);
 }
@@ -2795,8 +2906,13 @@ void cp_newrule_handle(struct cp_session* s, uint16_t nlmsg_type,
   if( nlmsg_type == RTM_NEWRULE && src.prefix > 0 )
     changed |= cp_ippl_add(cp_get_rule_src_p(s, af), &src, NULL);
   if( changed ) {
-    s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED |
-                CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED;
+    /* A new route destination can only change the prefix lengths of the
+     * fwd entries it overlaps, but a new rule may affect anything. */
+    if( nlmsg_type == RTM_NEWROUTE )
+      cp_fwd_cache_refresh_prefix(s, af, &dst);
+    else
+      s->flags |= CP_SESSION_FLAG_FWD_REFRESH_NEEDED;
+    s->flags |= CP_SESSION_FLAG_FWD_PREFIX_CHECK_NEEDED;
   }
 }
 
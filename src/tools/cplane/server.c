@@ -70,6 +70,7 @@ static int /*bool*/ ci_cfg_ipv6_no_source = false;
 static uint64_t cfg_affinity = -1;
 static int /*bool*/ ci_cfg_verify_routes = 0;
 static int /*bool*/ cfg_track_xdp = false;
+static int /*bool*/ cfg_neigh_refresh = false;
 
 static int cfg_uid = 0;
 static int cfg_gid = 0;
@@ -84,6 +85,7 @@ static int cfg_llap_max = 32;
 static int cfg_ipif_max = CI_CFG_MAX_LOCAL_IPADDRS;
 static int cfg_svc_arrays_max = 0;
 static int cfg_svc_ep_max = 0;
+static int cfg_svc_maglev_max = 64;
 static int cfg_bond_max = 64;
 static int cfg_mac_max = 1024;
 static int cfg_fwd_max = 1024;
@@ -155,6 +157,10 @@ static ci_cfg_desc cfg_opts[] = {
   { 0, "service-endpoints-max", CI_CFG_UINT, &cfg_svc_ep_max,
     "maximum number of k8s service endpoints (frontends + backends) "
     "(will be rounded up to a power of 2)" },
+  { 0, "service-maglev-max", CI_CFG_UINT, &cfg_svc_maglev_max,
+    "maximum number of k8s services with more than one backend to give a "
+    "Maglev consistent-hash table; other services pick backends by plain "
+    "modulo hashing" },
   { 'b', "bond-max", CI_CFG_UINT, &cfg_bond_max,
     "maximum number of bond/team interfaces and their ports" },
   { 'm', "mac-max", CI_CFG_UINT, &cfg_mac_max,
@@ -181,6 +187,9 @@ static ci_cfg_desc cfg_opts[] = {
     "Track XDP programs linked to network interfaces.  Such tracking "
     "is needed for EF_XDP_MODE=compatible, and prevents dropping "
     "CAP_SYS_ADMIN capability of the server." },
+  { 0, CPLANE_SERVER_NEIGH_REFRESH, CI_CFG_FLAG, &cfg_neigh_refresh,
+    "Ask the kernel to re-resolve neighbours of actively-used routes "
+    "before they expire, keeping Onload sends off the ARP slow path." },
 };
 #define N_CFG_OPTS (sizeof(cfg_opts) / sizeof(cfg_opts[0]))
 
@@ -343,11 +352,12 @@ cp_session_init_memory(struct cp_session* s, struct cp_tables_dim* m,
   s->mac_used = cp_row_mask_alloc(s->mac_mask + 1);
   s->ip6_mac_used = cp_row_mask_alloc(s->mac_mask + 1);
   s->service_used = cp_row_mask_alloc(m->svc_arrays_max);
+  s->svc_maglev_used = cp_row_mask_alloc(m->svc_maglev_max);
 
   /* Any allocations that succeed here will be leaked if others fail, but the
    * caller will exit on failure so this is fine */
   if( s->seen == NULL || s->mac_used == NULL || s->ip6_mac_used == NULL ||
-      s->service_used == NULL )
+      s->service_used == NULL || s->svc_maglev_used == NULL )
     return -ENOMEM;
 
 #define CHECK_CALLOC(target, num) \
@@ -359,6 +369,7 @@ cp_session_init_memory(struct cp_session* s, struct cp_tables_dim* m,
   CHECK_CALLOC(s->bond, cfg_bond_max);
   CHECK_CALLOC(s->mac, s->mac_mask + 1);
   CHECK_CALLOC(s->ip6_mac, s->mac_mask + 1);
+  CHECK_CALLOC(s->svc_maglev_perm, CP_SVC_MAGLEV_SIZE);
 
 #undef CHECK_CALLOC
 
@@ -1071,6 +1082,8 @@ int main(int argc, char** argv)
     s->flags |= CP_SESSION_LADDR_USE_PREF_SRC;
   if( cfg_track_xdp )
     s->flags |= CP_SESSION_TRACK_XDP;
+  if( cfg_neigh_refresh )
+    s->flags |= CP_SESSION_NEIGH_REFRESH;
 
   if( ci_cfg_bootstrap )
     bring_up_kernel_state();
@@ -1091,10 +1104,13 @@ int main(int argc, char** argv)
     dim.svc_arrays_max = cfg_svc_arrays_max;
     /* Round up to next power of 2 */
     dim.svc_ep_max = ci_pow2(ci_log2_ge(cfg_svc_ep_max, 1));
+    /* Every service with a table has at least one backend array. */
+    dim.svc_maglev_max = CI_MIN(cfg_svc_maglev_max, cfg_svc_arrays_max);
   }
   else {
     dim.svc_arrays_max = 0;
     dim.svc_ep_max = 0;
+    dim.svc_maglev_max = 0;
   }
 
   dim.fwd_ln2 = ci_log2_ge(cfg_fwd_max, 1);
@@ -1191,7 +1207,8 @@ int main(int argc, char** argv)
 
     /* If we are dumping something then we'll call cp_fwd_cache_refresh() at the
      * end.  Otherwise we should call it now. */
-    if( s->flags & CP_SESSION_FLAG_FWD_REFRESH_NEEDED &&
+    if( s->flags & (CP_SESSION_FLAG_FWD_REFRESH_NEEDED |
+                    CP_SESSION_FLAG_FWD_REFRESH_PARTIAL) &&
         s->state == CP_DUMP_IDLE ) {
       cp_fwd_cache_refresh(s);
     }
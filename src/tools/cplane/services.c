@@ -25,6 +25,14 @@
  * indices do not rely on hashes and are are stored in the service's frontend
  * element in the hash table.  It is envisaged that, for efficiency, the inner
  * arrays will at some point occupy and align with an entire page.
+ *
+ * Services with more than one backend are also given a Maglev lookup table
+ * (see "Maglev: A Fast and Reliable Software Network Load Balancer", NSDI
+ * 2016) from a separate, smaller pool, while any are free.  The table maps a
+ * flow hash straight to a backend's position in the arrays.  Each backend's
+ * preference order over the table entries is derived from the backend's
+ * address and port alone, so when backends come and go only a small
+ * proportion of flows move between the others.
  */
 
 #include "private.h"
@@ -223,6 +231,106 @@ svc_array_remove(struct cp_session* s, struct cp_mibs* mib,
 }
 
 
+static ci_uint32 svc_maglev_mix(ci_uint32 h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+
+static ci_uint32
+svc_maglev_hash(const struct cp_svc_endpoint* ep, ci_uint32 seed)
+{
+  ci_uint32 words[4];
+  ci_uint32 h = seed;
+  int i;
+
+  CI_BUILD_ASSERT(sizeof(words) == sizeof(ep->addr));
+  memcpy(words, &ep->addr, sizeof(words));
+  for( i = 0; i < 4; ++i )
+    h = svc_maglev_mix(h ^ words[i]);
+  return svc_maglev_mix(h ^ ep->port);
+}
+
+
+/* Release a service's Maglev table, if it has one.
+ * Note: Unsetting mask twice in mib loop is not an error. */
+static void
+svc_maglev_free(struct cp_session* s, struct cp_mibs* mib,
+                struct cp_svc_ep_dllist* svc)
+{
+  cicp_rowid_t maglev_id = svc->u.service.maglev_id;
+
+  if( ! CICP_ROWID_IS_VALID(maglev_id) )
+    return;
+  mib->svc_maglev[maglev_id].n_backends = 0;
+  cp_row_mask_unset(s->svc_maglev_used, maglev_id);
+  svc->u.service.maglev_id = CICP_ROWID_BAD;
+}
+
+
+/* Rebuild the Maglev table of a service after its backends have changed. */
+static void
+svc_maglev_build(struct cp_session* s, struct cp_mibs* mib,
+                 struct cp_svc_ep_dllist* svc)
+{
+  const ci_uint32 m = CP_SVC_MAGLEV_SIZE;
+  struct cp_svc_maglev_perm* perm = s->svc_maglev_perm;
+  struct cp_svc_maglev_table* maglev;
+  ci_uint32 n = svc->u.service.n_backends;
+  cicp_rowid_t array_id = svc->u.service.head_array_id;
+  ci_uint32 i, filled;
+
+  if( ! CICP_ROWID_IS_VALID(svc->u.service.maglev_id) )
+    return;
+  maglev = &mib->svc_maglev[svc->u.service.maglev_id];
+  if( n > m ) {
+    /* Leave the table marked as not matching the service. */
+    maglev->n_backends = 0;
+    return;
+  }
+
+  for( i = 0; i < n; ++i ) {
+    struct cp_svc_endpoint* ep;
+    cicp_rowid_t index = i % CP_SVC_BACKENDS_PER_ARRAY;
+
+    if( i != 0 && index == 0 )
+      array_id = mib->svc_arrays[array_id].next;
+    ep = &mib->svc_arrays[array_id].eps[index];
+    perm[i].offset = svc_maglev_hash(ep, 0) % m;
+    perm[i].skip = svc_maglev_hash(ep, 0x9e3779b9) % (m - 1) + 1;
+    perm[i].next = 0;
+    perm[i].pos = array_id * CP_SVC_BACKENDS_PER_ARRAY + index;
+  }
+
+  for( i = 0; i < m; ++i )
+    maglev->entry[i] = (ci_uint32) -1;
+
+  /* Each backend in turn takes the next entry in its preference order that
+   * is still free, until all entries are taken. */
+  filled = 0;
+  while( 1 ) {
+    for( i = 0; i < n; ++i ) {
+      ci_uint32 c;
+      do {
+        c = (perm[i].offset + (ci_uint64) perm[i].next * perm[i].skip) % m;
+        perm[i].next++;
+      } while( maglev->entry[c] != (ci_uint32) -1 );
+      maglev->entry[c] = perm[i].pos;
+      if( ++filled == m )
+        goto out;
+    }
+  }
+
+ out:
+  maglev->n_backends = n;
+}
+
+
 static void svc_oof_add(struct cp_session* s, struct cp_svc_ep_dllist* svc)
 {
   int rc;
@@ -342,6 +450,7 @@ cp_svc_add(struct cp_session* s,
       svc->u.service.n_backends = 0;
       svc->u.service.head_array_id = CICP_ROWID_BAD;
       svc->u.service.tail_array_id = CICP_ROWID_BAD;
+      svc->u.service.maglev_id = CICP_ROWID_BAD;
       ci_mib_dllist_init(mib->dim, &svc->u.service.backends, 0, "back");
     }
 
@@ -358,6 +467,7 @@ cp_svc_backend_add(struct cp_session* s, const cicp_mac_rowid_t svc_id,
   struct cp_mibs* mib;
   cicp_mac_rowid_t id;
   cicp_rowid_t free_array_id = CICP_ROWID_BAD;
+  cicp_rowid_t free_maglev_id = CICP_ROWID_BAD;
   bool was_externally_acceleratable = svc_externally_acceleratable(s, svc_id);
 
   MIB_UPDATE_LOOP(mib, s, mib_i)
@@ -377,6 +487,15 @@ cp_svc_backend_add(struct cp_session* s, const cicp_mac_rowid_t svc_id,
         MIB_UPDATE_LOOP_UNCHANGED(mib, s, return CICP_MAC_ROWID_BAD);
     }
 
+    /* A second backend means the service wants a Maglev table.  It does
+     * without if there are none free. */
+    if( svc->u.service.n_backends >= 1 &&
+        !CICP_ROWID_IS_VALID(svc->u.service.maglev_id) &&
+        !CICP_ROWID_IS_VALID(free_maglev_id) )
+      free_maglev_id = cp_row_mask_iter_set(s->svc_maglev_used,
+                                            0, mib->dim->svc_maglev_max,
+                                            false);
+
     cp_mibs_under_change(s);
     id = hash_add_backend(mib, addr, port);
     if( CICP_MAC_ROWID_IS_VALID(id) ) {
@@ -397,6 +516,14 @@ cp_svc_backend_add(struct cp_session* s, const cicp_mac_rowid_t svc_id,
         svc_array_append(s, mib, svc, &ep->ep, free_array_id);
 
       svc->u.service.n_backends++;
+      if( svc->u.service.n_backends > 1 &&
+          !CICP_ROWID_IS_VALID(svc->u.service.maglev_id) &&
+          CICP_ROWID_IS_VALID(free_maglev_id) ) {
+        /* Note: Setting mask twice in mib loop is not an error. */
+        cp_row_mask_set(s->svc_maglev_used, free_maglev_id);
+        svc->u.service.maglev_id = free_maglev_id;
+      }
+      svc_maglev_build(s, mib, svc);
     }
 
   MIB_UPDATE_LOOP_END(mib, s);
@@ -437,6 +564,7 @@ cp_svc_del(struct cp_session* s, const cicp_mac_rowid_t rowid)
     /* Free any backend arrays. */
     if( CICP_ROWID_IS_VALID(svc->u.service.head_array_id) )
       svc_array_free(s, mib, svc);
+    svc_maglev_free(s, mib, svc);
 
   MIB_UPDATE_LOOP_END(mib, s);
 
@@ -521,6 +649,10 @@ cp_svc_backend_del(struct cp_session* s, cicp_mac_rowid_t svc_id,
     }
     ci_mib_dllist_remove(mib->dim, &ep->u.backend.link);
     svc->u.service.n_backends--;
+    if( svc->u.service.n_backends <= 1 )
+      svc_maglev_free(s, mib, svc);
+    else
+      svc_maglev_build(s, mib, svc);
 
     svc_hash_ep_del(mib, rowid);
 
@@ -539,15 +671,19 @@ void cp_svc_erase_all(struct cp_session* s)
   size_t table_size = sizeof(struct cp_svc_ep_dllist) *
                       s->mib[0].dim->svc_ep_max;
   size_t mask_size = cp_row_mask_sizeof(s->mib[0].dim->svc_arrays_max);
+  size_t maglev_size = sizeof(struct cp_svc_maglev_table) *
+                       s->mib[0].dim->svc_maglev_max;
 
   MIB_UPDATE_LOOP(mib, s, mib_i)
 
     cp_mibs_under_change(s);
     memset(mib->svc_ep_table, 0, table_size);
+    memset(mib->svc_maglev, 0, maglev_size);
 
   MIB_UPDATE_LOOP_END(mib, s);
 
   cp_row_mask_init(s->service_used, mask_size);
+  cp_row_mask_init(s->svc_maglev_used, s->mib[0].dim->svc_maglev_max);
 
   svc_oof_erase_all(s);
 }
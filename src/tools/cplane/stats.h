@@ -11,6 +11,24 @@ CP_STAT("For RTM_GETRULE", int, rule);
 CP_STAT("For other message types", int, other);
 CP_STAT_GROUP_END(nlmsg_error)
 
+CP_STAT_GROUP_START("Netlink notification batches", nl_batch)
+CP_STAT("Number of batches read with recvmmsg()", int, batches)
+CP_STAT("Number of datagrams read in batches", int, datagrams)
+CP_STAT("Largest batch", int, hiwat)
+CP_STAT("Neighbour updates superseded within a batch", int, coalesced)
+CP_STAT("Number of netlink socket overruns (ENOBUFS)", int, overrun)
+CP_STAT("Datagrams truncated by the batch buffer size", int, truncated)
+CP_STAT_GROUP_END(nl_batch)
+
+CP_STAT_GROUP_START("Proactive neighbour refresh", neigh_refresh)
+CP_STAT("Re-resolve requests for stale neighbours of active routes",
+        int, stale)
+CP_STAT("Resolve requests for active routes with no neighbour entry",
+        int, missing)
+CP_STAT("Refreshed neighbours confirmed reachable", int, confirmed)
+CP_STAT("Refreshed neighbours which failed", int, failed)
+CP_STAT_GROUP_END(neigh_refresh)
+
 CP_STAT_GROUP_START("FWD table", fwd)
 CP_STAT("Overall number of collisions", int, collision)
 CP_STAT("Number of hash loops", int, hash_loop)
@@ -22,6 +40,10 @@ CP_STAT("Current length of fwd queue", int, req_queue_len)
 CP_STAT("High watermark of fwd-queue length", int, req_queue_hiwat)
 CP_STAT("Failed to find fwd table for a request", int, table_missing)
 CP_STAT("Failed to map fwd table", int, table_map_fail)
+CP_STAT("Number of fwd cache refreshes limited to changed routes", int,
+        refresh_partial)
+CP_STAT("Number of fwd entries re-resolved by cache refreshes", int,
+        refresh_resolved)
 CP_STAT("How many times a netlink message had a wrong id when "
         "updating an existing entry", int, nlmsg_mismatch)
 CP_STAT("How many times an NLMSG_ERROR message had a wrong id when "
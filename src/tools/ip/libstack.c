@@ -1104,6 +1104,9 @@ static int dump_via_buffers(oo_dump_request_fn_t dump_req_fn, void* arg,
 static void dump_sock_qs(ci_netif* ni, ci_tcp_state* ts)
 { ci_tcp_state_dump_qs(ni, S_SP(ts), cfg_dump); }
 
+static void dump_sock_lat_hist(ci_netif* ni, ci_tcp_state* ts)
+{ ci_tcp_lat_hist_dump(ni, ts, ci_log_dump_fn, NULL); }
+
 
 static void for_each_tcp_socket(ci_netif* ni,
 				void (*fn)(ci_netif*, ci_tcp_state*))
@@ -1548,6 +1551,12 @@ static void stack_qs(ci_netif* ni)
     libstack_netif_unlock(ni);
 }
 
+static void stack_lat_hist(ci_netif* ni)
+{
+  /* The histograms are written without locks, so neither do we. */
+  for_each_tcp_socket(ni, dump_sock_lat_hist);
+}
+
 static void stack_lock(ci_netif* ni)
 {
   if( cfg_lock )
@@ -1726,6 +1735,37 @@ static void stack_sizeof(ci_netif* ni)
   log_sizeof(ci_ip_sock_stats);
   log_sizeof(ci_ip_sock_stats_count);
   log_sizeof(ci_ip_sock_stats_range);
+  log_sizeof(ci_tcp_prev_seq_t);
+  log_sizeof(ci_tcp_timewait_t);
+
+  /* Endpoint buffers are cache-line aligned, so these show which lines of
+   * the socket state the fast paths touch. */
+# define log_offsetof(t, f)                                              \
+  ci_log("%30s: %4d line %d", #t "." #f, (int) offsetof(t, f),          \
+         (int) (offsetof(t, f) / CI_CACHE_LINE_SIZE))
+  log_offsetof(ci_tcp_state, s.b.state);
+  log_offsetof(ci_tcp_state, s.pkt);
+  log_offsetof(ci_tcp_state, c);
+  log_offsetof(ci_tcp_state, tcpflags);
+  log_offsetof(ci_tcp_state, snd_nxt);
+  log_offsetof(ci_tcp_state, cwnd);
+  log_offsetof(ci_tcp_state, rcv_wnd_advertised);
+  log_offsetof(ci_tcp_state, tsrecent);
+  log_offsetof(ci_tcp_state, send);
+  log_offsetof(ci_tcp_state, recv1);
+  log_offsetof(ci_tcp_state, send_prequeue_in);
+  log_offsetof(ci_tcp_state, rto_tid);
+  log_offsetof(ci_tcp_state, stats);
+  ci_log("%30s: %4d bytes, lines %d-%d", "ci_tcp_state fast path",
+         (int) (offsetof(ci_tcp_state, rto_tid) -
+                offsetof(ci_tcp_state, tcpflags)),
+         (int) (offsetof(ci_tcp_state, tcpflags) / CI_CACHE_LINE_SIZE),
+         (int) ((offsetof(ci_tcp_state, rto_tid) - 1) / CI_CACHE_LINE_SIZE));
+  log_offsetof(ci_udp_state, udpflags);
+  log_offsetof(ci_udp_state, recv_q);
+  log_offsetof(ci_udp_state, tx_count);
+  log_offsetof(ci_udp_state, ephemeral_pkt);
+  log_offsetof(ci_udp_state, stats);
 }
 
 static void stack_leak_pkts(ci_netif* ni)
@@ -2379,6 +2419,8 @@ static const stack_op_t stack_ops[] = {
   STACK_OP_F(clusters,         "show clusters", FL_ONCE),
 #endif
   STACK_OP(qs,                 "show queues for each socket in stack"),
+  STACK_OP(lat_hist,           "show latency histograms for each socket "
+                               "(EF_TCP_LATENCY_HIST)"),
   STACK_OP(lock,               "lock the stack"),
   STACK_OP_AX(lock_flags,      "lock the stack and set lock flags", "<flags>"),
   STACK_OP(trylock,            "try to lock the stack"),
@@ -2485,6 +2527,11 @@ static void socket_qs(ci_netif* ni, ci_tcp_state* ts) {
   ci_tcp_state_dump_qs(ni, S_SP(ts), cfg_dump);
 }
 
+static void socket_lat_hist(ci_netif* ni, ci_tcp_state* ts) {
+  ci_log("------------------------------------------------------------");
+  ci_tcp_lat_hist_dump(ni, ts, ci_log_dump_fn, NULL);
+}
+
 static void socket_lock(ci_netif* ni, ci_tcp_state* ts)
 { ci_sock_lock(ni, &ts->s.b); }
 
@@ -2790,6 +2837,8 @@ static const socket_op_t socket_ops[] = {
              "show socket content"),
   TCPC_OP   (qs,
              "show queues on socket"),
+  TCPC_OP_A (lat_hist, FL_NO_LOCK,
+             "show socket latency histograms (EF_TCP_LATENCY_HIST)", "", 0),
   SOCK_OP_F (lock,    FL_NO_LOCK,
              "lock socket"),
   SOCK_OP_F (unlock,  FL_NO_LOCK,
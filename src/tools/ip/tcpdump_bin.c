@@ -60,6 +60,11 @@ static int cfg_dump_os = 1;
 static int cfg_if_is_loop = 0;
 static int cfg_dump_no_match_only = 0;
 
+/* In-stack capture ring (EF_TCPDUMP_RING), written out as pcapng */
+static int cfg_ring = 0;
+static const char *cfg_ring_filter = NULL;
+static struct bpf_program ring_prog;
+
 /* capture precision */
 static const char *cfg_precision = "micro";
 static const char *cfg_timestamp_type = "host";
@@ -101,6 +106,10 @@ static ci_cfg_desc cfg_opts[] = {
                  "set the timestamp precision, default to \"micro\", man tcpdump"},
   {'j', "time-stamp-type", CI_CFG_STR, &cfg_timestamp_type,
           "set the timestamp type, defaults to \"host\", man tcpdump"},
+  {  3, "ring",      CI_CFG_FLAG, &cfg_ring,
+          "capture via the stack's EF_TCPDUMP_RING and write pcapng"},
+  {  4, "ring-filter", CI_CFG_STR, &cfg_ring_filter,
+          "with --ring, filter expression to run inside the stack"},
 };
 #define N_CFG_OPTS (sizeof(cfg_opts) / sizeof(cfg_opts[0]))
 
@@ -164,23 +173,15 @@ static void frc_resync(struct frc_sync* fs)
 }
 
 
-static void pkt_tstamp(const ci_ip_pkt_fmt* pkt, struct timespec* ts_out)
+static void frc_tstamp(uint64_t frc, struct timespec* ts_out)
 {
-  /* Use the HW timestamps if available and enabled (time_stamp_type setting).
-   * Uses onloads HW timestamps equivalent to adapter_unsynced setting. */
-  if( pkt->hw_stamp.tv_sec && hw_stamping ) {
-    ts_out->tv_nsec = pkt->hw_stamp.tv_nsec;
-    ts_out->tv_sec = pkt->hw_stamp.tv_sec;
-    return;
-  }
-
   static struct frc_sync fs;
-  int64_t ns, frc_diff = pkt->tstamp_frc - fs.sync_frc;
+  int64_t ns, frc_diff = frc - fs.sync_frc;
 
   /* This if() triggers on the first call. */
   if( frc_diff > fs.max_frc_diff ) {
     frc_resync(&fs);
-    frc_diff = pkt->tstamp_frc - fs.sync_frc;
+    frc_diff = frc - fs.sync_frc;
   }
 
   *ts_out = fs.sync_ts;
@@ -212,6 +213,19 @@ static void pkt_tstamp(const ci_ip_pkt_fmt* pkt, struct timespec* ts_out)
 }
 
 
+static void pkt_tstamp(const ci_ip_pkt_fmt* pkt, struct timespec* ts_out)
+{
+  /* Use the HW timestamps if available and enabled (time_stamp_type setting).
+   * Uses onloads HW timestamps equivalent to adapter_unsynced setting. */
+  if( pkt->hw_stamp.tv_sec && hw_stamping ) {
+    ts_out->tv_nsec = pkt->hw_stamp.tv_nsec;
+    ts_out->tv_sec = pkt->hw_stamp.tv_sec;
+    return;
+  }
+  frc_tstamp(pkt->tstamp_frc, ts_out);
+}
+
+
 static inline ci_uint8 dump_hwport_val_get(void) {
   return cfg_dump_no_match_only ? OO_INTF_I_DUMP_NO_MATCH :
                                   OO_INTF_I_DUMP_ALL;
@@ -266,6 +280,375 @@ suicide:
   exit(1);
 }
 
+/* Dump and flush dumped data */
+static void dump_data(const void *data, size_t size)
+{
+  if( fwrite(data, size, 1, stdout) != 1 ) {
+    ci_log("Failed to dump packet data to stdout");
+    exit(1);
+  }
+}
+static void dump_flush(void)
+{
+  if( fflush(stdout) == EOF ) {
+    ci_log("Failed to flush stdout");
+    exit(1);
+  }
+}
+
+
+/* pcapng output for --ring.  Blocks are built in blk_buf and written in
+ * one go.  See the pcapng specification for the layout. */
+#define PCAPNG_SHB                0x0A0D0D0A
+#define PCAPNG_IDB                0x00000001
+#define PCAPNG_ISB                0x00000005
+#define PCAPNG_EPB                0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC   0x1A2B3C4D
+
+#define PCAPNG_OPT_END            0
+#define PCAPNG_SHB_USERAPPL       4
+#define PCAPNG_IF_NAME            2
+#define PCAPNG_IF_DESCRIPTION     3
+#define PCAPNG_IF_TSRESOL         9
+#define PCAPNG_IF_FILTER          11
+#define PCAPNG_EPB_FLAGS          2
+#define PCAPNG_ISB_IFRECV         4
+#define PCAPNG_ISB_FILTERACCEPT   6
+#define PCAPNG_ISB_OSDROP         7
+#define PCAPNG_ISB_USRDELIV       8
+
+static char blk_buf[MAXIMUM_SNAPLEN + 512];
+static size_t blk_len;
+
+static void blk_put(const void* data, size_t len)
+{
+  ci_assert_le(blk_len + len + 3, sizeof(blk_buf));
+  memcpy(blk_buf + blk_len, data, len);
+  blk_len += len;
+  while( blk_len & 3 )
+    blk_buf[blk_len++] = 0;
+}
+
+static void blk_put32(ci_uint32 v)
+{
+  blk_put(&v, sizeof(v));
+}
+
+static void blk_start(ci_uint32 type)
+{
+  blk_len = 0;
+  blk_put32(type);
+  blk_put32(0);  /* length, filled in by blk_end() */
+}
+
+static void blk_opt(ci_uint16 code, const void* val, ci_uint16 len)
+{
+  ci_uint16 hdr[2] = { code, len };
+  blk_put(hdr, sizeof(hdr));
+  if( len != 0 )
+    blk_put(val, len);
+}
+
+static void blk_opt64(ci_uint16 code, ci_uint64 val)
+{
+  blk_opt(code, &val, sizeof(val));
+}
+
+static void blk_end(void)
+{
+  ci_uint32 total = blk_len + 4;
+  memcpy(blk_buf + 4, &total, sizeof(total));
+  blk_put32(total);
+  dump_data(blk_buf, blk_len);
+}
+
+static void blk_put_ts(const struct timespec* ts)
+{
+  ci_uint64 ns = (ci_uint64) ts->tv_sec * 1000000000 + ts->tv_nsec;
+  blk_put32(ns >> 32);
+  blk_put32((ci_uint32) ns);
+}
+
+static void write_pcapng_header(void)
+{
+  static const char appl[] = "onload_tcpdump";
+  ci_uint16 version[2] = { 1, 0 };
+  ci_int64 section_len = -1;  /* unknown */
+
+  blk_start(PCAPNG_SHB);
+  blk_put32(PCAPNG_BYTE_ORDER_MAGIC);
+  blk_put(version, sizeof(version));
+  blk_put(&section_len, sizeof(section_len));
+  blk_opt(PCAPNG_SHB_USERAPPL, appl, strlen(appl));
+  blk_opt(PCAPNG_OPT_END, NULL, 0);
+  blk_end();
+  dump_flush();
+}
+
+
+/* What we know about each stack we capture from with --ring.  Interface
+ * description blocks are written when an interface first has something to
+ * report, so that the ids are only allocated for interfaces in use. */
+struct ring_stack {
+  int                           if_id[OO_INTF_I_NUM];
+  struct oo_capture_intf_stats  base[OO_INTF_I_NUM];
+  ci_uint64                     delivered[OO_INTF_I_NUM];
+};
+
+static struct ring_stack** ring_stacks;
+static int ring_stacks_n;
+static int ring_next_if_id;
+
+static struct ring_stack* ring_stack_get(ci_netif* ni)
+{
+  int id = ni->state->stack_id;
+  struct ring_stack* rs;
+  int i;
+
+  if( id >= ring_stacks_n ) {
+    int n = CI_MAX(id + 1, ring_stacks_n * 2);
+    CI_TEST(ring_stacks = realloc(ring_stacks, n * sizeof(ring_stacks[0])));
+    memset(ring_stacks + ring_stacks_n, 0,
+           (n - ring_stacks_n) * sizeof(ring_stacks[0]));
+    ring_stacks_n = n;
+  }
+  if( ring_stacks[id] == NULL ) {
+    CI_TEST(rs = calloc(1, sizeof(*rs)));
+    for( i = 0; i < OO_INTF_I_NUM; ++i )
+      rs->if_id[i] = -1;
+    ring_stacks[id] = rs;
+  }
+  return ring_stacks[id];
+}
+
+static int ring_if_id(ci_netif* ni, struct ring_stack* rs, int intf_i)
+{
+  char name[64], desc[sizeof(ni->state->name) + 32];
+  char filter[256];
+  ci_uint16 linktype[2] = { DLT_EN10MB, 0 };
+  ci_uint8 tsresol = 9;  /* nanoseconds */
+  const char* dev;
+
+  if( rs->if_id[intf_i] >= 0 )
+    return rs->if_id[intf_i];
+
+  if( intf_i == OO_INTF_I_LOOPBACK )
+    dev = "lo";
+  else if( intf_i == OO_INTF_I_SEND_VIA_OS )
+    dev = "os";
+  else
+    dev = ni->state->nic[intf_i].dev_name;
+  snprintf(name, sizeof(name), "%d:%s", ni->state->stack_id, dev);
+  snprintf(desc, sizeof(desc), "Onload stack [%d,%s] %s",
+           ni->state->stack_id, ni->state->name, dev);
+
+  blk_start(PCAPNG_IDB);
+  blk_put(linktype, sizeof(linktype));
+  blk_put32(ni->state->capture.snaplen);
+  blk_opt(PCAPNG_IF_NAME, name, strlen(name));
+  blk_opt(PCAPNG_IF_DESCRIPTION, desc, strlen(desc));
+  blk_opt(PCAPNG_IF_TSRESOL, &tsresol, sizeof(tsresol));
+  if( cfg_ring_filter != NULL ) {
+    /* The first byte says this is a libpcap filter string. */
+    filter[0] = 0;
+    strncpy(filter + 1, cfg_ring_filter, sizeof(filter) - 1);
+    filter[sizeof(filter) - 1] = '\0';
+    blk_opt(PCAPNG_IF_FILTER, filter, 1 + strlen(filter + 1));
+  }
+  blk_opt(PCAPNG_OPT_END, NULL, 0);
+  blk_end();
+
+  return rs->if_id[intf_i] = ring_next_if_id++;
+}
+
+/* Write out everything in the stack's capture ring. */
+static void stack_dump_ring(ci_netif* ni)
+{
+  struct oo_capture_state* cs = &ni->state->capture;
+  struct ring_stack* rs = ring_stack_get(ni);
+  ci_uint32 read_i = cs->read_i;
+  ci_uint32 i, fill_level = cs->write_i - read_i;
+  sigset_t sigset;
+
+  if( fill_level == 0 )
+    return;
+  ci_assert_le(fill_level, ni->capture.mask + 1);
+
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+
+  /* As for the dump queue, release the ring in batches to avoid dirtying
+   * the cache line under the application's feet. */
+  if( fill_level > (ni->capture.mask + 1) / 4 )
+    fill_level = CI_MAX((ni->capture.mask + 1) / 4, 1);
+
+  ci_rmb();
+  CI_TEST( pthread_sigmask(SIG_BLOCK, &sigset, NULL) == 0 );
+
+  for( i = 0; i < fill_level; ++i, ++read_i ) {
+    struct oo_capture_rec* rec = (void*)
+      (ni->capture.slots + (read_i & ni->capture.mask) * ni->capture.stride);
+    char* data = (char*) (rec + 1);
+    unsigned caplen = CI_MIN(rec->caplen, ni->capture.max_snaplen);
+    struct timespec ts;
+    ci_uint32 flags;
+    int if_id;
+
+    if( rec->intf_i >= OO_INTF_I_NUM )
+      continue;
+    if_id = ring_if_id(ni, rs, rec->intf_i);
+
+    if( (rec->flags & OO_CAPTURE_REC_F_HW_TS) && hw_stamping ) {
+      ts.tv_sec = rec->hw_sec;
+      ts.tv_nsec = rec->hw_nsec;
+    }
+    else {
+      frc_tstamp(rec->frc, &ts);
+    }
+
+    /* For loopback, ensure that ethernet header is correct */
+    if( rec->intf_i == OO_INTF_I_LOOPBACK && caplen >= 2 * ETH_ALEN )
+      memset(data, 0, 2 * ETH_ALEN);
+
+    blk_start(PCAPNG_EPB);
+    blk_put32(if_id);
+    blk_put_ts(&ts);
+    blk_put32(caplen);
+    blk_put32(rec->len);
+    blk_put(data, caplen);
+    /* Direction is in the bottom two bits: 1 inbound, 2 outbound. */
+    flags = (rec->flags & OO_CAPTURE_REC_F_RX) ? 1 : 2;
+    blk_opt(PCAPNG_EPB_FLAGS, &flags, sizeof(flags));
+    blk_opt(PCAPNG_OPT_END, NULL, 0);
+    blk_end();
+    ++rs->delivered[rec->intf_i];
+  }
+
+  /* Ensure we've finished reading before we release. */
+  ci_mb();
+  cs->read_i = read_i;
+
+  dump_flush();
+  CI_TEST( pthread_sigmask(SIG_UNBLOCK, &sigset, NULL) == 0 );
+}
+
+/* Drain the ring of a stack we've stopped capturing from, and write its
+ * statistics, so that the file says how complete the capture is. */
+static void stack_ring_finish(ci_netif* ni)
+{
+  struct oo_capture_state* cs = &ni->state->capture;
+  struct ring_stack* rs;
+  ci_uint64 accepted = 0, dropped = 0, delivered = 0;
+  struct timespec now;
+  int intf_i;
+
+  /* Nothing to do if we never started capturing from this stack. */
+  if( ni->state->stack_id >= ring_stacks_n ||
+      ring_stacks[ni->state->stack_id] == NULL )
+    return;
+  rs = ring_stacks[ni->state->stack_id];
+
+  while( cs->write_i != cs->read_i )
+    stack_dump_ring(ni);
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  for( intf_i = 0; intf_i < OO_INTF_I_NUM; ++intf_i ) {
+    ci_uint32 seen = cs->intf[intf_i].seen - rs->base[intf_i].seen;
+    ci_uint32 acc = cs->intf[intf_i].accepted - rs->base[intf_i].accepted;
+    ci_uint32 drop = cs->intf[intf_i].dropped - rs->base[intf_i].dropped;
+    int if_id;
+
+    if( seen == 0 && rs->if_id[intf_i] < 0 )
+      continue;
+    if_id = ring_if_id(ni, rs, intf_i);
+    blk_start(PCAPNG_ISB);
+    blk_put32(if_id);
+    blk_put_ts(&now);
+    blk_opt64(PCAPNG_ISB_IFRECV, seen);
+    blk_opt64(PCAPNG_ISB_FILTERACCEPT, acc);
+    blk_opt64(PCAPNG_ISB_OSDROP, drop);
+    blk_opt64(PCAPNG_ISB_USRDELIV, rs->delivered[intf_i]);
+    blk_opt(PCAPNG_OPT_END, NULL, 0);
+    blk_end();
+    accepted += acc;
+    dropped += drop;
+    delivered += rs->delivered[intf_i];
+  }
+  dump_flush();
+
+  ci_log("Onload stack [%d,%s]: %"CI_PRIu64" packets matched, %"CI_PRIu64
+         " captured, %"CI_PRIu64" dropped by full ring",
+         ni->state->stack_id, ni->state->name, accepted, delivered, dropped);
+
+  /* The stack id may be reused by a new stack. */
+  free(rs);
+  ring_stacks[ni->state->stack_id] = NULL;
+}
+
+/* Start the in-stack capture ring.  Returns false if the stack has none. */
+static int stack_ring_on(ci_netif* ni)
+{
+  struct oo_capture_state* cs = &ni->state->capture;
+  struct ring_stack* rs;
+
+  ci_assert(ci_netif_is_locked(ni));
+
+  if( ni->capture.filter == NULL ) {
+    ci_log("ERROR: Onload stack [%d,%s] has no capture ring: set "
+           "EF_TCPDUMP_RING in its environment to use --ring",
+           ni->state->stack_id, ni->state->name);
+    return 0;
+  }
+  if( cfg_snaplen > cs->max_snaplen )
+    ci_log("Onload stack [%d,%s]: snaplen limited to %u by "
+           "EF_TCPDUMP_RING_SNAPLEN", ni->state->stack_id, ni->state->name,
+           cs->max_snaplen);
+
+  CI_BUILD_ASSERT(sizeof(struct bpf_insn) == sizeof(struct oo_capture_insn));
+  if( ring_prog.bf_len != 0 )
+    memcpy(ni->capture.filter, ring_prog.bf_insns,
+           ring_prog.bf_len * sizeof(struct oo_capture_insn));
+  cs->filter_len = ring_prog.bf_len;
+  cs->snaplen = CI_MIN(cfg_snaplen, cs->max_snaplen);
+  cs->read_i = cs->write_i;
+
+  rs = ring_stack_get(ni);
+  memcpy(rs->base, cs->intf, sizeof(rs->base));
+
+  /* The stack must see the filter before it sees [on]. */
+  ci_wmb();
+  cs->on = 1;
+  return 1;
+}
+
+/* Compile the --ring-filter expression to the program given to stacks. */
+static void ring_filter_compile(void)
+{
+  pcap_t* p;
+
+  if( cfg_ring_filter == NULL )
+    return;
+
+  p = pcap_open_dead(DLT_EN10MB, cfg_snaplen);
+  if( p == NULL ) {
+    ci_log("ERROR: pcap_open_dead failed");
+    exit(1);
+  }
+  if( pcap_compile(p, &ring_prog, cfg_ring_filter, 1,
+                   PCAP_NETMASK_UNKNOWN) != 0 ) {
+    ci_log("ERROR: bad ring filter '%s': %s", cfg_ring_filter,
+           pcap_geterr(p));
+    exit(1);
+  }
+  pcap_close(p);
+
+  if( ring_prog.bf_len > OO_CAPTURE_FILTER_MAX ) {
+    ci_log("ERROR: ring filter is too long (%u instructions, maximum %d)",
+           ring_prog.bf_len, OO_CAPTURE_FILTER_MAX);
+    exit(1);
+  }
+}
+
 /* Turn dumping on */
 static void stack_dump_on(ci_netif *ni)
 {
@@ -301,6 +684,11 @@ static void stack_dump_on(ci_netif *ni)
         ni->state->stack_id, ni->state->name);
   }
 
+  if( cfg_ring && ! stack_ring_on(ni) ) {
+    stack_detach(stack_attached(ni->state->stack_id), 1);
+    return;
+  }
+
   /* No data from other tcpdump processes should be available. */
   ci_assert_equal(ni->state->dump_read_i, ni->state->dump_write_i);
 
@@ -336,29 +724,17 @@ static void stack_dump_on(ci_netif *ni)
 static void stack_dump_off(ci_netif *ni)
 {
   memset(ni->state->dump_intf, 0, sizeof(ni->state->dump_intf));
+  if( cfg_ring )
+    ni->state->capture.on = 0;
   libstack_netif_lock(ni);
   oo_tcpdump_free_pkts(ni, ni->state->dump_read_i);
   ni->state->dump_read_i = ni->state->dump_write_i;
+  if( cfg_ring )
+    stack_ring_finish(ni);
   ci_log("Onload stack [%d,%s]: stop packet dump",
          ni->state->stack_id, ni->state->name);
 }
 
-/* Dump and flush dumped data */
-static void dump_data(const void *data, size_t size)
-{
-  if( fwrite(data, size, 1, stdout) != 1 ) {
-    ci_log("Failed to dump packet data to stdout");
-    exit(1);
-  }
-}
-static void dump_flush(void)
-{
-  if( fflush(stdout) == EOF ) {
-    ci_log("Failed to flush stdout");
-    exit(1);
-  }
-}
-
 /* Do dump */
 static void stack_dump(ci_netif *ni)
 {
@@ -368,6 +744,10 @@ static void stack_dump(ci_netif *ni)
   ci_uint16 i, fill_level = ni->state->dump_write_i - read_i;
   sigset_t sigset;
 
+  if( cfg_ring ) {
+    stack_dump_ring(ni);
+    return;
+  }
   if( fill_level == 0 )
     return;
 
@@ -489,8 +869,12 @@ static void stack_dump(ci_netif *ni)
 static void stack_pre_detach(ci_netif *ni)
 {
   memset(ni->state->dump_intf, 0, sizeof(ni->state->dump_intf));
+  if( cfg_ring )
+    ni->state->capture.on = 0;
   ci_wmb();
   stack_dump(ni);
+  if( cfg_ring )
+    stack_ring_finish(ni);
 
   /* The stack is dying, but we should free the last packets to check that
    * there is no packet leak */
@@ -735,7 +1119,13 @@ int main(int argc, char* argv[])
   parse_interface();
 
   /* Pcap file header */
-  write_pcap_header();
+  if( cfg_ring ) {
+    ring_filter_compile();
+    write_pcapng_header();
+  }
+  else {
+    write_pcap_header();
+  }
 
   /* Get the initial seq no of stack list */
   CI_TRY(oo_fd_open(&onload_fd));
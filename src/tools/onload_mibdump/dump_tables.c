@@ -195,11 +195,15 @@ void cp_dump_services(struct cp_mibs* mib)
 
     if( entry->row_type == CP_SVC_EMPTY )
       printf("(empty)\n");
+    else if( entry->row_type == CP_SVC_SERVICE )
+      printf(IPX_PORT_FMT" service backends=%zu maglev=%d\n",
+             IPX_ARG(AF_IP(entry->ep.addr)),
+             ntohs(entry->ep.port),
+             entry->u.service.n_backends, entry->u.service.maglev_id);
     else
       printf(IPX_PORT_FMT" %s\n",
              IPX_ARG(AF_IP(entry->ep.addr)),
              ntohs(entry->ep.port),
-             entry->row_type == CP_SVC_SERVICE ? "service" :
              entry->row_type == CP_SVC_BACKEND ? "backend" : "?");
   }
 }
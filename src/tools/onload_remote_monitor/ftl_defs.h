@@ -271,6 +271,8 @@ typedef struct oo_p_dllink oo_p_dllink_t;
   FTL_TFIELD_INT(ctx, ci_uint32,                  \
                  tx_dmaq_insert_seq_last_poll, ORM_OUTPUT_STACK)                          \
   FTL_TFIELD_INT(ctx, ci_uint32, tx_dmaq_done_seq, ORM_OUTPUT_STACK) \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_nolock_pkts, ORM_OUTPUT_STACK)  \
+  FTL_TFIELD_INT(ctx, ci_uint32, tx_nolock_bytes, ORM_OUTPUT_STACK) \
   FTL_TFIELD_INT(ctx, ci_int32, rx_frags, ORM_OUTPUT_STACK)         \
   FTL_TFIELD_INT(ctx, ci_uint32, pd_owner, ORM_OUTPUT_STACK)        \
   ON_CI_CFG_TIMESTAMPING( \
@@ -451,6 +453,8 @@ typedef struct oo_p_dllink oo_p_dllink_t;
   FTL_TFIELD_INT(ctx, ci_uint32, rx_ev_bad_desc_i, ORM_OUTPUT_STACK)         \
   FTL_TFIELD_INT(ctx, ci_uint32, rx_ev_bad_q_label, ORM_OUTPUT_STACK)        \
   FTL_TFIELD_INT(ctx, ci_uint32, evq_gap, ORM_OUTPUT_STACK)                  \
+  FTL_TFIELD_INT(ctx, ci_uint32, xdp_kicks, ORM_OUTPUT_STACK)                \
+  FTL_TFIELD_INT(ctx, ci_uint32, xdp_kicks_avoided, ORM_OUTPUT_STACK)        \
   FTL_TSTRUCT_END(ctx)
 
 #define STRUCT_SOCKET_CACHE(ctx)                                        \
@@ -572,6 +576,9 @@ typedef struct oo_p_dllink oo_p_dllink_t;
   FTL_TFIELD_SSTR(ctx, name,  ORM_OUTPUT_STACK)                          \
   FTL_TFIELD_INT(ctx, ci_int32, pid, ORM_OUTPUT_STACK)                    \
   FTL_TFIELD_INT(ctx, uid_t, uuid, ORM_OUTPUT_STACK)                       \
+  FTL_TFIELD_INT(ctx, ci_uint32, stack_pool_hits, ORM_OUTPUT_STACK)       \
+  FTL_TFIELD_INT(ctx, ci_uint32, stack_pool_misses, ORM_OUTPUT_STACK)     \
+  FTL_TFIELD_INT(ctx, ci_uint32, from_stack_pool, ORM_OUTPUT_STACK)       \
   FTL_TFIELD_INT(ctx, ci_uint32, defer_work_count, ORM_OUTPUT_STACK)      \
   FTL_TFIELD_ARRAYOFINT(ctx, ci_uint8, hash_salt, 16, ORM_OUTPUT_EXTRA) \
   ON_CI_CFG_STATS_NETIF(                                                \
@@ -632,6 +639,7 @@ typedef struct oo_p_dllink oo_p_dllink_t;
     FTL_TFIELD_INT(ctx, ci_int32, bufid, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                       \
     FTL_TFIELD_INT(ctx, ci_uint32, state, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                      \
     FTL_TFIELD_STRUCT(ctx, ci_sleep_seq_t, sleep_seq, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))    \
+    FTL_TFIELD_INT(ctx, ci_uint64, epoll_excl_seq, ORM_OUTPUT_EXTRA)                              \
     FTL_TFIELD_INT(ctx, ci_uint64, spin_cycles, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))          \
     FTL_TFIELD_INT(ctx, ci_uint32, wake_request, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))         \
     FTL_TFIELD_INT(ctx, ci_uint32, sb_flags, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                   \
@@ -642,6 +650,8 @@ typedef struct oo_p_dllink oo_p_dllink_t;
     FTL_TFIELD_INT(ctx, ci_int32, next_id, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))               \
     FTL_TFIELD_INT(ctx, ci_uint32, ready_lists_in_use, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))    \
     FTL_TFIELD_INT(ctx, oo_p, epoll, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                     \
+    FTL_TFIELD_INT(ctx, ci_uint16, ready_lists_excl, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))     \
+    FTL_TFIELD_INT(ctx, ci_uint16, ready_list_excl_last, ORM_OUTPUT_EXTRA)                        \
     FTL_TFIELD_INT(ctx, ci_int32, sigown, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                \
     ON_CI_CFG_ENDPOINT_MOVE(                                                                      \
       FTL_TFIELD_INT(ctx, ci_uint32, moved_to_stack_id, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))  \
@@ -1112,6 +1122,9 @@ typedef struct oo_tcp_socket_stats oo_tcp_socket_stats;
     )                                                                         \
     FTL_TFIELD_INT(ctx, ci_int32, send_prequeue, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                \
     FTL_TFIELD_INT(ctx, oo_atomic_t, send_prequeue_in, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))    \
+    FTL_TFIELD_INT(ctx, ci_int32, send_nolock, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))                  \
+    FTL_TFIELD_INT(ctx, ci_uint32, send_nolock_gate, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))             \
+    FTL_TFIELD_INT(ctx, ci_uint32, send_nolock_owner, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))            \
     FTL_TFIELD_STRUCT(ctx, oo_p_dllink_t, timeout_q_link, ORM_OUTPUT_EXTRA)   \
     FTL_TFIELD_STRUCT(ctx, oo_tcp_socket_stats, stats, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))          \
     FTL_TFIELD_ANON_STRUCT_BEGIN(ctx, rcvbuf_drs, (ORM_OUTPUT_STACK | ORM_OUTPUT_SOCKETS))               \
@@ -1,7 +1,7 @@
 # SPDX-License-Identifier: GPL-2.0
 # X-SPDX-Copyright-Text: (c) Copyright 2014-2020 Xilinx, Inc.
 
-APPS := orm_json
+APPS := orm_json orm_metrics
 
 SRCS := orm_json orm_json_lib
 
@@ -41,6 +41,9 @@ all: $(APPS)
 orm_json: $(DEPS)
 	(libs="$(LIBS)"; $(MMakeLinkCApp))
 
+orm_metrics: orm_metrics.o orm_json_lib.o $(MMAKE_LIB_DEPS)
+	(libs="$(LIBS)"; $(MMakeLinkCApp))
+
 orm_zmq_publisher: orm_zmq_publisher.o orm_json_lib.o
 	(libs="$(LIBS)"; $(MMakeLinkCApp))
 
@@ -116,7 +116,8 @@ static int orm_map_stack(orm_state_t* state, unsigned stack_id)
 }
 
 
-static int orm_map_stacks(orm_state_t* state)
+int orm_for_each_stack(int (*fn)(const ci_netif_info_t* info, void* arg),
+                       void* arg)
 {
   int rc, i;
   oo_fd fd;
@@ -139,8 +140,7 @@ static int orm_map_stacks(orm_state_t* state)
       goto out;
     }
     if( info.ni_exists ) {
-      int stack_id = info.ni_index;
-      if( (rc = orm_map_stack(state, stack_id)) != 0 )
+      if( (rc = fn(&info, arg)) != 0 )
         goto out;
     }
     else if( info.ni_no_perms_exists ) {
@@ -159,6 +159,18 @@ static int orm_map_stacks(orm_state_t* state)
 }
 
 
+static int orm_map_stack_fn(const ci_netif_info_t* info, void* arg)
+{
+  return orm_map_stack(arg, info->ni_index);
+}
+
+
+static int orm_map_stacks(orm_state_t* state)
+{
+  return orm_for_each_stack(orm_map_stack_fn, state);
+}
+
+
 static void orm_unmap_stacks(orm_state_t* state)
 {
   int i;
@@ -807,6 +819,51 @@ static void orm_dump_struct_ci_netif_config_opts(char* label, ci_netif_config_op
 #include "ftl_decls.h"
 
 
+static void orm_tcp_lat_hist_dump(ci_netif* ni, ci_tcp_state* ts)
+{
+  static const char* const names[CI_TCP_LAT_HIST_N] = { "rx", "tx", "rtt" };
+  const ci_tcp_lat_hist* h;
+  ci_uint64 n;
+  int kind, i;
+
+  if( OO_P_IS_NULL(ts->lat_hist[0]) )
+    return;
+
+  dump_buf_literal("\"latency_hist\":{");
+  for( kind = 0; kind < CI_TCP_LAT_HIST_N; ++kind ) {
+    if( OO_P_IS_NULL(ts->lat_hist[kind]) )
+      continue;
+    h = ci_ni_aux_p2lat_hist(ni, ts->lat_hist[kind]);
+    for( i = 0, n = 0; i < CI_TCP_LAT_HIST_BUCKETS; ++i )
+      n += h->count[i];
+    dump_buf_label("\"", names[kind], "\":{");
+    dump_buf_cat_comma("\"count\":%llu", (unsigned long long) n);
+    dump_buf_cat_comma("\"p50_ns\":%llu", (unsigned long long)
+           ci_tcp_lat_hist_cycles2ns(ni, ci_tcp_lat_hist_percentile(h, 500)));
+    dump_buf_cat_comma("\"p99_ns\":%llu", (unsigned long long)
+           ci_tcp_lat_hist_cycles2ns(ni, ci_tcp_lat_hist_percentile(h, 990)));
+    dump_buf_cat_comma("\"p999_ns\":%llu", (unsigned long long)
+           ci_tcp_lat_hist_cycles2ns(ni, ci_tcp_lat_hist_percentile(h, 999)));
+    dump_buf_cat_comma("\"max_ns\":%llu", (unsigned long long)
+           ci_tcp_lat_hist_cycles2ns(ni, h->max));
+    /* Upper bucket limits in ns; the last bucket is open-ended (0). */
+    dump_buf_literal("\"buckets\":[");
+    for( i = 0; i < CI_TCP_LAT_HIST_BUCKETS; ++i )
+      if( h->count[i] )
+        dump_buf_cat_comma("[%llu,%u]", (unsigned long long)
+                 ci_tcp_lat_hist_cycles2ns(ni,
+                                      ci_tcp_lat_hist_bucket_limit(h, i)),
+                 h->count[i]);
+    dump_buf_cleanup();
+    dump_buf_literal_comma("]");
+    dump_buf_cleanup();
+    dump_buf_literal_comma("}");
+  }
+  dump_buf_cleanup();
+  dump_buf_literal_comma("}");
+}
+
+
 static void orm_waitable_dump(ci_netif* ni, const char* sock_type,
                               int output_flags, const sockbuf_filter_t* sft)
 {
@@ -832,6 +889,7 @@ static void orm_waitable_dump(ci_netif* ni, const char* sock_type,
                sockbuf_filter_matches(sft, wo) ) {
         dump_buf_cat("\"%d\":{", W_FMT(w));
         orm_dump_struct_ci_tcp_state("tcp_state", &wo->tcp, output_flags);
+        orm_tcp_lat_hist_dump(ni, &wo->tcp);
         dump_buf_cleanup();
         dump_buf_literal_comma("}");
       }
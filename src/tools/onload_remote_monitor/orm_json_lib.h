@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: GPL-2.0 */
 /* X-SPDX-Copyright-Text: (c) Copyright 2020 Xilinx, Inc. */
 
+#include <onload/debug_intf.h>
+
 /* flags to control which info gets output */
 #define ORM_OUTPUT_NONE 0
 #define ORM_OUTPUT_STATS 0x1
@@ -30,6 +32,13 @@ struct orm_cfg {
  */
 extern int orm_parse_output_flags(int argc, const char* const* argv);
 
+/* Call fn() for each Onload stack this user can access, stopping at the
+ * first non-zero return from fn().
+ * Return 0 on success, or negative error code
+ */
+extern int orm_for_each_stack(int (*fn)(const ci_netif_info_t* info,
+                                        void* arg), void* arg);
+
 /* Generate JSON output to the given stream
  * Return 0 on success, or negative error code
  */
@@ -0,0 +1,505 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* X-SPDX-Copyright-Text: (c) Copyright 2026 Advanced Micro Devices, Inc. */
+/*
+ * Serve Onload stack statistics over HTTP in OpenMetrics text format.
+ *
+ * Unlike orm_json, which maps every stack and serialises its whole state
+ * on each invocation, this is a long-running exporter: stacks are mapped
+ * once and only their statistics are read on each scrape of /metrics.
+ * The metric table is generated from stats_def.h and more_stats_def.h at
+ * build time, and by default a scrape only emits the samples that have
+ * changed since the previous scrape.
+ */
+
+#define _GNU_SOURCE
+
+#include <ci/internal/ip.h>
+#include <ci/app/testapp.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <ci/internal/more_stats.h>
+#include "orm_json_lib.h"
+
+
+#define LOG(...) fprintf(stderr, __VA_ARGS__)
+
+static const char* cfg_addr = "127.0.0.1";
+static int cfg_port = 9924;
+static int cfg_rescan = 5;
+static const char* cfg_stackname;
+static bool cfg_all;
+
+static ci_cfg_desc cfg_opts[] = {
+  { 'h', "help", CI_CFG_USAGE, 0, "this message" },
+  { 0, "name",  CI_CFG_STR,  &cfg_stackname, "select a single stack name" },
+  { 0, "addr",  CI_CFG_STR,  &cfg_addr,
+    "address to serve /metrics on (default 127.0.0.1)" },
+  { 0, "port",  CI_CFG_INT,  &cfg_port,
+    "port to serve /metrics on (default 9924)" },
+  { 0, "rescan", CI_CFG_INT, &cfg_rescan,
+    "minimum interval between looking for new stacks in seconds "
+    "(default 5s)" },
+  { 0, "all",   CI_CFG_FLAG, &cfg_all,
+    "emit every sample on each scrape, not only those that changed since "
+    "the previous scrape" },
+};
+#define N_CFG_OPTS (sizeof(cfg_opts) / sizeof(cfg_opts[0]))
+
+
+/**********************************************************/
+/* Metric table */
+/**********************************************************/
+
+struct orm_metric {
+  const char* name;
+  const char* desc;
+  unsigned    offset;
+  unsigned    size;
+  int         counter;
+};
+
+#define OO_STAT_IS_count  1
+#define OO_STAT_IS_val    0
+
+#define OO_STAT(desc, type, name, kind)                                 \
+  { #name, (desc), offsetof(ci_netif_stats, name), sizeof(type),        \
+    OO_STAT_IS_##kind },
+
+static const struct orm_metric stats_metrics[] = {
+#include <ci/internal/stats_def.h>
+};
+
+#undef OO_STAT
+#define OO_STAT(desc, type, name, kind)                                 \
+  { #name, (desc), offsetof(more_stats_t, name), sizeof(type),          \
+    OO_STAT_IS_##kind },
+
+static const struct orm_metric more_stats_metrics[] = {
+#include <ci/internal/more_stats_def.h>
+};
+
+#undef OO_STAT
+#undef OO_STAT_IS_count
+#undef OO_STAT_IS_val
+
+#define N_STATS_METRICS \
+  (sizeof(stats_metrics) / sizeof(stats_metrics[0]))
+#define N_MORE_STATS_METRICS \
+  (sizeof(more_stats_metrics) / sizeof(more_stats_metrics[0]))
+#define N_FAMILIES  (N_STATS_METRICS + N_MORE_STATS_METRICS)
+
+
+/* Per-metric text that does not change between scrapes. */
+struct orm_family {
+  const struct orm_metric* m;
+  int   more;     /* value lives in more_stats_t, not ci_netif_stats */
+  char* header;   /* "# TYPE" and "# HELP" lines */
+  char* sample;   /* sample name, without labels */
+};
+
+static struct orm_family families[N_FAMILIES];
+
+
+/* Escape for a label value or HELP text. */
+static void orm_escape(FILE* f, const char* s)
+{
+  for( ; *s; ++s )
+    switch( *s ) {
+    case '\\':  fputs("\\\\", f);  break;
+    case '"':   fputs("\\\"", f);  break;
+    case '\n':  fputs("\\n", f);   break;
+    default:    fputc(*s, f);      break;
+    }
+}
+
+
+static char* orm_family_name(const struct orm_metric* m)
+{
+  char* name;
+  char* p;
+
+  if( asprintf(&name, "onload_%s", m->name) < 0 )
+    return NULL;
+  for( p = name; *p; ++p )
+    *p = tolower(*p);
+  return name;
+}
+
+
+static int orm_family_init(struct orm_family* fam,
+                           const struct orm_metric* m, int more)
+{
+  char* name = orm_family_name(m);
+  size_t len;
+  FILE* f;
+
+  if( name == NULL )
+    return -ENOMEM;
+  fam->m = m;
+  fam->more = more;
+  if( (f = open_memstream(&fam->header, &len)) == NULL ) {
+    free(name);
+    return -ENOMEM;
+  }
+  fprintf(f, "# TYPE %s %s\n# HELP %s ", name,
+          m->counter ? "counter" : "gauge", name);
+  orm_escape(f, m->desc);
+  fputc('\n', f);
+  fclose(f);
+
+  if( m->counter ) {
+    /* OpenMetrics counter samples carry a _total suffix. */
+    if( asprintf(&fam->sample, "%s_total", name) < 0 ) {
+      free(name);
+      return -ENOMEM;
+    }
+    free(name);
+  }
+  else {
+    fam->sample = name;
+  }
+  return 0;
+}
+
+
+static int orm_families_init(void)
+{
+  int i, rc;
+
+  for( i = 0; i < N_STATS_METRICS; ++i )
+    if( (rc = orm_family_init(&families[i], &stats_metrics[i], 0)) < 0 )
+      return rc;
+  for( i = 0; i < N_MORE_STATS_METRICS; ++i )
+    if( (rc = orm_family_init(&families[N_STATS_METRICS + i],
+                              &more_stats_metrics[i], 1)) < 0 )
+      return rc;
+  return 0;
+}
+
+
+/**********************************************************/
+/* Stack mappings */
+/**********************************************************/
+
+struct orm_mstack {
+  ci_netif       ni;
+  unsigned       stack_id;
+  bool           seen;
+  bool           have_prev;
+  char*          labels;
+  /* Snapshot for this scrape and the one before. */
+  ci_netif_stats stats, prev_stats;
+  more_stats_t   more, prev_more;
+};
+
+static struct orm_mstack** stacks;
+static int n_stacks;
+
+
+static struct orm_mstack* orm_stack_find(unsigned stack_id)
+{
+  int i;
+  for( i = 0; i < n_stacks; ++i )
+    if( stacks[i]->stack_id == stack_id )
+      return stacks[i];
+  return NULL;
+}
+
+
+static int orm_stack_map(const ci_netif_info_t* info)
+{
+  struct orm_mstack** new_stacks;
+  struct orm_mstack* s;
+  size_t len;
+  FILE* f;
+  int rc;
+
+  new_stacks = realloc(stacks, (n_stacks + 1) * sizeof(*stacks));
+  if( new_stacks == NULL )
+    return -ENOMEM;
+  stacks = new_stacks;
+
+  if( (s = calloc(1, sizeof(*s))) == NULL )
+    return -ENOMEM;
+  s->stack_id = info->ni_index;
+  if( (rc = ci_netif_restore_id(&s->ni, s->stack_id, true)) != 0 ) {
+    /* Most likely the stack went away under our feet: try again at the
+     * next rescan rather than giving up on the others. */
+    LOG("%s: Fail: ci_netif_restore_id(%d)=%d\n", __func__,
+        s->stack_id, rc);
+    free(s);
+    return 0;
+  }
+
+  if( (f = open_memstream(&s->labels, &len)) == NULL ) {
+    ci_netif_dtor(&s->ni);
+    free(s);
+    return -ENOMEM;
+  }
+  fprintf(f, "{stack=\"%u\",stack_name=\"", s->stack_id);
+  orm_escape(f, s->ni.state->name);
+  fputs("\"}", f);
+  fclose(f);
+
+  s->seen = true;
+  stacks[n_stacks++] = s;
+  return 0;
+}
+
+
+static int orm_stack_seen(const ci_netif_info_t* info, void* arg)
+{
+  struct orm_mstack* s = orm_stack_find(info->ni_index);
+
+  if( cfg_stackname != NULL && strcmp(info->ni_name, cfg_stackname) != 0 )
+    return 0;
+  if( s == NULL )
+    return orm_stack_map(info);
+  /* Our own mapping accounts for two references.  Once nobody else holds
+   * the stack let it go, otherwise we would keep it alive forever. */
+  if( info->rs_ref_count > 2 )
+    s->seen = true;
+  return 0;
+}
+
+
+static int orm_stacks_rescan(void)
+{
+  int i, j, rc;
+
+  for( i = 0; i < n_stacks; ++i )
+    stacks[i]->seen = false;
+  rc = orm_for_each_stack(orm_stack_seen, NULL);
+
+  for( i = j = 0; i < n_stacks; ++i ) {
+    struct orm_mstack* s = stacks[i];
+    if( s->seen ) {
+      stacks[j++] = s;
+      continue;
+    }
+    ci_netif_dtor(&s->ni);
+    free(s->labels);
+    free(s);
+  }
+  n_stacks = j;
+  return rc;
+}
+
+
+/**********************************************************/
+/* OpenMetrics output */
+/**********************************************************/
+
+static ci_uint64 orm_metric_get(const struct orm_metric* m, const void* base)
+{
+  const char* p = (const char*) base + m->offset;
+  if( m->size == sizeof(ci_uint64) )
+    return *(const ci_uint64*) p;
+  return *(const ci_uint32*) p;
+}
+
+
+static void orm_metrics_render(FILE* f)
+{
+  int i, j;
+
+  for( j = 0; j < n_stacks; ++j ) {
+    struct orm_mstack* s = stacks[j];
+    memcpy(&s->stats, &s->ni.state->stats, sizeof(s->stats));
+    get_more_stats(&s->ni, &s->more);
+  }
+
+  /* All samples of a family must be contiguous, so walk the table in the
+   * outer loop and the stacks in the inner one. */
+  for( i = 0; i < N_FAMILIES; ++i ) {
+    const struct orm_family* fam = &families[i];
+    bool header_done = false;
+
+    for( j = 0; j < n_stacks; ++j ) {
+      struct orm_mstack* s = stacks[j];
+      const void* cur = fam->more ? (void*) &s->more : (void*) &s->stats;
+      const void* prev = fam->more ? (void*) &s->prev_more :
+                                     (void*) &s->prev_stats;
+      ci_uint64 val = orm_metric_get(fam->m, cur);
+
+      if( ! cfg_all && s->have_prev && val == orm_metric_get(fam->m, prev) )
+        continue;
+      if( ! header_done ) {
+        fputs(fam->header, f);
+        header_done = true;
+      }
+      fprintf(f, "%s%s %llu\n", fam->sample, s->labels,
+              (unsigned long long) val);
+    }
+  }
+  fputs("# EOF\n", f);
+
+  for( j = 0; j < n_stacks; ++j ) {
+    struct orm_mstack* s = stacks[j];
+    memcpy(&s->prev_stats, &s->stats, sizeof(s->stats));
+    memcpy(&s->prev_more, &s->more, sizeof(s->more));
+    s->have_prev = true;
+  }
+}
+
+
+/**********************************************************/
+/* HTTP */
+/**********************************************************/
+
+static void orm_http_send(int fd, const char* buf, size_t len)
+{
+  while( len ) {
+    ssize_t rc = send(fd, buf, len, MSG_NOSIGNAL);
+    if( rc <= 0 ) {
+      if( rc < 0 && errno == EINTR )
+        continue;
+      return;
+    }
+    buf += rc;
+    len -= rc;
+  }
+}
+
+
+static void orm_http_reply(int fd, const char* status, const char* type,
+                           const char* body, size_t len)
+{
+  char hdr[256];
+  int n = snprintf(hdr, sizeof(hdr),
+                   "HTTP/1.1 %s\r\n"
+                   "Content-Type: %s\r\n"
+                   "Content-Length: %zu\r\n"
+                   "Connection: close\r\n\r\n", status, type, len);
+  orm_http_send(fd, hdr, n);
+  orm_http_send(fd, body, len);
+}
+
+
+static void orm_http_serve(int fd)
+{
+  static const char not_found[] = "Not found: try /metrics\n";
+  struct timeval tv = { .tv_sec = 2 };
+  char req[2048];
+  size_t len = 0;
+  char* path;
+
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  do {
+    ssize_t rc = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+    if( rc <= 0 )
+      return;
+    len += rc;
+    req[len] = '\0';
+  } while( strstr(req, "\r\n\r\n") == NULL && len < sizeof(req) - 1 );
+
+  if( strncmp(req, "GET ", 4) != 0 ) {
+    orm_http_reply(fd, "405 Method Not Allowed", "text/plain", "", 0);
+    return;
+  }
+  path = req + 4;
+  path[strcspn(path, " ?\r\n")] = '\0';
+
+  if( strcmp(path, "/metrics") == 0 ) {
+    char* body = NULL;
+    size_t body_len = 0;
+    struct timespec now;
+    static time_t last_rescan;
+    FILE* f;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if( last_rescan == 0 || now.tv_sec - last_rescan >= cfg_rescan ) {
+      orm_stacks_rescan();
+      last_rescan = now.tv_sec;
+    }
+
+    if( (f = open_memstream(&body, &body_len)) == NULL ) {
+      orm_http_reply(fd, "500 Internal Server Error", "text/plain", "", 0);
+      return;
+    }
+    orm_metrics_render(f);
+    fclose(f);
+    orm_http_reply(fd, "200 OK", "application/openmetrics-text; "
+                   "version=1.0.0; charset=utf-8", body, body_len);
+    free(body);
+  }
+  else {
+    orm_http_reply(fd, "404 Not Found", "text/plain",
+                   not_found, sizeof(not_found) - 1);
+  }
+}
+
+
+static int orm_http_listen(void)
+{
+  struct sockaddr_in sin;
+  int fd, one = 1;
+
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(cfg_port);
+  if( inet_pton(AF_INET, cfg_addr, &sin.sin_addr) != 1 ) {
+    LOG("ERROR: bad listen address '%s'\n", cfg_addr);
+    return -EINVAL;
+  }
+
+  if( (fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+      bind(fd, (struct sockaddr*) &sin, sizeof(sin)) < 0 ||
+      listen(fd, 16) < 0 ) {
+    int rc = -errno;
+    LOG("ERROR: cannot listen on %s:%d: %s\n", cfg_addr, cfg_port,
+        strerror(errno));
+    if( fd >= 0 )
+      close(fd);
+    return rc;
+  }
+  return fd;
+}
+
+
+int main(int argc, char** argv)
+{
+  int lfd, fd;
+
+  ci_app_standard_opts = 0;
+  ci_app_getopt("", &argc, argv, cfg_opts, N_CFG_OPTS);
+  if( argc != 1 ) {
+    ci_app_usage("unexpected arguments");
+    return EXIT_FAILURE;
+  }
+
+  if( orm_families_init() < 0 ) {
+    LOG("ERROR: out of memory building metric table\n");
+    return EXIT_FAILURE;
+  }
+  if( (lfd = orm_http_listen()) < 0 )
+    return EXIT_FAILURE;
+  printf("Serving OpenMetrics at http://%s:%d/metrics\n", cfg_addr, cfg_port);
+  fflush(stdout);
+
+  while( 1 ) {
+    if( (fd = accept(lfd, NULL, NULL)) < 0 ) {
+      if( errno == EINTR || errno == ECONNABORTED )
+        continue;
+      LOG("ERROR: accept: %s\n", strerror(errno));
+      break;
+    }
+    orm_http_serve(fd);
+    close(fd);
+  }
+
+  close(lfd);
+  return EXIT_FAILURE;
+}